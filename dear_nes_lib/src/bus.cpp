@@ -5,6 +5,7 @@
 #include <cassert>
 
 #include "dear_nes_lib/cartridge.h"
+#include "dear_nes_lib/cpu.h"
 #include "dear_nes_lib/dma.h"
 #include "dear_nes_lib/ppu.h"
 
@@ -12,11 +13,19 @@ namespace dearnes {
 
 Bus::Bus() {
     m_CpuRam.fill(0x00);
+    RebuildCpuPages(0x0000, 0xFFFF);
 }
 
 void Bus::SetCartridge(Cartridge* cartridge) {
     assert(cartridge != nullptr);
     m_Cartridge = cartridge;
+    m_Cartridge->ConnectBus(this);
+    RebuildCpuPages(0x0000, 0xFFFF);
+}
+
+void Bus::SetCpu(Cpu* cpu) {
+    assert(cpu != nullptr);
+    m_Cpu = cpu;
 }
 
 void Bus::SetDma(Dma* dma) {
@@ -24,9 +33,15 @@ void Bus::SetDma(Dma* dma) {
     m_Dma = dma;
 }
 
-void Bus::SetPpu(Ppu* ppu) {
-    assert(ppu != nullptr);
+void Bus::SetPpu(Ppu* ppu, PpuCatchUp catchUp) {
+    assert(ppu != nullptr && catchUp != nullptr);
     m_Ppu = ppu;
+    m_PpuCatchUp = catchUp;
+}
+
+void Bus::SetScheduler(Scheduler* scheduler) {
+    assert(scheduler != nullptr);
+    m_Scheduler = scheduler;
 }
 
 uint8_t Bus::GetControllerState(size_t controllerIdx) const {
@@ -41,11 +56,128 @@ void Bus::WriteControllerState(size_t controllerIdx, uint8_t data) {
     m_Controllers[controllerIdx] |= data;
 }
 
-void Bus::CpuWrite(uint16_t address, uint8_t data) {
+void Bus::RebuildCpuPages(uint16_t firstAddress, uint16_t lastAddress) {
+    for (size_t index = firstAddress >> 8; index <= (lastAddress >> 8);
+         ++index) {
+        const uint8_t pageNumber = static_cast<uint8_t>(index);
+        CpuPage page;
+        if (pageNumber < 0x20) {
+            // CPU RAM, mirrored every 0x0800 bytes
+            page.m_ReadMemory = &m_CpuRam[GetRealRamAddress(pageNumber << 8)];
+            page.m_WriteMemory = page.m_ReadMemory;
+        } else if (pageNumber < 0x40) {
+            page.m_ReadHandler = CpuPageHandler::kPpu;
+            page.m_WriteHandler = CpuPageHandler::kPpu;
+        } else if (pageNumber == 0x40) {
+            page.m_ReadHandler = CpuPageHandler::kIo;
+            page.m_WriteHandler = CpuPageHandler::kIo;
+        }
+
+        // The cartridge has priority over the rest of the devices
+        if (m_Cartridge != nullptr) {
+            uint8_t* memory = nullptr;
+            switch (m_Cartridge->GetCpuReadPage(pageNumber, memory)) {
+                case Cartridge::CpuPageMapping::kMemory:
+                    page.m_ReadMemory = memory;
+                    break;
+                case Cartridge::CpuPageMapping::kPartial:
+                    page.m_ReadMemory = nullptr;
+                    page.m_ReadHandler = CpuPageHandler::kCartridge;
+                    break;
+                default:
+                    break;
+            }
+            switch (m_Cartridge->GetCpuWritePage(pageNumber, memory)) {
+                case Cartridge::CpuPageMapping::kMemory:
+                    page.m_WriteMemory = memory;
+                    break;
+                case Cartridge::CpuPageMapping::kPartial:
+                    page.m_WriteMemory = nullptr;
+                    page.m_WriteHandler = CpuPageHandler::kCartridge;
+                    break;
+                default:
+                    break;
+            }
+        }
+        m_CpuPages[pageNumber] = page;
+    }
+
+    if (m_Cpu != nullptr) {
+        m_Cpu->InvalidateCode(firstAddress, lastAddress);
+    }
+}
+
+void Bus::InvalidatePatternTiles(uint16_t firstAddress, uint16_t lastAddress) {
+    if (m_Ppu != nullptr) {
+        m_Ppu->InvalidatePatternTiles(firstAddress, lastAddress);
+    }
+}
+
+void Bus::SetMirroringMode(CartridgeHeader::MIRRORING_MODE mode) {
+    if (m_Ppu != nullptr) {
+        // The cycles the PPU deferred read the nametables of the old mode
+        CatchUpPpu();
+        m_Ppu->SetMirroringMode(mode);
+    }
+}
+
+uint8_t Bus::CpuReadFromHandler(CpuPageHandler handler, uint16_t address,
+                                bool isReadOnly) {
+    uint8_t data = 0x00;
+    switch (handler) {
+        case CpuPageHandler::kPpu:
+            CatchUpPpu();
+            data = m_Ppu->CpuRead(GetRealPpuAddress(address), isReadOnly);
+            break;
+        case CpuPageHandler::kIo:
+            if (address >= 0x4016 && address <= 0x4017) {
+                data = (m_ControllerState[address & 0x0001] & 0x80) > 0;
+                if (!isReadOnly) {
+                    m_ControllerState[address & 0x0001] <<= 1;
+                }
+            }
+            break;
+        case CpuPageHandler::kCartridge:
+            data = CpuReadFromDevices(address, isReadOnly);
+            break;
+        default:
+            break;
+    }
+    return data;
+}
+
+void Bus::CpuWriteToHandler(CpuPageHandler handler, uint16_t address,
+                            uint8_t data) {
+    switch (handler) {
+        case CpuPageHandler::kPpu:
+            CatchUpPpu();
+            m_Ppu->CpuWrite(GetRealPpuAddress(address), data);
+            break;
+        case CpuPageHandler::kIo:
+            if (address == 0x4014) {
+                m_Dma->StartTransfer(data);
+            } else if (address >= 0x4016 && address <= 0x4017) {
+                m_ControllerState[address & 0x0001] =
+                    m_Controllers[address & 0x0001];
+            }
+            break;
+        case CpuPageHandler::kCartridge:
+            // The write may switch the banks or the mirroring the PPU reads,
+            // so the cycles it deferred must see the ones before it
+            CatchUpPpu();
+            CpuWriteToDevices(address, data);
+            break;
+        default:
+            break;
+    }
+}
+
+void Bus::CpuWriteToDevices(uint16_t address, uint8_t data) {
     if (m_Cartridge && m_Cartridge->CpuWrite(address, data)) {
     } else if (address >= 0x0000 && address <= 0x1FFF) {
         m_CpuRam[GetRealRamAddress(address)] = data;
     } else if (address >= 0x2000 && address <= 0x3FFF) {
+        CatchUpPpu();
         m_Ppu->CpuWrite(GetRealPpuAddress(address), data);
     } else if (address == 0x4014) {
         m_Dma->StartTransfer(data);
@@ -54,16 +186,19 @@ void Bus::CpuWrite(uint16_t address, uint8_t data) {
     }
 }
 
-uint8_t Bus::CpuRead(uint16_t address, bool isReadOnly) {
+uint8_t Bus::CpuReadFromDevices(uint16_t address, bool isReadOnly) {
     uint8_t data = 0x00;
     if (m_Cartridge && m_Cartridge->CpuRead(address, data)) {
     } else if (address >= 0x0000 && address <= 0x1FFF) {
         data = m_CpuRam[GetRealRamAddress(address)];
     } else if (address >= 0x2000 && address <= 0x3FFF) {
+        CatchUpPpu();
         data = m_Ppu->CpuRead(GetRealPpuAddress(address), isReadOnly);
     } else if (address >= 0x4016 && address <= 0x4017) {
         data = (m_ControllerState[address & 0x0001] & 0x80) > 0;
-        m_ControllerState[address & 0x0001] <<= 1;
+        if (!isReadOnly) {
+            m_ControllerState[address & 0x0001] <<= 1;
+        }
     }
 
     return data;
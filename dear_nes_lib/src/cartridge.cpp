@@ -1,57 +1,90 @@
 // Copyright (c) 2020 Emmanuel Arias
 #include "dear_nes_lib/cartridge.h"
-#include "dear_nes_lib/mapper.h"
 
 namespace dearnes {
 
-Cartridge::Cartridge(CartridgeHeader&& header, IMapper* mapper,
+Cartridge::Cartridge(CartridgeHeader&& header, MapperVariant&& mapper,
                      std::vector<uint8_t>&& programMemory,
                      std::vector<uint8_t>&& characterMemory)
     : m_CartridgeHeader{header},
-      m_Mapper{mapper},
+      m_Mapper{std::move(mapper)},
       m_ProgramMemory{programMemory},
       m_CharacterMemory{characterMemory} {}
 
-Cartridge::~Cartridge() { delete m_Mapper; }
-
 CartridgeHeader::MIRRORING_MODE Cartridge::GetMirroringMode() const {
     return m_CartridgeHeader.GetMirroringMode();
 }
 
-bool Cartridge::CpuRead(uint16_t address, uint8_t& data) {
-    uint32_t mappedAddr = 0;
-    if (m_Mapper->CpuMapRead(address, mappedAddr)) {
-        data = m_ProgramMemory[mappedAddr];
-        return true;
-    }
-    return false;
+uint8_t Cartridge::GetMapperId() const {
+    return m_CartridgeHeader.GetMapperId();
 }
 
-bool Cartridge::CpuWrite(uint16_t address, uint8_t data) {
-    uint32_t mappedAddr = 0;
-    if (m_Mapper->CpuMapWrite(address, mappedAddr)) {
-        m_ProgramMemory[mappedAddr] = data;
-        return true;
+uint32_t Cartridge::GetProgramMemoryChecksum() const {
+    uint32_t hash = 0x811C9DC5;
+    for (const uint8_t data : m_ProgramMemory) {
+        hash ^= data;
+        hash *= 0x01000193;
     }
-    return false;
+    return hash;
 }
 
-bool Cartridge::PpuRead(uint16_t address, uint8_t& data) {
-    uint32_t mappedAddr = 0;
-    if (m_Mapper->PpuMapRead(address, mappedAddr)) {
-        data = m_CharacterMemory[mappedAddr];
-        return true;
-    }
-    return false;
+void Cartridge::ConnectBus(Bus* bus) {
+    std::visit([bus](auto& mapper) { mapper.SetBus(bus); }, m_Mapper);
+}
+
+Cartridge::CpuPageMapping Cartridge::GetCpuReadPage(uint8_t page,
+                                                    uint8_t*& memory) {
+    return GetCpuPage(page, memory,
+                      [this](uint16_t address, uint32_t& mappedAddr) {
+                          return std::visit(
+                              [address, &mappedAddr](auto& mapper) {
+                                  return mapper.CpuMapRead(address, mappedAddr);
+                              },
+                              m_Mapper);
+                      });
 }
 
-bool Cartridge::PpuWrite(uint16_t address, uint8_t data) {
-    uint32_t mappedAddr = 0;
-    if (m_Mapper->PpuMapWrite(address, mappedAddr)) {
-        m_CharacterMemory[mappedAddr] = data;
-        return true;
+Cartridge::CpuPageMapping Cartridge::GetCpuWritePage(uint8_t page,
+                                                     uint8_t*& memory) {
+    return GetCpuPage(page, memory,
+                      [this](uint16_t address, uint32_t& mappedAddr) {
+                          return std::visit(
+                              [address, &mappedAddr](auto& mapper) {
+                                  return mapper.CpuMapWrite(address, mappedAddr);
+                              },
+                              m_Mapper);
+                      });
+}
+
+template <typename MapFunction>
+Cartridge::CpuPageMapping Cartridge::GetCpuPage(uint8_t page,
+                                                uint8_t*& memory,
+                                                MapFunction map) {
+    const uint16_t pageAddress = static_cast<uint16_t>(page << 8);
+    size_t mappedCount = 0;
+    bool isContiguous = true;
+    uint32_t firstMappedAddr = 0;
+    for (uint16_t offset = 0; offset < 0x100; ++offset) {
+        uint32_t mappedAddr = 0;
+        if (!map(pageAddress + offset, mappedAddr)) {
+            isContiguous = false;
+            continue;
+        }
+        if (offset == 0) {
+            firstMappedAddr = mappedAddr;
+        }
+        isContiguous = isContiguous && mappedAddr == firstMappedAddr + offset;
+        ++mappedCount;
+    }
+
+    if (mappedCount == 0) {
+        return CpuPageMapping::kNone;
+    }
+    if (isContiguous && firstMappedAddr + 0xFF < m_ProgramMemory.size()) {
+        memory = &m_ProgramMemory[firstMappedAddr];
+        return CpuPageMapping::kMemory;
     }
-    return false;
+    return CpuPageMapping::kPartial;
 }
 
 }  // namespace dearnes
\ No newline at end of file
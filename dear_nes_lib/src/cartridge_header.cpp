@@ -6,9 +6,13 @@ CartridgeHeader::CartridgeHeader(std::ifstream& inputStream) {
 	inputStream.read(reinterpret_cast<char*>(&m_iNesHeader),
                      sizeof(m_iNesHeader));
 
-    m_MirroringMode = (m_iNesHeader.m_Mapper1 & 0x01)
+    if (m_iNesHeader.m_Mapper1 & 0x08) {
+        m_MirroringMode = MIRRORING_MODE::FOUR_SCREEN;
+    } else {
+        m_MirroringMode = (m_iNesHeader.m_Mapper1 & 0x01)
                               ? MIRRORING_MODE::VERTICAL
                               : MIRRORING_MODE::HORIZONTAL;
+    }
 }
 
 bool CartridgeHeader::HasTrainerData() const { return m_iNesHeader.m_Mapper1 & 0x04; }
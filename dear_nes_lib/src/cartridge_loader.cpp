@@ -6,7 +6,6 @@
 
 #include "dear_nes_lib/cartridge.h"
 #include "dear_nes_lib/cartridge_header.h"
-#include "dear_nes_lib/mapper_000.h"
 
 namespace dearnes {
 
@@ -39,7 +38,7 @@ CartridgeLoader::LoadNewCartridge(std::ifstream& inputStream) {
         return result;
     }
 
-    IMapper* mapperPtr = CreateMapper(header);
+    MapperVariant mapper = CreateMapper(header);
 
     if (header.HasTrainerData()) {
         inputStream.seekg(512, std::ios_base::cur);
@@ -54,8 +53,8 @@ CartridgeLoader::LoadNewCartridge(std::ifstream& inputStream) {
              characterMemory.size());
 
     result =
-        new Cartridge{std::move(header), mapperPtr, std::move(programMemory),
-                      std::move(characterMemory)};
+        new Cartridge{std::move(header), std::move(mapper),
+                      std::move(programMemory), std::move(characterMemory)};
 
     return result;
 }
@@ -67,13 +66,11 @@ bool CartridgeLoader::IsMapperSupported(uint8_t mapperId) {
     return false;
 }
 
-IMapper* CartridgeLoader::CreateMapper(const CartridgeHeader& header) {
-    if (header.GetMapperId() == 0x00) {
-        return new Mapper_000(header.GetProgramMemoryBanks(),
-                              header.GetCharacterMemoryBanks());
-    }
-    // This should not be reachable
-    return nullptr;
+MapperVariant CartridgeLoader::CreateMapper(const CartridgeHeader& header) {
+    // IsMapperSupported() only accepts the mappers of MapperVariant, and NROM
+    // is the only one so far
+    return Mapper_000(header.GetProgramMemoryBanks(),
+                      header.GetCharacterMemoryBanks());
 }
 
 }  // namespace dearnes
\ No newline at end of file
@@ -1,12 +1,541 @@
 // Copyright (c) 2020 Emmanuel Arias
 #include "dear_nes_lib/cpu.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 
 #include "dear_nes_lib/bus.h"
+#include "dear_nes_lib/cpu_jit.h"
+#include "dear_nes_lib/recompiled_program.h"
 
 namespace dearnes {
 
+namespace {
+
+using AddressingMode = Cpu::AddressingMode;
+using Operation = Cpu::Operation;
+
+/// Number of bytes of an instruction, including the op code
+constexpr uint8_t GetAddressingModeLength(AddressingMode mode) {
+    switch (mode) {
+        case AddressingMode::kImplied:
+        case AddressingMode::kAccumulator:
+            return 1;
+        case AddressingMode::kAbsolute:
+        case AddressingMode::kIndexedAbsoluteX:
+        case AddressingMode::kIndexedAbsoluteY:
+        case AddressingMode::kAbsoluteIndirect:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+/// Operations that take one more cycle when the addressing mode crosses a page
+constexpr bool PaysPageCrossingCycle(Operation operation) {
+    switch (operation) {
+        case Operation::kADC:
+        case Operation::kAND:
+        case Operation::kCMP:
+        case Operation::kEOR:
+        case Operation::kLDA:
+        case Operation::kLDX:
+        case Operation::kLDY:
+        case Operation::kORA:
+        case Operation::kSBC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// CPU RAM is mirrored up to this address
+constexpr uint16_t kCpuRamEnd = 0x1FFF;
+constexpr uint16_t kCpuRamMask = SIZE_CPU_RAM - 1;
+
+constexpr uint16_t kCartridgeRomStart = 0x8000;
+
+constexpr size_t kDecodeCacheSize =
+    SIZE_CPU_RAM + (0x10000 - kCartridgeRomStart);
+
+/// Memory accesses done by an instruction, on top of reading itself and using
+/// the stack
+enum class MemoryAccess {
+    kNone,
+    kRead,
+    kWrite,
+    kReadWrite
+};
+
+constexpr MemoryAccess GetMemoryAccess(Operation operation,
+                                       AddressingMode mode) {
+    switch (mode) {
+        case AddressingMode::kImplied:
+        case AddressingMode::kAccumulator:
+        case AddressingMode::kImmediate:
+        case AddressingMode::kRelative:
+            return MemoryAccess::kNone;
+        default:
+            break;
+    }
+    switch (operation) {
+        case Operation::kNoImpl:
+        case Operation::kJAM:
+            return MemoryAccess::kNone;
+        case Operation::kJMP:
+        case Operation::kJSR:
+            // Only the indirect jump reads memory, to get its target
+            return mode == AddressingMode::kAbsoluteIndirect
+                       ? MemoryAccess::kRead
+                       : MemoryAccess::kNone;
+        case Operation::kSTA:
+        case Operation::kSTX:
+        case Operation::kSTY:
+            return MemoryAccess::kWrite;
+        case Operation::kASL:
+        case Operation::kDEC:
+        case Operation::kINC:
+        case Operation::kLSR:
+        case Operation::kROL:
+        case Operation::kROR:
+            return MemoryAccess::kReadWrite;
+        default:
+            return MemoryAccess::kRead;
+    }
+}
+
+/// True if the access only reaches CPU RAM or, for reads, cartridge ROM
+constexpr bool IsIsolatedAccess(uint16_t address, bool isWrite) {
+    return address <= kCpuRamEnd ||
+           (!isWrite && address >= kCartridgeRomStart);
+}
+
+/// Address of the high byte of the pointer read by the indirect jump. The
+/// 6502 does not carry into the high byte of the pointer address
+constexpr uint16_t GetIndirectHighByteAddress(uint16_t pointer) {
+    return (pointer & 0x00FF) == 0x00FF ? (pointer & 0xFF00) : pointer + 1;
+}
+
+/// True if the address is the PPU status register or one of its mirrors
+constexpr bool IsPpuStatusRegister(uint16_t address) {
+    return address >= 0x2000 && address <= 0x3FFF &&
+           (address & 0x0007) == 0x0002;
+}
+
+// Longest idle loop, in bytes, from its first instruction to the end of the
+// jump back to it
+constexpr uint16_t kMaxIdleLoopLength = 16;
+
+// Iterations that change the registers before a loop is not watched anymore
+constexpr uint8_t kMaxIdleLoopMismatches = 2;
+
+/// True if the operation can continue somewhere else than the next
+/// instruction
+constexpr bool ChangesProgramCounter(Operation operation) {
+    switch (operation) {
+        case Operation::kNoImpl:
+        case Operation::kJAM:
+        case Operation::kBCC:
+        case Operation::kBCS:
+        case Operation::kBEQ:
+        case Operation::kBMI:
+        case Operation::kBNE:
+        case Operation::kBPL:
+        case Operation::kBRK:
+        case Operation::kBVC:
+        case Operation::kBVS:
+        case Operation::kJMP:
+        case Operation::kJSR:
+        case Operation::kRTI:
+        case Operation::kRTS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Pairs of op codes executed by a single fused handler, first op code then
+// second one. The list comes from the hottest sequences of common loops
+#define DEARNES_CPU_FOR_EACH_FUSED_PAIR(macro)                                 \
+    /* LDA, STA */                                                             \
+    macro(0xA9, 0x85) macro(0xA9, 0x8D) macro(0xA5, 0x85) macro(0xA5, 0x8D)    \
+    macro(0xAD, 0x85) macro(0xAD, 0x8D) macro(0xBD, 0x9D) macro(0xB9, 0x99)    \
+    /* CMP, CPX or CPY, BNE or BEQ */                                          \
+    macro(0xC9, 0xD0) macro(0xC9, 0xF0) macro(0xC5, 0xD0) macro(0xE0, 0xD0)    \
+    macro(0xC0, 0xD0)                                                          \
+    /* DEX, DEY, INX or INY, BNE or BPL */                                     \
+    macro(0xCA, 0xD0) macro(0x88, 0xD0) macro(0xE8, 0xD0) macro(0xC8, 0xD0)    \
+    macro(0xCA, 0x10) macro(0x88, 0x10)                                        \
+    /* INC, LDA */                                                             \
+    macro(0xE6, 0xA5)                                                          \
+    /* LDA or AND, BNE or BEQ */                                               \
+    macro(0xA5, 0xD0) macro(0xA5, 0xF0) macro(0x29, 0xD0) macro(0x29, 0xF0)    \
+    /* BIT or LDA, BPL or BMI: waiting for the vertical blank */               \
+    macro(0x2C, 0x10) macro(0x2C, 0x30) macro(0xAD, 0x10) macro(0xAD, 0x30)
+
+#define DEARNES_CPU_FUSED_PAIR_KEY(first, second) \
+    static_cast<uint16_t>(((first) << 8) | (second)),
+
+constexpr uint16_t kFusedPairs[] = {
+    DEARNES_CPU_FOR_EACH_FUSED_PAIR(DEARNES_CPU_FUSED_PAIR_KEY)};
+
+#undef DEARNES_CPU_FUSED_PAIR_KEY
+
+constexpr size_t kFusedPairCount = sizeof(kFusedPairs) / sizeof(kFusedPairs[0]);
+
+constexpr size_t GetFusedPairIndex(uint8_t first, uint8_t second) {
+    const uint16_t key = static_cast<uint16_t>((first << 8) | second);
+    for (size_t index = 0; index < kFusedPairCount; ++index) {
+        if (kFusedPairs[index] == key) {
+            return index;
+        }
+    }
+    return kFusedPairCount;
+}
+
+/// True for the op codes that start a fused pair
+constexpr std::array<bool, 0x100> kStartsFusedPair = [] {
+    std::array<bool, 0x100> startsPair{};
+    for (const uint16_t key : kFusedPairs) {
+        startsPair[key >> 8] = true;
+    }
+    return startsPair;
+}();
+
+}  // namespace
+
+// clang-format off
+constexpr Cpu::Instruction Cpu::m_InstructionTable[0x100] = {
+    Instruction{Operation::kBRK, AddressingMode::kImplied, 7},           // 0x00
+    Instruction{Operation::kORA, AddressingMode::kIndexedIndirectX, 6},  // 0x01
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0x02
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedIndirectX,
+                8},  // 0x03
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 3},       // 0x04
+    Instruction{Operation::kORA, AddressingMode::kZeroPage, 3},          // 0x05
+    Instruction{Operation::kASL, AddressingMode::kZeroPage, 5},          // 0x06
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 5},       // 0x07
+    Instruction{Operation::kPHP, AddressingMode::kImplied, 3},           // 0x08
+    Instruction{Operation::kORA, AddressingMode::kImmediate, 2},         // 0x09
+    Instruction{Operation::kASL, AddressingMode::kAccumulator, 2},       // 0x0A
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0x0B
+    Instruction{Operation::kNoImpl, AddressingMode::kAbsolute, 4},       // 0x0C
+    Instruction{Operation::kORA, AddressingMode::kAbsolute, 4},          // 0x0D
+    Instruction{Operation::kASL, AddressingMode::kAbsolute, 6},          // 0x0E
+    Instruction{Operation::kNoImpl, AddressingMode::kAbsolute, 6},       // 0x0F
+    Instruction{Operation::kBPL, AddressingMode::kRelative, 2},          // 0x10
+    Instruction{Operation::kORA, AddressingMode::kIndirectIndexedY, 5},  // 0x11
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0x12
+    Instruction{Operation::kNoImpl, AddressingMode::kIndirectIndexedY,
+                8},  // 0x13
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                4},  // 0x14
+    Instruction{Operation::kORA, AddressingMode::kIndexedZeroPageX, 4},  // 0x15
+    Instruction{Operation::kASL, AddressingMode::kIndexedZeroPageX, 6},  // 0x16
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                6},  // 0x17
+    Instruction{Operation::kCLC, AddressingMode::kImplied, 2},           // 0x18
+    Instruction{Operation::kORA, AddressingMode::kIndexedAbsoluteY, 4},  // 0x19
+    Instruction{Operation::kNoImpl, AddressingMode::kImplied, 2},        // 0x1A
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                7},  // 0x1B
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                4},  // 0x1C
+    Instruction{Operation::kORA, AddressingMode::kIndexedAbsoluteX, 4},  // 0x1D
+    Instruction{Operation::kASL, AddressingMode::kIndexedAbsoluteX, 7},  // 0x1E
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                7},  // 0x1F
+    Instruction{Operation::kJSR, AddressingMode::kAbsolute, 6},          // 0x20
+    Instruction{Operation::kAND, AddressingMode::kIndexedIndirectX, 6},  // 0x21
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0x22
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedIndirectX,
+                8},  // 0x23
+    Instruction{Operation::kBIT, AddressingMode::kZeroPage, 3},          // 0x24
+    Instruction{Operation::kAND, AddressingMode::kZeroPage, 3},          // 0x25
+    Instruction{Operation::kROL, AddressingMode::kZeroPage, 5},          // 0x26
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 5},       // 0x27
+    Instruction{Operation::kPLP, AddressingMode::kImplied, 4},           // 0x28
+    Instruction{Operation::kAND, AddressingMode::kImmediate, 2},         // 0x29
+    Instruction{Operation::kROL, AddressingMode::kAccumulator, 2},       // 0x2A
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0x2B
+    Instruction{Operation::kBIT, AddressingMode::kAbsolute, 4},          // 0x2C
+    Instruction{Operation::kAND, AddressingMode::kAbsolute, 4},          // 0x2D
+    Instruction{Operation::kROL, AddressingMode::kAbsolute, 6},          // 0x2E
+    Instruction{Operation::kNoImpl, AddressingMode::kAbsolute, 6},       // 0x2F
+    Instruction{Operation::kBMI, AddressingMode::kRelative, 2},          // 0x30
+    Instruction{Operation::kAND, AddressingMode::kIndirectIndexedY, 5},  // 0x31
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0x32
+    Instruction{Operation::kNoImpl, AddressingMode::kIndirectIndexedY,
+                8},  // 0x33
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                4},  // 0x34
+    Instruction{Operation::kAND, AddressingMode::kIndexedZeroPageX, 4},  // 0x35
+    Instruction{Operation::kROL, AddressingMode::kIndexedZeroPageX, 6},  // 0x36
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                6},  // 0x37
+    Instruction{Operation::kSEC, AddressingMode::kImplied, 2},           // 0x38
+    Instruction{Operation::kAND, AddressingMode::kIndexedAbsoluteY, 4},  // 0x39
+    Instruction{Operation::kNoImpl, AddressingMode::kImplied, 2},        // 0x3A
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                7},  // 0x3B
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                4},  // 0x3C
+    Instruction{Operation::kAND, AddressingMode::kIndexedAbsoluteX, 4},  // 0x3D
+    Instruction{Operation::kROL, AddressingMode::kIndexedAbsoluteX, 7},  // 0x3E
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                7},  // 0x3F
+    Instruction{Operation::kRTI, AddressingMode::kImplied, 6},           // 0x40
+    Instruction{Operation::kEOR, AddressingMode::kIndexedIndirectX, 6},  // 0x41
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0x42
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedIndirectX,
+                8},  // 0x43
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 3},       // 0x44
+    Instruction{Operation::kEOR, AddressingMode::kZeroPage, 3},          // 0x45
+    Instruction{Operation::kLSR, AddressingMode::kZeroPage, 5},          // 0x46
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 5},       // 0x47
+    Instruction{Operation::kPHA, AddressingMode::kImplied, 3},           // 0x48
+    Instruction{Operation::kEOR, AddressingMode::kImmediate, 2},         // 0x49
+    Instruction{Operation::kLSR, AddressingMode::kAccumulator, 2},       // 0x4A
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0x4B
+    Instruction{Operation::kJMP, AddressingMode::kAbsolute, 3},          // 0x4C
+    Instruction{Operation::kEOR, AddressingMode::kAbsolute, 4},          // 0x4D
+    Instruction{Operation::kLSR, AddressingMode::kAbsolute, 6},          // 0x4E
+    Instruction{Operation::kNoImpl, AddressingMode::kAbsolute, 6},       // 0x4F
+    Instruction{Operation::kBVC, AddressingMode::kRelative, 2},          // 0x50
+    Instruction{Operation::kEOR, AddressingMode::kIndirectIndexedY, 5},  // 0x51
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0x52
+    Instruction{Operation::kNoImpl, AddressingMode::kIndirectIndexedY,
+                8},  // 0x53
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                4},  // 0x54
+    Instruction{Operation::kEOR, AddressingMode::kIndexedZeroPageX, 4},  // 0x55
+    Instruction{Operation::kLSR, AddressingMode::kIndexedZeroPageX, 6},  // 0x56
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                6},  // 0x57
+    Instruction{Operation::kCLI, AddressingMode::kImplied, 2},           // 0x58
+    Instruction{Operation::kEOR, AddressingMode::kIndexedAbsoluteY, 4},  // 0x59
+    Instruction{Operation::kNoImpl, AddressingMode::kImplied, 2},        // 0x5A
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                7},  // 0x5B
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                4},  // 0x5C
+    Instruction{Operation::kEOR, AddressingMode::kIndexedAbsoluteX, 4},  // 0x5D
+    Instruction{Operation::kLSR, AddressingMode::kIndexedAbsoluteX, 7},  // 0x5E
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                7},  // 0x5F
+    Instruction{Operation::kRTS, AddressingMode::kImplied, 6},           // 0x60
+    Instruction{Operation::kADC, AddressingMode::kIndexedIndirectX, 6},  // 0x61
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0x62
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedIndirectX,
+                8},  // 0x63
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 3},       // 0x64
+    Instruction{Operation::kADC, AddressingMode::kZeroPage, 3},          // 0x65
+    Instruction{Operation::kROR, AddressingMode::kZeroPage, 5},          // 0x66
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 5},       // 0x67
+    Instruction{Operation::kPLA, AddressingMode::kImplied, 4},           // 0x68
+    Instruction{Operation::kADC, AddressingMode::kImmediate, 2},         // 0x69
+    Instruction{Operation::kROR, AddressingMode::kAccumulator, 2},       // 0x6A
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0x6B
+    Instruction{Operation::kJMP, AddressingMode::kAbsoluteIndirect, 5},  // 0x6C
+    Instruction{Operation::kADC, AddressingMode::kAbsolute, 4},          // 0x6D
+    Instruction{Operation::kROR, AddressingMode::kAbsolute, 6},          // 0x6E
+    Instruction{Operation::kNoImpl, AddressingMode::kAbsolute, 6},       // 0x6F
+    Instruction{Operation::kBVS, AddressingMode::kRelative, 2},          // 0x70
+    Instruction{Operation::kADC, AddressingMode::kIndirectIndexedY, 5},  // 0x71
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0x72
+    Instruction{Operation::kNoImpl, AddressingMode::kIndirectIndexedY,
+                8},  // 0x73
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                4},  // 0x74
+    Instruction{Operation::kADC, AddressingMode::kIndexedZeroPageX, 4},  // 0x75
+    Instruction{Operation::kROR, AddressingMode::kIndexedZeroPageX, 6},  // 0x76
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                6},  // 0x77
+    Instruction{Operation::kSEI, AddressingMode::kImplied, 2},           // 0x78
+    Instruction{Operation::kADC, AddressingMode::kIndexedAbsoluteY, 4},  // 0x79
+    Instruction{Operation::kNoImpl, AddressingMode::kImplied, 2},        // 0x7A
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                7},  // 0x7B
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                4},  // 0x7C
+    Instruction{Operation::kADC, AddressingMode::kIndexedAbsoluteX, 4},  // 0x7D
+    Instruction{Operation::kROR, AddressingMode::kIndexedAbsoluteX, 7},  // 0x7E
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                7},  // 0x7F
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0x80
+    Instruction{Operation::kSTA, AddressingMode::kIndexedIndirectX, 6},  // 0x81
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0x82
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedIndirectX,
+                6},  // 0x83
+    Instruction{Operation::kSTY, AddressingMode::kZeroPage, 3},          // 0x84
+    Instruction{Operation::kSTA, AddressingMode::kZeroPage, 3},          // 0x85
+    Instruction{Operation::kSTX, AddressingMode::kZeroPage, 3},          // 0x86
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 3},       // 0x87
+    Instruction{Operation::kDEY, AddressingMode::kImplied, 2},           // 0x88
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0x89
+    Instruction{Operation::kTXA, AddressingMode::kImplied, 2},           // 0x8A
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0x8B
+    Instruction{Operation::kSTY, AddressingMode::kAbsolute, 4},          // 0x8C
+    Instruction{Operation::kSTA, AddressingMode::kAbsolute, 4},          // 0x8D
+    Instruction{Operation::kSTX, AddressingMode::kAbsolute, 4},          // 0x8E
+    Instruction{Operation::kNoImpl, AddressingMode::kAbsolute, 4},       // 0x8F
+    Instruction{Operation::kBCC, AddressingMode::kRelative, 2},          // 0x90
+    Instruction{Operation::kSTA, AddressingMode::kIndirectIndexedY, 6},  // 0x91
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0x92
+    Instruction{Operation::kNoImpl, AddressingMode::kIndirectIndexedY,
+                6},  // 0x93
+    Instruction{Operation::kSTY, AddressingMode::kIndexedZeroPageX, 4},  // 0x94
+    Instruction{Operation::kSTA, AddressingMode::kIndexedZeroPageX, 4},  // 0x95
+    Instruction{Operation::kSTX, AddressingMode::kIndexedZeroPageY, 4},  // 0x96
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageY,
+                4},  // 0x97
+    Instruction{Operation::kTYA, AddressingMode::kImplied, 2},           // 0x98
+    Instruction{Operation::kSTA, AddressingMode::kIndexedAbsoluteY, 5},  // 0x99
+    Instruction{Operation::kTXS, AddressingMode::kImplied, 2},           // 0x9A
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                5},  // 0x9B
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                5},  // 0x9C
+    Instruction{Operation::kSTA, AddressingMode::kIndexedAbsoluteX, 5},  // 0x9D
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                5},  // 0x9E
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                5},  // 0x9F
+    Instruction{Operation::kLDY, AddressingMode::kImmediate, 2},         // 0xA0
+    Instruction{Operation::kLDA, AddressingMode::kIndexedIndirectX, 6},  // 0xA1
+    Instruction{Operation::kLDX, AddressingMode::kImmediate, 2},         // 0xA2
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedIndirectX,
+                6},  // 0xA3
+    Instruction{Operation::kLDY, AddressingMode::kZeroPage, 3},          // 0xA4
+    Instruction{Operation::kLDA, AddressingMode::kZeroPage, 3},          // 0xA5
+    Instruction{Operation::kLDX, AddressingMode::kZeroPage, 3},          // 0xA6
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 3},       // 0xA7
+    Instruction{Operation::kTAY, AddressingMode::kImplied, 2},           // 0xA8
+    Instruction{Operation::kLDA, AddressingMode::kImmediate, 2},         // 0xA9
+    Instruction{Operation::kTAX, AddressingMode::kImplied, 2},           // 0xAA
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0xAB
+    Instruction{Operation::kLDY, AddressingMode::kAbsolute, 4},          // 0xAC
+    Instruction{Operation::kLDA, AddressingMode::kAbsolute, 4},          // 0xAD
+    Instruction{Operation::kLDX, AddressingMode::kAbsolute, 4},          // 0xAE
+    Instruction{Operation::kNoImpl, AddressingMode::kAbsolute, 4},       // 0xAF
+    Instruction{Operation::kBCS, AddressingMode::kRelative, 2},          // 0xB0
+    Instruction{Operation::kLDA, AddressingMode::kIndirectIndexedY, 5},  // 0xB1
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0xB2
+    Instruction{Operation::kNoImpl, AddressingMode::kIndirectIndexedY,
+                5},  // 0xB3
+    Instruction{Operation::kLDY, AddressingMode::kIndexedZeroPageX, 4},  // 0xB4
+    Instruction{Operation::kLDA, AddressingMode::kIndexedZeroPageX, 4},  // 0xB5
+    Instruction{Operation::kLDX, AddressingMode::kIndexedZeroPageY, 4},  // 0xB6
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageY,
+                4},  // 0xB7
+    Instruction{Operation::kCLV, AddressingMode::kImplied, 2},           // 0xB8
+    Instruction{Operation::kLDA, AddressingMode::kIndexedAbsoluteY, 4},  // 0xB9
+    Instruction{Operation::kTSX, AddressingMode::kImplied, 2},           // 0xBA
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                4},  // 0xBB
+    Instruction{Operation::kLDY, AddressingMode::kIndexedAbsoluteX, 4},  // 0xBC
+    Instruction{Operation::kLDA, AddressingMode::kIndexedAbsoluteX, 4},  // 0xBD
+    Instruction{Operation::kLDX, AddressingMode::kIndexedAbsoluteY, 4},  // 0xBE
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                4},  // 0xBF
+    Instruction{Operation::kCPY, AddressingMode::kImmediate, 2},         // 0xC0
+    Instruction{Operation::kCMP, AddressingMode::kIndexedIndirectX, 6},  // 0xC1
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0xC2
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedIndirectX,
+                8},  // 0xC3
+    Instruction{Operation::kCPY, AddressingMode::kZeroPage, 3},          // 0xC4
+    Instruction{Operation::kCMP, AddressingMode::kZeroPage, 3},          // 0xC5
+    Instruction{Operation::kDEC, AddressingMode::kZeroPage, 5},          // 0xC6
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 5},       // 0xC7
+    Instruction{Operation::kINY, AddressingMode::kImplied, 2},           // 0xC8
+    Instruction{Operation::kCMP, AddressingMode::kImmediate, 2},         // 0xC9
+    Instruction{Operation::kDEX, AddressingMode::kImplied, 2},           // 0xCA
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0xCB
+    Instruction{Operation::kCPY, AddressingMode::kAbsolute, 4},          // 0xCC
+    Instruction{Operation::kCMP, AddressingMode::kAbsolute, 4},          // 0xCD
+    Instruction{Operation::kDEC, AddressingMode::kAbsolute, 6},          // 0xCE
+    Instruction{Operation::kNoImpl, AddressingMode::kAbsolute, 6},       // 0xCF
+    Instruction{Operation::kBNE, AddressingMode::kRelative, 2},          // 0xD0
+    Instruction{Operation::kCMP, AddressingMode::kIndirectIndexedY, 5},  // 0xD1
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0xD2
+    Instruction{Operation::kNoImpl, AddressingMode::kIndirectIndexedY,
+                8},  // 0xD3
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                4},  // 0xD4
+    Instruction{Operation::kCMP, AddressingMode::kIndexedZeroPageX, 4},  // 0xD5
+    Instruction{Operation::kDEC, AddressingMode::kIndexedZeroPageX, 6},  // 0xD6
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                6},  // 0xD7
+    Instruction{Operation::kCLD, AddressingMode::kImplied, 2},           // 0xD8
+    Instruction{Operation::kCMP, AddressingMode::kIndexedAbsoluteY, 4},  // 0xD9
+    Instruction{Operation::kNoImpl, AddressingMode::kImplied, 2},        // 0xDA
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                7},  // 0xDB
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                4},  // 0xDC
+    Instruction{Operation::kCMP, AddressingMode::kIndexedAbsoluteX, 4},  // 0xDD
+    Instruction{Operation::kDEC, AddressingMode::kIndexedAbsoluteX, 7},  // 0xDE
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                7},  // 0xDF
+    Instruction{Operation::kCPX, AddressingMode::kImmediate, 2},         // 0xE0
+    Instruction{Operation::kSBC, AddressingMode::kIndexedIndirectX, 6},  // 0xE1
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0xE2
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedIndirectX,
+                8},  // 0xE3
+    Instruction{Operation::kCPX, AddressingMode::kZeroPage, 3},          // 0xE4
+    Instruction{Operation::kSBC, AddressingMode::kZeroPage, 3},          // 0xE5
+    Instruction{Operation::kINC, AddressingMode::kZeroPage, 5},          // 0xE6
+    Instruction{Operation::kNoImpl, AddressingMode::kZeroPage, 5},       // 0xE7
+    Instruction{Operation::kINX, AddressingMode::kImplied, 2},           // 0xE8
+    Instruction{Operation::kSBC, AddressingMode::kImmediate, 2},         // 0xE9
+    Instruction{Operation::kNOP, AddressingMode::kImplied, 2},           // 0xEA
+    Instruction{Operation::kNoImpl, AddressingMode::kImmediate, 2},      // 0xEB
+    Instruction{Operation::kCPX, AddressingMode::kAbsolute, 4},          // 0xEC
+    Instruction{Operation::kSBC, AddressingMode::kAbsolute, 4},          // 0xED
+    Instruction{Operation::kINC, AddressingMode::kAbsolute, 6},          // 0xEE
+    Instruction{Operation::kNoImpl, AddressingMode::kAbsolute, 6},       // 0xEF
+    Instruction{Operation::kBEQ, AddressingMode::kRelative, 2},          // 0xF0
+    Instruction{Operation::kSBC, AddressingMode::kIndirectIndexedY, 5},  // 0xF1
+    Instruction{Operation::kJAM, AddressingMode::kImplied, 2},           // 0xF2
+    Instruction{Operation::kNoImpl, AddressingMode::kIndirectIndexedY,
+                8},  // 0xF3
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                4},  // 0xF4
+    Instruction{Operation::kSBC, AddressingMode::kIndexedZeroPageX, 4},  // 0xF5
+    Instruction{Operation::kINC, AddressingMode::kIndexedZeroPageX, 6},  // 0xF6
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedZeroPageX,
+                6},  // 0xF7
+    Instruction{Operation::kSED, AddressingMode::kImplied, 2},           // 0xF8
+    Instruction{Operation::kSBC, AddressingMode::kIndexedAbsoluteY, 4},  // 0xF9
+    Instruction{Operation::kNoImpl, AddressingMode::kImplied, 2},        // 0xFA
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteY,
+                7},  // 0xFB
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                4},  // 0xFC
+    Instruction{Operation::kSBC, AddressingMode::kIndexedAbsoluteX, 4},  // 0xFD
+    Instruction{Operation::kINC, AddressingMode::kIndexedAbsoluteX, 7},  // 0xFE
+    Instruction{Operation::kNoImpl, AddressingMode::kIndexedAbsoluteX,
+                7}  // 0xFF
+};
+// clang-format on
+
+constexpr std::array<uint8_t, 0x100> Cpu::m_InstructionLengths = [] {
+    std::array<uint8_t, 0x100> lengths{};
+    for (size_t opCode = 0; opCode < lengths.size(); ++opCode) {
+        lengths[opCode] = GetAddressingModeLength(
+            m_InstructionTable[opCode].m_AddressingMode);
+    }
+    return lengths;
+}();
+
+Cpu::Cpu()
+    : m_DecodeCache(kDecodeCacheSize),
+      m_FusedPairCounts(kFusedPairCount, 0),
+      m_IdleLoopRejections(kDecodeCacheSize, 0) {}
+
+Cpu::~Cpu() = default;
+
 void Cpu::SetBus(Bus* bus) {
     assert(bus != nullptr);
     m_Bus = bus;
@@ -16,7 +545,7 @@ void Cpu::Reset() {
     m_RegisterA = 0;
     m_RegisterX = 0;
     m_RegisterY = 0;
-    m_StatusRegister = 0x00 | CpuFlag::U;
+    SetStatusRegister(0x00 | CpuFlag::U);
 
     constexpr uint16_t addressToReadPC = 0xFFFC;
     uint16_t lo = m_Bus->CpuRead(addressToReadPC);
@@ -26,266 +555,1252 @@ void Cpu::Reset() {
     m_StackPointer = 0xFD;
 
     m_Cycles = 8;
+
+    m_IdleLoop.isActive = false;
+    m_IdleLoopLastAddress = m_ProgramCounter;
+
+    FlushDecodeCache();
 }
 
 void Cpu::Clock() {
     if (m_Cycles == 0) {
-        m_OpCode = ReadWordFromProgramCounter();
+        m_Cycles = ExecuteNextStep();
+    }
+
+    m_Cycles--;
+    ++m_IdleLoopClock;
+}
 
-        SetFlag(CpuFlag::U, 1);
+int64_t Cpu::Run(int64_t budget) {
+    m_IdleLoopClock += budget;
+    int64_t remaining = budget - m_Cycles;
+    while (remaining > 0) {
+        // Not implemented op codes take no cycles, which makes Clock() wrap
+        // the counter around. Keep the same behavior.
+        const uint8_t cycles = ExecuteNextStep();
+        remaining -= cycles == 0 ? 0x100 : cycles;
+    }
+    m_Cycles = static_cast<uint8_t>(-remaining);
+    return -remaining;
+}
+
+int64_t Cpu::RunAhead(int64_t budget) {
+    assert(m_Cycles == 0);
+    if (m_IrqLine) {
+        // The line is sampled before every instruction. Only the devices can
+        // change it, so execute one instruction and let them react
+        m_Cycles = static_cast<uint8_t>(ExecuteNextStep() - 1);
+        ++m_IdleLoopClock;
+        return 1;
+    }
 
-        // TODO: Catch exception illegal instruction
-        const Instruction& instr = FindInstruction(m_OpCode);
+    // Every instruction goes through the interpreter to be counted
+    const bool isProfiling = IsProfilerEnabled();
+
+    int64_t remaining = budget;
+    bool isFirstInstruction = true;
+    while (remaining > 0) {
+        if (m_IsIdleLoopDetectionEnabled && !isProfiling &&
+            TrackIdleLoop(budget - remaining, remaining)) {
+            // Time went by, the devices must catch up before the loop reads
+            // them again
+            isFirstInstruction = false;
+            continue;
+        }
 
-        m_Cycles = instr.m_Cycles;
+        if (!m_RecompiledRoutines.empty() && !isProfiling) {
+            const int64_t cycles = RunRecompiledRoutine(remaining);
+            if (cycles > 0) {
+                remaining -= cycles;
+                isFirstInstruction = false;
+                continue;
+            }
+        }
 
-        if (instr.m_ExecureAddressingMode) {
-            (this->*instr.m_ExecureAddressingMode)();
+        if (m_Jit != nullptr && !isProfiling) {
+            const int64_t cycles = m_Jit->RunBlock(remaining);
+            if (cycles > 0) {
+                remaining -= cycles;
+                isFirstInstruction = false;
+                continue;
+            }
         }
 
-        assert(instr.m_ExecuteInstruction != nullptr);
-        (this->*instr.m_ExecuteInstruction)();
+        // The first instruction runs on its own cycle, so it can access the
+        // devices. The rest must wait for the others to catch up
+        uint8_t opCode = 0x00;
+        uint16_t operand = 0x0000;
+        const bool isDecoded = PeekNextInstruction(opCode, operand);
+        const bool isIsolated = isDecoded && IsIsolated(opCode, operand);
+        if (!isIsolated && !isFirstInstruction) {
+            break;
+        }
 
-        if (m_AddressingModeNeedsAdditionalCycle &&
-            m_InstructionNeedsAdditionalCycle) {
-            ++m_Cycles;
+        uint8_t cycles = 0;
+        const bool isFused = isDecoded && m_IsFusionEnabled &&
+                             !isProfiling && kStartsFusedPair[opCode] &&
+                             ExecuteFusedPair(opCode, operand, isIsolated,
+                                              remaining, cycles);
+        if (!isFused) {
+            cycles = isDecoded ? ExecuteDecodedInstruction(opCode, operand)
+                               : ExecuteNextInstruction();
         }
+        if (!isIsolated) {
+            // Only use its first cycle, like Clock(). The other devices might
+            // react to it (e.g. a DMA transfer) before the rest are counted
+            m_Cycles = static_cast<uint8_t>(cycles - 1);
+            ++m_IdleLoopClock;
+            return 1;
+        }
+        remaining -= cycles == 0 ? 0x100 : cycles;
+        isFirstInstruction = false;
+    }
 
-        SetFlag(U, true);
+    if (remaining < 0) {
+        m_Cycles = static_cast<uint8_t>(-remaining);
+        m_IdleLoopClock += budget;
+        return budget;
     }
+    m_IdleLoopClock += budget - remaining;
+    return budget - remaining;
+}
 
-    m_Cycles--;
+void Cpu::SetIdleLoopDetectionEnabled(bool enabled) {
+    m_IsIdleLoopDetectionEnabled = enabled;
+    m_IdleLoop.isActive = false;
 }
 
-void Cpu::NonMaskableInterrupt() {
-    Write(0x0100 + m_StackPointer, (m_ProgramCounter >> 8) & 0x00FF);
-    m_StackPointer--;
-    Write(0x0100 + m_StackPointer, m_ProgramCounter & 0x00FF);
-    m_StackPointer--;
+void Cpu::SetIdleLoopExclusions(std::vector<uint16_t> addresses) {
+    m_IdleLoopExclusions = std::move(addresses);
+    m_IdleLoop.isActive = false;
+}
 
-    SetFlag(B, 0);
-    SetFlag(U, 1);
-    SetFlag(I, 1);
-    Write(0x0100 + m_StackPointer, m_StatusRegister);
-    m_StackPointer--;
+bool Cpu::TrackIdleLoop(int64_t cyclesUsed, int64_t& remaining) {
+    const uint16_t address = m_ProgramCounter;
+    const uint16_t lastAddress = m_IdleLoopLastAddress;
+    m_IdleLoopLastAddress = address;
 
-    uint16_t addresToReadPC = 0xFFFA;
-    uint16_t lo = Read(addresToReadPC + 0);
-    uint16_t hi = Read(addresToReadPC + 1);
-    m_ProgramCounter = (hi << 8) | lo;
+    IdleLoop& loop = m_IdleLoop;
+    if (loop.isActive &&
+        (address < loop.address || address >= loop.endAddress)) {
+        loop.isActive = false;
+    }
 
-    m_Cycles = 8;
+    const uint64_t clock = m_IdleLoopClock + cyclesUsed;
+    if (loop.isActive) {
+        if (address != loop.address || clock == loop.clock) {
+            // In the middle of an iteration, or still on the last arrival
+            return false;
+        }
+    } else if (address > lastAddress ||
+               lastAddress - address >= kMaxIdleLoopLength) {
+        // A loop is found when the program jumps back to its start
+        return false;
+    }
+
+    const uint8_t status = GetStatusRegister();
+    if (!loop.isActive) {
+        if (!AnalyzeIdleLoop(address, loop)) {
+            return false;
+        }
+        loop.isActive = true;
+        loop.isConfirmed = false;
+        loop.mismatches = 0;
+    } else if (loop.registerA != m_RegisterA ||
+               loop.registerX != m_RegisterX ||
+               loop.registerY != m_RegisterY ||
+               loop.stackPointer != m_StackPointer ||
+               loop.statusRegister != status) {
+        loop.isConfirmed = false;
+        if (++loop.mismatches >= kMaxIdleLoopMismatches) {
+            // It does some work, do not look at it again
+            loop.isActive = false;
+            const DecodedInstruction* entry = GetDecodeCacheEntry(address, 1);
+            m_IdleLoopRejections[entry - m_DecodeCache.data()] =
+                m_DecodeCacheGeneration;
+            return false;
+        }
+    } else {
+        if (!loop.isConfirmed) {
+            loop.isConfirmed = true;
+            ++m_IdleLoopStatistics.loopsDetected;
+        }
+
+        // Every iteration from here on repeats the last one, as long as the
+        // values it reads stay the same. The skipped iterations must end
+        // before the budget does, so that the loop goes on from its start
+        const int64_t iterationCycles =
+            static_cast<int64_t>(clock - loop.clock);
+        int64_t skippableCycles = remaining - 1;
+        if (loop.readsPpuStatus) {
+            // All its reads of the PPU status, since the start of the last
+            // iteration, must be in the stable window
+            const int64_t iterationStart = cyclesUsed - iterationCycles;
+            skippableCycles =
+                iterationStart < -m_PpuStatusStableCyclesBefore
+                    ? 0
+                    : std::min(skippableCycles,
+                               m_PpuStatusStableCyclesAfter - cyclesUsed);
+        }
+        const int64_t iterations = skippableCycles / iterationCycles;
+        if (iterations > 0) {
+            const int64_t skippedCycles = iterations * iterationCycles;
+            remaining -= skippedCycles;
+            loop.clock = clock + skippedCycles;
+            m_IdleLoopStatistics.iterationsSkipped += iterations;
+            m_IdleLoopStatistics.cyclesSkipped += skippedCycles;
+            return true;
+        }
+    }
+
+    loop.clock = clock;
+    loop.registerA = m_RegisterA;
+    loop.registerX = m_RegisterX;
+    loop.registerY = m_RegisterY;
+    loop.stackPointer = m_StackPointer;
+    loop.statusRegister = status;
+    return false;
 }
 
-uint8_t Cpu::Read(uint16_t address) { return m_Bus->CpuRead(address); }
+bool Cpu::AnalyzeIdleLoop(uint16_t address, IdleLoop& loop) {
+    using AM = AddressingMode;
+    const DecodedInstruction* entry = GetDecodeCacheEntry(address, 1);
+    if (entry == nullptr) {
+        return false;
+    }
+    uint32_t& rejection = m_IdleLoopRejections[entry - m_DecodeCache.data()];
+    if (rejection == m_DecodeCacheGeneration ||
+        std::find(m_IdleLoopExclusions.begin(), m_IdleLoopExclusions.end(),
+                  address) != m_IdleLoopExclusions.end()) {
+        return false;
+    }
+    // Analyzed once per decode cache generation
+    rejection = m_DecodeCacheGeneration;
+
+    loop.readsPpuStatus = false;
+    uint16_t offset = 0;
+    while (offset < kMaxIdleLoopLength) {
+        const uint16_t instructionAddress = address + offset;
+        if (!IsIsolatedAccess(instructionAddress, false)) {
+            return false;
+        }
+        const uint8_t opCode = Read(instructionAddress);
+        const uint8_t length = m_InstructionLengths[opCode];
+        const uint16_t nextAddress = instructionAddress + length;
+        if (!IsIsolatedAccess(nextAddress - 1, false)) {
+            return false;
+        }
+        uint16_t operand = 0x0000;
+        if (length > 1) {
+            operand = Read(instructionAddress + 1);
+        }
+        if (length > 2) {
+            operand |= Read(instructionAddress + 2) << 8;
+        }
+        offset += length;
+
+        const Instruction& instruction = m_InstructionTable[opCode];
+        switch (instruction.m_Operation) {
+            case Operation::kNoImpl:
+            case Operation::kJAM:
+            case Operation::kBRK:
+            case Operation::kJSR:
+            case Operation::kRTI:
+            case Operation::kRTS:
+            case Operation::kPHA:
+            case Operation::kPHP:
+            case Operation::kPLA:
+            case Operation::kPLP:
+                return false;
+            case Operation::kJMP:
+                if (instruction.m_AddressingMode != AM::kAbsolute ||
+                    operand != address) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
 
-void Cpu::Write(uint16_t address, uint8_t data) {
-    m_Bus->CpuWrite(address, data);
+        bool isLast = instruction.m_Operation == Operation::kJMP;
+        switch (instruction.m_AddressingMode) {
+            case AM::kImplied:
+            case AM::kAccumulator:
+            case AM::kImmediate:
+            case AM::kZeroPage:
+            case AM::kIndexedZeroPageX:
+            case AM::kIndexedZeroPageY:
+                break;
+            case AM::kRelative: {
+                // Sign extend the offset
+                const uint16_t offsetRelative =
+                    (operand & 0x80) ? (operand | 0xFF00) : operand;
+                isLast = static_cast<uint16_t>(nextAddress + offsetRelative) ==
+                         address;
+                break;
+            }
+            case AM::kAbsolute:
+                if (IsPpuStatusRegister(operand)) {
+                    loop.readsPpuStatus = true;
+                } else if (!IsIsolatedAccess(operand, false)) {
+                    return false;
+                }
+                break;
+            case AM::kIndexedAbsoluteX:
+            case AM::kIndexedAbsoluteY:
+                // Any index must stay in CPU RAM or cartridge ROM
+                if (!IsIsolatedAccess(operand, false) ||
+                    !IsIsolatedAccess(operand + 0x00FF, false)) {
+                    return false;
+                }
+                break;
+            default:
+                // Indirect addresses depend on the memory
+                return false;
+        }
+        const MemoryAccess access = GetMemoryAccess(
+            instruction.m_Operation, instruction.m_AddressingMode);
+        if (access == MemoryAccess::kWrite ||
+            access == MemoryAccess::kReadWrite) {
+            return false;
+        }
+
+        if (isLast) {
+            loop.address = address;
+            loop.endAddress = nextAddress;
+            rejection = 0;
+            return true;
+        }
+    }
+    return false;
 }
 
-uint8_t Cpu::ReadWordFromProgramCounter() {
-    return m_Bus->CpuRead(m_ProgramCounter++);
+void Cpu::SetProfilerEnabled(bool enabled) {
+#if defined(DEARNES_CPU_PROFILER)
+    if (!enabled) {
+        m_Profile.reset();
+    } else if (m_Profile == nullptr) {
+        ResetProfile();
+    }
+    // The idle loop being watched missed the cycles of the profiled code
+    m_IdleLoop.isActive = false;
+#else
+    (void)enabled;
+#endif
 }
 
-uint16_t Cpu::ReadDoubleWordFromProgramCounter() {
-    uint16_t lowNibble = ReadWordFromProgramCounter();
-    uint16_t highNibble = ReadWordFromProgramCounter();
+CpuProfile Cpu::GetProfile() const {
+#if defined(DEARNES_CPU_PROFILER)
+    if (m_Profile != nullptr) {
+        return *m_Profile;
+    }
+#endif
+    return CpuProfile{};
+}
+
+void Cpu::ResetProfile() {
+#if defined(DEARNES_CPU_PROFILER)
+    m_Profile = std::make_unique<CpuProfile>();
+    m_Profile->programSamples.resize(0x10000 - CpuProfile::kProgramStart, 0);
+    m_ProfileSamplingCycles = 0;
+#endif
+}
+
+#if defined(DEARNES_CPU_PROFILER)
+void Cpu::ProfileInstruction(uint16_t address, uint8_t opCode,
+                             uint8_t cycles) {
+    const Instruction& instruction = m_InstructionTable[opCode];
+    CpuProfile::OpCodeCounters& counters = m_Profile->opCodes[opCode];
+    ++counters.executions;
+    counters.cycles += cycles;
+
+    // The cycles over the base ones are paid by a taken branch, and by
+    // crossing a page with the indexed operand or the branch target
+    const uint8_t additionalCycles =
+        cycles > instruction.m_Cycles ? cycles - instruction.m_Cycles : 0;
+    if (instruction.m_AddressingMode == AddressingMode::kRelative) {
+        counters.branchesTaken += additionalCycles > 0 ? 1 : 0;
+        counters.pageCrossings += additionalCycles > 1 ? 1 : 0;
+    } else {
+        counters.pageCrossings += additionalCycles;
+    }
 
-    return (highNibble << 8) | lowNibble;
+    m_ProfileSamplingCycles += cycles;
+    while (m_ProfileSamplingCycles >= CpuProfile::kSamplingPeriod) {
+        m_ProfileSamplingCycles -= CpuProfile::kSamplingPeriod;
+        if (address >= CpuProfile::kProgramStart) {
+            ++m_Profile->programSamples[address - CpuProfile::kProgramStart];
+        } else {
+            ++m_Profile->otherSamples;
+        }
+    }
 }
+#endif
 
-void Cpu::AddrImmediate() { m_AddressAbsolute = m_ProgramCounter++; }
+void Cpu::SetJitEnabled(bool enabled) {
+    if (!enabled) {
+        m_Jit.reset();
+    } else if (m_Jit == nullptr) {
+        auto jit = std::make_unique<CpuJit>(*this);
+        if (jit->IsAvailable()) {
+            m_Jit = std::move(jit);
+        }
+    }
+}
+
+void Cpu::SetRecompiledProgram(const RecompiledProgram* program) {
+    m_RecompiledProgram = program;
+    m_RecompiledRoutines.clear();
+    if (program == nullptr) {
+        return;
+    }
 
-void Cpu::AddrZeroPage() {
-    m_AddressAbsolute = ReadWordFromProgramCounter();
-    m_AddressAbsolute &= 0x00FF;
+    m_RecompiledRoutines.resize(0x10000 - kCartridgeRomStart, nullptr);
+    for (size_t i = 0; i < program->routineCount; ++i) {
+        const RecompiledRoutine& routine = program->routines[i];
+        if (routine.address >= kCartridgeRomStart) {
+            m_RecompiledRoutines[routine.address - kCartridgeRomStart] =
+                &routine;
+        }
+    }
 }
 
-void Cpu::AddrIndexedZeroPageX() {
-    m_AddressAbsolute = ReadWordFromProgramCounter();
-    m_AddressAbsolute += m_RegisterX;
-    m_AddressAbsolute &= 0x00FF;
+int64_t Cpu::RunRecompiledRoutine(int64_t budget) {
+    if (m_ProgramCounter < kCartridgeRomStart) {
+        return 0;
+    }
+    const RecompiledRoutine* routine =
+        m_RecompiledRoutines[m_ProgramCounter - kCartridgeRomStart];
+    if (routine == nullptr || budget <= routine->cyclesBeforeLastInstruction) {
+        return 0;
+    }
+    return routine->function(this);
 }
 
-void Cpu::AddrIndexedZeroPageY() {
-    m_AddressAbsolute = ReadWordFromProgramCounter();
-    m_AddressAbsolute += m_RegisterY;
-    m_AddressAbsolute &= 0x00FF;
+uint8_t Cpu::ExecuteNextInstruction() {
+    uint8_t opCode = 0x00;
+    uint16_t operand = 0x0000;
+    DecodeNextInstruction(opCode, operand);
+    return ExecuteDecodedInstruction(opCode, operand);
 }
 
-void Cpu::AddrAbsolute() {
-    m_AddressAbsolute = ReadDoubleWordFromProgramCounter();
+uint8_t Cpu::ExecuteNextStep() {
+    // Idle loops are only followed by RunAhead()
+    m_IdleLoop.isActive = false;
+    if (m_IrqLine && GetFlag(CpuFlag::I) == 0) {
+        return InterruptRequest();
+    }
+    return ExecuteNextInstruction();
 }
 
-void Cpu::AddrIndexedAbsoluteX() {
-    m_AddressAbsolute = ReadDoubleWordFromProgramCounter();
-    uint16_t highNibble = m_AddressAbsolute & 0xFF00;
+uint8_t Cpu::ExecuteDecodedInstruction(uint8_t opCode, uint16_t operand) {
+#if defined(DEARNES_CPU_PROFILER)
+    const uint16_t address = m_ProgramCounter;
+#endif
+    m_OpCode = opCode;
+    m_ProgramCounter += m_InstructionLengths[opCode];
 
-    m_AddressAbsolute += m_RegisterX;
+    SetFlag(CpuFlag::U, 1);
 
-    m_AddressingModeNeedsAdditionalCycle =
-        (m_AddressAbsolute & 0xFF00) != highNibble;
+    // Unofficial op codes are executed as a NOP, or halt the CPU
+    const uint8_t cycles = ExecuteInstruction(m_OpCode, operand);
+
+    SetFlag(U, true);
+#if defined(DEARNES_CPU_PROFILER)
+    if (m_Profile != nullptr) {
+        ProfileInstruction(address, opCode, cycles);
+    }
+#endif
+    return cycles;
 }
 
-void Cpu::AddrIndexedAbsoluteY() {
-    m_AddressAbsolute = ReadDoubleWordFromProgramCounter();
-    uint16_t highNibble = m_AddressAbsolute & 0xFF00;
+void Cpu::DecodeNextInstruction(uint8_t& opCode, uint16_t& operand) {
+    const uint16_t address = m_ProgramCounter;
 
-    m_AddressAbsolute += m_RegisterY;
+    // Entries are only filled when the whole instruction is cacheable
+    DecodedInstruction* entry = GetDecodeCacheEntry(address, 1);
+    if (entry != nullptr && entry->generation == m_DecodeCacheGeneration) {
+        ++m_DecodeCacheStatistics.hits;
+        opCode = entry->opCode;
+        operand = entry->operand;
+        return;
+    }
+
+    opCode = ReadWordFromProgramCounter();
+    operand = ReadOperandFromProgramCounter(opCode);
+    m_ProgramCounter = address;
+
+    const uint8_t length = m_InstructionLengths[opCode];
+    entry = GetDecodeCacheEntry(address, length);
+    if (entry != nullptr) {
+        ++m_DecodeCacheStatistics.misses;
+        entry->generation = m_DecodeCacheGeneration;
+        entry->operand = operand;
+        entry->opCode = opCode;
+        entry->length = length;
+    } else {
+        ++m_DecodeCacheStatistics.uncached;
+    }
+}
 
-    m_AddressingModeNeedsAdditionalCycle =
-        (m_AddressAbsolute & 0xFF00) != highNibble;
+bool Cpu::PeekNextInstruction(uint8_t& opCode, uint16_t& operand) {
+    const uint16_t address = m_ProgramCounter;
+    const DecodedInstruction* entry = GetDecodeCacheEntry(address, 1);
+    if (entry == nullptr || entry->generation != m_DecodeCacheGeneration) {
+        // Cached instructions are always in CPU RAM or cartridge ROM. For the
+        // rest, check the op code first to know how many bytes follow
+        if (!IsIsolatedAccess(address, false)) {
+            return false;
+        }
+        const uint16_t lastAddress =
+            address + m_InstructionLengths[Read(address)] - 1;
+        if (!IsIsolatedAccess(lastAddress, false)) {
+            return false;
+        }
+    }
+    DecodeNextInstruction(opCode, operand);
+    return true;
 }
 
-void Cpu::AddrAbsoluteIndirect() {
-    uint16_t pointer = ReadDoubleWordFromProgramCounter();
+bool Cpu::IsIsolated(uint8_t opCode, uint16_t operand) {
+    using AM = AddressingMode;
+    const Instruction& instruction = m_InstructionTable[opCode];
+    const MemoryAccess access =
+        GetMemoryAccess(instruction.m_Operation, instruction.m_AddressingMode);
+    if (access == MemoryAccess::kNone) {
+        return true;
+    }
 
-    // Simulate page boundary hardware bug
-    if ((pointer & 0x00FF) == 0x00FF) {
-        m_AddressAbsolute = (Read(pointer & 0xFF00) << 8) | Read(pointer);
-    } else {
-        m_AddressAbsolute = (Read(pointer + 1) << 8) | Read(pointer);
+    // Resolving the indexed indirect modes only reads the zero page
+    const bool isWrite = access != MemoryAccess::kRead;
+    bool pageCrossed = false;
+    switch (instruction.m_AddressingMode) {
+        case AM::kZeroPage:
+        case AM::kIndexedZeroPageX:
+        case AM::kIndexedZeroPageY:
+            return true;
+        case AM::kAbsolute:
+            return IsIsolatedAccess(operand, isWrite);
+        case AM::kIndexedAbsoluteX:
+            return IsIsolatedAccess(
+                ResolveAddress<AM::kIndexedAbsoluteX>(operand, pageCrossed),
+                isWrite);
+        case AM::kIndexedAbsoluteY:
+            return IsIsolatedAccess(
+                ResolveAddress<AM::kIndexedAbsoluteY>(operand, pageCrossed),
+                isWrite);
+        case AM::kIndexedIndirectX:
+            return IsIsolatedAccess(
+                ResolveAddress<AM::kIndexedIndirectX>(operand, pageCrossed),
+                isWrite);
+        case AM::kIndirectIndexedY:
+            return IsIsolatedAccess(
+                ResolveAddress<AM::kIndirectIndexedY>(operand, pageCrossed),
+                isWrite);
+        case AM::kAbsoluteIndirect:
+            return IsIsolatedAccess(operand, false) &&
+                   IsIsolatedAccess(GetIndirectHighByteAddress(operand), false);
+        default:
+            return false;
+    }
+}
+
+const char* Cpu::GetOperationName(Operation operation) {
+    switch (operation) {
+        case Operation::kADC:
+            return "ADC";
+        case Operation::kAND:
+            return "AND";
+        case Operation::kASL:
+            return "ASL";
+        case Operation::kBCC:
+            return "BCC";
+        case Operation::kBCS:
+            return "BCS";
+        case Operation::kBEQ:
+            return "BEQ";
+        case Operation::kBIT:
+            return "BIT";
+        case Operation::kBMI:
+            return "BMI";
+        case Operation::kBNE:
+            return "BNE";
+        case Operation::kBPL:
+            return "BPL";
+        case Operation::kBRK:
+            return "BRK";
+        case Operation::kBVC:
+            return "BVC";
+        case Operation::kBVS:
+            return "BVS";
+        case Operation::kCLC:
+            return "CLC";
+        case Operation::kCLD:
+            return "CLD";
+        case Operation::kCLI:
+            return "CLI";
+        case Operation::kCLV:
+            return "CLV";
+        case Operation::kCMP:
+            return "CMP";
+        case Operation::kCPX:
+            return "CPX";
+        case Operation::kCPY:
+            return "CPY";
+        case Operation::kDEC:
+            return "DEC";
+        case Operation::kDEX:
+            return "DEX";
+        case Operation::kDEY:
+            return "DEY";
+        case Operation::kEOR:
+            return "EOR";
+        case Operation::kINC:
+            return "INC";
+        case Operation::kINX:
+            return "INX";
+        case Operation::kINY:
+            return "INY";
+        case Operation::kJAM:
+            return "JAM";
+        case Operation::kJMP:
+            return "JMP";
+        case Operation::kJSR:
+            return "JSR";
+        case Operation::kLDA:
+            return "LDA";
+        case Operation::kLDX:
+            return "LDX";
+        case Operation::kLDY:
+            return "LDY";
+        case Operation::kLSR:
+            return "LSR";
+        case Operation::kNOP:
+            return "NOP";
+        case Operation::kORA:
+            return "ORA";
+        case Operation::kPHA:
+            return "PHA";
+        case Operation::kPHP:
+            return "PHP";
+        case Operation::kPLA:
+            return "PLA";
+        case Operation::kPLP:
+            return "PLP";
+        case Operation::kROL:
+            return "ROL";
+        case Operation::kROR:
+            return "ROR";
+        case Operation::kRTI:
+            return "RTI";
+        case Operation::kRTS:
+            return "RTS";
+        case Operation::kSBC:
+            return "SBC";
+        case Operation::kSEC:
+            return "SEC";
+        case Operation::kSED:
+            return "SED";
+        case Operation::kSEI:
+            return "SEI";
+        case Operation::kSTA:
+            return "STA";
+        case Operation::kSTX:
+            return "STX";
+        case Operation::kSTY:
+            return "STY";
+        case Operation::kTAX:
+            return "TAX";
+        case Operation::kTAY:
+            return "TAY";
+        case Operation::kTSX:
+            return "TSX";
+        case Operation::kTXA:
+            return "TXA";
+        case Operation::kTXS:
+            return "TXS";
+        case Operation::kTYA:
+            return "TYA";
+        default:
+            return "???";
     }
 }
 
-void Cpu::AddrIndexedIndirectX() {
-    uint16_t t = ReadWordFromProgramCounter();
+const char* Cpu::GetAddressingModeName(AddressingMode mode) {
+    switch (mode) {
+        case AddressingMode::kImplied:
+            return "IMP";
+        case AddressingMode::kAccumulator:
+            return "ACC";
+        case AddressingMode::kImmediate:
+            return "IMM";
+        case AddressingMode::kZeroPage:
+            return "ZP0";
+        case AddressingMode::kIndexedZeroPageX:
+            return "ZPX";
+        case AddressingMode::kIndexedZeroPageY:
+            return "ZPY";
+        case AddressingMode::kAbsolute:
+            return "ABS";
+        case AddressingMode::kIndexedAbsoluteX:
+            return "ABX";
+        case AddressingMode::kIndexedAbsoluteY:
+            return "ABY";
+        case AddressingMode::kAbsoluteIndirect:
+            return "IND";
+        case AddressingMode::kIndexedIndirectX:
+            return "IZX";
+        case AddressingMode::kIndirectIndexedY:
+            return "IZY";
+        case AddressingMode::kRelative:
+            return "REL";
+        default:
+            return "???";
+    }
+}
 
-    uint16_t registerXValue = static_cast<uint16_t>(m_RegisterX);
+bool Cpu::IsAlwaysIsolated(uint8_t opCode, uint16_t operand) {
+    using AM = AddressingMode;
+    const Instruction& instruction = m_InstructionTable[opCode];
+    const MemoryAccess access =
+        GetMemoryAccess(instruction.m_Operation, instruction.m_AddressingMode);
+    if (access == MemoryAccess::kNone) {
+        return true;
+    }
 
-    uint16_t lowNibbleAddress = (t + registerXValue) & 0x00FF;
-    uint16_t lowNibble = Read(lowNibbleAddress);
+    const bool isWrite = access != MemoryAccess::kRead;
+    switch (instruction.m_AddressingMode) {
+        case AM::kZeroPage:
+        case AM::kIndexedZeroPageX:
+        case AM::kIndexedZeroPageY:
+            return true;
+        case AM::kAbsolute:
+            return IsIsolatedAccess(operand, isWrite);
+        case AM::kIndexedAbsoluteX:
+        case AM::kIndexedAbsoluteY:
+            // Both ends of the indexed range are enough: it cannot span from
+            // CPU RAM to cartridge ROM but it can wrap around from the latter
+            return IsIsolatedAccess(operand, isWrite) &&
+                   IsIsolatedAccess(operand + 0xFF, isWrite);
+        default:
+            // Indirect addresses depend on the memory
+            return false;
+    }
+}
 
-    uint16_t highNibbleAddress = (t + registerXValue + 1) & 0x00FF;
-    uint16_t highNibble = Read(highNibbleAddress);
+bool Cpu::IsBranch(Operation operation) {
+    switch (operation) {
+        case Operation::kBCC:
+        case Operation::kBCS:
+        case Operation::kBEQ:
+        case Operation::kBMI:
+        case Operation::kBNE:
+        case Operation::kBPL:
+        case Operation::kBVC:
+        case Operation::kBVS:
+            return true;
+        default:
+            return false;
+    }
+}
 
-    m_AddressAbsolute = (highNibble << 8) | lowNibble;
+bool Cpu::IsTranslatable(uint8_t opCode) {
+    const Operation operation = m_InstructionTable[opCode].m_Operation;
+    return operation != Operation::kNoImpl && operation != Operation::kJAM;
 }
 
-void Cpu::AddrIndirectIndexedY() {
-    uint16_t t = ReadWordFromProgramCounter();
+bool Cpu::EndsTranslatedBlock(Operation operation) {
+    return ChangesProgramCounter(operation);
+}
 
-    uint16_t lowNibble = Read(t & 0x00FF);
-    uint16_t highNibble = Read((t + 1) & 0x00FF);
+uint8_t Cpu::GetMaxTranslatedCycles(uint8_t opCode) {
+    const Instruction& instruction = m_InstructionTable[opCode];
+    if (instruction.m_AddressingMode == AddressingMode::kIndexedAbsoluteX ||
+        instruction.m_AddressingMode == AddressingMode::kIndexedAbsoluteY) {
+        // Page crossing cycle
+        return instruction.m_Cycles + 1;
+    }
+    if (IsBranch(instruction.m_Operation)) {
+        // Branch taken, to another page
+        return instruction.m_Cycles + 2;
+    }
+    return instruction.m_Cycles;
+}
 
-    m_AddressAbsolute = (highNibble << 8) | lowNibble;
-    m_AddressAbsolute += m_RegisterY;
+Cpu::DecodedInstruction* Cpu::GetDecodeCacheEntry(uint16_t address,
+                                                  uint8_t length) {
+    // The instruction must be entirely in the same cacheable area
+    const uint32_t lastAddress = address + length - 1;
+    if (lastAddress <= kCpuRamEnd) {
+        return &m_DecodeCache[address & kCpuRamMask];
+    }
+    if (address >= kCartridgeRomStart && lastAddress <= 0xFFFF) {
+        return &m_DecodeCache[SIZE_CPU_RAM + (address - kCartridgeRomStart)];
+    }
+    return nullptr;
+}
 
-    m_AddressingModeNeedsAdditionalCycle =
-        (m_AddressAbsolute & 0xFF00) != (highNibble << 8);
+void Cpu::InvalidateDecodeCache(uint16_t address) {
+    // An instruction is 3 bytes long at most
+    for (uint16_t offset = 0; offset < 3; ++offset) {
+        const uint16_t ramAddress = (address - offset) & kCpuRamMask;
+        m_DecodeCache[ramAddress].generation = 0;
+    }
 }
 
-void Cpu::AddrRelative() {
-    m_AddressRelative = ReadWordFromProgramCounter();
+void Cpu::InvalidateCode(uint16_t firstAddress, uint16_t lastAddress) {
+    // Only the code in CPU RAM and cartridge ROM is cached
+    if (firstAddress > kCpuRamEnd && lastAddress < kCartridgeRomStart) {
+        return;
+    }
+    FlushDecodeCache();
 
-    if (m_AddressRelative & 0x80)  // if unsigned
-    {
-        m_AddressRelative |= 0xFF00;
+    // The recompiled code no longer matches the cartridge ROM
+    if (lastAddress >= kCartridgeRomStart && m_RecompiledProgram != nullptr) {
+        SetRecompiledProgram(nullptr);
     }
 }
 
-void Cpu::InstrADC() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
+void Cpu::FlushDecodeCache() {
+    ++m_DecodeCacheStatistics.flushes;
+    ++m_DecodeCacheGeneration;
+    if (m_DecodeCacheGeneration == 0) {
+        // Generation 0 marks an invalid entry, start over when it wraps around
+        for (DecodedInstruction& entry : m_DecodeCache) {
+            entry.generation = 0;
+        }
+        std::fill(m_IdleLoopRejections.begin(), m_IdleLoopRejections.end(),
+                  0);
+        m_DecodeCacheGeneration = 1;
+    }
+}
 
-    uint16_t castedFetched = static_cast<uint16_t>(valueFetched);
-    uint16_t castedCarry = static_cast<uint16_t>(GetFlag(CpuFlag::C));
-    uint16_t castedAccum = static_cast<uint16_t>(m_RegisterA);
+void Cpu::SetStatusRegister(uint8_t status) {
+    m_StatusRegister = status;
+    m_NegativeResult = status & CpuFlag::N;
+    m_ZeroResult = (status & CpuFlag::Z) == 0x00 ? 0x01 : 0x00;
+    m_CarryResult = status & CpuFlag::C;
+    m_OverflowResult = (status & CpuFlag::V) << 1;
+}
 
-    uint16_t temp = castedAccum + castedFetched + castedCarry;
-    SetFlag(CpuFlag::C, temp > 255);
-    SetFlag(CpuFlag::Z, (temp & 0x00FF) == 0);
-    SetFlag(CpuFlag::N, temp & 0x80);
-    SetFlag(V,
-            (~(castedAccum ^ castedFetched) & (castedAccum ^ temp)) & 0x0080);
+void Cpu::NonMaskableInterrupt() {
+    Write(0x0100 + m_StackPointer, (m_ProgramCounter >> 8) & 0x00FF);
+    m_StackPointer--;
+    Write(0x0100 + m_StackPointer, m_ProgramCounter & 0x00FF);
+    m_StackPointer--;
 
-    m_RegisterA = temp & 0x00FF;
+    SetFlag(B, 0);
+    SetFlag(U, 1);
+    SetFlag(I, 1);
+    Write(0x0100 + m_StackPointer, GetStatusRegister());
+    m_StackPointer--;
 
-    m_InstructionNeedsAdditionalCycle = true;
+    uint16_t addresToReadPC = 0xFFFA;
+    uint16_t lo = Read(addresToReadPC + 0);
+    uint16_t hi = Read(addresToReadPC + 1);
+    m_ProgramCounter = (hi << 8) | lo;
+
+    m_Cycles = 8;
+    m_IdleLoop.isActive = false;
 }
 
-void Cpu::InstrAND() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
+uint8_t Cpu::InterruptRequest() {
+    Write(0x0100 + m_StackPointer, (m_ProgramCounter >> 8) & 0x00FF);
+    m_StackPointer--;
+    Write(0x0100 + m_StackPointer, m_ProgramCounter & 0x00FF);
+    m_StackPointer--;
+
+    // The status is pushed before disabling the interrupts, so that RTI
+    // enables them again
+    SetFlag(B, 0);
+    SetFlag(U, 1);
+    Write(0x0100 + m_StackPointer, GetStatusRegister());
+    m_StackPointer--;
+    SetFlag(I, 1);
 
-    m_RegisterA &= valueFetched;
-    SetFlag(CpuFlag::Z, m_RegisterA == 0x00);
-    SetFlag(CpuFlag::N, m_RegisterA & 0x80);
+    uint16_t addresToReadPC = 0xFFFE;
+    uint16_t lo = Read(addresToReadPC + 0);
+    uint16_t hi = Read(addresToReadPC + 1);
+    m_ProgramCounter = (hi << 8) | lo;
 
-    m_InstructionNeedsAdditionalCycle = true;
+    return 7;
 }
 
-void Cpu::InstrASL() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
+uint8_t Cpu::Read(uint16_t address) { return m_Bus->CpuRead(address); }
 
-    uint16_t temp = static_cast<uint16_t>(valueFetched) << 1;
-    SetFlag(CpuFlag::C, (temp & 0xFF00) > 0);
-    SetFlag(CpuFlag::Z, (temp & 0x00FF) == 0);
-    SetFlag(CpuFlag::N, temp & 0x80);
+void Cpu::Write(uint16_t address, uint8_t data) {
+    if (address < kCartridgeRomStart) {
+        m_Bus->CpuWrite(address, data);
+        if (address <= kCpuRamEnd) {
+            InvalidateDecodeCache(address);
+        }
+        return;
+    }
 
-    Write(m_AddressAbsolute, temp & 0x00FF);
+    // Bank switches are reported by the bus. Otherwise, the cached code only
+    // goes stale if the write changed the byte mapped to the address
+    const uint8_t previous = m_Bus->CpuRead(address, true);
+    m_Bus->CpuWrite(address, data);
+    if (m_Bus->CpuRead(address, true) != previous) {
+        InvalidateCode(address, address);
+    }
 }
 
-void Cpu::InstrASL_AcummAddr() {
-    uint16_t temp = static_cast<uint16_t>(m_RegisterA) << 1;
-    SetFlag(CpuFlag::C, (temp & 0xFF00) > 0);
-    SetFlag(CpuFlag::Z, (temp & 0x00FF) == 0);
-    SetFlag(CpuFlag::N, temp & 0x80);
+uint8_t Cpu::ReadWordFromProgramCounter() {
+    return m_Bus->CpuRead(m_ProgramCounter++);
+}
 
-    m_RegisterA = temp & 0x00FF;
+uint16_t Cpu::ReadDoubleWordFromProgramCounter() {
+    uint16_t lowNibble = ReadWordFromProgramCounter();
+    uint16_t highNibble = ReadWordFromProgramCounter();
+
+    return (highNibble << 8) | lowNibble;
 }
 
-void Cpu::InstrExecuteBranch() {
-    m_Cycles++;
-    m_AddressAbsolute = m_ProgramCounter + m_AddressRelative;
+uint16_t Cpu::ReadOperandFromProgramCounter(uint8_t opCode) {
+    switch (m_InstructionLengths[opCode]) {
+        case 2:
+            return ReadWordFromProgramCounter();
+        case 3:
+            return ReadDoubleWordFromProgramCounter();
+        default:
+            return 0x0000;
+    }
+}
 
-    if ((m_AddressAbsolute & 0xFF00) != (m_ProgramCounter & 0xFF00)) {
-        m_Cycles++;
+template <Cpu::AddressingMode Mode>
+uint16_t Cpu::ResolveAddress(uint16_t operand, bool& pageCrossed) {
+    using AM = AddressingMode;
+    if constexpr (Mode == AM::kImmediate) {
+        // The operand is the value itself, Fetch() will not touch the bus
+        return operand;
+    } else if constexpr (Mode == AM::kZeroPage) {
+        return operand & 0x00FF;
+    } else if constexpr (Mode == AM::kIndexedZeroPageX) {
+        return (operand + m_RegisterX) & 0x00FF;
+    } else if constexpr (Mode == AM::kIndexedZeroPageY) {
+        return (operand + m_RegisterY) & 0x00FF;
+    } else if constexpr (Mode == AM::kAbsolute) {
+        return operand;
+    } else if constexpr (Mode == AM::kIndexedAbsoluteX ||
+                         Mode == AM::kIndexedAbsoluteY) {
+        const uint16_t index =
+            Mode == AM::kIndexedAbsoluteX ? m_RegisterX : m_RegisterY;
+        const uint16_t address = operand + index;
+        pageCrossed = (address & 0xFF00) != (operand & 0xFF00);
+        return address;
+    } else if constexpr (Mode == AM::kAbsoluteIndirect) {
+        // Simulate page boundary hardware bug
+        if ((operand & 0x00FF) == 0x00FF) {
+            return (Read(operand & 0xFF00) << 8) | Read(operand);
+        }
+        return (Read(operand + 1) << 8) | Read(operand);
+    } else if constexpr (Mode == AM::kIndexedIndirectX) {
+        const uint16_t pointer = operand + m_RegisterX;
+        uint16_t lowNibble = Read(pointer & 0x00FF);
+        uint16_t highNibble = Read((pointer + 1) & 0x00FF);
+        return (highNibble << 8) | lowNibble;
+    } else if constexpr (Mode == AM::kIndirectIndexedY) {
+        uint16_t lowNibble = Read(operand & 0x00FF);
+        uint16_t highNibble = Read((operand + 1) & 0x00FF);
+        const uint16_t address = ((highNibble << 8) | lowNibble) + m_RegisterY;
+        pageCrossed = (address & 0xFF00) != (highNibble << 8);
+        return address;
+    } else if constexpr (Mode == AM::kRelative) {
+        // Sign extend the offset
+        return (operand & 0x80) ? (operand | 0xFF00) : operand;
+    } else {
+        return 0x0000;
     }
-    m_ProgramCounter = m_AddressAbsolute;
 }
 
-void Cpu::InstrBCC() {
-    if (GetFlag(CpuFlag::C) == 0) {
-        InstrExecuteBranch();
+template <Cpu::AddressingMode Mode>
+uint8_t Cpu::Fetch(uint16_t address) {
+    if constexpr (Mode == AddressingMode::kImmediate) {
+        return static_cast<uint8_t>(address);
+    } else if constexpr (Mode == AddressingMode::kAccumulator) {
+        return m_RegisterA;
+    } else {
+        return Read(address);
     }
 }
 
-void Cpu::InstrBCS() {
-    if (GetFlag(CpuFlag::C) == 1) {
-        InstrExecuteBranch();
+template <Cpu::Operation Op, Cpu::AddressingMode Mode>
+uint8_t Cpu::ExecuteOperation(uint16_t address) {
+    using O = Operation;
+
+    // Read-modify-write operations work on register A or on memory
+    auto modify = [&](auto operation) {
+        if constexpr (Mode == AddressingMode::kAccumulator) {
+            m_RegisterA = (this->*operation)(m_RegisterA);
+        } else {
+            Write(address, (this->*operation)(Read(address)));
+        }
+    };
+
+    // clang-format off
+    if constexpr (Op == O::kADC) InstrADC(Fetch<Mode>(address));
+    else if constexpr (Op == O::kAND) InstrAND(Fetch<Mode>(address));
+    else if constexpr (Op == O::kASL) modify(&Cpu::InstrASL);
+    else if constexpr (Op == O::kBCC) return InstrExecuteBranch(m_CarryResult == 0x00, address);
+    else if constexpr (Op == O::kBCS) return InstrExecuteBranch(m_CarryResult != 0x00, address);
+    else if constexpr (Op == O::kBEQ) return InstrExecuteBranch(m_ZeroResult == 0x00, address);
+    else if constexpr (Op == O::kBIT) InstrBIT(Fetch<Mode>(address));
+    else if constexpr (Op == O::kBMI) return InstrExecuteBranch((m_NegativeResult & 0x80) != 0x00, address);
+    else if constexpr (Op == O::kBNE) return InstrExecuteBranch(m_ZeroResult != 0x00, address);
+    else if constexpr (Op == O::kBPL) return InstrExecuteBranch((m_NegativeResult & 0x80) == 0x00, address);
+    else if constexpr (Op == O::kBRK) InstrBRK();
+    else if constexpr (Op == O::kBVC) return InstrExecuteBranch((m_OverflowResult & 0x80) == 0x00, address);
+    else if constexpr (Op == O::kBVS) return InstrExecuteBranch((m_OverflowResult & 0x80) != 0x00, address);
+    else if constexpr (Op == O::kCLC) SetFlag(C, false);
+    else if constexpr (Op == O::kCLD) SetFlag(D, false);
+    else if constexpr (Op == O::kCLI) SetFlag(I, false);
+    else if constexpr (Op == O::kCLV) SetFlag(V, false);
+    else if constexpr (Op == O::kCMP) InstrCMP(Fetch<Mode>(address));
+    else if constexpr (Op == O::kCPX) InstrCPX(Fetch<Mode>(address));
+    else if constexpr (Op == O::kCPY) InstrCPY(Fetch<Mode>(address));
+    else if constexpr (Op == O::kDEC) modify(&Cpu::InstrDEC);
+    else if constexpr (Op == O::kDEX) InstrDEX();
+    else if constexpr (Op == O::kDEY) InstrDEY();
+    else if constexpr (Op == O::kEOR) InstrEOR(Fetch<Mode>(address));
+    else if constexpr (Op == O::kINC) modify(&Cpu::InstrINC);
+    else if constexpr (Op == O::kINX) InstrINX();
+    else if constexpr (Op == O::kINY) InstrINY();
+    else if constexpr (Op == O::kJAM) m_ProgramCounter -= 1;
+    else if constexpr (Op == O::kJMP) m_ProgramCounter = address;
+    else if constexpr (Op == O::kJSR) InstrJSR(address);
+    else if constexpr (Op == O::kLDA) InstrLDA(Fetch<Mode>(address));
+    else if constexpr (Op == O::kLDX) InstrLDX(Fetch<Mode>(address));
+    else if constexpr (Op == O::kLDY) InstrLDY(Fetch<Mode>(address));
+    else if constexpr (Op == O::kLSR) modify(&Cpu::InstrLSR);
+    else if constexpr (Op == O::kNOP) {}
+    else if constexpr (Op == O::kORA) InstrORA(Fetch<Mode>(address));
+    else if constexpr (Op == O::kPHA) InstrPHA();
+    else if constexpr (Op == O::kPHP) InstrPHP();
+    else if constexpr (Op == O::kPLA) InstrPLA();
+    else if constexpr (Op == O::kPLP) InstrPLP();
+    else if constexpr (Op == O::kROL) modify(&Cpu::InstrROL);
+    else if constexpr (Op == O::kROR) modify(&Cpu::InstrROR);
+    else if constexpr (Op == O::kRTI) InstrRTI();
+    else if constexpr (Op == O::kRTS) InstrRTS();
+    else if constexpr (Op == O::kSBC) InstrSBC(Fetch<Mode>(address));
+    else if constexpr (Op == O::kSEC) SetFlag(C, true);
+    else if constexpr (Op == O::kSED) SetFlag(D, true);
+    else if constexpr (Op == O::kSEI) SetFlag(I, true);
+    else if constexpr (Op == O::kSTA) Write(address, m_RegisterA);
+    else if constexpr (Op == O::kSTX) Write(address, m_RegisterX);
+    else if constexpr (Op == O::kSTY) Write(address, m_RegisterY);
+    else if constexpr (Op == O::kTAX) InstrTAX();
+    else if constexpr (Op == O::kTAY) InstrTAY();
+    else if constexpr (Op == O::kTSX) InstrTSX();
+    else if constexpr (Op == O::kTXA) InstrTXA();
+    else if constexpr (Op == O::kTXS) m_StackPointer = m_RegisterX;
+    else if constexpr (Op == O::kTYA) InstrTYA();
+    // clang-format on
+
+    return 0;
+}
+
+template <uint8_t OpCode>
+uint8_t Cpu::ExecuteInstruction(uint16_t operand) {
+    constexpr Instruction instr = m_InstructionTable[OpCode];
+
+    bool pageCrossed = false;
+    const uint16_t address =
+        ResolveAddress<instr.m_AddressingMode>(operand, pageCrossed);
+
+    uint8_t cycles = instr.m_Cycles;
+    cycles += ExecuteOperation<instr.m_Operation, instr.m_AddressingMode>(
+        address);
+
+    if constexpr (PaysPageCrossingCycle(instr.m_Operation)) {
+        cycles += pageCrossed ? 1 : 0;
     }
+    return cycles;
+}
+
+// Expand the macro once per op code, 0x00 to 0xFF
+#define DEARNES_CPU_OPCODE_ROW(macro, row)                                    \
+    macro(row##0) macro(row##1) macro(row##2) macro(row##3)                   \
+    macro(row##4) macro(row##5) macro(row##6) macro(row##7)                   \
+    macro(row##8) macro(row##9) macro(row##A) macro(row##B)                   \
+    macro(row##C) macro(row##D) macro(row##E) macro(row##F)
+#define DEARNES_CPU_FOR_EACH_OPCODE(macro)                                    \
+    DEARNES_CPU_OPCODE_ROW(macro, 0x0) DEARNES_CPU_OPCODE_ROW(macro, 0x1)     \
+    DEARNES_CPU_OPCODE_ROW(macro, 0x2) DEARNES_CPU_OPCODE_ROW(macro, 0x3)     \
+    DEARNES_CPU_OPCODE_ROW(macro, 0x4) DEARNES_CPU_OPCODE_ROW(macro, 0x5)     \
+    DEARNES_CPU_OPCODE_ROW(macro, 0x6) DEARNES_CPU_OPCODE_ROW(macro, 0x7)     \
+    DEARNES_CPU_OPCODE_ROW(macro, 0x8) DEARNES_CPU_OPCODE_ROW(macro, 0x9)     \
+    DEARNES_CPU_OPCODE_ROW(macro, 0xA) DEARNES_CPU_OPCODE_ROW(macro, 0xB)     \
+    DEARNES_CPU_OPCODE_ROW(macro, 0xC) DEARNES_CPU_OPCODE_ROW(macro, 0xD)     \
+    DEARNES_CPU_OPCODE_ROW(macro, 0xE) DEARNES_CPU_OPCODE_ROW(macro, 0xF)
+
+uint8_t Cpu::ExecuteInstruction(uint8_t opCode, uint16_t operand) {
+    // One case per op code, each one calls its own fused handler
+#define DEARNES_CPU_OPCODE_CASE(opCode) \
+    case opCode:                        \
+        return ExecuteInstruction<opCode>(operand);
+
+    switch (opCode) { DEARNES_CPU_FOR_EACH_OPCODE(DEARNES_CPU_OPCODE_CASE) }
+
+#undef DEARNES_CPU_OPCODE_CASE
+
+    // Not reachable, every op code has a case
+    return 0;
+}
+
+template <uint8_t OpCode>
+uint8_t Cpu::ExecuteTranslatedInstruction(Cpu* cpu, uint16_t operand,
+                                          uint16_t nextAddress) {
+    cpu->m_OpCode = OpCode;
+    cpu->m_ProgramCounter = nextAddress;
+
+    cpu->SetFlag(CpuFlag::U, 1);
+    const uint8_t cycles = cpu->ExecuteInstruction<OpCode>(operand);
+    cpu->SetFlag(U, true);
+    return cycles;
+}
+
+// Recompiled programs call the handlers from other translation units
+#define DEARNES_CPU_OPCODE_INSTANTIATION(opCode)                   \
+    template uint8_t Cpu::ExecuteTranslatedInstruction<opCode>( \
+        Cpu * cpu, uint16_t operand, uint16_t nextAddress);
+
+DEARNES_CPU_FOR_EACH_OPCODE(DEARNES_CPU_OPCODE_INSTANTIATION)
+
+#undef DEARNES_CPU_OPCODE_INSTANTIATION
+
+#define DEARNES_CPU_OPCODE_HANDLER(opCode) \
+    &Cpu::ExecuteTranslatedInstruction<opCode>,
+
+const std::array<Cpu::TranslatedInstructionHandler, 0x100>
+    Cpu::m_TranslatedInstructionHandlers = {
+        DEARNES_CPU_FOR_EACH_OPCODE(DEARNES_CPU_OPCODE_HANDLER)};
+
+#undef DEARNES_CPU_OPCODE_HANDLER
+#undef DEARNES_CPU_FOR_EACH_OPCODE
+#undef DEARNES_CPU_OPCODE_ROW
+
+bool Cpu::ExecuteFusedPair(uint8_t opCode, uint16_t operand, bool isIsolated,
+                           int64_t budget, uint8_t& cycles) {
+    if (!isIsolated) {
+        // Reading a device is fine, it happens on the first cycle anyway
+        const Instruction& instruction = m_InstructionTable[opCode];
+        if (GetMemoryAccess(instruction.m_Operation,
+                            instruction.m_AddressingMode) !=
+            MemoryAccess::kRead) {
+            return false;
+        }
+    }
+
+    const uint16_t nextAddress =
+        m_ProgramCounter + m_InstructionLengths[opCode];
+    const DecodedInstruction* next = GetDecodeCacheEntry(nextAddress, 1);
+    if (next == nullptr || next->generation != m_DecodeCacheGeneration ||
+        !IsAlwaysIsolated(next->opCode, next->operand)) {
+        return false;
+    }
+
+#define DEARNES_CPU_FUSED_PAIR_CASE(first, second)                     \
+    case ((first) << 8) | (second):                                    \
+        cycles = ExecuteFusedInstructions<first, second>(operand, *next, \
+                                                         budget);      \
+        return true;
+
+    switch ((opCode << 8) | next->opCode) {
+        DEARNES_CPU_FOR_EACH_FUSED_PAIR(DEARNES_CPU_FUSED_PAIR_CASE)
+        default:
+            return false;
+    }
+
+#undef DEARNES_CPU_FUSED_PAIR_CASE
 }
 
-void Cpu::InstrBEQ() {
-    if (GetFlag(CpuFlag::Z) == 1) {
-        InstrExecuteBranch();
+template <uint8_t First, uint8_t Second>
+uint8_t Cpu::ExecuteFusedInstructions(uint16_t firstOperand,
+                                      const DecodedInstruction& second,
+                                      int64_t budget) {
+    static_assert(!ChangesProgramCounter(m_InstructionTable[First].m_Operation),
+                  "The second instruction must follow the first one");
+    constexpr size_t pairIndex = GetFusedPairIndex(First, Second);
+
+    const uint8_t firstCycles = ExecuteTranslatedInstruction<First>(
+        this, firstOperand, m_ProgramCounter + m_InstructionLengths[First]);
+
+    // The first instruction might have written over the second one
+    if (budget <= firstCycles ||
+        second.generation != m_DecodeCacheGeneration) {
+        return firstCycles;
     }
+    const uint8_t secondCycles = ExecuteTranslatedInstruction<Second>(
+        this, second.operand, m_ProgramCounter + m_InstructionLengths[Second]);
+    ++m_FusedPairCounts[pairIndex];
+    return firstCycles + secondCycles;
+}
+
+std::vector<Cpu::FusedPairStatistics> Cpu::GetFusionStatistics() const {
+    std::vector<FusedPairStatistics> statistics(kFusedPairCount);
+    for (size_t index = 0; index < kFusedPairCount; ++index) {
+        statistics[index].firstOpCode =
+            static_cast<uint8_t>(kFusedPairs[index] >> 8);
+        statistics[index].secondOpCode =
+            static_cast<uint8_t>(kFusedPairs[index] & 0xFF);
+        statistics[index].executed = m_FusedPairCounts[index];
+    }
+    return statistics;
+}
+
+void Cpu::ResetFusionStatistics() {
+    std::fill(m_FusedPairCounts.begin(), m_FusedPairCounts.end(), 0);
 }
 
-void Cpu::InstrBIT() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
+#undef DEARNES_CPU_FOR_EACH_FUSED_PAIR
+
+void Cpu::InstrADC(uint8_t value) {
+    uint16_t castedFetched = static_cast<uint16_t>(value);
+    uint16_t castedCarry = static_cast<uint16_t>(m_CarryResult);
+    uint16_t castedAccum = static_cast<uint16_t>(m_RegisterA);
+
+    uint16_t temp = castedAccum + castedFetched + castedCarry;
+    m_CarryResult = static_cast<uint8_t>(temp >> 8);
+    SetZeroAndNegativeFlags(temp & 0x00FF);
+    m_OverflowResult = static_cast<uint8_t>(~(castedAccum ^ castedFetched) &
+                                            (castedAccum ^ temp));
 
-    uint16_t temp = m_RegisterA & valueFetched;
-    SetFlag(Z, (temp & 0x00FF) == 0x00);
-    SetFlag(N, valueFetched & (1 << 7));
-    SetFlag(V, valueFetched & (1 << 6));
+    m_RegisterA = temp & 0x00FF;
 }
 
-void Cpu::InstrBMI() {
-    if (GetFlag(CpuFlag::N) == 1) {
-        InstrExecuteBranch();
-    }
+void Cpu::InstrAND(uint8_t value) {
+    m_RegisterA &= value;
+    SetZeroAndNegativeFlags(m_RegisterA);
 }
 
-void Cpu::InstrBNE() {
-    if (GetFlag(CpuFlag::Z) == 0) {
-        InstrExecuteBranch();
-    }
+uint8_t Cpu::InstrASL(uint8_t value) {
+    uint16_t temp = static_cast<uint16_t>(value) << 1;
+    m_CarryResult = static_cast<uint8_t>(temp >> 8);
+    SetZeroAndNegativeFlags(temp & 0x00FF);
+
+    return temp & 0x00FF;
 }
 
-void Cpu::InstrBPL() {
-    if (GetFlag(CpuFlag::N) == 0) {
-        InstrExecuteBranch();
+uint8_t Cpu::InstrExecuteBranch(bool condition, uint16_t addressRelative) {
+    if (!condition) {
+        return 0;
+    }
+    uint8_t additionalCycles = 1;
+    uint16_t addressAbsolute = m_ProgramCounter + addressRelative;
+
+    if ((addressAbsolute & 0xFF00) != (m_ProgramCounter & 0xFF00)) {
+        additionalCycles++;
     }
+    m_ProgramCounter = addressAbsolute;
+    return additionalCycles;
+}
+
+void Cpu::InstrBIT(uint8_t value) {
+    m_ZeroResult = m_RegisterA & value;
+    m_NegativeResult = value;
+    m_OverflowResult = static_cast<uint8_t>(value << 1);
 }
 
 void Cpu::InstrBRK() {
@@ -298,7 +1813,7 @@ void Cpu::InstrBRK() {
     m_StackPointer--;
 
     SetFlag(CpuFlag::B, 1);
-    Write(0x0100 + m_StackPointer, m_StatusRegister);
+    Write(0x0100 + m_StackPointer, GetStatusRegister());
     m_StackPointer--;
     SetFlag(B, 0);
 
@@ -306,105 +1821,65 @@ void Cpu::InstrBRK() {
                        (static_cast<uint16_t>(Read(0xFFFF)) << 8);
 }
 
-void Cpu::InstrBVC() {
-    if (GetFlag(CpuFlag::V) == 0) {
-        InstrExecuteBranch();
-    }
-}
-
-void Cpu::InstrBVS() {
-    if (GetFlag(CpuFlag::V) == 1) {
-        InstrExecuteBranch();
-    }
-}
-
-void Cpu::InstrCLC() { SetFlag(CpuFlag::C, false); }
-
-void Cpu::InstrCLD() { SetFlag(CpuFlag::D, false); }
-
-void Cpu::InstrCLI() { SetFlag(CpuFlag::I, false); }
-
-void Cpu::InstrCLV() { SetFlag(CpuFlag::V, false); }
-
-void Cpu::InstrCMP() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    uint16_t temp = static_cast<uint16_t>(m_RegisterA) -
-                    static_cast<uint16_t>(valueFetched);
-    SetFlag(C, m_RegisterA >= valueFetched);
-    SetFlag(Z, (temp & 0x00FF) == 0x0000);
-    SetFlag(N, temp & 0x0080);
-    m_InstructionNeedsAdditionalCycle = true;
+void Cpu::InstrCMP(uint8_t value) {
+    uint16_t temp =
+        static_cast<uint16_t>(m_RegisterA) - static_cast<uint16_t>(value);
+    m_CarryResult = m_RegisterA >= value ? 0x01 : 0x00;
+    SetZeroAndNegativeFlags(temp & 0x00FF);
 }
 
-void Cpu::InstrCPX() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    uint16_t temp = static_cast<uint16_t>(m_RegisterX) -
-                    static_cast<uint16_t>(valueFetched);
-    SetFlag(C, m_RegisterX >= valueFetched);
-    SetFlag(Z, (temp & 0x00FF) == 0x0000);
-    SetFlag(N, temp & 0x0080);
+void Cpu::InstrCPX(uint8_t value) {
+    uint16_t temp =
+        static_cast<uint16_t>(m_RegisterX) - static_cast<uint16_t>(value);
+    m_CarryResult = m_RegisterX >= value ? 0x01 : 0x00;
+    SetZeroAndNegativeFlags(temp & 0x00FF);
 }
 
-void Cpu::InstrCPY() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    uint16_t temp = static_cast<uint16_t>(m_RegisterY) -
-                    static_cast<uint16_t>(valueFetched);
-    SetFlag(C, m_RegisterY >= valueFetched);
-    SetFlag(Z, (temp & 0x00FF) == 0x0000);
-    SetFlag(N, temp & 0x0080);
+void Cpu::InstrCPY(uint8_t value) {
+    uint16_t temp =
+        static_cast<uint16_t>(m_RegisterY) - static_cast<uint16_t>(value);
+    m_CarryResult = m_RegisterY >= value ? 0x01 : 0x00;
+    SetZeroAndNegativeFlags(temp & 0x00FF);
 }
 
-void Cpu::InstrDEC() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    uint16_t temp = valueFetched - 1;
-    Write(m_AddressAbsolute, temp & 0x00FF);
-    SetFlag(Z, (temp & 0x00FF) == 0x0000);
-    SetFlag(N, temp & 0x0080);
+uint8_t Cpu::InstrDEC(uint8_t value) {
+    uint16_t temp = value - 1;
+    SetZeroAndNegativeFlags(temp & 0x00FF);
+    return temp & 0x00FF;
 }
 
 void Cpu::InstrDEX() {
     m_RegisterX--;
-    SetFlag(Z, m_RegisterX == 0x00);
-    SetFlag(N, m_RegisterX & 0x80);
+    SetZeroAndNegativeFlags(m_RegisterX);
 }
 
 void Cpu::InstrDEY() {
     m_RegisterY--;
-    SetFlag(Z, m_RegisterY == 0x00);
-    SetFlag(N, m_RegisterY & 0x80);
+    SetZeroAndNegativeFlags(m_RegisterY);
 }
 
-void Cpu::InstrEOR() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    m_RegisterA = m_RegisterA ^ valueFetched;
-    SetFlag(Z, m_RegisterA == 0x00);
-    SetFlag(N, m_RegisterA & 0x80);
-    m_InstructionNeedsAdditionalCycle = true;
+void Cpu::InstrEOR(uint8_t value) {
+    m_RegisterA = m_RegisterA ^ value;
+    SetZeroAndNegativeFlags(m_RegisterA);
 }
 
-void Cpu::InstrINC() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    uint16_t temp = valueFetched + 1;
-    Write(m_AddressAbsolute, temp & 0x00FF);
-    SetFlag(Z, (temp & 0x00FF) == 0x0000);
-    SetFlag(N, temp & 0x0080);
+uint8_t Cpu::InstrINC(uint8_t value) {
+    uint16_t temp = value + 1;
+    SetZeroAndNegativeFlags(temp & 0x00FF);
+    return temp & 0x00FF;
 }
 
 void Cpu::InstrINX() {
     m_RegisterX++;
-    SetFlag(Z, m_RegisterX == 0x00);
-    SetFlag(N, m_RegisterX & 0x80);
+    SetZeroAndNegativeFlags(m_RegisterX);
 }
 
 void Cpu::InstrINY() {
     m_RegisterY++;
-    SetFlag(Z, m_RegisterY == 0x00);
-    SetFlag(N, m_RegisterY & 0x80);
+    SetZeroAndNegativeFlags(m_RegisterY);
 }
 
-void Cpu::InstrJMP() { m_ProgramCounter = m_AddressAbsolute; }
-
-void Cpu::InstrJSR() {
+void Cpu::InstrJSR(uint16_t address) {
     m_ProgramCounter--;
 
     Write(0x0100 + m_StackPointer, (m_ProgramCounter >> 8) & 0x00FF);
@@ -412,60 +1887,35 @@ void Cpu::InstrJSR() {
     Write(0x0100 + m_StackPointer, m_ProgramCounter & 0x00FF);
     m_StackPointer--;
 
-    m_ProgramCounter = m_AddressAbsolute;
-}
-
-void Cpu::InstrLDA() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    m_RegisterA = valueFetched;
-    SetFlag(Z, m_RegisterA == 0x00);
-    SetFlag(N, m_RegisterA & 0x80);
-    m_InstructionNeedsAdditionalCycle = true;
+    m_ProgramCounter = address;
 }
 
-void Cpu::InstrLDX() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    m_RegisterX = valueFetched;
-    SetFlag(Z, m_RegisterX == 0x00);
-    SetFlag(N, m_RegisterX & 0x80);
-    m_InstructionNeedsAdditionalCycle = true;
+void Cpu::InstrLDA(uint8_t value) {
+    m_RegisterA = value;
+    SetZeroAndNegativeFlags(m_RegisterA);
 }
 
-void Cpu::InstrLDY() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    m_RegisterY = valueFetched;
-    SetFlag(Z, m_RegisterY == 0x00);
-    SetFlag(N, m_RegisterY & 0x80);
-    m_InstructionNeedsAdditionalCycle = true;
+void Cpu::InstrLDX(uint8_t value) {
+    m_RegisterX = value;
+    SetZeroAndNegativeFlags(m_RegisterX);
 }
 
-void Cpu::InstrLSR() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    SetFlag(C, valueFetched & 0x0001);
-    uint16_t temp = valueFetched >> 1;
-    SetFlag(Z, (temp & 0x00FF) == 0x0000);
-    SetFlag(N, temp & 0x0080);
-
-    Write(m_AddressAbsolute, temp & 0x00FF);
+void Cpu::InstrLDY(uint8_t value) {
+    m_RegisterY = value;
+    SetZeroAndNegativeFlags(m_RegisterY);
 }
 
-void Cpu::InstrLSR_AcummAddr() {
-    SetFlag(C, m_RegisterA & 0x0001);
-    uint16_t temp = m_RegisterA >> 1;
-    SetFlag(Z, (temp & 0x00FF) == 0x0000);
-    SetFlag(N, temp & 0x0080);
+uint8_t Cpu::InstrLSR(uint8_t value) {
+    m_CarryResult = value & 0x01;
+    uint16_t temp = value >> 1;
+    SetZeroAndNegativeFlags(temp & 0x00FF);
 
-    m_RegisterA = temp & 0x00FF;
+    return temp & 0x00FF;
 }
 
-void Cpu::InstrNOP() {}
-
-void Cpu::InstrORA() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    m_RegisterA = m_RegisterA | valueFetched;
-    SetFlag(Z, m_RegisterA == 0x00);
-    SetFlag(N, m_RegisterA & 0x80);
-    m_InstructionNeedsAdditionalCycle = true;
+void Cpu::InstrORA(uint8_t value) {
+    m_RegisterA = m_RegisterA | value;
+    SetZeroAndNegativeFlags(m_RegisterA);
 }
 
 void Cpu::InstrPHA() {
@@ -474,7 +1924,7 @@ void Cpu::InstrPHA() {
 }
 
 void Cpu::InstrPHP() {
-    Write(0x0100 + m_StackPointer, m_StatusRegister | B | U);
+    Write(0x0100 + m_StackPointer, GetStatusRegister() | B | U);
     SetFlag(B, 0);
     SetFlag(U, 0);
     m_StackPointer--;
@@ -483,59 +1933,36 @@ void Cpu::InstrPHP() {
 void Cpu::InstrPLA() {
     m_StackPointer++;
     m_RegisterA = Read(0x0100 + m_StackPointer);
-    SetFlag(Z, m_RegisterA == 0x00);
-    SetFlag(N, m_RegisterA & 0x80);
+    SetZeroAndNegativeFlags(m_RegisterA);
 }
 
 void Cpu::InstrPLP() {
     m_StackPointer++;
-    m_StatusRegister = Read(0x0100 + m_StackPointer);
+    SetStatusRegister(Read(0x0100 + m_StackPointer));
     SetFlag(U, 1);
 }
 
-void Cpu::InstrROL() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    uint16_t temp = static_cast<uint16_t>(valueFetched << 1) | GetFlag(C);
-    SetFlag(C, temp & 0xFF00);
-    SetFlag(Z, (temp & 0x00FF) == 0x0000);
-    SetFlag(N, temp & 0x0080);
-
-    Write(m_AddressAbsolute, temp & 0x00FF);
-}
-
-void Cpu::InstrROL_AcummAddr() {
-    uint16_t temp = static_cast<uint16_t>(m_RegisterA << 1) | GetFlag(C);
-    SetFlag(C, temp & 0xFF00);
-    SetFlag(Z, (temp & 0x00FF) == 0x0000);
-    SetFlag(N, temp & 0x0080);
+uint8_t Cpu::InstrROL(uint8_t value) {
+    uint16_t temp = static_cast<uint16_t>(value << 1) | m_CarryResult;
+    m_CarryResult = static_cast<uint8_t>(temp >> 8);
+    SetZeroAndNegativeFlags(temp & 0x00FF);
 
-    m_RegisterA = temp & 0x00FF;
+    return temp & 0x00FF;
 }
 
-void Cpu::InstrROR() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-    uint16_t temp =
-        static_cast<uint16_t>(GetFlag(C) << 7) | (valueFetched >> 1);
-    SetFlag(C, valueFetched & 0x01);
-    SetFlag(Z, (temp & 0x00FF) == 0x00);
-    SetFlag(N, temp & 0x0080);
-
-    Write(m_AddressAbsolute, temp & 0x00FF);
-}
-void Cpu::InstrROR_AcummAddr() {
-    uint16_t temp = static_cast<uint16_t>(GetFlag(C) << 7) | (m_RegisterA >> 1);
-    SetFlag(C, m_RegisterA & 0x01);
-    SetFlag(Z, (temp & 0x00FF) == 0x00);
-    SetFlag(N, temp & 0x0080);
+uint8_t Cpu::InstrROR(uint8_t value) {
+    uint16_t temp = static_cast<uint16_t>(m_CarryResult << 7) | (value >> 1);
+    m_CarryResult = value & 0x01;
+    SetZeroAndNegativeFlags(temp & 0x00FF);
 
-    m_RegisterA = temp & 0x00FF;
+    return temp & 0x00FF;
 }
 
 void Cpu::InstrRTI() {
     m_StackPointer++;
-    m_StatusRegister = Read(0x0100 + m_StackPointer);
-    m_StatusRegister &= ~B;
-    m_StatusRegister &= ~U;
+    SetStatusRegister(Read(0x0100 + m_StackPointer));
+    SetFlag(B, 0);
+    SetFlag(U, 0);
 
     m_StackPointer++;
     m_ProgramCounter = static_cast<uint16_t>(Read(0x0100 + m_StackPointer));
@@ -554,342 +1981,45 @@ void Cpu::InstrRTS() {
     m_ProgramCounter++;
 }
 
-void Cpu::InstrSBC() {
-    uint8_t valueFetched = Read(m_AddressAbsolute);
-
+void Cpu::InstrSBC(uint8_t value) {
     // Operating in 16-bit domain to capture carry out
 
     // We can invert the bottom 8 bits with bitwise xor
-    uint16_t value = static_cast<uint16_t>(valueFetched) ^ 0x00FF;
+    uint16_t invertedValue = static_cast<uint16_t>(value) ^ 0x00FF;
 
     // Notice this is exactly the same as addition from here!
-    uint16_t temp = static_cast<uint16_t>(m_RegisterA) + value +
-                    static_cast<uint16_t>(GetFlag(C));
-    SetFlag(C, temp & 0xFF00);
-    SetFlag(Z, ((temp & 0x00FF) == 0));
-    SetFlag(V, (temp ^ static_cast<uint16_t>(m_RegisterA)) & (temp ^ value) &
-                   0x0080);
-    SetFlag(N, temp & 0x0080);
+    uint16_t temp = static_cast<uint16_t>(m_RegisterA) + invertedValue +
+                    static_cast<uint16_t>(m_CarryResult);
+    m_CarryResult = static_cast<uint8_t>(temp >> 8);
+    SetZeroAndNegativeFlags(temp & 0x00FF);
+    m_OverflowResult = static_cast<uint8_t>(
+        (temp ^ static_cast<uint16_t>(m_RegisterA)) & (temp ^ invertedValue));
     m_RegisterA = temp & 0x00FF;
-    m_InstructionNeedsAdditionalCycle = true;
 }
 
-void Cpu::InstrSEC() { SetFlag(C, true); }
-
-void Cpu::InstrSED() { SetFlag(D, true); }
-
-void Cpu::InstrSEI() { SetFlag(I, true); }
-
-void Cpu::InstrSTA() { Write(m_AddressAbsolute, m_RegisterA); }
-
-void Cpu::InstrSTX() { Write(m_AddressAbsolute, m_RegisterX); }
-
-void Cpu::InstrSTY() { Write(m_AddressAbsolute, m_RegisterY); }
-
 void Cpu::InstrTAX() {
     m_RegisterX = m_RegisterA;
-    SetFlag(Z, m_RegisterX == 0x00);
-    SetFlag(N, m_RegisterX & 0x80);
+    SetZeroAndNegativeFlags(m_RegisterX);
 }
 
 void Cpu::InstrTAY() {
     m_RegisterY = m_RegisterA;
-    SetFlag(Z, m_RegisterY == 0x00);
-    SetFlag(N, m_RegisterY & 0x80);
+    SetZeroAndNegativeFlags(m_RegisterY);
 }
 
 void Cpu::InstrTSX() {
     m_RegisterX = m_StackPointer;
-    SetFlag(Z, m_RegisterX == 0x00);
-    SetFlag(N, m_RegisterX & 0x80);
+    SetZeroAndNegativeFlags(m_RegisterX);
 }
 
 void Cpu::InstrTXA() {
     m_RegisterA = m_RegisterX;
-    SetFlag(Z, m_RegisterA == 0x00);
-    SetFlag(N, m_RegisterA & 0x80);
+    SetZeroAndNegativeFlags(m_RegisterA);
 }
 
-void Cpu::InstrTXS() { m_StackPointer = m_RegisterX; }
-
 void Cpu::InstrTYA() {
     m_RegisterA = m_RegisterY;
-    SetFlag(Z, m_RegisterA == 0x00);
-    SetFlag(N, m_RegisterA & 0x80);
-}
-
-void Cpu::InstrNoImpl() { return; }
-
-Cpu::Instruction Cpu::m_InstructionTable[0x100] = {
-    Instruction{&Cpu::InstrBRK, nullptr, 7},                     // 0x00
-    Instruction{&Cpu::InstrORA, &Cpu::AddrIndexedIndirectX, 6},  // 0x01
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x02
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x03
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x04
-    Instruction{&Cpu::InstrORA, &Cpu::AddrZeroPage, 3},          // 0x05
-    Instruction{&Cpu::InstrASL, &Cpu::AddrZeroPage, 5},          // 0x06
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x07
-    Instruction{&Cpu::InstrPHP, nullptr, 3},                     // 0x08
-    Instruction{&Cpu::InstrORA, &Cpu::AddrImmediate, 2},         // 0x09
-    Instruction{&Cpu::InstrASL_AcummAddr, nullptr, 2},           // 0x0A
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x0B
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x0C
-    Instruction{&Cpu::InstrORA, &Cpu::AddrAbsolute, 4},          // 0x0D
-    Instruction{&Cpu::InstrASL, &Cpu::AddrAbsolute, 6},          // 0x0E
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x0F
-    Instruction{&Cpu::InstrBPL, &Cpu::AddrRelative, 2},          // 0x10
-    Instruction{&Cpu::InstrORA, &Cpu::AddrIndirectIndexedY, 5},  // 0x11
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x12
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x13
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x14
-    Instruction{&Cpu::InstrORA, &Cpu::AddrIndexedZeroPageX, 4},  // 0x15
-    Instruction{&Cpu::InstrASL, &Cpu::AddrIndexedZeroPageX, 6},  // 0x16
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x17
-    Instruction{&Cpu::InstrCLC, nullptr, 2},                     // 0x18
-    Instruction{&Cpu::InstrORA, &Cpu::AddrIndexedAbsoluteY, 4},  // 0x19
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x1A
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x1B
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x1C
-    Instruction{&Cpu::InstrORA, &Cpu::AddrIndexedAbsoluteX, 4},  // 0x1D
-    Instruction{&Cpu::InstrASL, &Cpu::AddrIndexedAbsoluteX, 7},  // 0x1E
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x1F
-    Instruction{&Cpu::InstrJSR, &Cpu::AddrAbsolute, 6},          // 0x20
-    Instruction{&Cpu::InstrAND, &Cpu::AddrIndexedIndirectX, 6},  // 0x21
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x22
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x23
-    Instruction{&Cpu::InstrBIT, &Cpu::AddrZeroPage, 3},          // 0x24
-    Instruction{&Cpu::InstrAND, &Cpu::AddrZeroPage, 3},          // 0x25
-    Instruction{&Cpu::InstrROL, &Cpu::AddrZeroPage, 5},          // 0x26
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x27
-    Instruction{&Cpu::InstrPLP, nullptr, 4},                     // 0x28
-    Instruction{&Cpu::InstrAND, &Cpu::AddrImmediate, 2},         // 0x29
-    Instruction{&Cpu::InstrROL_AcummAddr, nullptr, 2},           // 0x2A
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x2B
-    Instruction{&Cpu::InstrBIT, &Cpu::AddrAbsolute, 4},          // 0x2C
-    Instruction{&Cpu::InstrAND, &Cpu::AddrAbsolute, 4},          // 0x2D
-    Instruction{&Cpu::InstrROL, &Cpu::AddrAbsolute, 6},          // 0x2E
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x2F
-    Instruction{&Cpu::InstrBMI, &Cpu::AddrRelative, 2},          // 0x30
-    Instruction{&Cpu::InstrAND, &Cpu::AddrIndirectIndexedY, 5},  // 0x31
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x32
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x33
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x34
-    Instruction{&Cpu::InstrAND, &Cpu::AddrIndexedZeroPageX, 4},  // 0x35
-    Instruction{&Cpu::InstrROL, &Cpu::AddrIndexedZeroPageX, 6},  // 0x36
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x37
-    Instruction{&Cpu::InstrSEC, nullptr, 2},                     // 0x38
-    Instruction{&Cpu::InstrAND, &Cpu::AddrIndexedAbsoluteY, 4},  // 0x39
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x3A
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x3B
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x3C
-    Instruction{&Cpu::InstrAND, &Cpu::AddrIndexedAbsoluteX, 4},  // 0x3D
-    Instruction{&Cpu::InstrROL, &Cpu::AddrIndexedAbsoluteX, 7},  // 0x3E
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x3F
-    Instruction{&Cpu::InstrRTI, nullptr, 6},                     // 0x40
-    Instruction{&Cpu::InstrEOR, &Cpu::AddrIndexedIndirectX, 6},  // 0x41
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x42
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x43
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x44
-    Instruction{&Cpu::InstrEOR, &Cpu::AddrZeroPage, 3},          // 0x45
-    Instruction{&Cpu::InstrLSR, &Cpu::AddrZeroPage, 5},          // 0x46
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x47
-    Instruction{&Cpu::InstrPHA, nullptr, 3},                     // 0x48
-    Instruction{&Cpu::InstrEOR, &Cpu::AddrImmediate, 2},         // 0x49
-    Instruction{&Cpu::InstrLSR_AcummAddr, nullptr, 2},           // 0x4A
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x4B
-    Instruction{&Cpu::InstrJMP, &Cpu::AddrAbsolute, 3},          // 0x4C
-    Instruction{&Cpu::InstrEOR, &Cpu::AddrAbsolute, 4},          // 0x4D
-    Instruction{&Cpu::InstrLSR, &Cpu::AddrAbsolute, 6},          // 0x4E
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x4F
-    Instruction{&Cpu::InstrBVC, &Cpu::AddrRelative, 2},          // 0x50
-    Instruction{&Cpu::InstrEOR, &Cpu::AddrIndirectIndexedY, 5},  // 0x51
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x52
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x53
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x54
-    Instruction{&Cpu::InstrEOR, &Cpu::AddrIndexedZeroPageX, 4},  // 0x55
-    Instruction{&Cpu::InstrLSR, &Cpu::AddrIndexedZeroPageX, 6},  // 0x56
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x57
-    Instruction{&Cpu::InstrCLI, nullptr, 2},                     // 0x58
-    Instruction{&Cpu::InstrEOR, &Cpu::AddrIndexedAbsoluteY, 4},  // 0x59
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x5A
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x5B
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x5C
-    Instruction{&Cpu::InstrEOR, &Cpu::AddrIndexedAbsoluteX, 4},  // 0x5D
-    Instruction{&Cpu::InstrLSR, &Cpu::AddrIndexedAbsoluteX, 7},  // 0x5E
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x5F
-    Instruction{&Cpu::InstrRTS, nullptr, 6},                     // 0x60
-    Instruction{&Cpu::InstrADC, &Cpu::AddrIndexedIndirectX, 6},  // 0x61
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x62
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x63
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x64
-    Instruction{&Cpu::InstrADC, &Cpu::AddrZeroPage, 3},          // 0x65
-    Instruction{&Cpu::InstrROR, &Cpu::AddrZeroPage, 5},          // 0x66
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x67
-    Instruction{&Cpu::InstrPLA, nullptr, 4},                     // 0x68
-    Instruction{&Cpu::InstrADC, &Cpu::AddrImmediate, 2},         // 0x69
-    Instruction{&Cpu::InstrROR_AcummAddr, nullptr, 2},           // 0x6A
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x6B
-    Instruction{&Cpu::InstrJMP, &Cpu::AddrAbsoluteIndirect, 5},  // 0x6C
-    Instruction{&Cpu::InstrADC, &Cpu::AddrAbsolute, 4},          // 0x6D
-    Instruction{&Cpu::InstrROR, &Cpu::AddrAbsolute, 6},          // 0x6E
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x6F
-    Instruction{&Cpu::InstrBVS, &Cpu::AddrRelative, 2},          // 0x70
-    Instruction{&Cpu::InstrADC, &Cpu::AddrIndirectIndexedY, 5},  // 0x71
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x72
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x73
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x74
-    Instruction{&Cpu::InstrADC, &Cpu::AddrIndexedZeroPageX, 4},  // 0x75
-    Instruction{&Cpu::InstrROR, &Cpu::AddrIndexedZeroPageX, 6},  // 0x76
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x77
-    Instruction{&Cpu::InstrSEI, nullptr, 2},                     // 0x78
-    Instruction{&Cpu::InstrADC, &Cpu::AddrIndexedAbsoluteY, 4},  // 0x79
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x7A
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x7B
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x7C
-    Instruction{&Cpu::InstrADC, &Cpu::AddrIndexedAbsoluteX, 4},  // 0x7D
-    Instruction{&Cpu::InstrROR, &Cpu::AddrIndexedAbsoluteX, 7},  // 0x7E
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x7F
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x80
-    Instruction{&Cpu::InstrSTA, &Cpu::AddrIndexedIndirectX, 6},  // 0x81
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x82
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x83
-    Instruction{&Cpu::InstrSTY, &Cpu::AddrZeroPage, 3},          // 0x84
-    Instruction{&Cpu::InstrSTA, &Cpu::AddrZeroPage, 3},          // 0x85
-    Instruction{&Cpu::InstrSTX, &Cpu::AddrZeroPage, 3},          // 0x86
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x87
-    Instruction{&Cpu::InstrDEY, nullptr, 2},                     // 0x88
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x89
-    Instruction{&Cpu::InstrTXA, nullptr, 2},                     // 0x8A
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x8B
-    Instruction{&Cpu::InstrSTY, &Cpu::AddrAbsolute, 4},          // 0x8C
-    Instruction{&Cpu::InstrSTA, &Cpu::AddrAbsolute, 4},          // 0x8D
-    Instruction{&Cpu::InstrSTX, &Cpu::AddrAbsolute, 4},          // 0x8E
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x8F
-    Instruction{&Cpu::InstrBCC, &Cpu::AddrRelative, 2},          // 0x90
-    Instruction{&Cpu::InstrSTA, &Cpu::AddrIndirectIndexedY, 6},  // 0x91
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x92
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x93
-    Instruction{&Cpu::InstrSTY, &Cpu::AddrIndexedZeroPageX, 4},  // 0x94
-    Instruction{&Cpu::InstrSTA, &Cpu::AddrIndexedZeroPageX, 4},  // 0x95
-    Instruction{&Cpu::InstrSTX, &Cpu::AddrIndexedZeroPageY, 4},  // 0x96
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x97
-    Instruction{&Cpu::InstrTYA, nullptr, 2},                     // 0x98
-    Instruction{&Cpu::InstrSTA, &Cpu::AddrIndexedAbsoluteY, 5},  // 0x99
-    Instruction{&Cpu::InstrTXS, nullptr, 2},                     // 0x9A
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x9B
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x9C
-    Instruction{&Cpu::InstrSTA, &Cpu::AddrIndexedAbsoluteX, 5},  // 0x9D
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x9E
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0x9F
-    Instruction{&Cpu::InstrLDY, &Cpu::AddrImmediate, 2},         // 0xA0
-    Instruction{&Cpu::InstrLDA, &Cpu::AddrIndexedIndirectX, 6},  // 0xA1
-    Instruction{&Cpu::InstrLDX, &Cpu::AddrImmediate, 2},         // 0xA2
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xA3
-    Instruction{&Cpu::InstrLDY, &Cpu::AddrZeroPage, 3},          // 0xA4
-    Instruction{&Cpu::InstrLDA, &Cpu::AddrZeroPage, 3},          // 0xA5
-    Instruction{&Cpu::InstrLDX, &Cpu::AddrZeroPage, 3},          // 0xA6
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xA7
-    Instruction{&Cpu::InstrTAY, nullptr, 2},                     // 0xA8
-    Instruction{&Cpu::InstrLDA, &Cpu::AddrImmediate, 2},         // 0xA9
-    Instruction{&Cpu::InstrTAX, nullptr, 2},                     // 0xAA
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xAB
-    Instruction{&Cpu::InstrLDY, &Cpu::AddrAbsolute, 4},          // 0xAC
-    Instruction{&Cpu::InstrLDA, &Cpu::AddrAbsolute, 4},          // 0xAD
-    Instruction{&Cpu::InstrLDX, &Cpu::AddrAbsolute, 4},          // 0xAE
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xAF
-    Instruction{&Cpu::InstrBCS, &Cpu::AddrRelative, 2},          // 0xB0
-    Instruction{&Cpu::InstrLDA, &Cpu::AddrIndirectIndexedY, 5},  // 0xB1
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xB2
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xB3
-    Instruction{&Cpu::InstrLDY, &Cpu::AddrIndexedZeroPageX, 4},  // 0xB4
-    Instruction{&Cpu::InstrLDA, &Cpu::AddrIndexedZeroPageX, 4},  // 0xB5
-    Instruction{&Cpu::InstrLDX, &Cpu::AddrIndexedZeroPageY, 4},  // 0xB6
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xB7
-    Instruction{&Cpu::InstrCLV, nullptr, 2},                     // 0xB8
-    Instruction{&Cpu::InstrLDA, &Cpu::AddrIndexedAbsoluteY, 4},  // 0xB9
-    Instruction{&Cpu::InstrTSX, nullptr, 2},                     // 0xBA
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xBB
-    Instruction{&Cpu::InstrLDY, &Cpu::AddrIndexedAbsoluteX, 4},  // 0xBC
-    Instruction{&Cpu::InstrLDA, &Cpu::AddrIndexedAbsoluteX, 4},  // 0xBD
-    Instruction{&Cpu::InstrLDX, &Cpu::AddrIndexedAbsoluteY, 4},  // 0xBE
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xBF
-    Instruction{&Cpu::InstrCPY, &Cpu::AddrImmediate, 2},         // 0xC0
-    Instruction{&Cpu::InstrCMP, &Cpu::AddrIndexedIndirectX, 6},  // 0xC1
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xC2
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xC3
-    Instruction{&Cpu::InstrCPY, &Cpu::AddrZeroPage, 3},          // 0xC4
-    Instruction{&Cpu::InstrCMP, &Cpu::AddrZeroPage, 3},          // 0xC5
-    Instruction{&Cpu::InstrDEC, &Cpu::AddrZeroPage, 5},          // 0xC6
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xC7
-    Instruction{&Cpu::InstrINY, nullptr, 2},                     // 0xC8
-    Instruction{&Cpu::InstrCMP, &Cpu::AddrImmediate, 2},         // 0xC9
-    Instruction{&Cpu::InstrDEX, nullptr, 2},                     // 0xCA
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xCB
-    Instruction{&Cpu::InstrCPY, &Cpu::AddrAbsolute, 4},          // 0xCC
-    Instruction{&Cpu::InstrCMP, &Cpu::AddrAbsolute, 4},          // 0xCD
-    Instruction{&Cpu::InstrDEC, &Cpu::AddrAbsolute, 6},          // 0xCE
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xCF
-    Instruction{&Cpu::InstrBNE, &Cpu::AddrRelative, 2},          // 0xD0
-    Instruction{&Cpu::InstrCMP, &Cpu::AddrIndirectIndexedY, 5},  // 0xD1
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xD2
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xD3
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xD4
-    Instruction{&Cpu::InstrCMP, &Cpu::AddrIndexedZeroPageX, 4},  // 0xD5
-    Instruction{&Cpu::InstrDEC, &Cpu::AddrIndexedZeroPageX, 6},  // 0xD6
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xD7
-    Instruction{&Cpu::InstrCLD, nullptr, 2},                     // 0xD8
-    Instruction{&Cpu::InstrCMP, &Cpu::AddrIndexedAbsoluteY, 4},  // 0xD9
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xDA
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xDB
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xDC
-    Instruction{&Cpu::InstrCMP, &Cpu::AddrIndexedAbsoluteX, 4},  // 0xDD
-    Instruction{&Cpu::InstrDEC, &Cpu::AddrIndexedAbsoluteX, 7},  // 0xDE
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xDF
-    Instruction{&Cpu::InstrCPX, &Cpu::AddrImmediate, 2},         // 0xE0
-    Instruction{&Cpu::InstrSBC, &Cpu::AddrIndexedIndirectX, 6},  // 0xE1
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xE2
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xE3
-    Instruction{&Cpu::InstrCPX, &Cpu::AddrZeroPage, 3},          // 0xE4
-    Instruction{&Cpu::InstrSBC, &Cpu::AddrZeroPage, 3},          // 0xE5
-    Instruction{&Cpu::InstrINC, &Cpu::AddrZeroPage, 5},          // 0xE6
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xE7
-    Instruction{&Cpu::InstrINX, nullptr, 2},                     // 0xE8
-    Instruction{&Cpu::InstrSBC, &Cpu::AddrImmediate, 2},         // 0xE9
-    Instruction{&Cpu::InstrNOP, nullptr, 2},                     // 0xEA
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xEB
-    Instruction{&Cpu::InstrCPX, &Cpu::AddrAbsolute, 4},          // 0xEC
-    Instruction{&Cpu::InstrSBC, &Cpu::AddrAbsolute, 4},          // 0xED
-    Instruction{&Cpu::InstrINC, &Cpu::AddrAbsolute, 6},          // 0xEE
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xEF
-    Instruction{&Cpu::InstrBEQ, &Cpu::AddrRelative, 2},          // 0xF0
-    Instruction{&Cpu::InstrSBC, &Cpu::AddrIndirectIndexedY, 5},  // 0xF1
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xF2
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xF3
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xF4
-    Instruction{&Cpu::InstrSBC, &Cpu::AddrIndexedZeroPageX, 4},  // 0xF5
-    Instruction{&Cpu::InstrINC, &Cpu::AddrIndexedZeroPageX, 6},  // 0xF6
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xF7
-    Instruction{&Cpu::InstrSED, nullptr, 2},                     // 0xF8
-    Instruction{&Cpu::InstrSBC, &Cpu::AddrIndexedAbsoluteY, 4},  // 0xF9
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xFA
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xFB
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0},                  // 0xFC
-    Instruction{&Cpu::InstrSBC, &Cpu::AddrIndexedAbsoluteX, 4},  // 0xFD
-    Instruction{&Cpu::InstrINC, &Cpu::AddrIndexedAbsoluteX, 7},  // 0xFE
-    Instruction{&Cpu::InstrNoImpl, nullptr, 0}                   // 0xFF
-};
-
-constexpr Cpu::Instruction::Instruction(const FuncPtr executeInstruction,
-                                        const FuncPtr execureAddressingMode,
-                                        const uint8_t cycles)
-    : m_ExecuteInstruction{executeInstruction},
-      m_ExecureAddressingMode{execureAddressingMode},
-      m_Cycles{cycles} {}
-
-constexpr const Cpu::Instruction& Cpu::FindInstruction(const uint8_t opCode) {
-    using Instruction = Cpu::Instruction;
-
-    return m_InstructionTable[opCode];
+    SetZeroAndNegativeFlags(m_RegisterA);
 }
 
-}  // namespace dearnes
\ No newline at end of file
+}  // namespace dearnes
@@ -0,0 +1,509 @@
+// Copyright (c) 2020 Emmanuel Arias
+#include "dear_nes_lib/cpu_jit.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "dear_nes_lib/cpu.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DEARNES_JIT_X64
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace dearnes {
+
+namespace {
+
+using AddressingMode = Cpu::AddressingMode;
+using Operation = Cpu::Operation;
+
+constexpr uint16_t kCartridgeRomStart = 0x8000;
+constexpr size_t kCartridgeRomSize = 0x10000 - kCartridgeRomStart;
+
+constexpr size_t kCodeSize = 1 << 20;
+constexpr uint32_t kMaxBlockInstructions = 64;
+
+constexpr int32_t kNotTranslated = -1;
+constexpr int32_t kNotTranslatable = -2;
+
+// The code memory is never writable and executable at once: it is mapped
+// writable, and each range of pages is switched to executable after the code
+// is copied into it, and back to writable before more code is copied
+uint8_t* AllocateCodeMemory(size_t size) {
+#if !defined(DEARNES_JIT_X64)
+    (void)size;
+    return nullptr;
+#elif defined(_WIN32)
+    return static_cast<uint8_t*>(
+        VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_JIT)
+    // Required by the hardened runtime of macOS to ever execute the pages
+    flags |= MAP_JIT;
+#endif
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return memory == MAP_FAILED ? nullptr : static_cast<uint8_t*>(memory);
+#endif
+}
+
+void FreeCodeMemory(uint8_t* memory, size_t size) {
+#if !defined(DEARNES_JIT_X64)
+    (void)memory;
+    (void)size;
+#elif defined(_WIN32)
+    (void)size;
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, size);
+#endif
+}
+
+size_t GetPageSize() {
+#if !defined(DEARNES_JIT_X64)
+    return 4096;
+#elif defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+/// <summary>
+/// Make the pages that hold a range of the code memory either writable or
+/// executable. The memory must start at a page boundary.
+/// </summary>
+/// <returns>False if the protection could not be changed</returns>
+bool ProtectCode(uint8_t* memory, size_t offset, size_t size,
+                 bool executable) {
+#if !defined(DEARNES_JIT_X64)
+    (void)memory;
+    (void)offset;
+    (void)size;
+    (void)executable;
+    return false;
+#else
+    static const size_t pageSize = GetPageSize();
+    const size_t first = offset / pageSize * pageSize;
+    const size_t last = (offset + size + pageSize - 1) / pageSize * pageSize;
+#if defined(_WIN32)
+    DWORD oldProtection;
+    return VirtualProtect(memory + first, last - first,
+                          executable ? PAGE_EXECUTE_READ : PAGE_READWRITE,
+                          &oldProtection) != 0;
+#else
+    return mprotect(memory + first, last - first,
+                    executable ? PROT_READ | PROT_EXEC
+                               : PROT_READ | PROT_WRITE) == 0;
+#endif
+#endif
+}
+
+/// <summary>
+/// Writes x86-64 machine code. The translated code keeps the CPU object
+/// pointer in rbx and the cycles returned by the handlers in r12d, so most of
+/// the memory operands are [rbx + offset].
+/// </summary>
+class X64Emitter {
+   public:
+    const std::vector<uint8_t>& GetCode() const { return m_Code; }
+
+    void Prologue() {
+        Bytes({0x53});        // push rbx
+        Bytes({0x41, 0x54});  // push r12
+        Bytes({0x48, 0x83, 0xEC, kFrameSize});  // sub rsp, kFrameSize
+#if defined(_WIN32)
+        Bytes({0x48, 0x89, 0xCB});  // mov rbx, rcx
+#else
+        Bytes({0x48, 0x89, 0xFB});  // mov rbx, rdi
+#endif
+        Bytes({0x45, 0x31, 0xE4});  // xor r12d, r12d
+    }
+
+    // Return r12d plus the cycles known at translation time
+    void Epilogue(uint32_t cycles) {
+        Bytes({0x44, 0x89, 0xE0});  // mov eax, r12d
+        Bytes({0x05});              // add eax, imm32
+        Value(cycles);
+        Bytes({0x48, 0x83, 0xC4, kFrameSize});  // add rsp, kFrameSize
+        Bytes({0x41, 0x5C});                    // pop r12
+        Bytes({0x5B});                          // pop rbx
+        Bytes({0xC3});                          // ret
+    }
+
+    // r12d += handler(cpu, operand, nextAddress)
+    void CallHandler(const void* handler, uint16_t operand,
+                     uint16_t nextAddress) {
+#if defined(_WIN32)
+        Bytes({0x48, 0x89, 0xD9});  // mov rcx, rbx
+        Bytes({0xBA});              // mov edx, imm32
+        Value<uint32_t>(operand);
+        Bytes({0x41, 0xB8});  // mov r8d, imm32
+        Value<uint32_t>(nextAddress);
+#else
+        Bytes({0x48, 0x89, 0xDF});  // mov rdi, rbx
+        Bytes({0xBE});              // mov esi, imm32
+        Value<uint32_t>(operand);
+        Bytes({0xBA});  // mov edx, imm32
+        Value<uint32_t>(nextAddress);
+#endif
+        Bytes({0x48, 0xB8});  // mov rax, imm64
+        Value(reinterpret_cast<uint64_t>(handler));
+        Bytes({0xFF, 0xD0});        // call rax
+        Bytes({0x0F, 0xB6, 0xC0});  // movzx eax, al
+        Bytes({0x41, 0x01, 0xC4});  // add r12d, eax
+    }
+
+    // movzx eax, byte [rbx + offset]
+    void LoadAl(int32_t offset) {
+        Bytes({0x0F, 0xB6, 0x83});
+        Value(offset);
+    }
+
+    // mov byte [rbx + offset], al
+    void StoreAl(int32_t offset) {
+        Bytes({0x88, 0x83});
+        Value(offset);
+    }
+
+    void IncrementAl() { Bytes({0xFE, 0xC0}); }
+
+    void DecrementAl() { Bytes({0xFE, 0xC8}); }
+
+    // mov byte [rbx + offset], imm8
+    void StoreByte(int32_t offset, uint8_t value) {
+        Bytes({0xC6, 0x83});
+        Value(offset);
+        Value(value);
+    }
+
+    // mov word [rbx + offset], imm16
+    void StoreWord(int32_t offset, uint16_t value) {
+        Bytes({0x66, 0xC7, 0x83});
+        Value(offset);
+        Value(value);
+    }
+
+    // and byte [rbx + offset], ~mask
+    void ClearBits(int32_t offset, uint8_t mask) {
+        Bytes({0x80, 0xA3});
+        Value(offset);
+        Value(static_cast<uint8_t>(~mask));
+    }
+
+    // or byte [rbx + offset], mask
+    void SetBits(int32_t offset, uint8_t mask) {
+        Bytes({0x80, 0x8B});
+        Value(offset);
+        Value(mask);
+    }
+
+   private:
+#if defined(_WIN32)
+    // Shadow space for the callee, and keep the stack aligned to 16 bytes
+    static constexpr uint8_t kFrameSize = 40;
+#else
+    static constexpr uint8_t kFrameSize = 8;
+#endif
+
+    void Bytes(std::initializer_list<uint8_t> bytes) {
+        m_Code.insert(m_Code.end(), bytes);
+    }
+
+    template <typename T>
+    void Value(T value) {
+        // x86 is little endian, like the host
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        m_Code.insert(m_Code.end(), bytes, bytes + sizeof(T));
+    }
+
+    std::vector<uint8_t> m_Code;
+};
+
+template <typename T>
+int32_t GetOffset(const Cpu& cpu, const T& member) {
+    return static_cast<int32_t>(reinterpret_cast<const uint8_t*>(&member) -
+                                reinterpret_cast<const uint8_t*>(&cpu));
+}
+
+}  // namespace
+
+CpuJit::CpuJit(Cpu& cpu)
+    : m_Cpu{cpu},
+      m_Code{AllocateCodeMemory(kCodeSize)},
+      m_BlockIndices(kCartridgeRomSize, kNotTranslated),
+      m_Generation{cpu.m_DecodeCacheGeneration} {
+    m_RegisterAOffset = GetOffset(cpu, cpu.m_RegisterA);
+    m_RegisterXOffset = GetOffset(cpu, cpu.m_RegisterX);
+    m_RegisterYOffset = GetOffset(cpu, cpu.m_RegisterY);
+    m_StackPointerOffset = GetOffset(cpu, cpu.m_StackPointer);
+    m_StatusRegisterOffset = GetOffset(cpu, cpu.m_StatusRegister);
+    m_NegativeResultOffset = GetOffset(cpu, cpu.m_NegativeResult);
+    m_ZeroResultOffset = GetOffset(cpu, cpu.m_ZeroResult);
+    m_CarryResultOffset = GetOffset(cpu, cpu.m_CarryResult);
+    m_OverflowResultOffset = GetOffset(cpu, cpu.m_OverflowResult);
+    m_ProgramCounterOffset = GetOffset(cpu, cpu.m_ProgramCounter);
+    m_OpCodeOffset = GetOffset(cpu, cpu.m_OpCode);
+}
+
+CpuJit::~CpuJit() {
+    if (m_Code != nullptr) {
+        FreeCodeMemory(m_Code, kCodeSize);
+    }
+}
+
+bool CpuJit::IsAvailable() const { return m_Code != nullptr; }
+
+int64_t CpuJit::RunBlock(int64_t budget) {
+    const Block* block = FindBlock(m_Cpu.m_ProgramCounter);
+    if (block == nullptr || budget <= block->cyclesBeforeLastInstruction) {
+        return 0;
+    }
+
+    ++m_Statistics.blocksExecuted;
+    m_Statistics.instructionsExecuted += block->instructions;
+    return block->function(&m_Cpu);
+}
+
+const CpuJit::Block* CpuJit::FindBlock(uint16_t address) {
+    if (address < kCartridgeRomStart) {
+        return nullptr;
+    }
+    if (m_Generation != m_Cpu.m_DecodeCacheGeneration) {
+        Flush();
+        m_Generation = m_Cpu.m_DecodeCacheGeneration;
+    }
+
+    int32_t& index = m_BlockIndices[address - kCartridgeRomStart];
+    if (index == kNotTranslated) {
+        Block block;
+        if (TranslateBlock(address, block)) {
+            index = static_cast<int32_t>(m_Blocks.size());
+            m_Blocks.push_back(block);
+        } else {
+            index = kNotTranslatable;
+        }
+    }
+    return index >= 0 ? &m_Blocks[index] : nullptr;
+}
+
+bool CpuJit::TranslateBlock(uint16_t address, Block& block) {
+    X64Emitter emitter;
+    emitter.Prologue();
+    // The unused flag is always set before an instruction is executed
+    emitter.SetBits(m_StatusRegisterOffset, CpuFlag::U);
+
+    uint32_t maxCycles = 0;
+    uint32_t staticCycles = 0;
+    bool isLastNative = false;
+    uint8_t lastOpCode = 0x00;
+    uint16_t nextAddress = address;
+    while (block.instructions < kMaxBlockInstructions &&
+           address >= kCartridgeRomStart) {
+        const uint8_t opCode = m_Cpu.Read(address);
+        const Cpu::Instruction& instruction = Cpu::m_InstructionTable[opCode];
+        const uint8_t length = Cpu::m_InstructionLengths[opCode];
+        if (!Cpu::IsTranslatable(opCode) || address + length - 1 > 0xFFFF) {
+            break;
+        }
+
+        uint16_t operand = 0x0000;
+        if (length > 1) {
+            operand = m_Cpu.Read(address + 1);
+        }
+        if (length > 2) {
+            operand |= m_Cpu.Read(address + 2) << 8;
+        }
+        if (!Cpu::IsAlwaysIsolated(opCode, operand)) {
+            break;
+        }
+
+        block.cyclesBeforeLastInstruction = maxCycles;
+        maxCycles += Cpu::GetMaxTranslatedCycles(opCode);
+
+        nextAddress = address + length;
+        isLastNative = true;
+        lastOpCode = opCode;
+
+        const int32_t status = m_StatusRegisterOffset;
+        // The N and Z flags are the result itself
+        auto setZeroAndNegativeFlags = [&]() {
+            emitter.StoreAl(m_NegativeResultOffset);
+            emitter.StoreAl(m_ZeroResultOffset);
+        };
+        auto transfer = [&](int32_t from, int32_t to, bool setFlags) {
+            emitter.LoadAl(from);
+            emitter.StoreAl(to);
+            if (setFlags) {
+                setZeroAndNegativeFlags();
+            }
+        };
+        auto increment = [&](int32_t offset, bool isIncrement) {
+            emitter.LoadAl(offset);
+            if (isIncrement) {
+                emitter.IncrementAl();
+            } else {
+                emitter.DecrementAl();
+            }
+            emitter.StoreAl(offset);
+            setZeroAndNegativeFlags();
+        };
+        auto loadImmediate = [&](int32_t offset) {
+            const uint8_t value = static_cast<uint8_t>(operand);
+            emitter.StoreByte(offset, value);
+            emitter.StoreByte(m_NegativeResultOffset, value);
+            emitter.StoreByte(m_ZeroResultOffset, value);
+        };
+
+        using O = Operation;
+        const bool isImmediate =
+            instruction.m_AddressingMode == AddressingMode::kImmediate;
+        const bool isAbsolute =
+            instruction.m_AddressingMode == AddressingMode::kAbsolute;
+        switch (instruction.m_Operation) {
+            case O::kCLC:
+                emitter.StoreByte(m_CarryResultOffset, 0x00);
+                break;
+            case O::kCLD:
+                emitter.ClearBits(status, CpuFlag::D);
+                break;
+            case O::kCLI:
+                emitter.ClearBits(status, CpuFlag::I);
+                break;
+            case O::kCLV:
+                emitter.StoreByte(m_OverflowResultOffset, 0x00);
+                break;
+            case O::kSEC:
+                emitter.StoreByte(m_CarryResultOffset, 0x01);
+                break;
+            case O::kSED:
+                emitter.SetBits(status, CpuFlag::D);
+                break;
+            case O::kSEI:
+                emitter.SetBits(status, CpuFlag::I);
+                break;
+            case O::kNOP:
+                break;
+            case O::kDEX:
+                increment(m_RegisterXOffset, false);
+                break;
+            case O::kDEY:
+                increment(m_RegisterYOffset, false);
+                break;
+            case O::kINX:
+                increment(m_RegisterXOffset, true);
+                break;
+            case O::kINY:
+                increment(m_RegisterYOffset, true);
+                break;
+            case O::kTAX:
+                transfer(m_RegisterAOffset, m_RegisterXOffset, true);
+                break;
+            case O::kTAY:
+                transfer(m_RegisterAOffset, m_RegisterYOffset, true);
+                break;
+            case O::kTSX:
+                transfer(m_StackPointerOffset, m_RegisterXOffset, true);
+                break;
+            case O::kTXA:
+                transfer(m_RegisterXOffset, m_RegisterAOffset, true);
+                break;
+            case O::kTXS:
+                transfer(m_RegisterXOffset, m_StackPointerOffset, false);
+                break;
+            case O::kTYA:
+                transfer(m_RegisterYOffset, m_RegisterAOffset, true);
+                break;
+            case O::kLDA:
+            case O::kLDX:
+            case O::kLDY:
+                if (!isImmediate) {
+                    isLastNative = false;
+                } else if (instruction.m_Operation == O::kLDA) {
+                    loadImmediate(m_RegisterAOffset);
+                } else if (instruction.m_Operation == O::kLDX) {
+                    loadImmediate(m_RegisterXOffset);
+                } else {
+                    loadImmediate(m_RegisterYOffset);
+                }
+                break;
+            case O::kJMP:
+                if (isAbsolute) {
+                    nextAddress = operand;
+                } else {
+                    isLastNative = false;
+                }
+                break;
+            default:
+                isLastNative = false;
+                break;
+        }
+
+        if (isLastNative) {
+            staticCycles += instruction.m_Cycles;
+        } else {
+            emitter.CallHandler(
+                reinterpret_cast<const void*>(
+                    Cpu::m_TranslatedInstructionHandlers[opCode]),
+                operand, nextAddress);
+        }
+
+        ++block.instructions;
+        address = nextAddress;
+        if (Cpu::EndsTranslatedBlock(instruction.m_Operation)) {
+            break;
+        }
+    }
+
+    if (block.instructions == 0) {
+        return false;
+    }
+
+    // The handlers keep the program counter and the op code up to date
+    if (isLastNative) {
+        emitter.StoreWord(m_ProgramCounterOffset, nextAddress);
+        emitter.StoreByte(m_OpCodeOffset, lastOpCode);
+    }
+    emitter.Epilogue(staticCycles);
+
+    const std::vector<uint8_t>& code = emitter.GetCode();
+    if (m_CodeUsed + code.size() > kCodeSize) {
+        Flush();
+    }
+    // The pages may hold blocks translated before, which are not running
+    if (!ProtectCode(m_Code, m_CodeUsed, code.size(), false)) {
+        return false;
+    }
+    uint8_t* function = m_Code + m_CodeUsed;
+    std::memcpy(function, code.data(), code.size());
+    if (!ProtectCode(m_Code, m_CodeUsed, code.size(), true)) {
+        // The blocks on the same pages cannot be executed either
+        Flush();
+        return false;
+    }
+    m_CodeUsed += code.size();
+
+    block.function = reinterpret_cast<BlockFunction>(function);
+    ++m_Statistics.blocksTranslated;
+    return true;
+}
+
+void CpuJit::Flush() {
+    ++m_Statistics.flushes;
+    std::fill(m_BlockIndices.begin(), m_BlockIndices.end(), kNotTranslated);
+    m_Blocks.clear();
+    m_CodeUsed = 0;
+}
+
+}  // namespace dearnes
@@ -0,0 +1,95 @@
+// Copyright (c) 2020 Emmanuel Arias
+#include "dear_nes_lib/cpu_profile.h"
+
+#include <iomanip>
+
+#include "dear_nes_lib/cpu.h"
+
+namespace dearnes {
+
+namespace {
+
+// Hexadecimal number with a fixed amount of digits, e.g. "A9" or "C004"
+struct Hex {
+    uint32_t value;
+    int digits;
+};
+
+std::ostream& operator<<(std::ostream& stream, const Hex& hex) {
+    const std::ios_base::fmtflags flags = stream.flags();
+    const char fill = stream.fill('0');
+    stream << std::hex << std::uppercase << std::setw(hex.digits)
+           << hex.value;
+    stream.fill(fill);
+    stream.flags(flags);
+    return stream;
+}
+
+}  // namespace
+
+void CpuProfile::WriteOpCodesCsv(std::ostream& stream) const {
+    stream << "op_code,operation,addressing_mode,executions,cycles,"
+              "page_crossings,branches_taken\n";
+    for (size_t opCode = 0; opCode < opCodes.size(); ++opCode) {
+        const OpCodeCounters& counters = opCodes[opCode];
+        if (counters.executions == 0) {
+            continue;
+        }
+        const Cpu::Instruction& instruction =
+            Cpu::GetInstruction(static_cast<uint8_t>(opCode));
+        stream << Hex{static_cast<uint32_t>(opCode), 2} << ','
+               << Cpu::GetOperationName(instruction.m_Operation) << ','
+               << Cpu::GetAddressingModeName(instruction.m_AddressingMode)
+               << ',' << counters.executions << ',' << counters.cycles << ','
+               << counters.pageCrossings << ',' << counters.branchesTaken
+               << '\n';
+    }
+}
+
+void CpuProfile::WriteSamplesCsv(std::ostream& stream) const {
+    stream << "address,samples\n";
+    for (size_t offset = 0; offset < programSamples.size(); ++offset) {
+        if (programSamples[offset] != 0) {
+            stream << Hex{static_cast<uint32_t>(kProgramStart + offset), 4}
+                   << ',' << programSamples[offset] << '\n';
+        }
+    }
+}
+
+void CpuProfile::WriteJson(std::ostream& stream) const {
+    stream << "{\n  \"op_codes\": [";
+    const char* separator = "\n";
+    for (size_t opCode = 0; opCode < opCodes.size(); ++opCode) {
+        const OpCodeCounters& counters = opCodes[opCode];
+        if (counters.executions == 0) {
+            continue;
+        }
+        const Cpu::Instruction& instruction =
+            Cpu::GetInstruction(static_cast<uint8_t>(opCode));
+        stream << separator << "    {\"op_code\": \""
+               << Hex{static_cast<uint32_t>(opCode), 2}
+               << "\", \"operation\": \""
+               << Cpu::GetOperationName(instruction.m_Operation)
+               << "\", \"addressing_mode\": \""
+               << Cpu::GetAddressingModeName(instruction.m_AddressingMode)
+               << "\", \"executions\": " << counters.executions
+               << ", \"cycles\": " << counters.cycles
+               << ", \"page_crossings\": " << counters.pageCrossings
+               << ", \"branches_taken\": " << counters.branchesTaken << "}";
+        separator = ",\n";
+    }
+    stream << "\n  ],\n  \"sampling_period\": " << kSamplingPeriod
+           << ",\n  \"samples\": [";
+    separator = "\n";
+    for (size_t offset = 0; offset < programSamples.size(); ++offset) {
+        if (programSamples[offset] != 0) {
+            stream << separator << "    {\"address\": \""
+                   << Hex{static_cast<uint32_t>(kProgramStart + offset), 4}
+                   << "\", \"samples\": " << programSamples[offset] << "}";
+            separator = ",\n";
+        }
+    }
+    stream << "\n  ],\n  \"other_samples\": " << otherSamples << "\n}\n";
+}
+
+}  // namespace dearnes
@@ -0,0 +1,66 @@
+// Copyright (c) 2020 Emmanuel Arias
+#include "dear_nes_lib/disassembler.h"
+
+#include <cstdio>
+
+#include "dear_nes_lib/cpu.h"
+
+namespace dearnes {
+
+std::string FormatHex(uint32_t value, int digits) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof(buffer), "%0*X", digits, value);
+    return buffer;
+}
+
+std::string FormatInstructionBytes(uint8_t opCode, uint16_t operand) {
+    std::string bytes = FormatHex(opCode, 2);
+    const uint8_t length = Cpu::GetInstructionLength(opCode);
+    for (uint8_t i = 1; i < length; ++i) {
+        bytes += " " + FormatHex((operand >> (8 * (i - 1))) & 0xFF, 2);
+    }
+    return bytes;
+}
+
+std::string Disassemble(uint16_t address, uint8_t opCode, uint16_t operand) {
+    using AM = Cpu::AddressingMode;
+    const Cpu::Instruction& info = Cpu::GetInstruction(opCode);
+    const std::string byte = "$" + FormatHex(operand & 0xFF, 2);
+    const std::string word = "$" + FormatHex(operand, 4);
+
+    std::string text = Cpu::GetOperationName(info.m_Operation);
+    switch (info.m_AddressingMode) {
+        case AM::kAccumulator:
+            return text + " A";
+        case AM::kImmediate:
+            return text + " #" + byte;
+        case AM::kZeroPage:
+            return text + " " + byte;
+        case AM::kIndexedZeroPageX:
+            return text + " " + byte + ",X";
+        case AM::kIndexedZeroPageY:
+            return text + " " + byte + ",Y";
+        case AM::kAbsolute:
+            return text + " " + word;
+        case AM::kIndexedAbsoluteX:
+            return text + " " + word + ",X";
+        case AM::kIndexedAbsoluteY:
+            return text + " " + word + ",Y";
+        case AM::kAbsoluteIndirect:
+            return text + " (" + word + ")";
+        case AM::kIndexedIndirectX:
+            return text + " (" + byte + ",X)";
+        case AM::kIndirectIndexedY:
+            return text + " (" + byte + "),Y";
+        case AM::kRelative: {
+            const uint16_t target = address +
+                                    Cpu::GetInstructionLength(opCode) +
+                                    static_cast<int8_t>(operand);
+            return text + " $" + FormatHex(target, 4);
+        }
+        default:
+            return text;
+    }
+}
+
+}  // namespace dearnes
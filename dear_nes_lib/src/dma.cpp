@@ -4,6 +4,7 @@
 #include <cassert>
 
 #include "dear_nes_lib/bus.h"
+#include "dear_nes_lib/ppu.h"
 
 namespace dearnes {
 
@@ -32,6 +33,15 @@ std::pair<uint8_t, uint8_t> Dma::GetLastReadData() {
     return {lastAddr, m_DmaData};
 }
 
+void Dma::TransferPage(Ppu* ppu) {
+    m_DmaWait = false;
+    while (m_DmaTransfer) {
+        ReadData();
+        auto [addr, data] = GetLastReadData();
+        ppu->WriteOam(addr, data);
+    }
+}
+
 void Dma::FinishTransfer() {
     m_DmaTransfer = false;
     m_DmaWait = true;
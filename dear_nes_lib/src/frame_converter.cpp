@@ -0,0 +1,283 @@
+// Copyright (c) 2020 Emmanuel Arias
+#include "dear_nes_lib/frame_converter.h"
+
+#include <cstring>
+#include <iterator>
+
+#include "dear_nes_lib/host_features.h"
+
+#if defined(DEARNES_HOST_X64)
+#include <immintrin.h>
+#endif
+
+namespace dearnes {
+
+namespace {
+
+constexpr uint8_t kIndexMask = 0x3F;
+
+using FormatTable = FrameConverter::FormatTable;
+
+template <size_t kBytes>
+void ConvertScalar(const FormatTable& table, const uint8_t* indices,
+                   size_t count, uint8_t* pixels) {
+    for (size_t i = 0; i < count; ++i) {
+        std::memcpy(pixels + i * kBytes, table.pixels[indices[i] & kIndexMask],
+                    kBytes);
+    }
+}
+
+#if defined(DEARNES_HOST_X64)
+// Look up 16 indices, 0 to 63, in a table of 64 bytes split in 4 quarters.
+// The shuffle gives 0 for the indices with the bit 7 set, so each quarter is
+// looked up with the indices moved to it, plus 0x70 with saturation: only
+// those that were in the quarter stay below 0x80
+DEARNES_TARGET_SSSE3
+inline __m128i LookUp(const __m128i (&table)[4], __m128i indices) {
+    const __m128i bias = _mm_set1_epi8(0x70);
+    __m128i result =
+        _mm_shuffle_epi8(table[0], _mm_adds_epu8(indices, bias));
+    for (int quarter = 1; quarter < 4; ++quarter) {
+        const __m128i moved = _mm_xor_si128(
+            indices, _mm_set1_epi8(static_cast<char>(quarter << 4)));
+        result = _mm_or_si128(
+            result, _mm_shuffle_epi8(table[quarter],
+                                     _mm_adds_epu8(moved, bias)));
+    }
+    return result;
+}
+
+template <size_t kBytes>
+DEARNES_TARGET_SSSE3 void ConvertSsse3(const FormatTable& table,
+                                       const uint8_t* indices, size_t count,
+                                       uint8_t* pixels) {
+    __m128i tables[kBytes][4];
+    for (size_t byte = 0; byte < kBytes; ++byte) {
+        for (int quarter = 0; quarter < 4; ++quarter) {
+            tables[byte][quarter] =
+                _mm_load_si128(reinterpret_cast<const __m128i*>(
+                    &table.bytes[byte][16 * quarter]));
+        }
+    }
+    const __m128i indexMask = _mm_set1_epi8(kIndexMask);
+    for (size_t i = 0; i < count; i += 16) {
+        const __m128i colorIndices = _mm_and_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i)),
+            indexMask);
+        __m128i* const output =
+            reinterpret_cast<__m128i*>(pixels + i * kBytes);
+        const __m128i byte0 = LookUp(tables[0], colorIndices);
+        if constexpr (kBytes == 1) {
+            _mm_storeu_si128(output, byte0);
+        } else {
+            // Interleave the bytes back into pixels
+            const __m128i byte1 = LookUp(tables[1], colorIndices);
+            const __m128i bytes01Low = _mm_unpacklo_epi8(byte0, byte1);
+            const __m128i bytes01High = _mm_unpackhi_epi8(byte0, byte1);
+            if constexpr (kBytes == 2) {
+                _mm_storeu_si128(output, bytes01Low);
+                _mm_storeu_si128(output + 1, bytes01High);
+            } else {
+                const __m128i byte2 = LookUp(tables[2], colorIndices);
+                const __m128i byte3 = LookUp(tables[3], colorIndices);
+                const __m128i bytes23Low = _mm_unpacklo_epi8(byte2, byte3);
+                const __m128i bytes23High = _mm_unpackhi_epi8(byte2, byte3);
+                _mm_storeu_si128(output,
+                                 _mm_unpacklo_epi16(bytes01Low, bytes23Low));
+                _mm_storeu_si128(output + 1,
+                                 _mm_unpackhi_epi16(bytes01Low, bytes23Low));
+                _mm_storeu_si128(output + 2,
+                                 _mm_unpacklo_epi16(bytes01High, bytes23High));
+                _mm_storeu_si128(output + 3,
+                                 _mm_unpackhi_epi16(bytes01High, bytes23High));
+            }
+        }
+    }
+}
+
+// Same as the SSSE3 version, on both 128-bit lanes
+DEARNES_TARGET_AVX2
+inline __m256i LookUp(const __m256i (&table)[4], __m256i indices) {
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    __m256i result =
+        _mm256_shuffle_epi8(table[0], _mm256_adds_epu8(indices, bias));
+    for (int quarter = 1; quarter < 4; ++quarter) {
+        const __m256i moved = _mm256_xor_si256(
+            indices, _mm256_set1_epi8(static_cast<char>(quarter << 4)));
+        result = _mm256_or_si256(
+            result, _mm256_shuffle_epi8(table[quarter],
+                                        _mm256_adds_epu8(moved, bias)));
+    }
+    return result;
+}
+
+// The unpacks work within the lanes: the first lane of each result has
+// pixels of the first 16, and the second lane the same pixels of the last
+// 16. They are put back in order when they are stored
+template <size_t kBytes>
+DEARNES_TARGET_AVX2 void ConvertAvx2(const FormatTable& table,
+                                     const uint8_t* indices, size_t count,
+                                     uint8_t* pixels) {
+    __m256i tables[kBytes][4];
+    for (size_t byte = 0; byte < kBytes; ++byte) {
+        for (int quarter = 0; quarter < 4; ++quarter) {
+            tables[byte][quarter] = _mm256_broadcastsi128_si256(
+                _mm_load_si128(reinterpret_cast<const __m128i*>(
+                    &table.bytes[byte][16 * quarter])));
+        }
+    }
+    const __m256i indexMask = _mm256_set1_epi8(kIndexMask);
+    for (size_t i = 0; i < count; i += 32) {
+        const __m256i colorIndices = _mm256_and_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + i)),
+            indexMask);
+        __m256i* const output =
+            reinterpret_cast<__m256i*>(pixels + i * kBytes);
+        const __m256i byte0 = LookUp(tables[0], colorIndices);
+        if constexpr (kBytes == 1) {
+            _mm256_storeu_si256(output, byte0);
+        } else {
+            const __m256i byte1 = LookUp(tables[1], colorIndices);
+            const __m256i bytes01Low = _mm256_unpacklo_epi8(byte0, byte1);
+            const __m256i bytes01High = _mm256_unpackhi_epi8(byte0, byte1);
+            if constexpr (kBytes == 2) {
+                _mm256_storeu_si256(output, _mm256_permute2x128_si256(
+                                                bytes01Low, bytes01High, 0x20));
+                _mm256_storeu_si256(
+                    output + 1,
+                    _mm256_permute2x128_si256(bytes01Low, bytes01High, 0x31));
+            } else {
+                const __m256i byte2 = LookUp(tables[2], colorIndices);
+                const __m256i byte3 = LookUp(tables[3], colorIndices);
+                const __m256i bytes23Low = _mm256_unpacklo_epi8(byte2, byte3);
+                const __m256i bytes23High = _mm256_unpackhi_epi8(byte2, byte3);
+                const __m256i pixels0 =
+                    _mm256_unpacklo_epi16(bytes01Low, bytes23Low);
+                const __m256i pixels4 =
+                    _mm256_unpackhi_epi16(bytes01Low, bytes23Low);
+                const __m256i pixels8 =
+                    _mm256_unpacklo_epi16(bytes01High, bytes23High);
+                const __m256i pixels12 =
+                    _mm256_unpackhi_epi16(bytes01High, bytes23High);
+                _mm256_storeu_si256(
+                    output, _mm256_permute2x128_si256(pixels0, pixels4, 0x20));
+                _mm256_storeu_si256(output + 1, _mm256_permute2x128_si256(
+                                                    pixels8, pixels12, 0x20));
+                _mm256_storeu_si256(output + 2, _mm256_permute2x128_si256(
+                                                    pixels0, pixels4, 0x31));
+                _mm256_storeu_si256(output + 3, _mm256_permute2x128_si256(
+                                                    pixels8, pixels12, 0x31));
+            }
+        }
+    }
+}
+#endif
+
+template <size_t kBytes>
+void ConvertPixels(FrameConverter::Kernel kernel, const FormatTable& table,
+                   const uint8_t* indices, size_t count, uint8_t* pixels) {
+    // The vector kernels convert whole blocks, and the scalar one the rest
+    size_t converted = 0;
+    switch (kernel) {
+#if defined(DEARNES_HOST_X64)
+        case FrameConverter::Kernel::kSsse3:
+            converted = count & ~static_cast<size_t>(15);
+            ConvertSsse3<kBytes>(table, indices, converted, pixels);
+            break;
+        case FrameConverter::Kernel::kAvx2:
+            converted = count & ~static_cast<size_t>(31);
+            ConvertAvx2<kBytes>(table, indices, converted, pixels);
+            break;
+#endif
+        default:
+            break;
+    }
+    ConvertScalar<kBytes>(table, indices + converted, count - converted,
+                          pixels + converted * kBytes);
+}
+
+// The pixel of a color, as a word of the size of the format. The bytes of
+// the 32-bit formats go to memory from the lowest one
+uint32_t GetPixelValue(PixelFormat format, uint32_t argb) {
+    const uint32_t red = (argb >> 16) & 0xFF;
+    const uint32_t green = (argb >> 8) & 0xFF;
+    const uint32_t blue = argb & 0xFF;
+    const uint32_t alpha = argb >> 24;
+    switch (format) {
+        case PixelFormat::kRgba8888:
+            return red | (green << 8) | (blue << 16) | (alpha << 24);
+        case PixelFormat::kBgra8888:
+            return argb;
+        case PixelFormat::kRgb565:
+            return ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+        case PixelFormat::kRgb555:
+            return ((red >> 3) << 10) | ((green >> 3) << 5) | (blue >> 3);
+        case PixelFormat::kGray8:
+            // Luma of ITU-R BT.601
+            return (77 * red + 150 * green + 29 * blue + 128) >> 8;
+        default:
+            return 0;
+    }
+}
+
+}  // namespace
+
+FrameConverter::FrameConverter(const uint32_t* colors) {
+    for (size_t format = 0; format < std::size(m_Tables); ++format) {
+        const PixelFormat pixelFormat = static_cast<PixelFormat>(format);
+        const size_t bytes = GetBytesPerPixel(pixelFormat);
+        FormatTable& table = m_Tables[format];
+        std::memset(&table, 0, sizeof(table));
+        for (size_t i = 0; i < kColors; ++i) {
+            const uint32_t value = pixelFormat == PixelFormat::kIndexed8
+                                       ? static_cast<uint32_t>(i)
+                                       : GetPixelValue(pixelFormat, colors[i]);
+            if (bytes == 2) {
+                // The 16-bit formats are in the byte order of the processor
+                const uint16_t word = static_cast<uint16_t>(value);
+                std::memcpy(table.pixels[i], &word, sizeof(word));
+            } else {
+                // The 32-bit formats are defined by their order in memory
+                for (size_t byte = 0; byte < bytes; ++byte) {
+                    table.pixels[i][byte] =
+                        static_cast<uint8_t>(value >> (8 * byte));
+                }
+            }
+            for (size_t byte = 0; byte < bytes; ++byte) {
+                table.bytes[byte][i] = table.pixels[i][byte];
+            }
+        }
+    }
+}
+
+size_t FrameConverter::GetBytesPerPixel(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::kRgba8888:
+        case PixelFormat::kBgra8888:
+            return 4;
+        case PixelFormat::kRgb565:
+        case PixelFormat::kRgb555:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+void FrameConverter::Convert(const uint8_t* indices, size_t count,
+                             PixelFormat format, void* pixels) const {
+    const FormatTable& table = m_Tables[static_cast<size_t>(format)];
+    uint8_t* const output = static_cast<uint8_t*>(pixels);
+    switch (GetBytesPerPixel(format)) {
+        case 4:
+            ConvertPixels<4>(GetKernel(), table, indices, count, output);
+            break;
+        case 2:
+            ConvertPixels<2>(GetKernel(), table, indices, count, output);
+            break;
+        default:
+            ConvertPixels<1>(GetKernel(), table, indices, count, output);
+            break;
+    }
+}
+
+}  // namespace dearnes
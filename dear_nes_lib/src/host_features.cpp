@@ -0,0 +1,86 @@
+// Copyright (c) 2020 Emmanuel Arias
+#include "dear_nes_lib/host_features.h"
+
+#if defined(DEARNES_HOST_X64) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace dearnes {
+
+namespace {
+
+#if defined(DEARNES_HOST_X64) && defined(_MSC_VER)
+bool HasSsse3() {
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+}
+
+bool HasAvx2() {
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    // The operating system must save the AVX registers too
+    __cpuid(info, 1);
+    const bool hasOsXsave = (info[2] & (1 << 27)) != 0;
+    if (!hasOsXsave || (_xgetbv(0) & 0x06) != 0x06) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+#elif defined(DEARNES_HOST_X64)
+bool HasSsse3() { return __builtin_cpu_supports("ssse3"); }
+
+bool HasAvx2() { return __builtin_cpu_supports("avx2"); }
+#else
+bool HasSsse3() { return false; }
+
+bool HasAvx2() { return false; }
+#endif
+
+}  // namespace
+
+bool HostSupportsSsse3() {
+    static const bool hasSsse3 = HasSsse3();
+    return hasSsse3;
+}
+
+bool HostSupportsAvx2() {
+    static const bool hasAvx2 = HasAvx2();
+    return hasAvx2;
+}
+
+bool HostSupportsKernel(SimdKernel kernel) {
+    switch (kernel) {
+        case SimdKernel::kScalar:
+            return true;
+#if defined(DEARNES_HOST_X64)
+        case SimdKernel::kSse2:
+            return true;
+        case SimdKernel::kSsse3:
+            return HostSupportsSsse3();
+        case SimdKernel::kAvx2:
+            return HostSupportsAvx2();
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* GetSimdKernelName(SimdKernel kernel) {
+    switch (kernel) {
+        case SimdKernel::kSse2:
+            return "SSE2";
+        case SimdKernel::kSsse3:
+            return "SSSE3";
+        case SimdKernel::kAvx2:
+            return "AVX2";
+        default:
+            return "scalar";
+    }
+}
+
+}  // namespace dearnes
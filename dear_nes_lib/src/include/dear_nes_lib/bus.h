@@ -3,20 +3,28 @@
 #include <array>
 #include <cinttypes>
 
+#include "dear_nes_lib/cartridge_header.h"
 #include "dear_nes_lib/enums.h"
 
 namespace dearnes {
 
 // Forward declarations
 class Cartridge;
+class Cpu;
 class Dma;
 class Ppu;
+class Scheduler;
 
 /// <summary>
 /// In charge of handling memory access for the CPU and the DMA module.
 /// The CPU will be unaware from which place the memory comes from. A read
 /// or write request from the CPU can be executed in the cartridge, the PPU,
 /// the DMA (to start the transfer process), or to the controllers registers.
+///
+/// The CPU address space is split in pages of 256 bytes. A page backed by
+/// plain memory (CPU RAM or cartridge memory mapped as a whole) is accessed
+/// through a pointer to it. The rest of the pages go through the handler of
+/// the device behind them.
 /// </summary>
 class Bus {
    public:
@@ -36,7 +44,14 @@ class Bus {
     /// </summary>
     /// <param name="address">Address to write</param>
     /// <param name="data">Data to be written</param>
-    void CpuWrite(uint16_t address, uint8_t data);
+    inline void CpuWrite(uint16_t address, uint8_t data) {
+        const CpuPage& page = m_CpuPages[address >> 8];
+        if (page.m_WriteMemory != nullptr) {
+            page.m_WriteMemory[address & 0x00FF] = data;
+        } else {
+            CpuWriteToHandler(page.m_WriteHandler, address, data);
+        }
+    }
 
     /// <summary>
     /// Read a byte from memory. This function follows the same rules as CpuWrite
@@ -46,7 +61,13 @@ class Bus {
     /// information on whether they can write when reading.
     /// </param>
     /// <returns>Byte from memory</returns>
-    uint8_t CpuRead(uint16_t address, bool isReadOnly = false);
+    inline uint8_t CpuRead(uint16_t address, bool isReadOnly = false) {
+        const CpuPage& page = m_CpuPages[address >> 8];
+        if (page.m_ReadMemory != nullptr) {
+            return page.m_ReadMemory[address & 0x00FF];
+        }
+        return CpuReadFromHandler(page.m_ReadHandler, address, isReadOnly);
+    }
 
     /// <summary>
     /// Load the current cartridge
@@ -54,17 +75,81 @@ class Bus {
     /// <param name="cartridge"></param>
     void SetCartridge(Cartridge* cartridge);
 
+    /// <summary>
+    /// Set the reference to the CPU, which drops the code it decoded from the
+    /// pages rebuilt by RebuildCpuPages()
+    /// </summary>
+    /// <param name="cpu"></param>
+    void SetCpu(Cpu* cpu);
+
     /// <summary>
     /// Set the reference to the DMA module
     /// </summary>
     /// <param name="dma"></param>
     void SetDma(Dma* dma);
 
+    /// <summary>
+    /// Function that executes the cycles the PPU deferred, with the features
+    /// of the console chosen at compile time
+    /// </summary>
+    using PpuCatchUp = void (*)(Ppu& ppu);
+
     /// <summary>
     /// Set the reference to the PPU module
     /// </summary>
     /// <param name="ppu"></param>
-    void SetPpu(Ppu* ppu);
+    /// <param name="catchUp">Called to bring the PPU up to date before any
+    /// access to it</param>
+    void SetPpu(Ppu* ppu, PpuCatchUp catchUp);
+
+    /// <summary>
+    /// Set the reference to the event scheduler. Mappers reach it through the
+    /// bus to raise their IRQs.
+    /// </summary>
+    /// <param name="scheduler"></param>
+    void SetScheduler(Scheduler* scheduler);
+
+    /// <summary>
+    /// Returns the event scheduler, or nullptr
+    /// </summary>
+    /// <returns></returns>
+    inline Scheduler* GetScheduler() const { return m_Scheduler; }
+
+    /// <summary>
+    /// Returns true if a page of the CPU address space is backed by plain
+    /// memory for reads, so reading it has no side effects
+    /// </summary>
+    /// <param name="page">High byte of the addresses of the page</param>
+    /// <returns></returns>
+    inline bool IsCpuReadPageMemory(uint8_t page) const {
+        return m_CpuPages[page].m_ReadMemory != nullptr;
+    }
+
+    /// <summary>
+    /// Rebuild the memory map of the CPU for the pages that contain the
+    /// addresses of the range. Mappers call it when they switch banks. The CPU
+    /// drops the code it decoded from them.
+    /// </summary>
+    /// <param name="firstAddress"></param>
+    /// <param name="lastAddress"></param>
+    void RebuildCpuPages(uint16_t firstAddress, uint16_t lastAddress);
+
+    /// <summary>
+    /// Drop the decoded tiles of the PPU for the pattern table address range.
+    /// Mappers call it when they switch character memory banks. The PPU must
+    /// have been brought up to date before the switch, which CpuWrite() does
+    /// for the writes to the cartridge.
+    /// </summary>
+    /// <param name="firstAddress"></param>
+    /// <param name="lastAddress"></param>
+    void InvalidatePatternTiles(uint16_t firstAddress, uint16_t lastAddress);
+
+    /// <summary>
+    /// Map the nametables of the PPU with a mirroring mode, after bringing
+    /// the PPU up to date. Mappers call it when they switch the mirroring.
+    /// </summary>
+    /// <param name="mode"></param>
+    void SetMirroringMode(CartridgeHeader::MIRRORING_MODE mode);
 
     // TODO: Provide better controller API
     
@@ -102,16 +187,66 @@ class Bus {
     /// <param name="data">Mask to apply to the controller state</param>
     void WriteControllerState(size_t controllerIdx, uint8_t data);
 
+    /// <summary>
+    /// Returns the CPU RAM, for inspection
+    /// </summary>
+    /// <returns></returns>
+    inline const std::array<uint8_t, SIZE_CPU_RAM>& GetCpuRam() const {
+        return m_CpuRam;
+    }
+
    private:
+    /// <summary>
+    /// Device that serves the accesses to a page without memory
+    /// </summary>
+    enum class CpuPageHandler : uint8_t {
+        // Nothing is mapped, reads return 0
+        kOpenBus,
+        // PPU registers, 0x2000 -> 0x3FFF
+        kPpu,
+        // DMA and controllers, 0x4000 -> 0x40FF
+        kIo,
+        // The cartridge first, then the other devices, like the real bus
+        kCartridge
+    };
+
+    /// <summary>
+    /// Entry of the CPU memory map, for 256 bytes of the address space
+    /// </summary>
+    struct CpuPage {
+        uint8_t* m_ReadMemory = nullptr;
+        uint8_t* m_WriteMemory = nullptr;
+        CpuPageHandler m_ReadHandler = CpuPageHandler::kOpenBus;
+        CpuPageHandler m_WriteHandler = CpuPageHandler::kOpenBus;
+    };
+
+    uint8_t CpuReadFromHandler(CpuPageHandler handler, uint16_t address,
+                               bool isReadOnly);
+
+    void CpuWriteToHandler(CpuPageHandler handler, uint16_t address,
+                           uint8_t data);
+
+    uint8_t CpuReadFromDevices(uint16_t address, bool isReadOnly);
+
+    void CpuWriteToDevices(uint16_t address, uint8_t data);
+
+    std::array<CpuPage, 0x100> m_CpuPages;
+
     Cartridge* m_Cartridge = nullptr;
+    Cpu* m_Cpu = nullptr;
     Dma* m_Dma = nullptr;
     Ppu* m_Ppu = nullptr;
+    PpuCatchUp m_PpuCatchUp = nullptr;
+    Scheduler* m_Scheduler = nullptr;
 
     uint8_t m_Controllers[NUM_CONTROLLERS] = {0};
     uint8_t m_ControllerState[NUM_CONTROLLERS] = {0};
 
     std::array<uint8_t, SIZE_CPU_RAM> m_CpuRam;
 
+    // The PPU may be lagging behind the CPU, bring it up to date
+    inline void CatchUpPpu() { m_PpuCatchUp(*m_Ppu); }
+
     inline uint16_t GetRealRamAddress(uint16_t address) const {
         return address & 0x07FF;
     }
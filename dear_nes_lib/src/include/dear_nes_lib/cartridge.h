@@ -6,11 +6,12 @@
 #include <vector>
 
 #include "dear_nes_lib/cartridge_header.h"
+#include "dear_nes_lib/mapper_variant.h"
 
 namespace dearnes {
 
 // Forward declarations
-class IMapper;
+class Bus;
 class CartridgeLoader;
 
 /// <summary>
@@ -22,15 +23,73 @@ class CartridgeLoader;
 /// </summary>
 class Cartridge {
    public:
-
-    Cartridge(CartridgeHeader&& header, IMapper* mapper,
+    Cartridge(CartridgeHeader&& header, MapperVariant&& mapper,
               std::vector<uint8_t>&& programMemory,
               std::vector<uint8_t>&& characterMemory);
 
-    ~Cartridge();
+    /// <summary>
+    /// How the cartridge takes part in a page of 256 bytes of the CPU address
+    /// space
+    /// </summary>
+    enum class CpuPageMapping {
+        // No address of the page belongs to the cartridge
+        kNone,
+        // The whole page is mapped to contiguous program memory
+        kMemory,
+        // Some addresses belong to the cartridge, or they are not contiguous.
+        // They must go through CpuRead() and CpuWrite()
+        kPartial
+    };
+
+    /// <summary>
+    /// Connect the bus whose CPU memory map must be rebuilt when the mapper
+    /// switches banks
+    /// </summary>
+    /// <param name="bus"></param>
+    void ConnectBus(Bus* bus);
+
+    /// <summary>
+    /// Find how the mapper handles CPU reads from a page, with the current
+    /// banks.
+    /// </summary>
+    /// <param name="page">High byte of the addresses of the page</param>
+    /// <param name="memory">Program memory of the page, for kMemory</param>
+    /// <returns></returns>
+    CpuPageMapping GetCpuReadPage(uint8_t page, uint8_t*& memory);
+
+    /// <summary>
+    /// Find how the mapper handles CPU writes to a page, with the current
+    /// banks.
+    /// </summary>
+    /// <param name="page">High byte of the addresses of the page</param>
+    /// <param name="memory">Program memory of the page, for kMemory</param>
+    /// <returns></returns>
+    CpuPageMapping GetCpuWritePage(uint8_t page, uint8_t*& memory);
 
     CartridgeHeader::MIRRORING_MODE GetMirroringMode() const;
 
+    /// <summary>
+    /// Returns the iNES mapper number of the cartridge
+    /// </summary>
+    /// <returns></returns>
+    uint8_t GetMapperId() const;
+
+    /// <summary>
+    /// Returns a 32-bit FNV-1a hash of the program memory, with its current
+    /// content. It identifies the program a recompiled program was generated
+    /// from.
+    /// </summary>
+    /// <returns></returns>
+    uint32_t GetProgramMemoryChecksum() const;
+
+    /// <summary>
+    /// Returns the size in bytes of the program memory
+    /// </summary>
+    /// <returns></returns>
+    inline size_t GetProgramMemorySize() const {
+        return m_ProgramMemory.size();
+    }
+
     /// <summary>
     /// Attempt to read from the CPU to the cartridge memory. If the mapper
     /// determines that the address is not in its domain, returns false and do
@@ -39,7 +98,18 @@ class Cartridge {
     /// <param name="address"></param>
     /// <param name="data"></param>
     /// <returns></returns>
-    bool CpuRead(uint16_t address, uint8_t& data);
+    inline bool CpuRead(uint16_t address, uint8_t& data) {
+        uint32_t mappedAddr = 0;
+        const bool isMapped = std::visit(
+            [address, &mappedAddr](auto& mapper) {
+                return mapper.CpuMapRead(address, mappedAddr);
+            },
+            m_Mapper);
+        if (isMapped) {
+            data = m_ProgramMemory[mappedAddr];
+        }
+        return isMapped;
+    }
 
     /// <summary>
     /// Attempt to write from the CPU to the cartridge memory. If the mapper
@@ -49,7 +119,18 @@ class Cartridge {
     /// <param name="address"></param>
     /// <param name="data"></param>
     /// <returns></returns>
-    bool CpuWrite(uint16_t address, uint8_t data);
+    inline bool CpuWrite(uint16_t address, uint8_t data) {
+        uint32_t mappedAddr = 0;
+        const bool isMapped = std::visit(
+            [address, &mappedAddr](auto& mapper) {
+                return mapper.CpuMapWrite(address, mappedAddr);
+            },
+            m_Mapper);
+        if (isMapped) {
+            m_ProgramMemory[mappedAddr] = data;
+        }
+        return isMapped;
+    }
 
     /// <summary>
     /// Attempt to read from the PPU to the cartridge memory. If the mapper
@@ -59,7 +140,18 @@ class Cartridge {
     /// <param name="address"></param>
     /// <param name="data"></param>
     /// <returns></returns>
-    bool PpuRead(uint16_t address, uint8_t& data);
+    inline bool PpuRead(uint16_t address, uint8_t& data) {
+        uint32_t mappedAddr = 0;
+        const bool isMapped = std::visit(
+            [address, &mappedAddr](auto& mapper) {
+                return mapper.PpuMapRead(address, mappedAddr);
+            },
+            m_Mapper);
+        if (isMapped) {
+            data = m_CharacterMemory[mappedAddr];
+        }
+        return isMapped;
+    }
 
     /// <summary>
     /// Attempt to write from the PPU to the cartridge memory. If the mapper
@@ -69,12 +161,27 @@ class Cartridge {
     /// <param name="address"></param>
     /// <param name="data"></param>
     /// <returns></returns>
-    bool PpuWrite(uint16_t address, uint8_t data);
+    inline bool PpuWrite(uint16_t address, uint8_t data) {
+        uint32_t mappedAddr = 0;
+        const bool isMapped = std::visit(
+            [address, &mappedAddr](auto& mapper) {
+                return mapper.PpuMapWrite(address, mappedAddr);
+            },
+            m_Mapper);
+        if (isMapped) {
+            m_CharacterMemory[mappedAddr] = data;
+        }
+        return isMapped;
+    }
 
    private:
+    template <typename MapFunction>
+    CpuPageMapping GetCpuPage(uint8_t page, uint8_t*& memory,
+                              MapFunction map);
+
     CartridgeHeader m_CartridgeHeader;
 
-    IMapper* m_Mapper = nullptr;
+    MapperVariant m_Mapper;
 
     std::vector<uint8_t> m_ProgramMemory;
     std::vector<uint8_t> m_CharacterMemory;
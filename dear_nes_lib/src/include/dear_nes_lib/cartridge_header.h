@@ -23,7 +23,9 @@ class CartridgeHeader {
         HORIZONTAL,
         VERTICAL,
         ONESCREEN_LO,
-        ONESCREEN_HI
+        ONESCREEN_HI,
+        /// The cartridge has the memory for two more nametables
+        FOUR_SCREEN
     };
 
     bool HasTrainerData() const;
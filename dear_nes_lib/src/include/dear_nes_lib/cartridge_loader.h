@@ -4,13 +4,13 @@
 #include <variant>
 
 #include "dear_nes_lib/enums.h"
+#include "dear_nes_lib/mapper_variant.h"
 
 namespace dearnes {
 
 // Forward declaration
 class Cartridge;
 class CartridgeHeader;
-class IMapper;
 
 class CartridgeLoader {
    public:
@@ -23,7 +23,14 @@ class CartridgeLoader {
    private:
     bool IsMapperSupported(uint8_t mapperId);
 
-    IMapper* CreateMapper(const CartridgeHeader& header);
+    /// <summary>
+    /// Create the mapper of the cartridge. The mapper is selected once here,
+    /// every access after this is dispatched at compile time.
+    /// </summary>
+    /// <param name="header">Header of a cartridge with a supported
+    /// mapper</param>
+    /// <returns></returns>
+    MapperVariant CreateMapper(const CartridgeHeader& header);
 };
 
 }  // namespace dearnes
\ No newline at end of file
@@ -1,25 +1,34 @@
 // Copyright (c) 2020 Emmanuel Arias
 #pragma once
+#include <array>
 #include <cinttypes>
+#include <memory>
+#include <vector>
 
+#include "dear_nes_lib/cpu_profile.h"
 #include "dear_nes_lib/enums.h"
 
 namespace dearnes {
 
 // Forward declaration
 class Bus;
+class CpuJit;
+struct RecompiledProgram;
+struct RecompiledRoutine;
 
 /// <summary>
 /// Virtual implementation of the 6502 CPU version for the NES. The instruction
 /// set for this implementation is based on https://www.masswerk.at/6502/6502_instruction_set.html
 /// The CPU can be reset using the Reset() function, and this will simulate the real
 /// life version of the reset routine.
-/// In this current implementation illegal instruction are not handled. There are some instruction
-/// that do not crash the system, but they do originally undocumented operations. Some games
-/// take advantage of this and will need to support said instructions.
+/// The unofficial instructions are executed as a NOP with their length and
+/// cycles, see Operation. Some games take advantage of their undocumented
+/// operations and will need to support said instructions.
 /// </summary>
 class Cpu {
    public:
+    Cpu();
+    ~Cpu();
 
     /// <summary>
     /// Set the reference to the memory bus
@@ -45,6 +54,84 @@ class Cpu {
     /// </summary>
     void Clock();
 
+    /// <summary>
+    /// Execute instructions back to back until the budget of cycles is used.
+    /// The result is the same as calling Clock() once per cycle in the budget,
+    /// but the cycles an instruction waits are not counted down one by one.
+    /// The instruction in progress, if any, is completed first.
+    /// </summary>
+    /// <param name="budget">Amount of CPU cycles to run</param>
+    /// <returns>Cycles that the last instruction needs past the budget. They
+    /// will be consumed by the next call to Clock() or Run()</returns>
+    int64_t Run(int64_t budget);
+
+    /// <summary>
+    /// Execute the next instruction, and keep executing instructions back to
+    /// back while they start within the budget and cannot access the devices
+    /// connected to the bus (PPU, DMA, controllers and mapper registers).
+    /// Only CPU RAM and cartridge ROM reads are considered free of side
+    /// effects. This lets the CPU run ahead of the other devices, without
+    /// changing the result. The instruction in progress must be complete.
+    /// </summary>
+    /// <param name="budget">Amount of CPU cycles to run</param>
+    /// <returns>Cycles of the budget that were used. It is less than the
+    /// budget when the CPU stopped before an instruction that could access a
+    /// device; in that case the CPU is ready to execute it on the next cycle.
+    /// If the first instruction could access a device, only its first cycle
+    /// is used and the rest are left to count down, like with
+    /// Clock()</returns>
+    int64_t RunAhead(int64_t budget);
+
+    /// <summary>
+    /// Enable or disable the translation of basic blocks to native code. When
+    /// enabled, RunAhead() executes the translated blocks instead of
+    /// interpreting them. Enabling it has no effect if the platform is not
+    /// supported, see IsJitEnabled().
+    /// </summary>
+    /// <param name="enabled"></param>
+    void SetJitEnabled(bool enabled);
+
+    /// <summary>
+    /// Returns true if the basic block translator is in use
+    /// </summary>
+    /// <returns></returns>
+    inline bool IsJitEnabled() const { return m_Jit != nullptr; }
+
+    /// <summary>
+    /// Get the basic block translator, or nullptr if it is disabled
+    /// </summary>
+    /// <returns></returns>
+    inline const CpuJit *GetJit() const { return m_Jit.get(); }
+
+    /// <summary>
+    /// Install a program recompiled ahead of time, or remove it with nullptr.
+    /// RunAhead() calls its routines when the program counter lands on their
+    /// address, and interprets the code otherwise. The caller must make sure
+    /// that the program matches the cartridge, see Nes::SetRecompiledProgram().
+    /// The program is removed as soon as the cartridge ROM changes, see
+    /// InvalidateCode().
+    /// </summary>
+    /// <param name="program"></param>
+    void SetRecompiledProgram(const RecompiledProgram *program);
+
+    /// <summary>
+    /// Get the recompiled program in use, or nullptr if there is none
+    /// </summary>
+    /// <returns></returns>
+    inline const RecompiledProgram *GetRecompiledProgram() const {
+        return m_RecompiledProgram;
+    }
+
+    /// <summary>
+    /// Drop the decoded and translated code after the memory of an address
+    /// range changed under it. The bus calls it when the mapper switches
+    /// banks, and the CPU when it writes a different byte to cartridge ROM.
+    /// Writes to CPU RAM only invalidate the instructions that contain them.
+    /// </summary>
+    /// <param name="firstAddress"></param>
+    /// <param name="lastAddress"></param>
+    void InvalidateCode(uint16_t firstAddress, uint16_t lastAddress);
+
     /// <summary>
     /// Simulate the NMI (non maskable interruption) process. The IRL process is
     /// described in this wiki entry:
@@ -52,6 +139,14 @@ class Cpu {
     /// </summary>
     void NonMaskableInterrupt();
 
+    /// <summary>
+    /// Set the level of the IRQ input. The line is sampled before every
+    /// instruction: while it is asserted and the I flag is clear, the CPU
+    /// services the IRQ instead of executing the next instruction.
+    /// </summary>
+    /// <param name="asserted"></param>
+    inline void SetIrqLine(bool asserted) { m_IrqLine = asserted; }
+
     /// <summary>
     /// Returns true if the current instruction has finished to wait for the cycles
     /// it takes to finish in the real hardware version
@@ -59,16 +154,31 @@ class Cpu {
     /// <returns></returns>
     inline bool IsCurrentInstructionComplete() const { return m_Cycles == 0; }
 
+    /// <summary>
+    /// Returns the amount of cycles the CPU will wait before executing the
+    /// next instruction
+    /// </summary>
+    /// <returns></returns>
+    inline uint8_t GetRemainingCycles() const { return m_Cycles; }
+
     /// <summary>
     /// Return 0x01 or 0x01 for a given register flag
     /// </summary>
     /// <param name="flag"></param>
     /// <returns></returns>
     inline uint8_t GetFlag(CpuFlag flag) const {
-        if ((m_StatusRegister & flag) == 0x00) {
-            return 0;
+        switch (flag) {
+            case CpuFlag::N:
+                return m_NegativeResult >> 7;
+            case CpuFlag::Z:
+                return m_ZeroResult == 0x00 ? 1 : 0;
+            case CpuFlag::C:
+                return m_CarryResult & 0x01;
+            case CpuFlag::V:
+                return m_OverflowResult >> 7;
+            default:
+                return (m_StatusRegister & flag) == 0x00 ? 0 : 1;
         }
-        return 1;
     }
 
     /// <summary>
@@ -77,13 +187,43 @@ class Cpu {
     /// <param name="flag"></param>
     /// <param name="value"></param>
     inline void SetFlag(CpuFlag flag, bool value) {
-        if (value) {
-            m_StatusRegister |= flag;
-        } else {
-            m_StatusRegister &= ~flag;
+        switch (flag) {
+            case CpuFlag::N:
+                m_NegativeResult = value ? 0x80 : 0x00;
+                break;
+            case CpuFlag::Z:
+                m_ZeroResult = value ? 0x00 : 0x01;
+                break;
+            case CpuFlag::C:
+                m_CarryResult = value ? 0x01 : 0x00;
+                break;
+            case CpuFlag::V:
+                m_OverflowResult = value ? 0x80 : 0x00;
+                break;
+            default:
+                if (value) {
+                    m_StatusRegister |= flag;
+                } else {
+                    m_StatusRegister &= ~flag;
+                }
+                break;
         }
     }
 
+    /// <summary>
+    /// Get the value for the status register, with all its flags
+    /// </summary>
+    /// <returns></returns>
+    inline uint8_t GetStatusRegister() const {
+        uint8_t status = m_StatusRegister & ~(CpuFlag::N | CpuFlag::Z |
+                                              CpuFlag::C | CpuFlag::V);
+        status |= m_NegativeResult & CpuFlag::N;
+        status |= m_ZeroResult == 0x00 ? CpuFlag::Z : 0x00;
+        status |= m_CarryResult & CpuFlag::C;
+        status |= (m_OverflowResult >> 1) & CpuFlag::V;
+        return status;
+    }
+
     /// <summary>
     /// Get the value for register A
     /// </summary>
@@ -115,36 +255,313 @@ class Cpu {
     inline uint16_t GetProgramCounter() const { return m_ProgramCounter; }
 
     /// <summary>
-    /// Typedef for a void() function pointer. Used for the instruction table callbacks.
+    /// Counters of the decode cache. Instructions are decoded once and reused
+    /// while the memory they were read from is not written to.
+    /// </summary>
+    struct DecodeCacheStatistics {
+        /// Instructions executed from the cache
+        uint64_t hits = 0;
+
+        /// Cacheable instructions that had to be decoded from memory
+        uint64_t misses = 0;
+
+        /// Instructions fetched from memory that cannot be cached
+        uint64_t uncached = 0;
+
+        /// Times the whole cache was flushed
+        uint64_t flushes = 0;
+    };
+
+    /// <summary>
+    /// Get the decode cache counters accumulated since the last reset
+    /// </summary>
+    /// <returns></returns>
+    inline const DecodeCacheStatistics &GetDecodeCacheStatistics() const {
+        return m_DecodeCacheStatistics;
+    }
+
+    /// <summary>
+    /// Set all the decode cache counters to zero
+    /// </summary>
+    inline void ResetDecodeCacheStatistics() {
+        m_DecodeCacheStatistics = DecodeCacheStatistics{};
+    }
+
+    /// <summary>
+    /// Enable or disable the fused handlers of common instruction pairs, such
+    /// as LDA/STA or DEX/BNE. RunAhead() executes a pair with a single handler
+    /// when both instructions are in the decode cache and the second one would
+    /// start within the budget. The result is the same either way. Enabled by
+    /// default.
+    /// </summary>
+    /// <param name="enabled"></param>
+    inline void SetFusionEnabled(bool enabled) { m_IsFusionEnabled = enabled; }
+
+    /// <summary>
+    /// Returns true if instruction pairs are executed by fused handlers
+    /// </summary>
+    /// <returns></returns>
+    inline bool IsFusionEnabled() const { return m_IsFusionEnabled; }
+
+    /// <summary>
+    /// Counter of an instruction pair that has a fused handler
+    /// </summary>
+    struct FusedPairStatistics {
+        uint8_t firstOpCode = 0x00;
+        uint8_t secondOpCode = 0x00;
+
+        /// Times both instructions were executed by the fused handler
+        uint64_t executed = 0;
+    };
+
+    /// <summary>
+    /// Get the counters of every pair with a fused handler, accumulated since
+    /// the last reset
+    /// </summary>
+    /// <returns></returns>
+    std::vector<FusedPairStatistics> GetFusionStatistics() const;
+
+    /// <summary>
+    /// Set all the fused pair counters to zero
+    /// </summary>
+    void ResetFusionStatistics();
+
+    /// <summary>
+    /// Enable or disable the detection of idle loops. An idle loop is a short
+    /// loop closed by a branch or a jump back to its start, whose body only
+    /// reads CPU RAM, cartridge ROM or the PPU status register, and that
+    /// leaves the registers exactly as it found them. Once RunAhead() has
+    /// seen it do so, the rest of the iterations that fit in the budget are
+    /// skipped in one step, since they cannot change anything. Loops that
+    /// poll the PPU status are only skipped while it cannot change, see
+    /// SetPpuStatusStableCycles(). The result is the same either way.
+    /// Enabled by default.
+    /// </summary>
+    /// <param name="enabled"></param>
+    void SetIdleLoopDetectionEnabled(bool enabled);
+
+    /// <summary>
+    /// Returns true if idle loops are skipped
+    /// </summary>
+    /// <returns></returns>
+    inline bool IsIdleLoopDetectionEnabled() const {
+        return m_IsIdleLoopDetectionEnabled;
+    }
+
+    /// <summary>
+    /// Set the loops that must never be skipped, by the address of their
+    /// first instruction. It covers the false positives of a given program,
+    /// see Nes::AddIdleLoopOverride().
+    /// </summary>
+    /// <param name="addresses"></param>
+    void SetIdleLoopExclusions(std::vector<uint16_t> addresses);
+
+    /// <summary>
+    /// Set the window, around the first cycle of the next RunAhead() call,
+    /// during which reading the PPU status register returns the same value.
+    /// Idle loops that poll it are only skipped if all their reads, the one
+    /// that confirmed the loop included, fall in this window.
+    /// </summary>
+    /// <param name="cyclesBefore">Cycles before the first one in the window,
+    /// or -1 if the first one is not</param>
+    /// <param name="cyclesAfter">Cycles in the window from the first one on,
+    /// including it</param>
+    inline void SetPpuStatusStableCycles(int64_t cyclesBefore,
+                                         int64_t cyclesAfter) {
+        m_PpuStatusStableCyclesBefore = cyclesBefore;
+        m_PpuStatusStableCyclesAfter = cyclesAfter;
+    }
+
+    /// <summary>
+    /// Counters of the idle loop detection
+    /// </summary>
+    struct IdleLoopStatistics {
+        /// Times a loop was found to be idle
+        uint64_t loopsDetected = 0;
+
+        /// Iterations skipped without executing them
+        uint64_t iterationsSkipped = 0;
+
+        /// CPU cycles taken by the skipped iterations
+        uint64_t cyclesSkipped = 0;
+    };
+
+    /// <summary>
+    /// Get the idle loop counters accumulated since the last reset
+    /// </summary>
+    /// <returns></returns>
+    inline const IdleLoopStatistics &GetIdleLoopStatistics() const {
+        return m_IdleLoopStatistics;
+    }
+
+    /// <summary>
+    /// Set all the idle loop counters to zero
+    /// </summary>
+    inline void ResetIdleLoopStatistics() {
+        m_IdleLoopStatistics = IdleLoopStatistics{};
+    }
+
+    /// <summary>
+    /// Returns true if the library was built with the profiler, with the
+    /// ENABLE_CPU_PROFILER option. Otherwise the profiler compiles to nothing
+    /// and cannot be enabled.
+    /// </summary>
+    /// <returns></returns>
+    static constexpr bool IsProfilerAvailable() {
+#if defined(DEARNES_CPU_PROFILER)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /// <summary>
+    /// Enable or disable the profiler, which counts the executions, cycles,
+    /// page crossings and taken branches of every op code, and samples the
+    /// address of the running instruction. While it is enabled, RunAhead()
+    /// interprets every instruction, so that all of them are counted: the
+    /// fused pairs, the translated blocks, the recompiled routines and the
+    /// idle loop skipping are not used. Interrupt requests are not counted.
+    /// Disabling it discards the counters. Disabled by default.
+    /// </summary>
+    /// <param name="enabled"></param>
+    void SetProfilerEnabled(bool enabled);
+
+    /// <summary>
+    /// Returns true if the profiler is counting
+    /// </summary>
+    /// <returns></returns>
+    inline bool IsProfilerEnabled() const {
+#if defined(DEARNES_CPU_PROFILER)
+        return m_Profile != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    /// <summary>
+    /// Get a copy of the profiler counters accumulated since it was enabled or
+    /// reset. Empty if it is disabled.
+    /// </summary>
+    /// <returns></returns>
+    CpuProfile GetProfile() const;
+
+    /// <summary>
+    /// Set all the profiler counters to zero
+    /// </summary>
+    void ResetProfile();
+
+    /// <summary>
+    /// Invalidate every decoded instruction. Call this when the memory visible
+    /// to the CPU is modified without going through the CPU itself.
+    /// </summary>
+    void FlushDecodeCache();
+
+    /// <summary>
+    /// Memory addressing modes of the 6502. Each mode defines how the operand
+    /// bytes that follow the operation code are turned into the address (or
+    /// value) the instruction works with.
     /// </summary>
-    using FuncPtr = void (Cpu::*)();
+    enum class AddressingMode : uint8_t {
+        kImplied,
+        kAccumulator,
+        kImmediate,
+        kZeroPage,
+        kIndexedZeroPageX,
+        kIndexedZeroPageY,
+        kAbsolute,
+        kIndexedAbsoluteX,
+        kIndexedAbsoluteY,
+        kAbsoluteIndirect,
+        kIndexedIndirectX,
+        kIndirectIndexedY,
+        kRelative
+    };
+
+    /// <summary>
+    /// Operations of the official 6502 instruction set. kNoImpl marks the
+    /// unofficial operation codes, which are executed as a NOP with their
+    /// length and cycles. kJAM marks the ones that halt the 6502: the CPU
+    /// executes them again and again, until it is reset.
+    /// </summary>
+    enum class Operation : uint8_t {
+        kNoImpl,
+        kADC,
+        kAND,
+        kASL,
+        kBCC,
+        kBCS,
+        kBEQ,
+        kBIT,
+        kBMI,
+        kBNE,
+        kBPL,
+        kBRK,
+        kBVC,
+        kBVS,
+        kCLC,
+        kCLD,
+        kCLI,
+        kCLV,
+        kCMP,
+        kCPX,
+        kCPY,
+        kDEC,
+        kDEX,
+        kDEY,
+        kEOR,
+        kINC,
+        kINX,
+        kINY,
+        kJAM,
+        kJMP,
+        kJSR,
+        kLDA,
+        kLDX,
+        kLDY,
+        kLSR,
+        kNOP,
+        kORA,
+        kPHA,
+        kPHP,
+        kPLA,
+        kPLP,
+        kROL,
+        kROR,
+        kRTI,
+        kRTS,
+        kSBC,
+        kSEC,
+        kSED,
+        kSEI,
+        kSTA,
+        kSTX,
+        kSTY,
+        kTAX,
+        kTAY,
+        kTSX,
+        kTXA,
+        kTXS,
+        kTYA
+    };
 
     /// <summary>
-    /// Wrapper object for a item in the look-up table. It is meant to be used in
-    /// a constexpr container.
+    /// Item of the look-up table. The table is only read at compile time: every
+    /// operation code gets its own handler, generated from its item, where the
+    /// addressing mode and the operation are fused together.
     /// </summary>
     struct Instruction {
         /// <summary>
-        /// Construct a constexpr item for the instruction set lookup table.
-        /// The table will reference the operation code to the proper callbacks.
-        /// </summary>
-        /// <param name="executeInstruction"></param>
-        /// <param name="execureAddressingMode"></param>
-        /// <param name="cycles"></param>
-        constexpr Instruction(const FuncPtr executeInstruction,
-                              const FuncPtr execureAddressingMode,
-                               const uint8_t cycles);        
-        /// <summary>
-        /// Instruction callback. This is the virtual implementation of the instruction.
+        /// Operation executed by the instruction.
         /// </summary>
-        const FuncPtr m_ExecuteInstruction;
+        Operation m_Operation;
 
         /// <summary>
-        /// Virtual implementation for the memory addressing associated to the instruction.
-        /// A instruction can have more than one op code, each associated to a specific
+        /// Memory addressing associated to the instruction. An operation can
+        /// have more than one op code, each associated to a specific
         /// addressing mode.
         /// </summary>
-        const FuncPtr m_ExecureAddressingMode;
+        AddressingMode m_AddressingMode;
 
         /// <summary>
         /// Base cycle duration for the instruction.
@@ -152,6 +569,94 @@ class Cpu {
         uint8_t m_Cycles;
     };
 
+    /// <summary>
+    /// Get the look-up table item of an op code
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <returns></returns>
+    static inline const Instruction &GetInstruction(uint8_t opCode) {
+        return m_InstructionTable[opCode];
+    }
+
+    /// <summary>
+    /// Get the amount of bytes of an instruction, op code included
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <returns></returns>
+    static inline uint8_t GetInstructionLength(uint8_t opCode) {
+        return m_InstructionLengths[opCode];
+    }
+
+    /// <summary>
+    /// Get the mnemonic of an operation, e.g. "LDA"
+    /// </summary>
+    /// <param name="operation"></param>
+    /// <returns></returns>
+    static const char *GetOperationName(Operation operation);
+
+    /// <summary>
+    /// Get the short name of an addressing mode, e.g. "ABX" for indexed
+    /// absolute X
+    /// </summary>
+    /// <param name="mode"></param>
+    /// <returns></returns>
+    static const char *GetAddressingModeName(AddressingMode mode);
+
+    /// <summary>
+    /// Returns true if executing the instruction cannot access a device,
+    /// whatever the state of the registers and memory is.
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <param name="operand"></param>
+    /// <returns></returns>
+    static bool IsAlwaysIsolated(uint8_t opCode, uint16_t operand);
+
+    /// <summary>
+    /// Returns true if the operation is a conditional branch
+    /// </summary>
+    /// <param name="operation"></param>
+    /// <returns></returns>
+    static bool IsBranch(Operation operation);
+
+    /// <summary>
+    /// Returns true if the op code can be part of a block of translated or
+    /// recompiled code. The unofficial op codes are left to the interpreter.
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <returns></returns>
+    static bool IsTranslatable(uint8_t opCode);
+
+    /// <summary>
+    /// Returns true if a block of translated or recompiled code ends after
+    /// the operation, since it jumps somewhere else
+    /// </summary>
+    /// <param name="operation"></param>
+    /// <returns></returns>
+    static bool EndsTranslatedBlock(Operation operation);
+
+    /// <summary>
+    /// Get the worst case of the cycles taken by an instruction of translated
+    /// or recompiled code: a page is crossed, or the branch is taken to
+    /// another page
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <returns></returns>
+    static uint8_t GetMaxTranslatedCycles(uint8_t opCode);
+
+    /// <summary>
+    /// Execute an instruction whose op code and operand bytes are known in
+    /// advance, from translated or recompiled code. It sets the program
+    /// counter to the next instruction and runs the fused handler of the op
+    /// code, like the interpreter does.
+    /// </summary>
+    /// <param name="cpu"></param>
+    /// <param name="operand">Operand bytes of the instruction</param>
+    /// <param name="nextAddress">Address of the next instruction</param>
+    /// <returns>Cycles taken by the instruction</returns>
+    template <uint8_t OpCode>
+    static uint8_t ExecuteTranslatedInstruction(Cpu *cpu, uint16_t operand,
+                                                uint16_t nextAddress);
+
    private:
     Bus *m_Bus;
 
@@ -161,132 +666,345 @@ class Cpu {
 
     uint8_t m_StackPointer = 0x00;
 
+    // Flags I, D, B and U. The others are kept apart and only turned into
+    // bits when observed, see GetStatusRegister()
     uint8_t m_StatusRegister = 0x00;
 
-    uint16_t m_ProgramCounter = 0x00;
+    // N is bit 7 of the last result, Z is set when it is zero
+    uint8_t m_NegativeResult = 0x00;
+    uint8_t m_ZeroResult = 0x01;
+
+    // C is bit 0
+    uint8_t m_CarryResult = 0x00;
 
-    uint16_t m_AddressAbsolute = 0x0000;
-    uint16_t m_AddressRelative = 0x0000;
+    // V is bit 7
+    uint8_t m_OverflowResult = 0x00;
+
+    uint16_t m_ProgramCounter = 0x00;
 
     uint8_t m_OpCode = 0x00;
     uint8_t m_Cycles = 0x00;
 
-    bool m_AddressingModeNeedsAdditionalCycle = false;
-    bool m_InstructionNeedsAdditionalCycle = false;
+    bool m_IrqLine = false;
 
-    static Instruction m_InstructionTable[0x100];
+    static const Instruction m_InstructionTable[0x100];
 
-   private:
-    uint8_t Read(uint16_t address);
+    static const std::array<uint8_t, 0x100> m_InstructionLengths;
 
-    void Write(uint16_t address, uint8_t data);
+    // Entry of the decode cache, for the instruction starting at a given
+    // address. It is only valid when its generation matches the cache's one
+    struct DecodedInstruction {
+        uint32_t generation = 0;
+        uint16_t operand = 0x0000;
+        uint8_t opCode = 0x00;
+        uint8_t length = 0;
+    };
 
-    uint8_t ReadWordFromProgramCounter();
+    // Instructions in CPU RAM (indexed by the real RAM address) followed by
+    // the ones in cartridge space 0x8000 -> 0xFFFF
+    std::vector<DecodedInstruction> m_DecodeCache;
+    uint32_t m_DecodeCacheGeneration = 1;
+    DecodeCacheStatistics m_DecodeCacheStatistics;
+
+    bool m_IsFusionEnabled = true;
+    std::vector<uint64_t> m_FusedPairCounts;
+
+    // Loop being watched by the idle loop detection
+    struct IdleLoop {
+        bool isActive = false;
+        bool isConfirmed = false;
+        bool readsPpuStatus = false;
+        uint8_t mismatches = 0;
+
+        // Address of the first instruction and the one after the branch
+        uint16_t address = 0x0000;
+        uint16_t endAddress = 0x0000;
+
+        // State on the last arrival to the first instruction
+        uint64_t clock = 0;
+        uint8_t registerA = 0x00;
+        uint8_t registerX = 0x00;
+        uint8_t registerY = 0x00;
+        uint8_t stackPointer = 0x00;
+        uint8_t statusRegister = 0x00;
+    };
 
-    uint16_t ReadDoubleWordFromProgramCounter();
+    bool m_IsIdleLoopDetectionEnabled = true;
+    IdleLoop m_IdleLoop;
+
+    // CPU cycles elapsed, it measures the loop iterations
+    uint64_t m_IdleLoopClock = 0;
+
+    // Start address of the last step of RunAhead()
+    uint16_t m_IdleLoopLastAddress = 0x0000;
+
+    // Decode cache generation on which each instruction was found not to start
+    // an idle loop, indexed like the decode cache
+    std::vector<uint32_t> m_IdleLoopRejections;
+
+    std::vector<uint16_t> m_IdleLoopExclusions;
+    int64_t m_PpuStatusStableCyclesBefore = -1;
+    int64_t m_PpuStatusStableCyclesAfter = 0;
+    IdleLoopStatistics m_IdleLoopStatistics;
+
+#if defined(DEARNES_CPU_PROFILER)
+    // Counters of the profiler, null while it is disabled
+    std::unique_ptr<CpuProfile> m_Profile;
 
-    constexpr const Instruction& FindInstruction(const uint8_t opCode);
+    // Cycles executed since the last address sample
+    uint32_t m_ProfileSamplingCycles = 0;
+#endif
+
+    std::unique_ptr<CpuJit> m_Jit;
+
+    // Routine of the recompiled program starting at each cartridge ROM
+    // address, empty when there is no program
+    const RecompiledProgram *m_RecompiledProgram = nullptr;
+    std::vector<const RecompiledRoutine *> m_RecompiledRoutines;
+
+    // Handler of an op code with a plain function signature, so that it can
+    // be called from translated code. It also sets the program counter to the
+    // next instruction and the unused flag, like ExecuteNextInstruction()
+    using TranslatedInstructionHandler = uint8_t (*)(Cpu *cpu, uint16_t operand,
+                                                     uint16_t nextAddress);
+    static const std::array<TranslatedInstructionHandler, 0x100>
+        m_TranslatedInstructionHandlers;
+
+    friend class CpuJit;
 
    private:
-    void AddrImmediate();
+    /// <summary>
+    /// Set all the flags of the status register
+    /// </summary>
+    /// <param name="status"></param>
+    void SetStatusRegister(uint8_t status);
+
+    /// <summary>
+    /// Set the N and Z flags from the result of an operation
+    /// </summary>
+    /// <param name="result"></param>
+    inline void SetZeroAndNegativeFlags(uint8_t result) {
+        m_NegativeResult = result;
+        m_ZeroResult = result;
+    }
 
-    void AddrZeroPage();
+    uint8_t Read(uint16_t address);
 
-    void AddrIndexedZeroPageX();
+    void Write(uint16_t address, uint8_t data);
 
-    void AddrIndexedZeroPageY();
+    uint8_t ReadWordFromProgramCounter();
 
-    void AddrAbsolute();
+    uint16_t ReadDoubleWordFromProgramCounter();
 
-    void AddrIndexedAbsoluteX();
+    /// <summary>
+    /// Read and execute the instruction pointed by the program counter
+    /// </summary>
+    /// <returns>Cycles taken by the instruction</returns>
+    uint8_t ExecuteNextInstruction();
 
-    void AddrIndexedAbsoluteY();
+    /// <summary>
+    /// Service the IRQ if it is requested, or execute the next instruction
+    /// otherwise
+    /// </summary>
+    /// <returns>Cycles taken</returns>
+    uint8_t ExecuteNextStep();
 
-    void AddrAbsoluteIndirect();
+    /// <summary>
+    /// Push the program counter and the status register, and jump to the IRQ
+    /// vector
+    /// </summary>
+    /// <returns>Cycles taken</returns>
+    uint8_t InterruptRequest();
 
-    void AddrIndexedIndirectX();
+    /// <summary>
+    /// Execute an instruction already decoded from the address pointed by the
+    /// program counter
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <param name="operand">Operand bytes of the instruction</param>
+    /// <returns>Cycles taken by the instruction</returns>
+    uint8_t ExecuteDecodedInstruction(uint8_t opCode, uint16_t operand);
 
-    void AddrIndirectIndexedY();
+    /// <summary>
+    /// Watch the loop the program counter is in, on the start of every step
+    /// of RunAhead(), and skip the iterations of a confirmed idle loop.
+    /// </summary>
+    /// <param name="cyclesUsed">Cycles used by the RunAhead() call so
+    /// far</param>
+    /// <param name="remaining">Cycles of the budget left, the skipped cycles
+    /// are taken from it</param>
+    /// <returns>True if iterations were skipped</returns>
+    bool TrackIdleLoop(int64_t cyclesUsed, int64_t &remaining);
 
-    void AddrRelative();
+    /// <summary>
+    /// Check the instructions that start at the address form a loop that can
+    /// be idle: a backward branch to the address closes it, and the body only
+    /// reads CPU RAM, cartridge ROM or the PPU status register.
+    /// </summary>
+    /// <param name="address"></param>
+    /// <param name="loop">Filled with the loop bounds</param>
+    /// <returns></returns>
+    bool AnalyzeIdleLoop(uint16_t address, IdleLoop &loop);
 
-    void InstrNoImpl();
+#if defined(DEARNES_CPU_PROFILER)
+    /// <summary>
+    /// Add an executed instruction to the profiler counters
+    /// </summary>
+    /// <param name="address">Address of the instruction</param>
+    /// <param name="opCode"></param>
+    /// <param name="cycles">Cycles taken by the instruction</param>
+    void ProfileInstruction(uint16_t address, uint8_t opCode, uint8_t cycles);
+#endif
 
-    void InstrADC();
+    /// <summary>
+    /// Read the op code and operand bytes of the instruction pointed by the
+    /// program counter, through the decode cache. The program counter is not
+    /// modified.
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <param name="operand"></param>
+    void DecodeNextInstruction(uint8_t &opCode, uint16_t &operand);
 
-    void InstrAND();
+    /// <summary>
+    /// Decode the instruction pointed by the program counter, only if all its
+    /// bytes can be read without side effects.
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <param name="operand"></param>
+    /// <returns>False if reading the instruction could access a
+    /// device</returns>
+    bool PeekNextInstruction(uint8_t &opCode, uint16_t &operand);
 
-    void InstrASL();
+    /// <summary>
+    /// Returns true if executing the instruction, with the current state of
+    /// the registers and memory, cannot access a device.
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <param name="operand"></param>
+    /// <returns></returns>
+    bool IsIsolated(uint8_t opCode, uint16_t operand);
 
-    void InstrASL_AcummAddr();
+    /// <summary>
+    /// Execute the instruction pointed by the program counter together with
+    /// the next one, if they have a fused handler and the next one is cached
+    /// and cannot access a device. The second instruction is only executed if
+    /// it would start within the budget. A first instruction that could
+    /// access a device is only fused if it does not write to memory.
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <param name="operand">Operand bytes of the first instruction</param>
+    /// <param name="isIsolated">True if the first instruction cannot access
+    /// a device</param>
+    /// <param name="budget">Amount of CPU cycles left</param>
+    /// <param name="cycles">Cycles taken by the executed instructions</param>
+    /// <returns>False if nothing was executed</returns>
+    bool ExecuteFusedPair(uint8_t opCode, uint16_t operand, bool isIsolated,
+                          int64_t budget, uint8_t &cycles);
+
+    template <uint8_t First, uint8_t Second>
+    uint8_t ExecuteFusedInstructions(uint16_t firstOperand,
+                                     const DecodedInstruction &second,
+                                     int64_t budget);
 
-    void InstrExecuteBranch();
+    /// <summary>
+    /// Call the recompiled routine that starts at the program counter, if
+    /// there is one and all its instructions would start within the budget.
+    /// </summary>
+    /// <param name="budget">Amount of CPU cycles left</param>
+    /// <returns>Cycles taken by the routine, or 0 if it was not
+    /// called</returns>
+    int64_t RunRecompiledRoutine(int64_t budget);
 
-    void InstrBCC();
+    /// <summary>
+    /// Read the operand bytes of the instruction identified by the op code and
+    /// leave the program counter pointing to the next instruction.
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <returns>Operand bytes, low byte first</returns>
+    uint16_t ReadOperandFromProgramCounter(uint8_t opCode);
 
-    void InstrBCS();
+    /// <summary>
+    /// Return the decode cache entry for the instruction starting at the
+    /// address, or nullptr if the instruction cannot be cached. Only memory
+    /// that can be read without side effects is cached.
+    /// </summary>
+    /// <param name="address">Address of the op code</param>
+    /// <param name="length">Length of the instruction</param>
+    /// <returns></returns>
+    DecodedInstruction *GetDecodeCacheEntry(uint16_t address, uint8_t length);
 
-    void InstrBEQ();
+    /// <summary>
+    /// Invalidate the cached instructions that contain a written address of
+    /// CPU RAM
+    /// </summary>
+    /// <param name="address">Address written by the CPU</param>
+    void InvalidateDecodeCache(uint16_t address);
 
-    void InstrBIT();
+    /// <summary>
+    /// Run the fused handler for the op code. The program counter must be
+    /// already pointing to the next instruction.
+    /// </summary>
+    /// <param name="opCode"></param>
+    /// <param name="operand">Operand bytes of the instruction</param>
+    /// <returns>Cycles taken by the instruction</returns>
+    uint8_t ExecuteInstruction(uint8_t opCode, uint16_t operand);
 
-    void InstrBMI();
+    template <uint8_t OpCode>
+    uint8_t ExecuteInstruction(uint16_t operand);
 
-    void InstrBNE();
+    template <AddressingMode Mode>
+    uint16_t ResolveAddress(uint16_t operand, bool &pageCrossed);
 
-    void InstrBPL();
+    template <AddressingMode Mode>
+    uint8_t Fetch(uint16_t address);
 
-    void InstrBRK();
+    template <Operation Op, AddressingMode Mode>
+    uint8_t ExecuteOperation(uint16_t address);
 
-    void InstrBVC();
+   private:
+    void InstrADC(uint8_t value);
 
-    void InstrBVS();
+    void InstrAND(uint8_t value);
 
-    void InstrCLC();
+    uint8_t InstrASL(uint8_t value);
 
-    void InstrCLD();
+    uint8_t InstrExecuteBranch(bool condition, uint16_t addressRelative);
 
-    void InstrCLI();
+    void InstrBIT(uint8_t value);
 
-    void InstrCLV();
+    void InstrBRK();
 
-    void InstrCMP();
+    void InstrCMP(uint8_t value);
 
-    void InstrCPX();
+    void InstrCPX(uint8_t value);
 
-    void InstrCPY();
+    void InstrCPY(uint8_t value);
 
-    void InstrDEC();
+    uint8_t InstrDEC(uint8_t value);
 
     void InstrDEX();
 
     void InstrDEY();
 
-    void InstrEOR();
+    void InstrEOR(uint8_t value);
 
-    void InstrINC();
+    uint8_t InstrINC(uint8_t value);
 
     void InstrINX();
 
     void InstrINY();
 
-    void InstrJMP();
+    void InstrJSR(uint16_t address);
 
-    void InstrJSR();
+    void InstrLDA(uint8_t value);
 
-    void InstrLDA();
+    void InstrLDX(uint8_t value);
 
-    void InstrLDX();
+    void InstrLDY(uint8_t value);
 
-    void InstrLDY();
+    uint8_t InstrLSR(uint8_t value);
 
-    void InstrLSR();
-
-    void InstrLSR_AcummAddr();
-
-    void InstrNOP();
-
-    void InstrORA();
+    void InstrORA(uint8_t value);
 
     void InstrPHA();
 
@@ -296,31 +1014,15 @@ class Cpu {
 
     void InstrPLP();
 
-    void InstrROL();
-
-    void InstrROL_AcummAddr();
+    uint8_t InstrROL(uint8_t value);
 
-    void InstrROR();
-
-    void InstrROR_AcummAddr();
+    uint8_t InstrROR(uint8_t value);
 
     void InstrRTI();
 
     void InstrRTS();
 
-    void InstrSBC();
-
-    void InstrSEC();
-
-    void InstrSED();
-
-    void InstrSEI();
-
-    void InstrSTA();
-
-    void InstrSTX();
-
-    void InstrSTY();
+    void InstrSBC(uint8_t value);
 
     void InstrTAX();
 
@@ -330,8 +1032,6 @@ class Cpu {
 
     void InstrTXA();
 
-    void InstrTXS();
-
     void InstrTYA();
 };
 
@@ -0,0 +1,131 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+namespace dearnes {
+
+// Forward declaration
+class Cpu;
+
+/// <summary>
+/// Translator of 6502 basic blocks to native x86-64 code, used by
+/// Cpu::RunAhead() when enabled with Cpu::SetJitEnabled().
+///
+/// A block is a run of straight-line instructions. It ends after a branch,
+/// JMP, JSR, RTS, RTI or BRK, or before an instruction that could access a
+/// device or that is not implemented. These are left to the interpreter, so
+/// the timing of the PPU and the DMA is not affected. Only code in cartridge
+/// ROM is translated, code in CPU RAM is always interpreted.
+///
+/// Register transfers, increments, flag changes and immediate loads become
+/// native code. The rest of the instructions become a call to the fused
+/// handler of their op code. Cycles are accounted once per block. The
+/// translated blocks are discarded whenever the CPU flushes its decode cache,
+/// which happens when the mapper switches banks or the cartridge ROM changes,
+/// see Cpu::InvalidateCode().
+///
+/// The memory of the native code is never writable and executable at the
+/// same time. The pages of each block are made executable once the block is
+/// copied into them.
+///
+/// On other architectures IsAvailable() returns false and the CPU keeps using
+/// the interpreter.
+/// </summary>
+class CpuJit {
+   public:
+    /// <summary>
+    /// Counters of the translator
+    /// </summary>
+    struct Statistics {
+        /// Blocks translated to native code
+        uint64_t blocksTranslated = 0;
+
+        /// Times a translated block was executed
+        uint64_t blocksExecuted = 0;
+
+        /// Instructions executed by translated blocks
+        uint64_t instructionsExecuted = 0;
+
+        /// Times all the translated blocks were discarded
+        uint64_t flushes = 0;
+    };
+
+    explicit CpuJit(Cpu &cpu);
+    ~CpuJit();
+
+    CpuJit(const CpuJit &) = delete;
+    CpuJit &operator=(const CpuJit &) = delete;
+
+    /// <summary>
+    /// Returns true if native code can be generated and executed on this
+    /// platform
+    /// </summary>
+    /// <returns></returns>
+    bool IsAvailable() const;
+
+    /// <summary>
+    /// Execute the block that starts at the program counter, translating it
+    /// first if needed. The block is only executed if all its instructions
+    /// would start within the budget.
+    /// </summary>
+    /// <param name="budget">Amount of CPU cycles left</param>
+    /// <returns>Cycles taken by the block, or 0 if it was not
+    /// executed</returns>
+    int64_t RunBlock(int64_t budget);
+
+    /// <summary>
+    /// Get the counters accumulated since the translator was created
+    /// </summary>
+    /// <returns></returns>
+    inline const Statistics &GetStatistics() const { return m_Statistics; }
+
+   private:
+    using BlockFunction = uint32_t (*)(Cpu *cpu);
+
+    struct Block {
+        BlockFunction function = nullptr;
+
+        // Worst case of the cycles taken by the instructions before the last
+        // one. The block fits in a budget bigger than this
+        uint32_t cyclesBeforeLastInstruction = 0;
+
+        uint32_t instructions = 0;
+    };
+
+    const Block *FindBlock(uint16_t address);
+
+    bool TranslateBlock(uint16_t address, Block &block);
+
+    void Flush();
+
+    Cpu &m_Cpu;
+
+    uint8_t *m_Code = nullptr;
+    size_t m_CodeUsed = 0;
+
+    // Index of the block starting at each cartridge ROM address
+    std::vector<int32_t> m_BlockIndices;
+    std::vector<Block> m_Blocks;
+
+    // Decode cache generation the blocks were translated for
+    uint32_t m_Generation = 0;
+
+    Statistics m_Statistics;
+
+    // Position of the CPU members, relative to the CPU object
+    int32_t m_RegisterAOffset = 0;
+    int32_t m_RegisterXOffset = 0;
+    int32_t m_RegisterYOffset = 0;
+    int32_t m_StackPointerOffset = 0;
+    int32_t m_StatusRegisterOffset = 0;
+    int32_t m_NegativeResultOffset = 0;
+    int32_t m_ZeroResultOffset = 0;
+    int32_t m_CarryResultOffset = 0;
+    int32_t m_OverflowResultOffset = 0;
+    int32_t m_ProgramCounterOffset = 0;
+    int32_t m_OpCodeOffset = 0;
+};
+
+}  // namespace dearnes
@@ -0,0 +1,74 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <array>
+#include <cinttypes>
+#include <ostream>
+#include <vector>
+
+namespace dearnes {
+
+/// <summary>
+/// Snapshot of the counters of the CPU profiler, see
+/// Cpu::SetProfilerEnabled(). It tells which op codes and addressing modes
+/// take the execution time of a program, and which of its addresses are hot.
+/// </summary>
+struct CpuProfile {
+    /// <summary>
+    /// Counters of a single op code
+    /// </summary>
+    struct OpCodeCounters {
+        /// Times the op code was executed
+        uint64_t executions = 0;
+
+        /// CPU cycles taken by those executions, penalties included
+        uint64_t cycles = 0;
+
+        /// Executions that paid a cycle for crossing a page, either with the
+        /// indexed operand or with the target of a branch
+        uint64_t pageCrossings = 0;
+
+        /// Executions of a branch that was taken
+        uint64_t branchesTaken = 0;
+    };
+
+    /// First address of the cartridge program memory
+    static constexpr uint16_t kProgramStart = 0x8000;
+
+    /// The address of the instruction being executed is sampled once every
+    /// this many CPU cycles
+    static constexpr uint32_t kSamplingPeriod = 64;
+
+    /// Counters indexed by op code
+    std::array<OpCodeCounters, 0x100> opCodes = {};
+
+    /// Samples taken at each address of the cartridge program memory,
+    /// kProgramStart -> 0xFFFF. Empty if the profiler was never enabled.
+    std::vector<uint64_t> programSamples;
+
+    /// Samples taken while running code outside of the program memory, e.g.
+    /// from CPU RAM
+    uint64_t otherSamples = 0;
+
+    /// <summary>
+    /// Write the counters of the executed op codes as CSV, one op code per
+    /// row, with a header row
+    /// </summary>
+    /// <param name="stream"></param>
+    void WriteOpCodesCsv(std::ostream& stream) const;
+
+    /// <summary>
+    /// Write the sampled addresses of the program memory as CSV, one address
+    /// per row, with a header row. Addresses without samples are left out.
+    /// </summary>
+    /// <param name="stream"></param>
+    void WriteSamplesCsv(std::ostream& stream) const;
+
+    /// <summary>
+    /// Write the whole snapshot as a JSON object, with the same content as
+    /// the CSV tables
+    /// </summary>
+    /// <param name="stream"></param>
+    void WriteJson(std::ostream& stream) const;
+};
+
+}  // namespace dearnes
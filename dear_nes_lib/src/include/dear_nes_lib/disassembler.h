@@ -0,0 +1,35 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <cinttypes>
+#include <string>
+
+namespace dearnes {
+
+/// <summary>
+/// Format a value in upper case hexadecimal, padded with zeros
+/// </summary>
+/// <param name="value"></param>
+/// <param name="digits">Minimum amount of digits</param>
+/// <returns></returns>
+std::string FormatHex(uint32_t value, int digits);
+
+/// <summary>
+/// Format the bytes of an instruction, op code first, e.g. "BD 00 02". Only
+/// the operand bytes the instruction takes are written.
+/// </summary>
+/// <param name="opCode"></param>
+/// <param name="operand">Bytes that follow the op code, low byte first</param>
+/// <returns></returns>
+std::string FormatInstructionBytes(uint8_t opCode, uint16_t operand);
+
+/// <summary>
+/// Disassemble an instruction with the syntax of the nestest log, e.g.
+/// "LDA $0200,X". Branches show the address they jump to.
+/// </summary>
+/// <param name="address">Address of the op code</param>
+/// <param name="opCode"></param>
+/// <param name="operand">Bytes that follow the op code, low byte first</param>
+/// <returns></returns>
+std::string Disassemble(uint16_t address, uint8_t opCode, uint16_t operand);
+
+}  // namespace dearnes
@@ -6,6 +6,7 @@
 namespace dearnes {
 
 class Bus;
+class Ppu;
 
 
 /// <summary>
@@ -56,6 +57,15 @@ class Dma {
     /// <returns></returns>
     std::pair<uint8_t, uint8_t> GetLastReadData();
 
+    /// <summary>
+    /// Copy the whole page to the OAM at once and terminate the transfer.
+    /// The emulator uses it instead of ReadData() and GetLastReadData() when
+    /// nothing can observe the transfer in progress: reading the page has no
+    /// side effects and the PPU does not read the OAM until it is completed.
+    /// </summary>
+    /// <param name="ppu">PPU that owns the OAM</param>
+    void TransferPage(Ppu *ppu);
+
     /// <summary>
     /// Reset the DMA registers.
     /// </summary>
@@ -73,6 +83,12 @@ class Dma {
     /// <returns></returns>
     inline bool IsInWaitState() const { return m_DmaWait; }
 
+    /// <summary>
+    /// Returns the page the transfer copies, the high byte of its addresses
+    /// </summary>
+    /// <returns></returns>
+    inline uint8_t GetPage() const { return m_DmaPage; }
+
    private:
     Bus *m_Bus = nullptr;
     uint8_t m_DmaPage = 0x00;
@@ -0,0 +1,86 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "dear_nes_lib/kernel_dispatch.h"
+
+namespace dearnes {
+
+/// <summary>
+/// Formats of the pixels of a converted screen
+/// </summary>
+enum class PixelFormat {
+    /// 4 bytes: red, green, blue and alpha, in this order in memory
+    kRgba8888,
+    /// 4 bytes: blue, green, red and alpha, in this order in memory. It is
+    /// the format ARGB of a 32-bit word on little-endian processors
+    kBgra8888,
+    /// A 16-bit word in the byte order of the processor: 5 bits of red in the
+    /// highest bits, 6 of green and 5 of blue
+    kRgb565,
+    /// A 16-bit word in the byte order of the processor: 5 bits of red, green
+    /// and blue, and the highest bit clear
+    kRgb555,
+    /// 1 byte: the index of the color in the system palette, 0 to 63
+    kIndexed8,
+    /// 1 byte: the luma of the color
+    kGray8,
+    kPixelFormatSize
+};
+
+/// <summary>
+/// Conversion of the color indices the PPU writes, 0 to 63, to the colors of
+/// a system palette, in any of the pixel formats. It has a scalar kernel,
+/// and SSSE3 and AVX2 kernels on x86-64 that convert 16 and 32 pixels at
+/// once.
+///
+/// The vector kernels keep every byte of the pixels as a table of 64 bytes,
+/// and look up each of its four 16-byte quarters with a byte shuffle.
+/// </summary>
+class FrameConverter : public KernelDispatch<SimdKernel::kScalar,
+                                             SimdKernel::kSsse3,
+                                             SimdKernel::kAvx2> {
+   public:
+    /// Amount of colors of the system palette
+    static constexpr size_t kColors = 64;
+
+    /// <summary>
+    /// Create a converter with the fastest kernel available
+    /// </summary>
+    /// <param name="colors">The 64 colors of the system palette, in format
+    /// ARGB</param>
+    explicit FrameConverter(const uint32_t* colors);
+
+    /// <summary>
+    /// Returns the size of the pixels of a format
+    /// </summary>
+    /// <param name="format"></param>
+    /// <returns>1, 2 or 4 bytes</returns>
+    static size_t GetBytesPerPixel(PixelFormat format);
+
+    /// <summary>
+    /// Convert color indices to pixels
+    /// </summary>
+    /// <param name="indices">Color indices. The bits 6 and 7 are
+    /// ignored</param>
+    /// <param name="count">Amount of pixels</param>
+    /// <param name="format">Format of the result</param>
+    /// <param name="pixels">Pixels of the result, with no alignment
+    /// requirement</param>
+    void Convert(const uint8_t* indices, size_t count, PixelFormat format,
+                 void* pixels) const;
+
+    /// The pixels of the 64 colors in one format
+    struct FormatTable {
+        /// Bytes of the pixel of every color, in memory order
+        uint8_t pixels[kColors][4];
+        /// Byte n of the pixel of every color, for the vector kernels
+        alignas(16) uint8_t bytes[4][kColors];
+    };
+
+   private:
+    FormatTable m_Tables[static_cast<size_t>(PixelFormat::kPixelFormatSize)];
+};
+
+}  // namespace dearnes
@@ -0,0 +1,56 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+
+// The SIMD kernels of the library are written for x86-64, and the rest of
+// the processors use their scalar versions
+#if defined(__x86_64__) || defined(_M_X64)
+#define DEARNES_HOST_X64
+#endif
+
+// Kernels for extensions beyond SSE2 are compiled for their extension alone,
+// and only called after checking that the processor has it. MSVC needs no
+// attribute to use their intrinsics
+#if defined(DEARNES_HOST_X64) && defined(__GNUC__)
+#define DEARNES_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define DEARNES_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DEARNES_TARGET_SSSE3
+#define DEARNES_TARGET_AVX2
+#endif
+
+namespace dearnes {
+
+/// <summary>
+/// Instruction sets the kernels of the library are written for
+/// </summary>
+enum class SimdKernel { kScalar, kSse2, kSsse3, kAvx2 };
+
+/// <summary>
+/// Returns true if the processor running the emulator has SSSE3
+/// </summary>
+/// <returns></returns>
+bool HostSupportsSsse3();
+
+/// <summary>
+/// Returns true if the processor running the emulator has AVX2, and the
+/// operating system saves its registers
+/// </summary>
+/// <returns></returns>
+bool HostSupportsAvx2();
+
+/// <summary>
+/// Returns true if the processor running the emulator can run kernels
+/// written for the instruction set
+/// </summary>
+/// <param name="kernel"></param>
+/// <returns></returns>
+bool HostSupportsKernel(SimdKernel kernel);
+
+/// <summary>
+/// Returns the name of the instruction set of a kernel, for logs
+/// </summary>
+/// <param name="kernel"></param>
+/// <returns></returns>
+const char* GetSimdKernelName(SimdKernel kernel);
+
+}  // namespace dearnes
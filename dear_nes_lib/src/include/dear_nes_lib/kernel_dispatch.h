@@ -0,0 +1,75 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+
+#include "dear_nes_lib/host_features.h"
+
+namespace dearnes {
+
+/// <summary>
+/// Choice among the kernels of a class that has a scalar kernel and SIMD
+/// ones, listed in kKernels from the slowest to the fastest. The fastest one
+/// that can run on this processor is chosen at run time. Any other available
+/// kernel can be chosen instead, to compare them, since all the kernels of a
+/// class must give the same result.
+/// </summary>
+/// <typeparam name="kKernels">Kernels of the class, the scalar one
+/// first</typeparam>
+template <SimdKernel... kKernels>
+class KernelDispatch {
+   public:
+    using Kernel = SimdKernel;
+
+    /// <summary>
+    /// Returns true if the class has the kernel, and it can run on this
+    /// processor
+    /// </summary>
+    /// <param name="kernel"></param>
+    /// <returns></returns>
+    static bool IsKernelAvailable(Kernel kernel) {
+        return ((kernel == kKernels) || ...) && HostSupportsKernel(kernel);
+    }
+
+    /// <summary>
+    /// Returns the fastest kernel that can run on this processor
+    /// </summary>
+    /// <returns></returns>
+    static Kernel GetBestKernel() {
+        Kernel best = Kernel::kScalar;
+        ((best = HostSupportsKernel(kKernels) ? kKernels : best), ...);
+        return best;
+    }
+
+    /// <summary>
+    /// Returns the name of a kernel, for logs
+    /// </summary>
+    /// <param name="kernel"></param>
+    /// <returns></returns>
+    static const char* GetKernelName(Kernel kernel) {
+        return GetSimdKernelName(kernel);
+    }
+
+    /// <summary>
+    /// Choose the kernel
+    /// </summary>
+    /// <param name="kernel"></param>
+    /// <returns>False if it is not available, and the kernel is not
+    /// changed</returns>
+    bool SetKernel(Kernel kernel) {
+        if (!IsKernelAvailable(kernel)) {
+            return false;
+        }
+        m_Kernel = kernel;
+        return true;
+    }
+
+    /// <summary>
+    /// Returns the kernel in use
+    /// </summary>
+    /// <returns></returns>
+    inline Kernel GetKernel() const { return m_Kernel; }
+
+   private:
+    Kernel m_Kernel = GetBestKernel();
+};
+
+}  // namespace dearnes
@@ -3,12 +3,58 @@
 #include <cstdint>
 #include <memory>
 
+#include "dear_nes_lib/cartridge_header.h"
+
 namespace dearnes {
 
+// Forward declaration
+class Bus;
+
 /// <summary>
-/// Interface class for iNES mapper implementation. Each implementation will define
-/// the memory address that belongs to it. This class might be reworked in the future
-/// to avoid having virtual functions.
+/// Base class for iNES mapper implementation. Each implementation will define
+/// the memory address that belongs to it. The interface is bound at compile
+/// time, without virtual functions: the cartridge holds its mapper in a
+/// MapperVariant, so the address translation can be inlined in the hot
+/// paths. An implementation derives from this class, provides the functions
+/// below and is added to MapperVariant.
+///
+/// bool CpuMapRead(uint16_t addr, uint32_t &mappedAddr):
+/// Handle CPU read request, if the address to read belongs to the mapper
+/// domain, save the program memory address in the output param and return
+/// true, otherwise return false.
+///
+/// bool CpuMapWrite(uint16_t addr, uint32_t &mappedAddr):
+/// Handle CPU write request, if the address to write belongs to the mapper
+/// domain, save the program memory address in the output param and return
+/// true, otherwise return false.
+///
+/// bool PpuMapRead(uint16_t addr, uint32_t &mappedAddr):
+/// Same as CpuMapRead() for the PPU and the character memory. Only the
+/// addresses of the pattern tables, $0000 to $1FFF, are requested: the PPU
+/// maps the nametables itself, following OnMirroringChanged().
+///
+/// bool PpuMapWrite(uint16_t addr, uint32_t &mappedAddr):
+/// Same as CpuMapWrite() for the PPU and the character memory.
+///
+/// The bus keeps a memory map of the CPU address space built from
+/// CpuMapRead() and CpuMapWrite(). Implementations that switch banks must call
+/// OnCpuBanksSwitched() afterwards, so that the map is rebuilt. Likewise,
+/// the PPU keeps the tiles of the pattern tables decoded, and implementations
+/// that switch character memory banks must call OnPpuBanksSwitched().
+/// Implementations that switch the nametable mirroring must call
+/// OnMirroringChanged(), so that the PPU maps its nametables again.
+/// PpuMapRead() must not have side effects, since the PPU reads whole tiles
+/// at once to decode them.
+///
+/// The PPU lags behind the CPU, and must be brought up to date before the
+/// banks or the mirroring it reads change. The bus does it before it forwards
+/// any CPU write to the cartridge, and before it applies OnMirroringChanged().
+/// Implementations must only switch character memory banks from
+/// CpuMapWrite().
+///
+/// Mappers that raise IRQs schedule SchedulerEvent::kMapperIrq with the
+/// scheduler of the bus, which asserts the IRQ line when it is due. They
+/// release it with Scheduler::SetIrqLine() once the IRQ is acknowledged.
 /// </summary>
 class IMapper {
    public:
@@ -20,46 +66,42 @@ class IMapper {
     /// <param name="chrBanks"></param>
     IMapper(uint8_t prgBanks, uint8_t chrBanks);
 
-    virtual ~IMapper() = default;
+    /// <summary>
+    /// Set the bus that is notified of bank switches
+    /// </summary>
+    /// <param name="bus"></param>
+    void SetBus(Bus *bus);
 
+   protected:
     /// <summary>
-    /// Handle CPU read request, if the address to read belongs to the mapper domain,
-    /// save the value in the input param and return true, otherwise return false.
+    /// Rebuild the CPU memory map of the bus for the address range, after the
+    /// banks mapped to it changed.
     /// </summary>
-    /// <param name="addr"></param>
-    /// <param name="mappedAddr"></param>
-    /// <returns></returns>
-    virtual bool CpuMapRead(uint16_t addr, uint32_t &mappedAddr) = 0;
+    /// <param name="firstAddress"></param>
+    /// <param name="lastAddress"></param>
+    void OnCpuBanksSwitched(uint16_t firstAddress, uint16_t lastAddress);
 
     /// <summary>
-    /// Handle CPU write request, if the address to read belongs to the mapper
-    /// domain, write the data and return true, otherwise return false.
+    /// Drop the decoded tiles of the PPU for the pattern table address range,
+    /// after the banks mapped to it changed.
     /// </summary>
-    /// <param name="addr"></param>
-    /// <param name="mappedAddr"></param>
-    /// <returns></returns>
-    virtual bool CpuMapWrite(uint16_t addr, uint32_t &mappedAddr) = 0;
+    /// <param name="firstAddress"></param>
+    /// <param name="lastAddress"></param>
+    void OnPpuBanksSwitched(uint16_t firstAddress, uint16_t lastAddress);
 
     /// <summary>
-    /// Handle PPU read request, if the address to read belongs to the mapper
-    /// domain, save the value in the input param and return true, otherwise
-    /// return false.
+    /// Map the nametables of the PPU with the mirroring mode the mapper
+    /// switched to. The bus brings the PPU up to date first, so the cycles it
+    /// deferred still read the nametables of the old mode.
     /// </summary>
-    /// <param name="addr"></param>
-    /// <param name="mappedAddr"></param>
-    /// <returns></returns>
-    virtual bool PpuMapRead(uint16_t addr, uint32_t &mappedAddr) = 0;
+    /// <param name="mode"></param>
+    void OnMirroringChanged(CartridgeHeader::MIRRORING_MODE mode);
 
     /// <summary>
-    /// Handle PPU write request, if the address to read belongs to the mapper
-    /// domain, write the data and return true, otherwise return false.
+    /// Bus connected to the cartridge, or nullptr
     /// </summary>
-    /// <param name="addr"></param>
-    /// <param name="mappedAddr"></param>
-    /// <returns></returns>
-    virtual bool PpuMapWrite(uint16_t addr, uint32_t &mappedAddr) = 0;
+    Bus *m_Bus = nullptr;
 
-   protected:
     /// <summary>
     /// Number of program memory banks
     /// </summary>
@@ -22,9 +22,34 @@ class Mapper_000 : public IMapper {
     /// <param name="chrBanks"></param>
     Mapper_000(uint8_t prgBanks, uint8_t chrBanks);
 
-    bool CpuMapRead(uint16_t addr, uint32_t &mappedAddr) override;
-    bool CpuMapWrite(uint16_t addr, uint32_t &mappedAddr) override;
-    bool PpuMapRead(uint16_t addr, uint32_t &mappedAddr) override;
-    bool PpuMapWrite(uint16_t addr, uint32_t &mappedAddr) override;
+    inline bool CpuMapRead(uint16_t addr, uint32_t &mappedAddr) const {
+        if (addr >= 0x8000) {
+            mappedAddr = addr & (m_PrgBanks > 1 ? 0x7FFF : 0x3FFF);
+            return true;
+        }
+        return false;
+    }
+
+    inline bool CpuMapWrite(uint16_t addr, uint32_t &mappedAddr) const {
+        if (addr >= 0x8000) {
+            mappedAddr = addr & (m_PrgBanks > 1 ? 0x7FFF : 0x3FFF);
+            return true;
+        }
+        return false;
+    }
+
+    inline bool PpuMapRead(uint16_t addr, uint32_t &mappedAddr) const {
+        if (addr <= 0x1FFF) {
+            mappedAddr = addr;
+            return true;
+        }
+        return false;
+    }
+
+    inline bool PpuMapWrite(uint16_t /*addr*/,
+                            uint32_t & /*mappedAddr*/) const {
+        // no writing in ROM
+        return false;
+    }
 };
 }  // namespace dearnes
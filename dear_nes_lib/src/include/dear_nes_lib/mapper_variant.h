@@ -0,0 +1,17 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <variant>
+
+#include "dear_nes_lib/mapper_000.h"
+
+namespace dearnes {
+
+/// <summary>
+/// Every mapper implemented by the emulator. CartridgeLoader picks the
+/// alternative once, when the cartridge is loaded, and the cartridge
+/// dispatches to it with std::visit, which lets the compiler inline the
+/// address translation.
+/// </summary>
+using MapperVariant = std::variant<Mapper_000>;
+
+}  // namespace dearnes
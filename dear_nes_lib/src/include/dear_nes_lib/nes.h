@@ -2,28 +2,53 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <vector>
 
 #include "dear_nes_lib/bus.h"
 #include "dear_nes_lib/cpu.h"
 #include "dear_nes_lib/dma.h"
+#include "dear_nes_lib/nes_policy.h"
+#include "dear_nes_lib/nes_state.h"
 #include "dear_nes_lib/ppu.h"
+#include "dear_nes_lib/scheduler.h"
+#include "dear_nes_lib/trace_recorder.h"
 
 namespace dearnes {
 
 // Forward declarations
 class Cartridge;
+struct RecompiledProgram;
+
+/// <summary>
+/// The console. The policy chooses its features at compile time, see
+/// nes_policy.h. Nes is the console with the StandardPolicy.
+/// </summary>
+/// <typeparam name="Policy"></typeparam>
+template <typename Policy>
+class BasicNes {
+    static_assert(!Policy::kInstructionHook ||
+                      Policy::kCpuStepping == CpuStepping::kCycle,
+                  "The instruction hook needs the CPU stepped by cycle");
+    static_assert(!Policy::kTraceRecording ||
+                      Policy::kCpuStepping == CpuStepping::kCycle,
+                  "The trace recording needs the CPU stepped by cycle");
 
-class Nes {
    public:
+    /// <summary>
+    /// Called before every CPU instruction, see SetInstructionHook()
+    /// </summary>
+    using InstructionHook = std::function<void(const Cpu&)>;
+
     /// <summary>
     /// Constructs a new NES instance
     /// </summary>
-    Nes();
+    BasicNes();
 
     /// <summary>
     /// Default destructor
     /// </summary>
-    ~Nes();
+    ~BasicNes();
 
     /// <summary>
     /// Returns a global counter of ticks since creation
@@ -45,7 +70,8 @@ class Nes {
 
     /// <summary>
     /// Run a single NES tick. The PPU will always tick. Every three ticks,
-    /// the CPU will tick, unless there is a DMA transfer in progress.
+    /// the CPU will tick, unless there is a DMA transfer in progress. The
+    /// events of the scheduler due on the tick are handled after it.
     /// </summary>
     void Clock();
 
@@ -54,6 +80,21 @@ class Nes {
     /// </summary>
     void DoFrame();
 
+    /// <summary>
+    /// Run the emulator for the given amount of ticks. The result is the same
+    /// as calling Clock() that many times. Unless the policy steps the CPU by
+    /// cycle, the CPU executes whole instructions instead of being ticked on
+    /// every third tick.
+    /// </summary>
+    /// <param name="cycles">Amount of master clock ticks to run</param>
+    void RunCycles(uint64_t cycles);
+
+    /// <summary>
+    /// Run the emulator until a frame is completed. The result is the same as
+    /// calling DoFrame(), using the same driver as RunCycles().
+    /// </summary>
+    void RunFrame();
+
     /// <summary>
     /// Verify that a cartridge has been fully loaded. This will be rework into
     /// a better pattern.
@@ -61,6 +102,67 @@ class Nes {
     /// <returns></returns>
     bool IsCartridgeLoaded() const;
 
+    /// <summary>
+    /// Install a program recompiled ahead of time from the inserted
+    /// cartridge, or remove it with nullptr. See Cpu::SetRecompiledProgram().
+    /// Inserting a new cartridge removes it.
+    /// </summary>
+    /// <param name="program"></param>
+    /// <returns>False if the program was not generated from the program
+    /// memory of the inserted cartridge. The program is not installed in that
+    /// case</returns>
+    bool SetRecompiledProgram(const RecompiledProgram* program);
+
+    /// <summary>
+    /// Install the function called with the CPU before it executes each
+    /// instruction or services an interrupt request, or remove it with an
+    /// empty function. It is only called if the policy enables
+    /// kInstructionHook.
+    /// </summary>
+    /// <param name="hook"></param>
+    void SetInstructionHook(InstructionHook hook);
+
+    /// <summary>
+    /// Install the recorder that gets the state of the console before every
+    /// CPU instruction, or remove it with nullptr. It is only used if the
+    /// policy enables kTraceRecording. The recorder must outlive the console
+    /// or be removed first.
+    /// </summary>
+    /// <param name="recorder"></param>
+    void SetTraceRecorder(TraceRecorder* recorder);
+
+    /// <summary>
+    /// Never skip the idle loop that starts at the address while running the
+    /// program with the checksum, for the loops the detection gets wrong. It
+    /// assumes the loops only read memory that does not change on its own,
+    /// which a mapper could break. See Cpu::SetIdleLoopDetectionEnabled().
+    /// </summary>
+    /// <param name="programMemoryChecksum">Result of
+    /// Cartridge::GetProgramMemoryChecksum() for the program</param>
+    /// <param name="loopAddress">Address of the first instruction of the
+    /// loop</param>
+    void AddIdleLoopOverride(uint32_t programMemoryChecksum,
+                             uint16_t loopAddress);
+
+    /// <summary>
+    /// Give the CPU more cycles per frame, for the games that slow down when
+    /// their logic does not fit in a frame. The vertical blank is extended
+    /// with idle scan lines, from the next frame on. See
+    /// Ppu::SetExtraScanLines().
+    /// </summary>
+    /// <param name="scanLines">Amount of extra scan lines, 0 to run at the
+    /// normal speed</param>
+    void SetExtraScanLines(uint16_t scanLines);
+
+    /// <summary>
+    /// Capture the observable state of the console, to compare it with the
+    /// state of another one. The deferred PPU cycles are executed first.
+    /// </summary>
+    /// <param name="includeOutputScreen">False to skip hashing the output
+    /// screen, which is the slowest part</param>
+    /// <returns></returns>
+    NesState CaptureState(bool includeOutputScreen = true);
+
     /// <summary>
     /// Get the register for a particular virtual controller.
     /// The virtual controller #1 is identified by index 0
@@ -110,6 +212,32 @@ class Nes {
     inline Cpu* GetCpu() { return &m_Cpu; }
 
    private:
+    void Run(uint64_t endTick, bool stopAtFrameCompleted);
+
+    // Complete the pending DMA transfer in one go, if nothing can observe it
+    // in progress and it ends before endTick. Returns false otherwise
+    bool RunDmaTransfer(uint64_t endTick);
+
+    // Handle the events due on the tick or before
+    void DispatchEvents(uint64_t tick);
+
+    // Tell the CPU the window around the tick in which the PPU status register
+    // keeps its value, for the idle loops that poll it
+    void SetPpuStatusWindow(uint64_t tick);
+
+    // Pass the idle loop overrides of the inserted cartridge to the CPU
+    void ApplyIdleLoopOverrides();
+
+    void FinishFrame();
+
+    // Tick the CPU, calling the instruction hook and the trace recorder first
+    // if it starts one
+    void ClockCpu();
+
+    // Add the state of the console to the trace recorder
+    void RecordTrace();
+
+    Scheduler m_Scheduler;
     Bus m_Bus;
     Dma m_Dma;
     Ppu m_Ppu;
@@ -117,8 +245,43 @@ class Nes {
 
     Cartridge* m_Cartridge = nullptr;
 
+    struct IdleLoopOverride {
+        uint32_t programMemoryChecksum;
+        uint16_t loopAddress;
+    };
+    std::vector<IdleLoopOverride> m_IdleLoopOverrides;
+
+    InstructionHook m_InstructionHook;
+
+    TraceRecorder* m_TraceRecorder = nullptr;
+
     bool m_IsCartridgeLoaded = false;
 
-    uint32_t m_SystemClockCounter = 0;
+    uint64_t m_SystemClockCounter = 0;
 };
+
+extern template class BasicNes<AccuratePolicy>;
+extern template class BasicNes<StandardPolicy>;
+extern template class BasicNes<HeadlessPolicy>;
+extern template class BasicNes<DotRenderingPolicy>;
+
+/// <summary>
+/// The console with the StandardPolicy. It is a class, not an alias, so that
+/// it can still be forward declared.
+///
+/// Clock() and DoFrame() work as they always did: the CPU is ticked on every
+/// third tick and the PPU on every tick. RunCycles() and RunFrame() execute
+/// whole CPU instructions and render whole scan lines instead, with the same
+/// result. The instruction hook and the trace recorder are left out; a
+/// BasicNes with the AccuratePolicy has them.
+///
+/// The policy only parameterizes BasicNes. The Cpu and the Bus are the same
+/// for every policy, and the JIT, the instruction fusion, the idle loop
+/// skipping and the profiler are still enabled at run time on the Cpu.
+/// </summary>
+class Nes : public BasicNes<StandardPolicy> {
+   public:
+    using BasicNes<StandardPolicy>::BasicNes;
+};
+
 }  // namespace dearnes
\ No newline at end of file
@@ -0,0 +1,92 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+
+namespace dearnes {
+
+/// <summary>
+/// How BasicNes::RunFrame() and BasicNes::RunCycles() step the CPU
+/// </summary>
+enum class CpuStepping {
+    // Tick it on every third master clock tick, like BasicNes::Clock()
+    kCycle = 0,
+    // Execute whole instructions, and catch up the PPU only when needed
+    kInstruction
+};
+
+/// <summary>
+/// How the PPU executes the cycles it deferred
+/// </summary>
+enum class PpuRendering {
+    // Clock every cycle, like BasicNes::Clock()
+    kDot = 0,
+    // Compose whole visible scan lines at once, and skip the idle ones
+    kScanLine
+};
+
+/// <summary>
+/// Policies choose, at compile time, the features of a BasicNes. The code of
+/// the features a policy disables is not compiled in its instantiation. A
+/// policy is a type with these members:
+///
+/// kCpuStepping: the CpuStepping of RunFrame() and RunCycles().
+///
+/// kInstructionHook: true to call the hook installed with
+/// BasicNes::SetInstructionHook() before every CPU instruction. It requires
+/// the CPU to be stepped cycle by cycle.
+///
+/// kVideoOutput: true to write the output screen of the PPU.
+///
+/// kPpuRendering: the PpuRendering of the cycles the PPU deferred.
+///
+/// kTraceRecording: true to add a record to the TraceRecorder installed with
+/// BasicNes::SetTraceRecorder() before every CPU instruction. It requires the
+/// CPU to be stepped cycle by cycle.
+///
+/// The library is built with the policies below. Other policies need the
+/// definitions of nes.cpp.
+/// </summary>
+struct AccuratePolicy {
+    static constexpr CpuStepping kCpuStepping = CpuStepping::kCycle;
+    static constexpr bool kInstructionHook = true;
+    static constexpr bool kVideoOutput = true;
+    static constexpr bool kTraceRecording = true;
+    static constexpr PpuRendering kPpuRendering = PpuRendering::kDot;
+};
+
+/// <summary>
+/// Policy of the Nes type: the CPU executes whole instructions, and the video
+/// is produced
+/// </summary>
+struct StandardPolicy {
+    static constexpr CpuStepping kCpuStepping = CpuStepping::kInstruction;
+    static constexpr bool kInstructionHook = false;
+    static constexpr bool kVideoOutput = true;
+    static constexpr bool kTraceRecording = false;
+    static constexpr PpuRendering kPpuRendering = PpuRendering::kScanLine;
+};
+
+/// <summary>
+/// Policy for simulations that do not show the video. The output screen is
+/// never written
+/// </summary>
+struct HeadlessPolicy {
+    static constexpr CpuStepping kCpuStepping = CpuStepping::kInstruction;
+    static constexpr bool kInstructionHook = false;
+    static constexpr bool kVideoOutput = false;
+    static constexpr bool kTraceRecording = false;
+    static constexpr PpuRendering kPpuRendering = PpuRendering::kScanLine;
+};
+
+/// <summary>
+/// Policy like the StandardPolicy, with the PPU clocked cycle by cycle. It
+/// checks the scan line renderer against the cycle one
+/// </summary>
+struct DotRenderingPolicy {
+    static constexpr CpuStepping kCpuStepping = CpuStepping::kInstruction;
+    static constexpr bool kInstructionHook = false;
+    static constexpr bool kVideoOutput = true;
+    static constexpr bool kTraceRecording = false;
+    static constexpr PpuRendering kPpuRendering = PpuRendering::kDot;
+};
+
+}  // namespace dearnes
@@ -0,0 +1,74 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <array>
+#include <cinttypes>
+#include <string>
+
+#include "dear_nes_lib/enums.h"
+
+namespace dearnes {
+
+/// <summary>
+/// Observable state of a console at a master clock tick, taken with
+/// BasicNes::CaptureState(). Two consoles that run the same program with the
+/// same inputs must have the same state on every tick, whatever their
+/// policies and optimizations are. The memories that are too big to copy on
+/// every comparison are kept as hashes.
+/// </summary>
+struct NesState {
+    uint64_t tick = 0;
+
+    // CPU
+    uint16_t programCounter = 0x0000;
+    uint8_t registerA = 0x00;
+    uint8_t registerX = 0x00;
+    uint8_t registerY = 0x00;
+    uint8_t stackPointer = 0x00;
+    uint8_t statusRegister = 0x00;
+
+    /// Cycles left of the instruction in progress
+    uint8_t remainingCycles = 0;
+
+    std::array<uint8_t, SIZE_CPU_RAM> cpuRam = {};
+
+    // PPU
+    int16_t scanLine = 0;
+    int16_t cycle = 0;
+    uint8_t ppuControl = 0x00;
+    uint8_t ppuMask = 0x00;
+    uint8_t ppuStatus = 0x00;
+    uint16_t vramAddress = 0x0000;
+
+    /// Hash of the object attribute memory
+    uint64_t objectAttributeHash = 0;
+
+    /// Hash of the output screen, 0 if it was not captured
+    uint64_t outputScreenHash = 0;
+};
+
+/// <summary>
+/// Compare two states
+/// </summary>
+/// <param name="expected"></param>
+/// <param name="actual"></param>
+/// <returns>Description of the first field that differs, e.g. "A: 3F !=
+/// 40", or an empty string if they are the same</returns>
+std::string FindStateDifference(const NesState& expected,
+                                const NesState& actual);
+
+/// <summary>
+/// Describe the registers of a state in a single line, for logs
+/// </summary>
+/// <param name="state"></param>
+/// <returns></returns>
+std::string FormatState(const NesState& state);
+
+/// <summary>
+/// FNV-1a hash of a block of memory, as used for the hashes of NesState
+/// </summary>
+/// <param name="data"></param>
+/// <param name="size">Amount of bytes</param>
+/// <returns></returns>
+uint64_t HashMemory(const void* data, size_t size);
+
+}  // namespace dearnes
@@ -0,0 +1,53 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "dear_nes_lib/kernel_dispatch.h"
+
+namespace dearnes {
+
+/// <summary>
+/// Composition of the background and sprite pixels of a scan line, with the
+/// priority rules of the PPU. It has a scalar kernel, and SSE2 and AVX2
+/// kernels on x86-64 that compose 16 and 32 pixels at once.
+///
+/// A background pixel is a byte with the color index, 0 to 3, in the bits 0
+/// and 1, and the palette, 0 to 3, in the bits 2 and 3. A sprite pixel has
+/// the same layout, with the sprite palette, plus the flags
+/// kSpriteBehindBackground and kSpriteZero. Transparent sprite pixels are 0.
+///
+/// The result of each pixel is its index in the 32 palette entries: the
+/// palette, 0 to 7, in the bits 2 to 4, and the color index in the bits 0 and
+/// 1. It is 0 when both pixels are transparent.
+/// </summary>
+class PixelCompositor : public KernelDispatch<SimdKernel::kScalar,
+                                              SimdKernel::kSse2,
+                                              SimdKernel::kAvx2> {
+   public:
+    /// The sprite goes behind opaque background pixels
+    static constexpr uint8_t kSpriteBehindBackground = 0x10;
+
+    /// The pixel comes from the sprite in the first slot of the scan line
+    static constexpr uint8_t kSpriteZero = 0x20;
+
+    /// Amount of pixels the pixel counts of Compose() are a multiple of
+    static constexpr size_t kPixelsPerBlock = 32;
+
+    /// <summary>
+    /// Compose pixels
+    /// </summary>
+    /// <param name="background">Background pixels</param>
+    /// <param name="sprites">Sprite pixels</param>
+    /// <param name="count">Amount of pixels, a multiple of
+    /// kPixelsPerBlock</param>
+    /// <param name="indices">Palette indices of the result</param>
+    /// <param name="spriteZeroHits">A bit for every pixel, the lowest bit of
+    /// the first word for the first pixel, set where the sprite zero hits an
+    /// opaque background pixel. A word for every 32 pixels</param>
+    void Compose(const uint8_t* background, const uint8_t* sprites,
+                 size_t count, uint8_t* indices,
+                 uint32_t* spriteZeroHits) const;
+};
+
+}  // namespace dearnes
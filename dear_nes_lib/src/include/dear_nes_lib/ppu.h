@@ -3,10 +3,17 @@
 #include <array>
 #include <cstdint>
 
+#include "dear_nes_lib/cartridge_header.h"
+#include "dear_nes_lib/frame_converter.h"
+#include "dear_nes_lib/nes_policy.h"
+#include "dear_nes_lib/pixel_compositor.h"
+#include "dear_nes_lib/tile_cache.h"
+
 namespace dearnes {
 
 // Forward declaration
 class Cartridge;
+class Scheduler;
 class Sprite;
 
 /// <summary>
@@ -145,7 +152,9 @@ class Ppu {
     /// range $2008-$3FFF.
     /// </summary>
     /// <param name="address"></param>
-    /// <param name="readOnly"></param>
+    /// <param name="readOnly">True to read without side effects: the
+    /// vertical blank flag, the address latch and the PPU address are left
+    /// as they are</param>
     /// <returns></returns>
     uint8_t CpuRead(uint16_t address, bool readOnly = false);
 
@@ -166,27 +175,59 @@ class Ppu {
     void ConnectCatridge(Cartridge* cartridge);
 
     /// <summary>
-    /// Perform a tick PPU routine.
+    /// Perform a tick PPU routine, with the video output chosen at compile
+    /// time. Without it, the pixels are still composed, since the sprite zero
+    /// hit depends on them, but their color is not written to the output
+    /// screen.
     /// </summary>
+    /// <typeparam name="kVideoOutput"></typeparam>
+    template <bool kVideoOutput>
     void Clock();
 
     /// <summary>
     /// Handle a read request from the PPU memory. This routine will prioritize
-    /// the cartridge read routine over the PPU space address.
+    /// the cartridge read routine over the pattern tables. The nametables and
+    /// the palettes are always read from the PPU. Reads have no side effects,
+    /// since mappers translate the PPU addresses without side effects (see
+    /// IMapper), so the same function serves the read-only reads.
     /// </summary>
     /// <param name="address"></param>
-    /// <param name="readOnly"></param>
     /// <returns></returns>
-    uint8_t PpuRead(uint16_t address, bool readOnly = false);
+    uint8_t PpuRead(uint16_t address);
     
     /// <summary>
     /// Handle a write request to the PPU memory. This routine will prioritize
-    /// the cartridge write routine over the PPU space address.
+    /// the cartridge write routine over the pattern tables. The nametables
+    /// and the palettes are always written in the PPU.
     /// </summary>
     /// <param name="address"></param>
     /// <param name="data"></param>
     void PpuWrite(uint16_t address, uint8_t data);
 
+    /// <summary>
+    /// Return the compositor of the scan line renderer, to choose its kernel
+    /// </summary>
+    /// <returns></returns>
+    inline PixelCompositor* GetPixelCompositor() { return &m_Compositor; }
+
+    /// <summary>
+    /// Drop the decoded tiles of the pattern table addresses of the range, so
+    /// they are read again from the pattern memory. Mappers call it, through
+    /// the bus, when they switch character memory banks. Writes from the PPU
+    /// invalidate the tiles already.
+    /// </summary>
+    /// <param name="firstAddress"></param>
+    /// <param name="lastAddress"></param>
+    void InvalidatePatternTiles(uint16_t firstAddress, uint16_t lastAddress);
+
+    /// <summary>
+    /// Map the four nametables of the address space to the nametable memory.
+    /// The cartridge sets it when it is connected, and mappers that switch
+    /// the mirroring set it again through the bus.
+    /// </summary>
+    /// <param name="mode"></param>
+    void SetMirroringMode(CartridgeHeader::MIRRORING_MODE mode);
+
     /// <summary>
     /// Retrieve a color from the palette. For more info refer to:
     /// https://wiki.nesdev.com/w/index.php/PPU_palettes
@@ -196,13 +237,63 @@ class Ppu {
     /// <returns></returns>
     int GetColorFromPalette(uint8_t palette, uint8_t pixel);
 
+    /// <summary>
+    /// Retrieve the index of a color of the palette in the system palette
+    /// </summary>
+    /// <param name="palette">Index of the palette to choose a color from</param>
+    /// <param name="pixel">Index of the color within the palette</param>
+    /// <returns>The color index, 0 to 63</returns>
+    inline uint8_t GetColorIndexFromPalette(uint8_t palette,
+                                            uint8_t pixel) const {
+        return m_PaletteTable[kPaletteAddresses[(palette << 2) + pixel]] &
+               0x3F;
+    }
+
     /// <summary>
     /// Return the raw data of the output screen. Each element is a color
-    /// pixel in format ARGB.
+    /// pixel in format ARGB. The PPU renders color indices, and they are
+    /// converted the first time the screen is requested after a change.
     /// </summary>
     /// <returns></returns>
     const int* GetOutputScreen() const;
 
+    /// <summary>
+    /// Return the screen as the PPU renders it. Each element is the index of
+    /// the color of the pixel in the system palette, 0 to 63. Consumers that
+    /// do not need the colors avoid converting the screen with it.
+    /// </summary>
+    /// <returns></returns>
+    inline const uint8_t* GetIndexScreen() const { return m_IndexScreen; }
+
+    /// <summary>
+    /// Convert the output screen into a buffer of the caller, with no copy in
+    /// between
+    /// </summary>
+    /// <param name="pixels">First pixel of the top row</param>
+    /// <param name="pitch">Distance in bytes between the starts of two
+    /// rows</param>
+    /// <param name="format">Format of the pixels</param>
+    void CopyOutputScreen(void* pixels, size_t pitch,
+                          PixelFormat format) const;
+
+    /// <summary>
+    /// Set a buffer of the caller where the PPU converts every scan line as
+    /// soon as it is rendered, so a completed frame is already in it. The
+    /// buffer must hold 256x240 pixels, and stay valid until it is replaced.
+    /// </summary>
+    /// <param name="pixels">First pixel of the top row, or nullptr to stop
+    /// converting the scan lines</param>
+    /// <param name="pitch">Distance in bytes between the starts of two
+    /// rows</param>
+    /// <param name="format">Format of the pixels</param>
+    void SetOutputTarget(void* pixels, size_t pitch, PixelFormat format);
+
+    /// <summary>
+    /// Return the converter of the output screen, to choose its kernel
+    /// </summary>
+    /// <returns></returns>
+    inline FrameConverter* GetFrameConverter() { return &m_FrameConverter; }
+
     /// <summary>
     /// Return true when the PPU has finished processing a frame. This will be
     /// refactored in the future.
@@ -225,17 +316,217 @@ class Ppu {
     bool NeedsToDoNMI();
 
     /// <summary>
-    /// PPU OAM memory pointer. This is a hack-ish way to write to the OAM. In the
-    /// DMA tranfer, the data will be writing in order. This means that the tranfer will
-    /// copy the data defined in ObjectAttributeEntry in order, 64 times. This will be
-    /// refactored for a more readable process.
+    /// Let the PPU lag behind the rest of the system. The cycles will not be
+    /// executed until CatchUp() is called.
     /// </summary>
-    uint8_t* m_OAMPtr = (uint8_t*)m_OAM;
+    /// <param name="cycles">Amount of PPU cycles to defer</param>
+    inline void AddPendingCycles(uint64_t cycles) { m_PendingCycles += cycles; }
+
+    /// <summary>
+    /// Return the amount of PPU cycles that have been deferred.
+    /// </summary>
+    /// <returns></returns>
+    inline uint64_t GetPendingCycles() const { return m_PendingCycles; }
+
+    /// <summary>
+    /// Execute all the deferred cycles, so that the PPU state is in sync
+    /// with the rest of the system. The bus will call this before any access
+    /// to the PPU registers.
+    ///
+    /// With PpuRendering::kScanLine, a visible scan line that is fully
+    /// deferred is composed in a single pass from the nametables, the pattern
+    /// tables and the sprites found on the previous line, and the scan lines
+    /// of the vertical blank are skipped. The result is the same as clocking
+    /// every cycle. A scan line with a CPU access in the middle is split
+    /// there, and is clocked cycle by cycle instead.
+    /// </summary>
+    /// <typeparam name="kVideoOutput">True to write the output
+    /// screen</typeparam>
+    /// <typeparam name="kRendering"></typeparam>
+    template <bool kVideoOutput, PpuRendering kRendering>
+    void CatchUp();
+
+    /// <summary>
+    /// Return the amount of PPU cycles, counting from the current PPU position
+    /// and including the cycle itself, until the cycle that will request the
+    /// NMI. Return kNoPendingEvent if the NMI is disabled. Deferred cycles are
+    /// not taken into account.
+    /// </summary>
+    /// <returns></returns>
+    uint64_t GetCyclesUntilNMI() const;
+
+    /// <summary>
+    /// Return the amount of PPU cycles, counting from the current PPU position
+    /// and including the cycle itself, until the cycle that completes the
+    /// frame. Deferred cycles are not taken into account.
+    /// </summary>
+    /// <returns></returns>
+    uint64_t GetCyclesUntilFrameCompleted() const;
+
+    /// <summary>
+    /// Return the amount of PPU cycles, counting from the current PPU position
+    /// and including the cycle itself, until the next cycle that reads the OAM
+    /// to find the sprites of a scan line. Deferred cycles are not taken into
+    /// account.
+    /// </summary>
+    /// <returns></returns>
+    uint64_t GetCyclesUntilSpriteEvaluation() const;
+
+    /// <summary>
+    /// Return the amount of PPU cycles, counting from the current PPU position
+    /// and including the cycle itself, until the next cycle that might change
+    /// the value read from the status register. Return 1 if reading the
+    /// register would change it. Deferred cycles are not taken into account.
+    /// </summary>
+    /// <returns></returns>
+    uint64_t GetCyclesUntilStatusChange() const;
+
+    /// <summary>
+    /// Return the master clock tick of the last cycle that changed the value
+    /// read from the status register. When a CPU access changed it, the tick
+    /// of the next cycle.
+    /// </summary>
+    /// <returns></returns>
+    inline uint64_t GetStatusChangeTick() const { return m_StatusChangeTick; }
+
+    /// <summary>
+    /// Return the value of the control register, PPUCTRL
+    /// </summary>
+    /// <returns></returns>
+    inline uint8_t GetControlRegister() const {
+        return m_ControlReg.GetRegister();
+    }
+
+    /// <summary>
+    /// Return the value of the mask register, PPUMASK
+    /// </summary>
+    /// <returns></returns>
+    inline uint8_t GetMaskRegister() const { return m_MaskReg.GetRegister(); }
+
+    /// <summary>
+    /// Return the value of the status register, PPUSTATUS, without the side
+    /// effects of reading it from the CPU
+    /// </summary>
+    /// <returns></returns>
+    inline uint8_t GetStatusRegister() const {
+        return m_StatusReg.GetRegister();
+    }
+
+    /// <summary>
+    /// Return the current VRAM address, the loopy register v
+    /// </summary>
+    /// <returns></returns>
+    inline uint16_t GetVramAddress() const { return m_VramAddress.reg; }
+
+    /// <summary>
+    /// Return the scan line of the next PPU cycle, from -1 (pre-render) on.
+    /// Deferred cycles are not taken into account.
+    /// </summary>
+    /// <returns></returns>
+    inline int16_t GetScanLine() const { return m_ScanLine; }
+
+    /// <summary>
+    /// Return the position of the next PPU cycle in its scan line, 0 to 340.
+    /// Deferred cycles are not taken into account.
+    /// </summary>
+    /// <returns></returns>
+    inline int16_t GetCycle() const { return m_Cycle; }
+
+    /// <summary>
+    /// Return the master clock tick of the next PPU cycle, deferred cycles not
+    /// included
+    /// </summary>
+    /// <returns></returns>
+    inline uint64_t GetTick() const { return m_Tick; }
+
+    /// <summary>
+    /// Overclock the CPU by adding idle scan lines at the end of the vertical
+    /// blank, before the pre-render scan line. The PPU does nothing on them,
+    /// so the rendering is not changed, while the CPU gets more cycles per
+    /// frame. The NMI is still requested at the start of the vertical blank.
+    /// The setting takes effect when the next frame starts.
+    /// </summary>
+    /// <param name="scanLines">Amount of extra scan lines, 0 to disable
+    /// overclocking</param>
+    void SetExtraScanLines(uint16_t scanLines);
+
+    /// <summary>
+    /// Return the amount of extra scan lines requested with
+    /// SetExtraScanLines()
+    /// </summary>
+    /// <returns></returns>
+    inline uint16_t GetExtraScanLines() const {
+        return m_RequestedExtraScanLines;
+    }
+
+    /// <summary>
+    /// Return the length in PPU cycles of the current frame, extra scan lines
+    /// included
+    /// </summary>
+    /// <returns></returns>
+    uint64_t GetCyclesPerFrame() const;
+
+    /// Returned by the GetCyclesUntil routines when the event will not happen
+    static constexpr uint64_t kNoPendingEvent = UINT32_MAX;
+
+    /// <summary>
+    /// Set the scheduler the PPU registers its events with: the NMI, while it
+    /// is enabled, and the completion of the frame.
+    /// </summary>
+    /// <param name="scheduler"></param>
+    void SetScheduler(Scheduler* scheduler);
+
+    /// <summary>
+    /// Set the master clock tick of the next PPU cycle, deferred cycles not
+    /// included, and schedule the PPU events from it. The PPU keeps the tick
+    /// up to date as it runs.
+    /// </summary>
+    /// <param name="tick"></param>
+    void SynchronizeTick(uint64_t tick);
+
+    /// <summary>
+    /// Schedule the PPU events that are not pending yet. The emulator calls
+    /// this after handling one of them.
+    /// </summary>
+    void ScheduleEvents();
+
+    /// <summary>
+    /// Read a byte of the OAM at an address as the CPU sees it: 4 bytes per
+    /// sprite, with its Y coordinate, tile, attributes and X coordinate.
+    /// </summary>
+    /// <param name="address"></param>
+    /// <returns></returns>
+    inline uint8_t ReadOam(uint8_t address) const {
+        return m_OAM[address & 0x03][address >> 2];
+    }
+
+    /// <summary>
+    /// Write a byte of the OAM at an address as the CPU sees it. The $2004
+    /// register and the DMA transfers write through it.
+    /// </summary>
+    /// <param name="address"></param>
+    /// <param name="data"></param>
+    inline void WriteOam(uint8_t address, uint8_t data) {
+        m_OAM[address & 0x03][address >> 2] = data;
+        ++m_OamVersion;
+    }
 
    private:
-    std::size_t GetNextActions(std::array<PpuAction, 3>& nextActions);
     std::pair<uint8_t, uint8_t> GetCurrentPixelToRender();
 
+    // Run the actions of a cycle, given as one bit per PpuAction
+    void RunCycleActions(uint16_t actions);
+
+    // Compose the pixel of the current cycle, and write it to the screen if
+    // it is visible
+    template <bool kVideoOutput>
+    void RenderCyclePixel();
+
+    // Clock the cycles of the current run of cycles with the same actions in
+    // the timeline, up to a maximum. Returns the amount of cycles run
+    template <bool kVideoOutput>
+    int16_t ClockRun(uint64_t maxCycles);
+
     void DoPpuActionPrerenderClear();
     void DoPpuActionPrerenderTransferY();
 
@@ -248,6 +539,45 @@ class Ppu {
     void DoPpuActionRenderUpdateSprites();
     void DoPpuActionRenderEndFrameRendering();
 
+    // Set a field of the status register, keeping track of the tick it
+    // changed on
+    void SetStatusField(StatusRegisterFields field, bool value);
+
+    // Render the visible scan line the PPU is at, from its cycle 0, with the
+    // same result as clocking its 341 cycles
+    template <bool kVideoOutput>
+    void RenderScanLine();
+
+    // Run cycles of a scan line on which the PPU does nothing but compose a
+    // pixel that is not shown, in the vertical blank
+    void SkipIdleCycles(int16_t cycles);
+
+    // Move the PPU position forward, without going past the end of the scan
+    // line
+    void AdvanceCycles(int16_t cycles);
+
+    // Mark a completed scan line of the index screen as rendered: the output
+    // screen needs a new conversion, and the output target gets the line
+    void FinishScanLine(int16_t scanLine);
+
+    // Evaluate the sprites of a visible scan line into its sprite list
+    void EvaluateSprites(int16_t scanLine, uint8_t spriteHeight);
+
+    // Get a row of the pattern tables from the tile cache, decoding its tile
+    // first if needed
+    uint64_t GetPatternRow(uint16_t address, bool isFlipped);
+
+    // Read a byte of the nametables, from $2000 to $3EFF, with the mirroring
+    inline uint8_t ReadNametable(uint16_t address) const {
+        return m_NametableSlots[(address >> 10) & 0x03][address & 0x03FF];
+    }
+
+    // Steps of the background tile fetch
+    void FetchBackgroundTileId();
+    void FetchBackgroundTileAttribute();
+    void FetchBackgroundTileLsb();
+    void FetchBackgroundTileMsb();
+
     void UpdateShifters();
     void LoadBackgroundShifters();
     void IncrementScrollX();
@@ -270,6 +600,15 @@ class Ppu {
     /// one byte. https://wiki.nesdev.com/w/index.php/PPU_palettes
     uint8_t m_PaletteTable[32] = {0};
 
+    /// Address in m_PaletteTable of each palette entry. The transparent
+    /// colors of the sprite palettes mirror the ones of the background
+    /// palettes
+    static constexpr uint8_t kPaletteAddresses[32] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+        0x00, 0x11, 0x12, 0x13, 0x04, 0x15, 0x16, 0x17,
+        0x08, 0x19, 0x1A, 0x1B, 0x0C, 0x1D, 0x1E, 0x1F};
+
     /// The pattern table is an area of memory connected to the PPU that defines
     /// the shapes of tiles that make up backgrounds and sprites. Each tile in
     /// the pattern table is 16 bytes, made of two planes. The first plane
@@ -288,13 +627,34 @@ class Ppu {
 
     uint8_t m_FineX = 0x00;
 
+    uint8_t* m_IndexScreen = nullptr;
+
     int* m_OutputScreen = nullptr;
 
+    // The index screen changed after the last conversion of the output one
+    mutable bool m_IsOutputScreenStale = false;
+
+    // Buffer of the caller that receives the rendered scan lines
+    uint8_t* m_OutputTarget = nullptr;
+    size_t m_OutputTargetPitch = 0;
+    PixelFormat m_OutputTargetFormat = PixelFormat::kBgra8888;
+
     Cartridge* m_Cartridge = nullptr;
 
+    /// Nametable memory of each of the four nametables of the address space,
+    /// from $2000 to $2FFF, following the mirroring mode
+    uint8_t* m_NametableSlots[4] = {nullptr};
+
+    /// Memory of the third and fourth nametables, that four-screen
+    /// cartridges carry
+    uint8_t m_CartridgeNametables[2][1024] = {{0}};
+
     int16_t m_ScanLine = 0;
     int16_t m_Cycle = 0;
 
+    // Class of the current scan line in the timeline of the PPU actions
+    uint8_t m_ScanLineClass = 0;
+
     PpuRegister<StatusRegisterFields> m_StatusReg;
     PpuRegister<MaskRegisterFields> m_MaskReg;
     PpuRegister<ControlRegisterFields> m_ControlReg;
@@ -327,15 +687,44 @@ class Ppu {
         uint8_t attribute;
         uint8_t x;
     };
-    ObjectAttributeEntry m_OAM[64];
+
+    // The OAM as a structure of arrays: a row for each field of the 64
+    // sprites, in the order of ObjectAttributeEntry. The sprite evaluation
+    // compares the 64 Y coordinates at once. It starts cleared, so that the
+    // sprites drawn before the program fills it do not depend on the memory
+    // the PPU was allocated in
+    enum OamField { kOamY = 0, kOamId, kOamAttribute, kOamX };
+    alignas(16) uint8_t m_OAM[4][64] = {{0}};
+
+    // Changes on every OAM write
+    uint64_t m_OamVersion = 1;
+
+    // The sprites of a scan line, by their OAM index in order, for the OAM
+    // version and the sprite height they were evaluated with
+    struct SpriteList {
+        uint64_t oamVersion;
+        uint8_t spriteHeight;
+        uint8_t count;
+        uint8_t sprites[8];
+    };
+
+    // Sprite evaluation of the visible scan lines, kept while the OAM does
+    // not change
+    SpriteList m_SpriteLists[240] = {};
 
     uint8_t m_OAMAddress = 0x00;
 
-    ObjectAttributeEntry m_SpriteScanLine[8];
+    ObjectAttributeEntry m_SpriteScanLine[8] = {};
     uint8_t m_SpriteCount = 0;
 
-    uint8_t m_SpriteShifterPatternLo[8];
-    uint8_t m_SpriteShifterPatternHi[8];
+    TileCache m_TileCache;
+
+    PixelCompositor m_Compositor;
+
+    FrameConverter m_FrameConverter{m_PalScreen};
+
+    uint8_t m_SpriteShifterPatternLo[8] = {0};
+    uint8_t m_SpriteShifterPatternHi[8] = {0};
 
     bool m_SpriteZeroHitPossible = false;
     bool m_SpriteZeroBeingRendered = false;
@@ -344,9 +733,22 @@ class Ppu {
 
     bool m_DoNMI = false;
 
+    // Extra scan lines of the current frame, and of the next ones
+    uint16_t m_ExtraScanLines = 0;
+    uint16_t m_RequestedExtraScanLines = 0;
+
+    uint64_t m_PendingCycles = 0;
+
+    Scheduler* m_Scheduler = nullptr;
+
+    // Master clock tick of the next cycle
+    uint64_t m_Tick = 0;
+
+    uint64_t m_StatusChangeTick = 0;
+
     // Colors are in format ARGB
     // Table taken from https://wiki.nesdev.com/w/index.php/PPU_palettes
-    static constexpr unsigned int m_PalScreen[0x40] = {
+    static constexpr uint32_t m_PalScreen[0x40] = {
         0xFF545454, 0xFF001E74, 0xFF081090, 0xFF300088, 0xFF440064, 0xFF5C0030,
         0xFF540400, 0xFF3C1800, 0xFF202A00, 0xFF083A00, 0xFF004000, 0xFF003C00,
         0xFF00323C, 0xFF000000, 0xFF000000, 0xFF000000, 0xFF989698, 0xFF084CC4,
@@ -0,0 +1,46 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+
+namespace dearnes {
+
+// Forward declaration
+class Cpu;
+
+/// <summary>
+/// Routine of a recompiled program. It is a run of straight-line instructions
+/// that starts at a fixed address of cartridge ROM and cannot access a device,
+/// with the same rules as the blocks of CpuJit.
+/// </summary>
+struct RecompiledRoutine {
+    /// Address of the first instruction
+    uint16_t address;
+
+    /// Worst case of the cycles taken by the instructions before the last
+    /// one. The routine is only called with a budget bigger than this
+    uint16_t cyclesBeforeLastInstruction;
+
+    /// Execute the routine and return the cycles it took. It leaves the
+    /// program counter pointing to the next instruction
+    uint32_t (*function)(Cpu *cpu);
+};
+
+/// <summary>
+/// Code of a cartridge translated ahead of time to C++ by the nes_recompiler
+/// tool. The tool emits a translation unit that defines one of these, with
+/// the routines sorted by address. Install it with Nes::SetRecompiledProgram(),
+/// which checks that the inserted cartridge is the one it was generated from.
+/// </summary>
+struct RecompiledProgram {
+    /// Result of Cartridge::GetProgramMemoryChecksum() for the cartridge
+    uint32_t programMemoryChecksum;
+
+    /// Size in bytes of the program memory of the cartridge
+    uint32_t programMemorySize;
+
+    const RecompiledRoutine *routines;
+    size_t routineCount;
+};
+
+}  // namespace dearnes
@@ -0,0 +1,148 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+namespace dearnes {
+
+/// <summary>
+/// Kinds of events that can be scheduled. Events due on the same tick are
+/// handled in this order.
+/// </summary>
+enum class SchedulerEvent : uint8_t {
+    // The PPU requests the NMI, if it is enabled
+    kNonMaskableInterrupt = 0,
+    // The PPU completes a frame
+    kFrameCompleted,
+    // The last byte of an OAM DMA transfer is written
+    kDmaTransferCompleted,
+    // A mapper asserts the IRQ line
+    kMapperIrq,
+    kSchedulerEventSize
+};
+
+/// <summary>
+/// Devices that can assert the IRQ line of the CPU
+/// </summary>
+enum class IrqSource : uint8_t { kMapper = 0 };
+
+/// <summary>
+/// Central queue of the future events of the emulator, keyed by the master
+/// clock tick they happen on. The emulator only stops the CPU and catches up
+/// the other devices when an event is due, instead of polling them on every
+/// tick.
+///
+/// There is at most one pending event of each kind. Scheduling an event again
+/// moves it. The events are kept in a binary heap; the entries of events that
+/// were moved or canceled stay in it and are skipped when they reach the top.
+///
+/// The scheduler also holds the IRQ line, which is the OR of the IRQ sources.
+/// The emulator drives the IRQ input of the CPU with it.
+/// </summary>
+class Scheduler {
+   public:
+    /// Returned by GetNextEventTick() when there is no pending event
+    static constexpr uint64_t kNoPendingEvent = UINT64_MAX;
+
+    Scheduler();
+
+    /// <summary>
+    /// Schedule an event on a tick, replacing the pending event of the same
+    /// kind if there is one
+    /// </summary>
+    /// <param name="event"></param>
+    /// <param name="tick">Master clock tick the event happens on</param>
+    void Schedule(SchedulerEvent event, uint64_t tick);
+
+    /// <summary>
+    /// Remove the pending event of a kind, if there is one
+    /// </summary>
+    /// <param name="event"></param>
+    void Cancel(SchedulerEvent event);
+
+    /// <summary>
+    /// Returns true if there is a pending event of the kind
+    /// </summary>
+    /// <param name="event"></param>
+    /// <returns></returns>
+    inline bool IsScheduled(SchedulerEvent event) const {
+        return m_ScheduledTicks[static_cast<size_t>(event)] != kNoPendingEvent;
+    }
+
+    /// <summary>
+    /// Returns the tick of the earliest pending event, or kNoPendingEvent
+    /// </summary>
+    /// <returns></returns>
+    inline uint64_t GetNextEventTick() const {
+        return m_Heap.empty() ? kNoPendingEvent : m_Heap.front().tick;
+    }
+
+    /// <summary>
+    /// Remove the earliest pending event if it happens on the tick or
+    /// before.
+    /// </summary>
+    /// <param name="tick"></param>
+    /// <param name="event">Kind of the removed event</param>
+    /// <returns>False if no event is due</returns>
+    bool PopDueEvent(uint64_t tick, SchedulerEvent& event);
+
+    /// <summary>
+    /// Remove all the pending events and release the IRQ line
+    /// </summary>
+    void Clear();
+
+    /// <summary>
+    /// Set the tick the emulator is on. The emulator keeps it up to date
+    /// before any device access, so that the devices can schedule events
+    /// relative to it.
+    /// </summary>
+    /// <param name="tick"></param>
+    inline void SetCurrentTick(uint64_t tick) { m_CurrentTick = tick; }
+
+    /// <summary>
+    /// Returns the tick of the last device access
+    /// </summary>
+    /// <returns></returns>
+    inline uint64_t GetCurrentTick() const { return m_CurrentTick; }
+
+    /// <summary>
+    /// Assert or release the IRQ line on behalf of a device. The line stays
+    /// asserted while any source asserts it.
+    /// </summary>
+    /// <param name="source"></param>
+    /// <param name="asserted"></param>
+    void SetIrqLine(IrqSource source, bool asserted);
+
+    /// <summary>
+    /// Returns true if any source asserts the IRQ line
+    /// </summary>
+    /// <returns></returns>
+    inline bool IsIrqLineAsserted() const { return m_IrqSources != 0x00; }
+
+   private:
+    struct Entry {
+        uint64_t tick;
+        SchedulerEvent event;
+    };
+
+    // Ordering of the heap, the earliest event goes on top
+    static bool IsLater(const Entry& lhs, const Entry& rhs);
+
+    void PopStaleEntries();
+
+    std::vector<Entry> m_Heap;
+
+    // Tick of the pending event of each kind, the heap entries that do not
+    // match it are stale
+    std::array<uint64_t,
+               static_cast<size_t>(SchedulerEvent::kSchedulerEventSize)>
+        m_ScheduledTicks;
+
+    uint64_t m_CurrentTick = 0;
+
+    uint8_t m_IrqSources = 0x00;
+};
+
+}  // namespace dearnes
@@ -0,0 +1,107 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dearnes {
+
+/// <summary>
+/// Cache of the 512 tiles of the pattern tables, with their rows already
+/// decoded. A row holds the color indices, 0 to 3, of its 8 pixels, one byte
+/// each and the leftmost pixel in the lowest byte, so a renderer gets a whole
+/// row with a single 8-byte load. Each row is also kept flipped
+/// horizontally, for sprites.
+///
+/// The PPU decodes a tile the first time it is used, and drops it when the
+/// pattern memory behind it changes: on PPU writes to the pattern tables,
+/// and when a mapper switches character memory banks.
+/// </summary>
+class TileCache {
+   public:
+    /// Amount of tiles in the two pattern tables
+    static constexpr uint16_t kTiles = 512;
+
+    TileCache();
+
+    /// <summary>
+    /// Returns true if the tile that contains the pattern table address is
+    /// decoded
+    /// </summary>
+    /// <param name="address">Address within the pattern tables, $0000 to
+    /// $1FFF</param>
+    /// <returns></returns>
+    inline bool IsDecoded(uint16_t address) const {
+        return m_IsDecoded[GetTile(address)];
+    }
+
+    /// <summary>
+    /// Decode a tile from its 16 bytes: the 8 rows of the low bit plane,
+    /// followed by the 8 rows of the high one
+    /// </summary>
+    /// <param name="address">Address within the pattern tables of any byte of
+    /// the tile</param>
+    /// <param name="data"></param>
+    void Decode(uint16_t address, const uint8_t (&data)[16]);
+
+    /// <summary>
+    /// Get a row of a decoded tile
+    /// </summary>
+    /// <param name="address">Address within the pattern tables of the low bit
+    /// plane of the row</param>
+    /// <param name="isFlipped">Get the row flipped horizontally</param>
+    /// <returns></returns>
+    inline uint64_t GetRow(uint16_t address, bool isFlipped) const {
+        const size_t index = (GetTile(address) << 3) | (address & 0x07);
+        return isFlipped ? m_FlippedRows[index] : m_Rows[index];
+    }
+
+    /// <summary>
+    /// Drop the tiles that contain the pattern table addresses of the range
+    /// </summary>
+    /// <param name="firstAddress"></param>
+    /// <param name="lastAddress"></param>
+    void Invalidate(uint16_t firstAddress, uint16_t lastAddress);
+
+    /// <summary>
+    /// Drop every tile
+    /// </summary>
+    void InvalidateAll();
+
+    /// <summary>
+    /// Returns the low bit plane of a decoded row, as it is in the pattern
+    /// tables: the leftmost pixel in the highest bit
+    /// </summary>
+    /// <param name="row"></param>
+    /// <returns></returns>
+    static inline uint8_t GetLowPlane(uint64_t row) {
+        return GatherPlane(row & 0x0101010101010101);
+    }
+
+    /// <summary>
+    /// Returns the high bit plane of a decoded row
+    /// </summary>
+    /// <param name="row"></param>
+    /// <returns></returns>
+    static inline uint8_t GetHighPlane(uint64_t row) {
+        return GatherPlane((row >> 1) & 0x0101010101010101);
+    }
+
+   private:
+    static inline size_t GetTile(uint16_t address) {
+        return (address >> 4) & (kTiles - 1);
+    }
+
+    // Move the bit 0 of every byte, each 0 or 1, to a single byte, the lowest
+    // byte becoming the highest bit. The multiplication puts them in the top
+    // byte, without carries
+    static inline uint8_t GatherPlane(uint64_t bits) {
+        return static_cast<uint8_t>((bits * 0x8040201008040201) >> 56);
+    }
+
+    std::vector<uint64_t> m_Rows;
+    std::vector<uint64_t> m_FlippedRows;
+    std::vector<bool> m_IsDecoded;
+};
+
+}  // namespace dearnes
@@ -0,0 +1,157 @@
+// Copyright (c) 2020 Emmanuel Arias
+#pragma once
+#include <atomic>
+#include <cinttypes>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dearnes {
+
+/// <summary>
+/// Recorder of the state of the CPU before every instruction, for comparing
+/// executions. Install it with BasicNes::SetTraceRecorder(), on a console
+/// whose policy enables kTraceRecording.
+///
+/// Records have a fixed size and go into a lock-free ring buffer. By default
+/// the buffer keeps the last records, overwriting the oldest ones. After
+/// SpillToFile(), a background thread writes them to a file instead, and the
+/// emulator waits for it when the buffer is full, so no record is lost.
+///
+/// A trace file starts with a FileHeader, followed by the records in
+/// the native byte order. The nes_trace_decoder tool turns it into text.
+/// </summary>
+class TraceRecorder {
+   public:
+    /// <summary>
+    /// State of the console before an instruction
+    /// </summary>
+    struct Record {
+        /// Master clock tick the instruction starts on
+        uint64_t tick;
+
+        uint16_t programCounter;
+
+        /// Bytes that follow the op code, as many as the instruction takes
+        uint16_t operand;
+
+        /// Position of the PPU
+        int16_t scanLine;
+        int16_t cycle;
+
+        uint8_t opCode;
+        uint8_t registerA;
+        uint8_t registerX;
+        uint8_t registerY;
+        uint8_t statusRegister;
+        uint8_t stackPointer;
+    };
+
+    /// <summary>
+    /// First bytes of a trace file
+    /// </summary>
+    struct FileHeader {
+        char magic[4];
+        uint32_t recordSize;
+    };
+
+    /// Value of FileHeader::magic
+    static constexpr char kFileMagic[4] = {'D', 'N', 'T', 'R'};
+
+    /// <summary>
+    /// Format a record as a line of the nestest log, without the line break:
+    /// address, instruction bytes, disassembly, registers, PPU position and
+    /// CPU cycle
+    /// </summary>
+    /// <param name="record"></param>
+    /// <returns></returns>
+    static std::string FormatRecord(const Record& record);
+
+    /// <summary>
+    /// Create a recorder that keeps the last records in memory
+    /// </summary>
+    /// <param name="capacity">Size of the ring buffer, in records. It is
+    /// rounded up to a power of two</param>
+    explicit TraceRecorder(size_t capacity = 1 << 16);
+
+    /// <summary>
+    /// Stop spilling to the file, if it was
+    /// </summary>
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    /// <summary>
+    /// Start writing the records to a file from a background thread. The
+    /// records in memory are discarded.
+    /// </summary>
+    /// <param name="path"></param>
+    /// <returns>False if the file cannot be created</returns>
+    bool SpillToFile(const std::string& path);
+
+    /// <summary>
+    /// Write the pending records and close the file. The recorder keeps the
+    /// next records in memory again.
+    /// </summary>
+    void Stop();
+
+    /// <summary>
+    /// Returns true while the records are written to a file
+    /// </summary>
+    /// <returns></returns>
+    inline bool IsSpilling() const { return m_IsSpilling; }
+
+    /// <summary>
+    /// Add a record. Only one thread can add records.
+    /// </summary>
+    /// <param name="record"></param>
+    inline void Add(const Record& record) {
+        const uint64_t head = m_Head.load(std::memory_order_relaxed);
+        if (m_IsSpilling) {
+            while (head - m_Tail.load(std::memory_order_acquire) >=
+                   m_Records.size()) {
+                std::this_thread::yield();
+            }
+        }
+        m_Records[head & m_IndexMask] = record;
+        m_Head.store(head + 1, std::memory_order_release);
+    }
+
+    /// <summary>
+    /// Get the records kept in memory, the oldest first. Empty while spilling
+    /// to a file.
+    /// </summary>
+    /// <returns></returns>
+    std::vector<Record> GetRecords() const;
+
+    /// <summary>
+    /// Returns the amount of records added since the recorder was created
+    /// </summary>
+    /// <returns></returns>
+    inline uint64_t GetRecordCount() const {
+        return m_Head.load(std::memory_order_relaxed);
+    }
+
+   private:
+    // Body of the background thread
+    void WriteRecords();
+
+    std::vector<Record> m_Records;
+    size_t m_IndexMask = 0;
+
+    // Amount of records added, and written to the file
+    std::atomic<uint64_t> m_Head{0};
+    std::atomic<uint64_t> m_Tail{0};
+
+    // Only changed by the thread that adds the records
+    bool m_IsSpilling = false;
+
+    std::ofstream m_File;
+    std::thread m_Writer;
+    std::atomic<bool> m_IsStopping{false};
+};
+
+}  // namespace dearnes
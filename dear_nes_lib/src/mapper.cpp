@@ -1,7 +1,29 @@
 // Copyright (c) 2020 Emmanuel Arias
 #include "dear_nes_lib/mapper.h"
 
+#include "dear_nes_lib/bus.h"
+
 namespace dearnes {
 IMapper::IMapper(uint8_t prgBanks, uint8_t chrBanks)
     : m_PrgBanks{prgBanks}, m_ChrBanks{chrBanks} {}
+
+void IMapper::SetBus(Bus *bus) { m_Bus = bus; }
+
+void IMapper::OnCpuBanksSwitched(uint16_t firstAddress, uint16_t lastAddress) {
+    if (m_Bus != nullptr) {
+        m_Bus->RebuildCpuPages(firstAddress, lastAddress);
+    }
+}
+
+void IMapper::OnPpuBanksSwitched(uint16_t firstAddress, uint16_t lastAddress) {
+    if (m_Bus != nullptr) {
+        m_Bus->InvalidatePatternTiles(firstAddress, lastAddress);
+    }
+}
+
+void IMapper::OnMirroringChanged(CartridgeHeader::MIRRORING_MODE mode) {
+    if (m_Bus != nullptr) {
+        m_Bus->SetMirroringMode(mode);
+    }
+}
 }  // namespace dearnes
\ No newline at end of file
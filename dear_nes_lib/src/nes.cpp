@@ -1,32 +1,71 @@
 // Copyright (c) 2020 Emmanuel Arias
 #include "dear_nes_lib/nes.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <limits>
 
 #include "dear_nes_lib/cartridge.h"
 #include "dear_nes_lib/enums.h"
+#include "dear_nes_lib/recompiled_program.h"
 
 namespace dearnes {
 
-Nes::Nes() {
-    m_Bus.SetPpu(&m_Ppu);
+namespace {
+
+// The CPU is ticked on every third master clock tick
+constexpr uint64_t kTicksPerCpuCycle = 3;
+
+// First tick, starting at tick, on which the CPU is ticked
+inline uint64_t GetNextCpuTick(uint64_t tick) {
+    return (tick + kTicksPerCpuCycle - 1) / kTicksPerCpuCycle *
+           kTicksPerCpuCycle;
+}
+
+// Amount of ticks in [startTick, endTick) on which the CPU is ticked
+inline uint64_t CountCpuTicks(uint64_t startTick, uint64_t endTick) {
+    return (GetNextCpuTick(endTick) - GetNextCpuTick(startTick)) /
+           kTicksPerCpuCycle;
+}
+
+// Execute the cycles the PPU deferred, with the features of the policy
+template <typename Policy>
+void CatchUpPpu(Ppu& ppu) {
+    ppu.CatchUp<Policy::kVideoOutput, Policy::kPpuRendering>();
+}
+
+}  // namespace
+
+template <typename Policy>
+BasicNes<Policy>::BasicNes() {
+    m_Bus.SetPpu(&m_Ppu, &CatchUpPpu<Policy>);
+    m_Bus.SetCpu(&m_Cpu);
     m_Bus.SetDma(&m_Dma);
+    m_Bus.SetScheduler(&m_Scheduler);
+
+    m_Ppu.SetScheduler(&m_Scheduler);
+    m_Ppu.SynchronizeTick(m_SystemClockCounter);
 
     m_Dma.SetBus(&m_Bus);
 
     m_Cpu.SetBus(&m_Bus);
 }
 
-Nes::~Nes() {
+template <typename Policy>
+BasicNes<Policy>::~BasicNes() {
     if (m_Cartridge != nullptr) {
         delete m_Cartridge;
     }
 }
 
-uint64_t Nes::GetSystemClockCounter() const { return m_SystemClockCounter; }
+template <typename Policy>
+uint64_t BasicNes<Policy>::GetSystemClockCounter() const {
+    return m_SystemClockCounter;
+}
 
-void Nes::InsertCatridge(Cartridge* cartridge) {
+template <typename Policy>
+void BasicNes<Policy>::InsertCatridge(Cartridge* cartridge) {
     m_Bus.SetCartridge(cartridge);
     m_Ppu.ConnectCatridge(cartridge);
     m_IsCartridgeLoaded = true;
@@ -34,18 +73,26 @@ void Nes::InsertCatridge(Cartridge* cartridge) {
         delete m_Cartridge;
     }
     m_Cartridge = cartridge;
+    m_Cpu.SetRecompiledProgram(nullptr);
+    ApplyIdleLoopOverrides();
     Reset();
 }
 
-void Nes::Reset() {
+template <typename Policy>
+void BasicNes<Policy>::Reset() {
     if (!m_IsCartridgeLoaded) {
         return;
     }
     m_Cpu.Reset();
     m_SystemClockCounter = 0;
+
+    m_Scheduler.Clear();
+    m_Cpu.SetIrqLine(false);
+    m_Ppu.SynchronizeTick(m_SystemClockCounter);
 }
 
-void Nes::Clock() {
+template <typename Policy>
+void BasicNes<Policy>::Clock() {
     auto DoDMATransfer = [&]() {
         if (m_Dma.IsInWaitState()) {
             if (m_SystemClockCounter % 2 == 1) {
@@ -56,25 +103,28 @@ void Nes::Clock() {
                 m_Dma.ReadData();
             } else {
                 auto [addr, data] = m_Dma.GetLastReadData();
-                m_Ppu.m_OAMPtr[addr] = data;
+                m_Ppu.WriteOam(addr, data);
             }
         }
     };
-    m_Ppu.Clock();
+    m_Ppu.Clock<Policy::kVideoOutput>();
     if (m_SystemClockCounter % 3 == 0) {
         if (m_Dma.IsTranferInProgress()) {
             DoDMATransfer();
         } else {
-            m_Cpu.Clock();
+            m_Scheduler.SetCurrentTick(m_SystemClockCounter);
+            m_Cpu.SetIrqLine(m_Scheduler.IsIrqLineAsserted());
+            ClockCpu();
         }
     }
-    if (m_Ppu.NeedsToDoNMI()) {
-        m_Cpu.NonMaskableInterrupt();
+    if (m_SystemClockCounter >= m_Scheduler.GetNextEventTick()) {
+        DispatchEvents(m_SystemClockCounter);
     }
     ++m_SystemClockCounter;
 }
 
-void Nes::DoFrame() {
+template <typename Policy>
+void BasicNes<Policy>::DoFrame() {
     if (!m_IsCartridgeLoaded) {
         return;
     }
@@ -82,28 +132,351 @@ void Nes::DoFrame() {
         Clock();
     } while (!m_Ppu.IsFrameCompleted());
 
+    FinishFrame();
+}
+
+template <typename Policy>
+void BasicNes<Policy>::RunCycles(uint64_t cycles) {
+    if (!m_IsCartridgeLoaded) {
+        return;
+    }
+    if constexpr (Policy::kCpuStepping == CpuStepping::kCycle) {
+        for (uint64_t cycle = 0; cycle < cycles; ++cycle) {
+            Clock();
+        }
+    } else {
+        Run(m_SystemClockCounter + cycles, false);
+    }
+}
+
+template <typename Policy>
+void BasicNes<Policy>::RunFrame() {
+    if constexpr (Policy::kCpuStepping == CpuStepping::kCycle) {
+        DoFrame();
+    } else {
+        if (!m_IsCartridgeLoaded) {
+            return;
+        }
+        // Like DoFrame(), tick at least once even if the frame is already
+        // completed
+        if (m_Ppu.IsFrameCompleted()) {
+            Clock();
+        } else {
+            Run(std::numeric_limits<uint64_t>::max(), true);
+        }
+        FinishFrame();
+    }
+}
+
+template <typename Policy>
+void BasicNes<Policy>::Run(uint64_t endTick, bool stopAtFrameCompleted) {
+    while (m_SystemClockCounter < endTick) {
+        if (m_Dma.IsTranferInProgress()) {
+            // Otherwise, the DMA transfer is driven by the tick parity, use
+            // the regular path
+            if (!RunDmaTransfer(endTick)) {
+                CatchUpPpu<Policy>(m_Ppu);
+                Clock();
+            }
+            if (stopAtFrameCompleted && m_Ppu.IsFrameCompleted()) {
+                break;
+            }
+            continue;
+        }
+
+        // The PPU lags behind and is only caught up when the CPU accesses its
+        // registers, or on the tick of the next event. Events past the end
+        // are left for the next call
+        const uint64_t startTick = m_SystemClockCounter;
+        const uint64_t eventTick =
+            std::min(m_Scheduler.GetNextEventTick(), endTick - 1);
+        m_Cpu.SetIrqLine(m_Scheduler.IsIrqLineAsserted());
+
+        // Until the tick that fetches the next instruction, the CPU is only
+        // waiting
+        const uint64_t fetchTick =
+            GetNextCpuTick(startTick) +
+            kTicksPerCpuCycle * m_Cpu.GetRemainingCycles();
+        const uint64_t stopTick = std::min({fetchTick, endTick, eventTick + 1});
+        m_Ppu.AddPendingCycles(stopTick - startTick);
+        m_Cpu.Run(CountCpuTicks(startTick, stopTick));
+        m_SystemClockCounter = stopTick;
+
+        // On the fetch tick, the PPU cycle goes before the CPU execution. The
+        // CPU keeps running ahead while the instructions do not access the
+        // devices, up to the last tick it can fetch on
+        if (m_SystemClockCounter == fetchTick && fetchTick < endTick &&
+            fetchTick <= eventTick) {
+            m_Ppu.AddPendingCycles(1);
+            m_Scheduler.SetCurrentTick(fetchTick);
+            if (m_Cpu.IsIdleLoopDetectionEnabled()) {
+                SetPpuStatusWindow(fetchTick);
+            }
+            const uint64_t lastFetchTick = std::min(eventTick, endTick - 1);
+            const int64_t cycles =
+                m_Cpu.RunAhead(CountCpuTicks(fetchTick, lastFetchTick + 1));
+            // Stop right after the last CPU tick that was run
+            const uint64_t nextTick =
+                fetchTick + kTicksPerCpuCycle * (cycles - 1) + 1;
+            m_Ppu.AddPendingCycles(nextTick - fetchTick - 1);
+            m_SystemClockCounter = nextTick;
+        }
+
+        if (m_SystemClockCounter > eventTick) {
+            DispatchEvents(eventTick);
+            if (stopAtFrameCompleted && m_Ppu.IsFrameCompleted()) {
+                break;
+            }
+        }
+    }
+    CatchUpPpu<Policy>(m_Ppu);
+}
+
+template <typename Policy>
+bool BasicNes<Policy>::RunDmaTransfer(uint64_t endTick) {
+    // Only a transfer that did not copy anything yet, from plain memory
+    if (!m_Dma.IsInWaitState() ||
+        !m_Bus.IsCpuReadPageMemory(m_Dma.GetPage())) {
+        return false;
+    }
+
+    // The transfer waits for an odd CPU tick, then it reads on the even ones
+    // and writes on the odd ones
+    uint64_t firstTick = GetNextCpuTick(m_SystemClockCounter);
+    if (firstTick % 2 == 0) {
+        firstTick += kTicksPerCpuCycle;
+    }
+    const uint64_t lastTick = firstTick + 2 * 0x100 * kTicksPerCpuCycle;
+
+    // Nothing can happen while the transfer is in progress, not even the PPU
+    // reading the OAM
+    const uint64_t ppuTick = m_SystemClockCounter - m_Ppu.GetPendingCycles();
+    const uint64_t spriteEvaluationTick =
+        ppuTick + m_Ppu.GetCyclesUntilSpriteEvaluation() - 1;
+    if (lastTick >= endTick || lastTick >= m_Scheduler.GetNextEventTick() ||
+        lastTick >= spriteEvaluationTick) {
+        return false;
+    }
+
+    // The CPU is halted until the transfer is completed
+    m_Scheduler.Schedule(SchedulerEvent::kDmaTransferCompleted, lastTick);
+    m_Ppu.AddPendingCycles(lastTick + 1 - m_SystemClockCounter);
+    m_SystemClockCounter = lastTick + 1;
+    DispatchEvents(lastTick);
+    return true;
+}
+
+template <typename Policy>
+void BasicNes<Policy>::DispatchEvents(uint64_t tick) {
+    SchedulerEvent event;
+    while (m_Scheduler.PopDueEvent(tick, event)) {
+        switch (event) {
+            case SchedulerEvent::kNonMaskableInterrupt:
+            case SchedulerEvent::kFrameCompleted:
+                CatchUpPpu<Policy>(m_Ppu);
+                if (m_Ppu.NeedsToDoNMI()) {
+                    m_Cpu.NonMaskableInterrupt();
+                }
+                m_Ppu.ScheduleEvents();
+                break;
+            case SchedulerEvent::kDmaTransferCompleted:
+                if (m_Dma.IsTranferInProgress()) {
+                    m_Dma.TransferPage(&m_Ppu);
+                }
+                break;
+            case SchedulerEvent::kMapperIrq:
+                m_Scheduler.SetIrqLine(IrqSource::kMapper, true);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+template <typename Policy>
+void BasicNes<Policy>::SetPpuStatusWindow(uint64_t tick) {
+    // The PPU lags behind, it knows when the value changed last and when it
+    // can change next. The CPU reads it after the PPU cycle of the same tick
+    const uint64_t lastChangeTick = m_Ppu.GetStatusChangeTick();
+    const uint64_t nextChangeTick =
+        m_Ppu.GetTick() + m_Ppu.GetCyclesUntilStatusChange() - 1;
+    if (lastChangeTick >= tick || nextChangeTick <= tick) {
+        m_Cpu.SetPpuStatusStableCycles(-1, 0);
+        return;
+    }
+    const uint64_t cyclesBefore =
+        (tick - lastChangeTick - 1) / kTicksPerCpuCycle;
+    const uint64_t cyclesAfter =
+        (nextChangeTick - tick + kTicksPerCpuCycle - 1) / kTicksPerCpuCycle;
+    m_Cpu.SetPpuStatusStableCycles(static_cast<int64_t>(cyclesBefore),
+                                   static_cast<int64_t>(cyclesAfter));
+}
+
+template <typename Policy>
+void BasicNes<Policy>::FinishFrame() {
+    m_Scheduler.SetCurrentTick(m_SystemClockCounter);
     do {
-        m_Cpu.Clock();
+        ClockCpu();
     } while (m_Cpu.IsCurrentInstructionComplete());
 
     m_Ppu.StartNewFrame();
 }
 
-bool Nes::IsCartridgeLoaded() const { return m_IsCartridgeLoaded; }
+template <typename Policy>
+void BasicNes<Policy>::ClockCpu() {
+    if constexpr (Policy::kInstructionHook) {
+        if (m_InstructionHook && m_Cpu.IsCurrentInstructionComplete()) {
+            m_InstructionHook(m_Cpu);
+        }
+    }
+    if constexpr (Policy::kTraceRecording) {
+        if (m_TraceRecorder != nullptr &&
+            m_Cpu.IsCurrentInstructionComplete()) {
+            RecordTrace();
+        }
+    }
+    m_Cpu.Clock();
+}
+
+template <typename Policy>
+void BasicNes<Policy>::RecordTrace() {
+    // The instruction bytes are read without side effects
+    const uint16_t address = m_Cpu.GetProgramCounter();
+    const uint8_t opCode = m_Bus.CpuRead(address, true);
+    const uint8_t length = Cpu::GetInstructionLength(opCode);
+    uint16_t operand = 0x0000;
+    if (length > 1) {
+        operand = m_Bus.CpuRead(address + 1, true);
+    }
+    if (length > 2) {
+        operand |= m_Bus.CpuRead(address + 2, true) << 8;
+    }
+
+    TraceRecorder::Record record = {};
+    record.tick = m_SystemClockCounter;
+    record.programCounter = address;
+    record.operand = operand;
+    record.scanLine = m_Ppu.GetScanLine();
+    record.cycle = m_Ppu.GetCycle();
+    record.opCode = opCode;
+    record.registerA = m_Cpu.GetRegisterA();
+    record.registerX = m_Cpu.GetRegisterX();
+    record.registerY = m_Cpu.GetRegisterY();
+    record.statusRegister = m_Cpu.GetStatusRegister();
+    record.stackPointer = m_Cpu.GetStackPointer();
+    m_TraceRecorder->Add(record);
+}
+
+template <typename Policy>
+bool BasicNes<Policy>::IsCartridgeLoaded() const {
+    return m_IsCartridgeLoaded;
+}
+
+template <typename Policy>
+bool BasicNes<Policy>::SetRecompiledProgram(
+    const RecompiledProgram* program) {
+    if (program != nullptr &&
+        (m_Cartridge == nullptr ||
+         program->programMemorySize != m_Cartridge->GetProgramMemorySize() ||
+         program->programMemoryChecksum !=
+             m_Cartridge->GetProgramMemoryChecksum())) {
+        return false;
+    }
+    m_Cpu.SetRecompiledProgram(program);
+    return true;
+}
+
+template <typename Policy>
+void BasicNes<Policy>::SetInstructionHook(InstructionHook hook) {
+    m_InstructionHook = std::move(hook);
+}
+
+template <typename Policy>
+void BasicNes<Policy>::SetTraceRecorder(TraceRecorder* recorder) {
+    m_TraceRecorder = recorder;
+}
+
+template <typename Policy>
+void BasicNes<Policy>::AddIdleLoopOverride(uint32_t programMemoryChecksum,
+                                           uint16_t loopAddress) {
+    m_IdleLoopOverrides.push_back({programMemoryChecksum, loopAddress});
+    ApplyIdleLoopOverrides();
+}
 
-uint8_t Nes::GetControllerState(size_t controllerIdx) const {
+template <typename Policy>
+void BasicNes<Policy>::SetExtraScanLines(uint16_t scanLines) {
+    m_Ppu.SetExtraScanLines(scanLines);
+}
+
+template <typename Policy>
+void BasicNes<Policy>::ApplyIdleLoopOverrides() {
+    std::vector<uint16_t> addresses;
+    if (m_Cartridge != nullptr) {
+        const uint32_t checksum = m_Cartridge->GetProgramMemoryChecksum();
+        for (const IdleLoopOverride& loopOverride : m_IdleLoopOverrides) {
+            if (loopOverride.programMemoryChecksum == checksum) {
+                addresses.push_back(loopOverride.loopAddress);
+            }
+        }
+    }
+    m_Cpu.SetIdleLoopExclusions(std::move(addresses));
+}
+
+template <typename Policy>
+NesState BasicNes<Policy>::CaptureState(bool includeOutputScreen) {
+    CatchUpPpu<Policy>(m_Ppu);
+
+    NesState state;
+    state.tick = m_SystemClockCounter;
+    state.programCounter = m_Cpu.GetProgramCounter();
+    state.registerA = m_Cpu.GetRegisterA();
+    state.registerX = m_Cpu.GetRegisterX();
+    state.registerY = m_Cpu.GetRegisterY();
+    state.stackPointer = m_Cpu.GetStackPointer();
+    state.statusRegister = m_Cpu.GetStatusRegister();
+    state.remainingCycles = m_Cpu.GetRemainingCycles();
+    state.cpuRam = m_Bus.GetCpuRam();
+    state.scanLine = m_Ppu.GetScanLine();
+    state.cycle = m_Ppu.GetCycle();
+    state.ppuControl = m_Ppu.GetControlRegister();
+    state.ppuMask = m_Ppu.GetMaskRegister();
+    state.ppuStatus = m_Ppu.GetStatusRegister();
+    state.vramAddress = m_Ppu.GetVramAddress();
+    uint8_t objectAttributes[256];
+    for (size_t address = 0; address < 256; ++address) {
+        objectAttributes[address] =
+            m_Ppu.ReadOam(static_cast<uint8_t>(address));
+    }
+    state.objectAttributeHash = HashMemory(objectAttributes, 256);
+    if (includeOutputScreen) {
+        // The colors follow from the indices, so they are not converted
+        state.outputScreenHash = HashMemory(m_Ppu.GetIndexScreen(), 256 * 240);
+    }
+    return state;
+}
+
+template <typename Policy>
+uint8_t BasicNes<Policy>::GetControllerState(size_t controllerIdx) const {
     assert(controllerIdx < NUM_CONTROLLERS);
     return m_Bus.GetControllerState(controllerIdx);
 }
 
-void Nes::ClearControllerState(size_t controllerIdx) {
+template <typename Policy>
+void BasicNes<Policy>::ClearControllerState(size_t controllerIdx) {
     assert(controllerIdx < NUM_CONTROLLERS);
     m_Bus.ClearControllerState(controllerIdx);
 }
 
-void Nes::WriteControllerState(size_t controllerIdx, uint8_t data) {
+template <typename Policy>
+void BasicNes<Policy>::WriteControllerState(size_t controllerIdx,
+                                            uint8_t data) {
     assert(controllerIdx < NUM_CONTROLLERS);
     m_Bus.WriteControllerState(controllerIdx, data);
 }
 
+template class BasicNes<AccuratePolicy>;
+template class BasicNes<StandardPolicy>;
+template class BasicNes<HeadlessPolicy>;
+template class BasicNes<DotRenderingPolicy>;
+
 }  // namespace dearnes
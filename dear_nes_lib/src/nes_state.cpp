@@ -0,0 +1,102 @@
+// Copyright (c) 2020 Emmanuel Arias
+#include "dear_nes_lib/nes_state.h"
+
+#include <cstdio>
+
+#include "dear_nes_lib/disassembler.h"
+
+namespace dearnes {
+
+namespace {
+
+// The values are written in hexadecimal with the amount of digits, or in
+// decimal if it is 0
+std::string DescribeDifference(const char* field, int32_t expected,
+                               int32_t actual, int digits) {
+    if (digits == 0) {
+        return std::string(field) + ": " + std::to_string(expected) +
+               " != " + std::to_string(actual);
+    }
+    return std::string(field) + ": " +
+           FormatHex(static_cast<uint32_t>(expected), digits) + " != " +
+           FormatHex(static_cast<uint32_t>(actual), digits);
+}
+
+}  // namespace
+
+std::string FindStateDifference(const NesState& expected,
+                                const NesState& actual) {
+    // In the order the devices would make them diverge
+    const struct {
+        const char* field;
+        int32_t expected;
+        int32_t actual;
+        int digits;
+    } fields[] = {
+        {"PC", expected.programCounter, actual.programCounter, 4},
+        {"A", expected.registerA, actual.registerA, 2},
+        {"X", expected.registerX, actual.registerX, 2},
+        {"Y", expected.registerY, actual.registerY, 2},
+        {"SP", expected.stackPointer, actual.stackPointer, 2},
+        {"P", expected.statusRegister, actual.statusRegister, 2},
+        {"CPU cycles left", expected.remainingCycles, actual.remainingCycles,
+         0},
+        {"PPUCTRL", expected.ppuControl, actual.ppuControl, 2},
+        {"PPUMASK", expected.ppuMask, actual.ppuMask, 2},
+        {"PPUSTATUS", expected.ppuStatus, actual.ppuStatus, 2},
+        {"VRAM address", expected.vramAddress, actual.vramAddress, 4},
+        {"Scan line", expected.scanLine, actual.scanLine, 0},
+        {"PPU cycle", expected.cycle, actual.cycle, 0},
+    };
+    for (const auto& field : fields) {
+        if (field.expected != field.actual) {
+            return DescribeDifference(field.field, field.expected,
+                                      field.actual, field.digits);
+        }
+    }
+
+    for (size_t address = 0; address < expected.cpuRam.size(); ++address) {
+        if (expected.cpuRam[address] != actual.cpuRam[address]) {
+            return "RAM $" + FormatHex(static_cast<uint32_t>(address), 4) +
+                   ": " + FormatHex(expected.cpuRam[address], 2) + " != " +
+                   FormatHex(actual.cpuRam[address], 2);
+        }
+    }
+
+    if (expected.objectAttributeHash != actual.objectAttributeHash) {
+        return "OAM contents";
+    }
+    if (expected.outputScreenHash != actual.outputScreenHash) {
+        return "Output screen";
+    }
+    if (expected.tick != actual.tick) {
+        return "Tick: " + std::to_string(expected.tick) +
+               " != " + std::to_string(actual.tick);
+    }
+    return std::string();
+}
+
+std::string FormatState(const NesState& state) {
+    char line[160];
+    std::snprintf(line, sizeof(line),
+                  "PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%u "
+                  "PPU:%3d,%3d CTRL:%02X MASK:%02X STATUS:%02X V:%04X",
+                  state.programCounter, state.registerA, state.registerX,
+                  state.registerY, state.statusRegister, state.stackPointer,
+                  state.remainingCycles, state.scanLine, state.cycle,
+                  state.ppuControl, state.ppuMask, state.ppuStatus,
+                  state.vramAddress);
+    return line;
+}
+
+uint64_t HashMemory(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = 0xCBF29CE484222325;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3;
+    }
+    return hash;
+}
+
+}  // namespace dearnes
@@ -0,0 +1,158 @@
+// Copyright (c) 2020 Emmanuel Arias
+#include "dear_nes_lib/pixel_compositor.h"
+
+#include "dear_nes_lib/host_features.h"
+
+#if defined(DEARNES_HOST_X64)
+#include <immintrin.h>
+#endif
+
+namespace dearnes {
+
+namespace {
+
+constexpr uint8_t kColorMask = 0x03;
+constexpr uint8_t kIndexMask = 0x0F;
+constexpr uint8_t kSpritePalettes = 0x10;
+
+void ComposeScalar(const uint8_t* background, const uint8_t* sprites,
+                   size_t count, uint8_t* indices, uint32_t* spriteZeroHits) {
+    for (size_t block = 0; block < count; block += 32) {
+        uint32_t hits = 0;
+        for (size_t i = 0; i < 32; ++i) {
+            const uint8_t bgPixel = background[block + i];
+            const uint8_t fgPixel = sprites[block + i];
+            const bool isBackgroundOpaque = (bgPixel & kColorMask) != 0;
+            const bool isSpriteOpaque = (fgPixel & kColorMask) != 0;
+            if (isSpriteOpaque &&
+                (!isBackgroundOpaque ||
+                 !(fgPixel & PixelCompositor::kSpriteBehindBackground))) {
+                indices[block + i] = (fgPixel & kIndexMask) | kSpritePalettes;
+            } else {
+                indices[block + i] =
+                    isBackgroundOpaque ? bgPixel & kIndexMask : 0x00;
+            }
+            if (isBackgroundOpaque &&
+                (fgPixel & PixelCompositor::kSpriteZero)) {
+                hits |= 1u << i;
+            }
+        }
+        spriteZeroHits[block / 32] = hits;
+    }
+}
+
+#if defined(DEARNES_HOST_X64)
+void ComposeSse2(const uint8_t* background, const uint8_t* sprites,
+                 size_t count, uint8_t* indices, uint32_t* spriteZeroHits) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colorMask = _mm_set1_epi8(kColorMask);
+    const __m128i indexMask = _mm_set1_epi8(kIndexMask);
+    const __m128i spritePalettes = _mm_set1_epi8(kSpritePalettes);
+    const __m128i behindFlag =
+        _mm_set1_epi8(PixelCompositor::kSpriteBehindBackground);
+    const __m128i spriteZeroFlag = _mm_set1_epi8(PixelCompositor::kSpriteZero);
+    for (size_t i = 0; i < count; i += 16) {
+        const __m128i bgPixels = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(background + i));
+        const __m128i fgPixels =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(sprites + i));
+
+        const __m128i isBackgroundTransparent =
+            _mm_cmpeq_epi8(_mm_and_si128(bgPixels, colorMask), zero);
+        const __m128i isSpriteTransparent =
+            _mm_cmpeq_epi8(_mm_and_si128(fgPixels, colorMask), zero);
+        const __m128i isSpriteInFront =
+            _mm_cmpeq_epi8(_mm_and_si128(fgPixels, behindFlag), zero);
+
+        // The sprite wins if it is opaque, and in front or over a
+        // transparent background
+        const __m128i useSprite = _mm_andnot_si128(
+            isSpriteTransparent,
+            _mm_or_si128(isBackgroundTransparent, isSpriteInFront));
+        const __m128i spriteIndices = _mm_or_si128(
+            _mm_and_si128(fgPixels, indexMask), spritePalettes);
+        const __m128i backgroundIndices = _mm_andnot_si128(
+            isBackgroundTransparent, _mm_and_si128(bgPixels, indexMask));
+        const __m128i result =
+            _mm_or_si128(_mm_and_si128(useSprite, spriteIndices),
+                         _mm_andnot_si128(useSprite, backgroundIndices));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), result);
+
+        const __m128i isSpriteZero = _mm_cmpeq_epi8(
+            _mm_and_si128(fgPixels, spriteZeroFlag), spriteZeroFlag);
+        const uint32_t hits = static_cast<uint32_t>(_mm_movemask_epi8(
+            _mm_andnot_si128(isBackgroundTransparent, isSpriteZero)));
+        if (i % 32 == 0) {
+            spriteZeroHits[i / 32] = hits;
+        } else {
+            spriteZeroHits[i / 32] |= hits << 16;
+        }
+    }
+}
+
+DEARNES_TARGET_AVX2
+void ComposeAvx2(const uint8_t* background, const uint8_t* sprites,
+                 size_t count, uint8_t* indices, uint32_t* spriteZeroHits) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i colorMask = _mm256_set1_epi8(kColorMask);
+    const __m256i indexMask = _mm256_set1_epi8(kIndexMask);
+    const __m256i spritePalettes = _mm256_set1_epi8(kSpritePalettes);
+    const __m256i behindFlag =
+        _mm256_set1_epi8(PixelCompositor::kSpriteBehindBackground);
+    const __m256i spriteZeroFlag =
+        _mm256_set1_epi8(PixelCompositor::kSpriteZero);
+    for (size_t i = 0; i < count; i += 32) {
+        const __m256i bgPixels = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(background + i));
+        const __m256i fgPixels =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sprites + i));
+
+        const __m256i isBackgroundTransparent =
+            _mm256_cmpeq_epi8(_mm256_and_si256(bgPixels, colorMask), zero);
+        const __m256i isSpriteTransparent =
+            _mm256_cmpeq_epi8(_mm256_and_si256(fgPixels, colorMask), zero);
+        const __m256i isSpriteInFront =
+            _mm256_cmpeq_epi8(_mm256_and_si256(fgPixels, behindFlag), zero);
+
+        const __m256i useSprite = _mm256_andnot_si256(
+            isSpriteTransparent,
+            _mm256_or_si256(isBackgroundTransparent, isSpriteInFront));
+        const __m256i spriteIndices = _mm256_or_si256(
+            _mm256_and_si256(fgPixels, indexMask), spritePalettes);
+        const __m256i backgroundIndices = _mm256_andnot_si256(
+            isBackgroundTransparent, _mm256_and_si256(bgPixels, indexMask));
+        const __m256i result = _mm256_blendv_epi8(backgroundIndices,
+                                                  spriteIndices, useSprite);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(indices + i), result);
+
+        const __m256i isSpriteZero = _mm256_cmpeq_epi8(
+            _mm256_and_si256(fgPixels, spriteZeroFlag), spriteZeroFlag);
+        spriteZeroHits[i / 32] = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_andnot_si256(isBackgroundTransparent, isSpriteZero)));
+    }
+}
+#endif
+
+}  // namespace
+
+void PixelCompositor::Compose(const uint8_t* background,
+                              const uint8_t* sprites, size_t count,
+                              uint8_t* indices,
+                              uint32_t* spriteZeroHits) const {
+    switch (GetKernel()) {
+#if defined(DEARNES_HOST_X64)
+        case Kernel::kSse2:
+            ComposeSse2(background, sprites, count, indices, spriteZeroHits);
+            break;
+        case Kernel::kAvx2:
+            ComposeAvx2(background, sprites, count, indices, spriteZeroHits);
+            break;
+#endif
+        default:
+            ComposeScalar(background, sprites, count, indices,
+                          spriteZeroHits);
+            break;
+    }
+}
+
+}  // namespace dearnes
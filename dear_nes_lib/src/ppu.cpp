@@ -1,26 +1,227 @@
 // Copyright (c) 2020 Emmanuel Arias
 #include "dear_nes_lib/ppu.h"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstring>
 
 #include "dear_nes_lib/cartridge.h"
+#include "dear_nes_lib/host_features.h"
+#include "dear_nes_lib/scheduler.h"
+
+#if defined(DEARNES_HOST_X64)
+#include <emmintrin.h>
+#endif
 
 namespace dearnes {
 
-Ppu::Ppu() : m_OutputScreen{new int[256 * 240]} {}
+namespace {
+
+constexpr int16_t kCyclesPerScanLine = 341;
+constexpr int16_t kScanLinesPerFrame = 262;
+
+// Position of a PPU cycle within the frame. The pre-render scan line -1 is
+// the first one
+constexpr uint64_t GetFramePosition(int16_t scanLine, int16_t cycle) {
+    return static_cast<uint64_t>(scanLine + 1) * kCyclesPerScanLine + cycle;
+}
+
+// Cycles from the current position until the cycle at the target position,
+// both included, in a frame of the given length
+constexpr uint64_t GetCyclesUntil(uint64_t currentPosition,
+                                  uint64_t targetPosition,
+                                  uint64_t cyclesPerFrame) {
+    return (targetPosition + cyclesPerFrame - currentPosition) %
+               cyclesPerFrame +
+           1;
+}
+
+// Scan lines that do the same actions on every cycle
+enum ScanLineClass : uint8_t {
+    kPreRenderScanLine = 0,
+    kFirstVisibleScanLine,
+    kVisibleScanLine,
+    kVerticalBlankStartScanLine,
+    kIdleScanLine,
+    kScanLineClassSize
+};
+
+constexpr ScanLineClass GetScanLineClass(int16_t scanLine) {
+    if (scanLine == -1) {
+        return kPreRenderScanLine;
+    }
+    if (scanLine == 0) {
+        return kFirstVisibleScanLine;
+    }
+    if (scanLine < 240) {
+        return kVisibleScanLine;
+    }
+    return scanLine == 241 ? kVerticalBlankStartScanLine : kIdleScanLine;
+}
+
+constexpr uint16_t GetActionBit(PpuAction action) {
+    return static_cast<uint16_t>(1 << action);
+}
+
+// The actions of a cycle, one bit each. They run in the order of PpuAction
+constexpr uint16_t GetCycleActions(ScanLineClass scanLineClass,
+                                   int16_t cycle) {
+    uint16_t actions = 0;
+    if (scanLineClass == kPreRenderScanLine) {
+        if (cycle == 1) {
+            actions |= GetActionBit(kPrerenderClear);
+        } else if (cycle >= 280 && cycle < 305) {
+            actions |= GetActionBit(kPrerenderTransferY);
+        }
+    }
+    if (scanLineClass == kFirstVisibleScanLine && cycle == 0) {
+        actions |= GetActionBit(kRenderSkipOdd);
+    }
+    if (scanLineClass == kPreRenderScanLine ||
+        scanLineClass == kFirstVisibleScanLine ||
+        scanLineClass == kVisibleScanLine) {
+        if ((cycle >= 2 && cycle < 258) || (cycle >= 321 && cycle < 338)) {
+            actions |= GetActionBit(kRenderProcessNextTile);
+        }
+        if (cycle == 256) {
+            actions |= GetActionBit(kRenderIncrementScrollY);
+        }
+        if (cycle == 257) {
+            actions |= GetActionBit(kRenderLoadShiftersAndTransferX);
+        }
+        if (cycle == 338 || cycle == 340) {
+            actions |= GetActionBit(kRenderLoadNextBackgroundTile);
+        }
+        if (cycle == 257 && scanLineClass != kPreRenderScanLine) {
+            actions |= GetActionBit(kRenderDoOAMTransfer);
+        }
+        if (cycle == 340) {
+            actions |= GetActionBit(kRenderUpdateSprites);
+        }
+    }
+    if (scanLineClass == kVerticalBlankStartScanLine && cycle == 1) {
+        actions |= GetActionBit(kRenderEndFrameRendering);
+    }
+    return actions;
+}
+
+// A cycle of the timeline: its actions, and the amount of cycles from it to
+// the end of the run of cycles with the same actions, within the scan line
+struct TimelineCycle {
+    uint16_t actions;
+    int16_t runLength;
+};
 
-Ppu::~Ppu() { delete[] m_OutputScreen; }
+using Timeline = std::array<std::array<TimelineCycle, kCyclesPerScanLine>,
+                            kScanLineClassSize>;
+
+constexpr Timeline CreateTimeline() {
+    Timeline timeline{};
+    for (uint8_t lineClass = 0; lineClass < kScanLineClassSize; ++lineClass) {
+        auto& cycles = timeline[lineClass];
+        for (int16_t cycle = kCyclesPerScanLine - 1; cycle >= 0; --cycle) {
+            const uint16_t actions = GetCycleActions(
+                static_cast<ScanLineClass>(lineClass), cycle);
+            const bool continuesRun = cycle + 1 < kCyclesPerScanLine &&
+                                      cycles[cycle + 1].actions == actions;
+            cycles[cycle].actions = actions;
+            cycles[cycle].runLength =
+                continuesRun ? cycles[cycle + 1].runLength + 1 : 1;
+        }
+    }
+    return timeline;
+}
+
+// The actions of every cycle of the frame, by the class of its scan line
+constexpr Timeline kTimeline = CreateTimeline();
+
+static_assert(kTimeline[kVisibleScanLine][2].runLength == 254,
+              "The cycles 2 to 255 of a visible scan line are one run");
+
+// The sprites whose rows cover a scan line, a bit for each of the 64 sprites
+// of the OAM, from the lowest one
+uint64_t GetSpritesOnScanLine(const uint8_t (&spriteY)[64], int16_t scanLine,
+                              uint8_t spriteHeight) {
+    uint64_t sprites = 0;
+#if defined(DEARNES_HOST_X64)
+    // The row of the scan line in the sprite, line - y, is only valid when
+    // y <= line, and then it fits in a byte
+    const __m128i line = _mm_set1_epi8(static_cast<char>(scanLine));
+    const __m128i lastRow = _mm_set1_epi8(static_cast<char>(spriteHeight - 1));
+    for (int i = 0; i < 4; ++i) {
+        const __m128i y =
+            _mm_load_si128(reinterpret_cast<const __m128i*>(&spriteY[16 * i]));
+        const __m128i isAboveLine = _mm_cmpeq_epi8(_mm_min_epu8(y, line), y);
+        const __m128i row = _mm_sub_epi8(line, y);
+        const __m128i isRowInSprite =
+            _mm_cmpeq_epi8(_mm_min_epu8(row, lastRow), row);
+        const uint64_t mask = static_cast<uint16_t>(
+            _mm_movemask_epi8(_mm_and_si128(isAboveLine, isRowInSprite)));
+        sprites |= mask << (16 * i);
+    }
+#else
+    for (int i = 0; i < 64; ++i) {
+        const int16_t row = scanLine - spriteY[i];
+        if (row >= 0 && row < spriteHeight) {
+            sprites |= static_cast<uint64_t>(1) << i;
+        }
+    }
+#endif
+    return sprites;
+}
+
+}  // namespace
+
+Ppu::Ppu()
+    : m_IndexScreen{new uint8_t[256 * 240]()},
+      m_OutputScreen{new int[256 * 240]()},
+      m_ScanLineClass{GetScanLineClass(m_ScanLine)} {
+    SetMirroringMode(CartridgeHeader::MIRRORING_MODE::HORIZONTAL);
+}
+
+Ppu::~Ppu() {
+    delete[] m_IndexScreen;
+    delete[] m_OutputScreen;
+}
 
 int Ppu::GetColorFromPalette(uint8_t palette, uint8_t pixel) {
     assert(pixel <= 3);
-    uint8_t data = PpuRead(0x3F00 + (palette << 2) + pixel) & 0x3F;
+    return m_PalScreen[GetColorIndexFromPalette(palette, pixel)];
+}
 
-    return m_PalScreen[data];
+const int* Ppu::GetOutputScreen() const {
+    // ARGB words are stored as BGRA on little-endian processors
+    if (m_IsOutputScreenStale) {
+        m_FrameConverter.Convert(m_IndexScreen, 256 * 240,
+                                 PixelFormat::kBgra8888, m_OutputScreen);
+        m_IsOutputScreenStale = false;
+    }
+    return m_OutputScreen;
 }
 
-const int* Ppu::GetOutputScreen() const { return m_OutputScreen; }
+void Ppu::CopyOutputScreen(void* pixels, size_t pitch,
+                           PixelFormat format) const {
+    uint8_t* row = static_cast<uint8_t*>(pixels);
+    for (int y = 0; y < 240; ++y, row += pitch) {
+        m_FrameConverter.Convert(m_IndexScreen + y * 256, 256, format, row);
+    }
+}
+
+void Ppu::SetOutputTarget(void* pixels, size_t pitch, PixelFormat format) {
+    m_OutputTarget = static_cast<uint8_t*>(pixels);
+    m_OutputTargetPitch = pitch;
+    m_OutputTargetFormat = format;
+}
+
+void Ppu::FinishScanLine(int16_t scanLine) {
+    m_IsOutputScreenStale = true;
+    if (m_OutputTarget) {
+        m_FrameConverter.Convert(
+            m_IndexScreen + scanLine * 256, 256, m_OutputTargetFormat,
+            m_OutputTarget + scanLine * m_OutputTargetPitch);
+    }
+}
 
 bool Ppu::IsFrameCompleted() const { return m_FrameIsCompleted; }
 
@@ -36,21 +237,35 @@ uint8_t Ppu::CpuRead(uint16_t address, bool readOnly) {
         case 0x0002:  // Status
             data = static_cast<uint8_t>(m_StatusReg.GetRegister() & 0xE0) |
                    static_cast<uint8_t>(m_PpuDataBuffer & 0x1F);
-            m_StatusReg.SetField(VERTICAL_BLANK, false);
+            if (readOnly) {
+                break;
+            }
+            SetStatusField(VERTICAL_BLANK, false);
             m_AddressLatch = 0x00;
             break;
         case 0x0003:  // OAM address
             break;
         case 0x0004:  // OAM data
-            data = m_OAMPtr[m_OAMAddress];
+            data = ReadOam(m_OAMAddress);
             break;
         case 0x0005:  // Scroll
             break;
         case 0x0006:  // PPU address
             break;
         case 0x0007:  // PPU data
+            if (readOnly) {
+                // The palette is read directly, the rest through the buffer
+                data = m_VramAddress.reg > 0x3F00
+                           ? PpuRead(m_VramAddress.reg)
+                           : m_PpuDataBuffer;
+                break;
+            }
             data = m_PpuDataBuffer;
             m_PpuDataBuffer = PpuRead(m_VramAddress.reg);
+            // Its low bits are read from the status register too
+            if (((data ^ m_PpuDataBuffer) & 0x1F) != 0x00) {
+                m_StatusChangeTick = m_Tick;
+            }
 
             if (m_VramAddress.reg > 0x3F00) {
                 data = m_PpuDataBuffer;
@@ -71,6 +286,8 @@ void Ppu::CpuWrite(uint16_t address, uint8_t data) {
                 m_ControlReg.GetField(ControlRegisterFields::NAMETABLE_X);
             m_TramAddress.nametable_y =
                 m_ControlReg.GetField(ControlRegisterFields::NAMETABLE_Y);
+            // The NMI might have been enabled
+            ScheduleEvents();
             break;
         case 0x0001:  // mask
             m_MaskReg.SetRegister(data);
@@ -81,7 +298,7 @@ void Ppu::CpuWrite(uint16_t address, uint8_t data) {
             m_OAMAddress = data;
             break;
         case 0x0004:  // OAM data
-            m_OAMPtr[m_OAMAddress] = data;
+            WriteOam(m_OAMAddress, data);
             break;
         case 0x0005:  // Scroll
             if (m_AddressLatch == 0x00) {
@@ -118,93 +335,89 @@ void Ppu::CpuWrite(uint16_t address, uint8_t data) {
 void Ppu::ConnectCatridge(Cartridge* cartridge) {
     // Logger::Get().Log("PPU", "Connecting cartridge");
     m_Cartridge = cartridge;
+    m_TileCache.InvalidateAll();
+    if (m_Cartridge) {
+        SetMirroringMode(m_Cartridge->GetMirroringMode());
+    }
 }
 
-uint8_t Ppu::PpuRead(uint16_t address, bool readOnly) {
+void Ppu::SetMirroringMode(CartridgeHeader::MIRRORING_MODE mode) {
+    // Nametable memory of the slots $2000, $2400, $2800 and $2C00
+    uint8_t* const first = m_Nametables[0];
+    uint8_t* const second = m_Nametables[1];
+    switch (mode) {
+        case CartridgeHeader::MIRRORING_MODE::HORIZONTAL:
+            m_NametableSlots[0] = m_NametableSlots[1] = first;
+            m_NametableSlots[2] = m_NametableSlots[3] = second;
+            break;
+        case CartridgeHeader::MIRRORING_MODE::VERTICAL:
+            m_NametableSlots[0] = m_NametableSlots[2] = first;
+            m_NametableSlots[1] = m_NametableSlots[3] = second;
+            break;
+        case CartridgeHeader::MIRRORING_MODE::ONESCREEN_LO:
+            m_NametableSlots[0] = m_NametableSlots[1] = first;
+            m_NametableSlots[2] = m_NametableSlots[3] = first;
+            break;
+        case CartridgeHeader::MIRRORING_MODE::ONESCREEN_HI:
+            m_NametableSlots[0] = m_NametableSlots[1] = second;
+            m_NametableSlots[2] = m_NametableSlots[3] = second;
+            break;
+        case CartridgeHeader::MIRRORING_MODE::FOUR_SCREEN:
+            m_NametableSlots[0] = first;
+            m_NametableSlots[1] = second;
+            m_NametableSlots[2] = m_CartridgeNametables[0];
+            m_NametableSlots[3] = m_CartridgeNametables[1];
+            break;
+    }
+}
+
+uint8_t Ppu::PpuRead(uint16_t address) {
     uint8_t data = 0x00;
     address &= 0x3FFF;
 
-    if (m_Cartridge && m_Cartridge->PpuRead(address, data)) {
-    } else if (address >= 0x0000 && address <= 0x1FFF) {
-        data = m_PatternTables[(address & 0x1000) >> 12][address & 0x0FFF];
-    } else if (address >= 0x2000 && address <= 0x3EFF) {
-        address &= 0x0FFF;
-        if (m_Cartridge && m_Cartridge->GetMirroringMode() ==
-                               CartridgeHeader::MIRRORING_MODE::VERTICAL) {
-            // Vertical
-            if (address >= 0x0000 && address <= 0x03FF)
-                data = m_Nametables[0][address & 0x03FF];
-            if (address >= 0x0400 && address <= 0x07FF)
-                data = m_Nametables[1][address & 0x03FF];
-            if (address >= 0x0800 && address <= 0x0BFF)
-                data = m_Nametables[0][address & 0x03FF];
-            if (address >= 0x0C00 && address <= 0x0FFF)
-                data = m_Nametables[1][address & 0x03FF];
-        } else if (m_Cartridge &&
-                   m_Cartridge->GetMirroringMode() ==
-                       CartridgeHeader::MIRRORING_MODE::HORIZONTAL) {
-            // Horizontal
-            if (address >= 0x0000 && address <= 0x03FF)
-                data = m_Nametables[0][address & 0x03FF];
-            if (address >= 0x0400 && address <= 0x07FF)
-                data = m_Nametables[0][address & 0x03FF];
-            if (address >= 0x0800 && address <= 0x0BFF)
-                data = m_Nametables[1][address & 0x03FF];
-            if (address >= 0x0C00 && address <= 0x0FFF)
-                data = m_Nametables[1][address & 0x03FF];
-        }
-    } else if (address >= 0x3F00 && address <= 0x3FFF) {
-        address &= 0x001F;
-        if (address == 0x0010) address = 0x0000;
-        if (address == 0x0014) address = 0x0004;
-        if (address == 0x0018) address = 0x0008;
-        if (address == 0x001C) address = 0x000C;
-        data = m_PaletteTable[address];
+    if (address <= 0x1FFF) {
+        if (!m_Cartridge || !m_Cartridge->PpuRead(address, data)) {
+            data = m_PatternTables[(address & 0x1000) >> 12][address & 0x0FFF];
+        }
+    } else if (address <= 0x3EFF) {
+        data = ReadNametable(address);
+    } else {
+        data = m_PaletteTable[kPaletteAddresses[address & 0x001F]];
     }
     return data;
 }
 
 void Ppu::PpuWrite(uint16_t address, uint8_t data) {
     address &= 0x3FFF;
-    if (m_Cartridge && m_Cartridge->PpuWrite(address, data)) {
-    } else if (address >= 0x0000 && address <= 0x1FFF) {
-        m_PatternTables[(address & 0x1000) >> 12][address & 0x0FFF] = data;
-    } else if (address >= 0x2000 && address <= 0x3EFF) {
-        address &= 0x0FFF;
-        if (m_Cartridge && m_Cartridge->GetMirroringMode() ==
-                               CartridgeHeader::MIRRORING_MODE::VERTICAL) {
-            // Vertical
-            if (address >= 0x0000 && address <= 0x03FF)
-                m_Nametables[0][address & 0x03FF] = data;
-            if (address >= 0x0400 && address <= 0x07FF)
-                m_Nametables[1][address & 0x03FF] = data;
-            if (address >= 0x0800 && address <= 0x0BFF)
-                m_Nametables[0][address & 0x03FF] = data;
-            if (address >= 0x0C00 && address <= 0x0FFF)
-                m_Nametables[1][address & 0x03FF] = data;
-        } else if (m_Cartridge &&
-                   m_Cartridge->GetMirroringMode() ==
-                       CartridgeHeader::MIRRORING_MODE::HORIZONTAL) {
-            // Horizontal
-            if (address >= 0x0000 && address <= 0x03FF)
-                m_Nametables[0][address & 0x03FF] = data;
-            if (address >= 0x0400 && address <= 0x07FF)
-                m_Nametables[0][address & 0x03FF] = data;
-            if (address >= 0x0800 && address <= 0x0BFF)
-                m_Nametables[1][address & 0x03FF] = data;
-            if (address >= 0x0C00 && address <= 0x0FFF)
-                m_Nametables[1][address & 0x03FF] = data;
-        }
-    } else if (address >= 0x3F00 && address <= 0x3FFF) {
-        address &= 0x001F;
-        if (address == 0x0010) address = 0x0000;
-        if (address == 0x0014) address = 0x0004;
-        if (address == 0x0018) address = 0x0008;
-        if (address == 0x001C) address = 0x000C;
-        m_PaletteTable[address] = data;
+    if (address <= 0x1FFF) {
+        m_TileCache.Invalidate(address, address);
+        if (!m_Cartridge || !m_Cartridge->PpuWrite(address, data)) {
+            m_PatternTables[(address & 0x1000) >> 12][address & 0x0FFF] = data;
+        }
+    } else if (address <= 0x3EFF) {
+        m_NametableSlots[(address >> 10) & 0x03][address & 0x03FF] = data;
+    } else {
+        m_PaletteTable[kPaletteAddresses[address & 0x001F]] = data;
     }
 }
 
+void Ppu::InvalidatePatternTiles(uint16_t firstAddress,
+                                 uint16_t lastAddress) {
+    m_TileCache.Invalidate(firstAddress, lastAddress);
+}
+
+uint64_t Ppu::GetPatternRow(uint16_t address, bool isFlipped) {
+    if (!m_TileCache.IsDecoded(address)) {
+        const uint16_t tileAddress = address & 0x1FF0;
+        uint8_t data[16];
+        for (uint16_t i = 0; i < 16; ++i) {
+            data[i] = PpuRead(tileAddress + i);
+        }
+        m_TileCache.Decode(tileAddress, data);
+    }
+    return m_TileCache.GetRow(address, isFlipped);
+}
+
 void Ppu::UpdateShifters() {
     if (m_MaskReg.GetField(RENDER_BACKGROUND)) {
         m_BackgroundShifter.patternLo <<= 1;
@@ -238,6 +451,37 @@ void Ppu::LoadBackgroundShifters() {
         ((m_NextBackgroundTileInfo.attribute & 0b10) ? 0xFF : 0x00);
 };
 
+void Ppu::FetchBackgroundTileId() {
+    m_NextBackgroundTileInfo.id = ReadNametable(m_VramAddress.reg);
+}
+
+void Ppu::FetchBackgroundTileAttribute() {
+    m_NextBackgroundTileInfo.attribute =
+        ReadNametable(0x23C0 | (m_VramAddress.nametable_y << 11) |
+                      (m_VramAddress.nametable_x << 10) |
+                      ((m_VramAddress.coarse_y >> 2) << 3) |
+                      (m_VramAddress.coarse_x >> 2));
+    if (m_VramAddress.coarse_y & 0x02) m_NextBackgroundTileInfo.attribute >>= 4;
+    if (m_VramAddress.coarse_x & 0x02) m_NextBackgroundTileInfo.attribute >>= 2;
+    m_NextBackgroundTileInfo.attribute &= 0x03;
+}
+
+void Ppu::FetchBackgroundTileLsb() {
+    m_NextBackgroundTileInfo.lsb = PpuRead(
+        (m_ControlReg.GetField(ControlRegisterFields::PATTERN_BACKGROUND)
+         << 12) +
+        ((uint16_t)m_NextBackgroundTileInfo.id << 4) +
+        (m_VramAddress.fine_y + 0));
+}
+
+void Ppu::FetchBackgroundTileMsb() {
+    m_NextBackgroundTileInfo.msb = PpuRead(
+        (m_ControlReg.GetField(ControlRegisterFields::PATTERN_BACKGROUND)
+         << 12) +
+        ((uint16_t)m_NextBackgroundTileInfo.id << 4) +
+        (m_VramAddress.fine_y + 8));
+}
+
 void Ppu::IncrementScrollX() {
     if (m_MaskReg.GetField(MaskRegisterFields::RENDER_BACKGROUND) ||
         m_MaskReg.GetField(MaskRegisterFields::RENDER_SPRITES)) {
@@ -266,46 +510,118 @@ bool Ppu::NeedsToDoNMI() {
     return false;
 }
 
-size_t Ppu::GetNextActions(std::array<PpuAction, 3>& nextActions) {
-    size_t arrIndex = 0;
-    if (const bool isPreRenderScanline = m_ScanLine == -1;
-        isPreRenderScanline) {
-        if (m_Cycle == 1) {
-            nextActions[arrIndex++] = PpuAction::kPrerenderClear;
-        } else if (m_Cycle >= 280 && m_Cycle < 305) {
-            nextActions[arrIndex++] = PpuAction::kPrerenderTransferY;
+template <bool kVideoOutput, PpuRendering kRendering>
+void Ppu::CatchUp() {
+    while (m_PendingCycles > 0) {
+        if constexpr (kRendering == PpuRendering::kScanLine) {
+            // No CPU access can happen within the deferred cycles
+            if (m_Cycle == 0 && m_ScanLine >= 0 && m_ScanLine < 240 &&
+                m_PendingCycles >= kCyclesPerScanLine) {
+                RenderScanLine<kVideoOutput>();
+                m_PendingCycles -= kCyclesPerScanLine;
+                continue;
+            }
+            // Apart from the start of the vertical blank, on the cycle 1 of
+            // the scan line 241, the PPU does nothing after the visible ones
+            if (m_ScanLine >= 240 && (m_ScanLine != 241 || m_Cycle > 1)) {
+                const int16_t cycles = static_cast<int16_t>(std::min<uint64_t>(
+                    m_PendingCycles, kCyclesPerScanLine - m_Cycle));
+                SkipIdleCycles(cycles);
+                m_PendingCycles -= cycles;
+                continue;
+            }
         }
+        m_PendingCycles -= ClockRun<kVideoOutput>(m_PendingCycles);
     }
-    if (m_ScanLine == 0 && m_Cycle == 0) {
-        nextActions[arrIndex++] = PpuAction::kRenderSkipOdd;
+}
+
+template void Ppu::CatchUp<true, PpuRendering::kDot>();
+template void Ppu::CatchUp<true, PpuRendering::kScanLine>();
+template void Ppu::CatchUp<false, PpuRendering::kDot>();
+template void Ppu::CatchUp<false, PpuRendering::kScanLine>();
+
+uint64_t Ppu::GetCyclesUntilNMI() const {
+    if (!m_ControlReg.GetField(ControlRegisterFields::ENABLE_NMI)) {
+        return kNoPendingEvent;
     }
-    if (const bool isRenderScanline = m_ScanLine >= -1 && m_ScanLine < 240;
-        isRenderScanline) {
-        if ((m_Cycle >= 2 && m_Cycle < 258) ||
-            (m_Cycle >= 321 && m_Cycle < 338)) {
-            nextActions[arrIndex++] = PpuAction::kRenderProcessNextTile;
-        }
-        if (m_Cycle == 256) {
-            nextActions[arrIndex++] = PpuAction::kRenderIncrementScrollY;
-        }
-        if (m_Cycle == 257) {
-            nextActions[arrIndex++] =
-                PpuAction::kRenderLoadShiftersAndTransferX;
-        }
-        if (m_Cycle == 338 || m_Cycle == 340) {
-            nextActions[arrIndex++] = PpuAction::kRenderLoadNextBackgroundTile;
-        }
-        if (m_Cycle == 257 && m_ScanLine >= 0) {
-            nextActions[arrIndex++] = PpuAction::kRenderDoOAMTransfer;
-        }
-        if (m_Cycle == 340) {
-            nextActions[arrIndex++] = PpuAction::kRenderUpdateSprites;
-        }
+    // The NMI is requested by the cycle 1 of the scan line 241
+    return GetCyclesUntil(GetFramePosition(m_ScanLine, m_Cycle),
+                          GetFramePosition(241, 1), GetCyclesPerFrame());
+}
+
+uint64_t Ppu::GetCyclesUntilFrameCompleted() const {
+    // The frame is completed by the last cycle of the last scan line
+    const uint64_t cyclesPerFrame = GetCyclesPerFrame();
+    return GetCyclesUntil(GetFramePosition(m_ScanLine, m_Cycle),
+                          cyclesPerFrame - 1, cyclesPerFrame);
+}
+
+uint64_t Ppu::GetCyclesUntilSpriteEvaluation() const {
+    // The OAM is read by the cycle 257 of the visible scan lines
+    constexpr int16_t kEvaluationCycle = 257;
+    const uint64_t position = GetFramePosition(m_ScanLine, m_Cycle);
+    int16_t scanLine =
+        m_Cycle <= kEvaluationCycle ? m_ScanLine : m_ScanLine + 1;
+    if (scanLine < 0 || scanLine >= 240) {
+        scanLine = 0;
     }
-    if (m_ScanLine == 241 && m_Cycle == 1) {  // covered
-        nextActions[arrIndex++] = PpuAction::kRenderEndFrameRendering;
+    return GetCyclesUntil(position,
+                          GetFramePosition(scanLine, kEvaluationCycle),
+                          GetCyclesPerFrame());
+}
+
+uint64_t Ppu::GetCyclesUntilStatusChange() const {
+    // Reading it clears the vertical blank flag, and the sprite zero hit can
+    // be found on any cycle
+    if (m_StatusReg.GetField(VERTICAL_BLANK) ||
+        (m_SpriteZeroHitPossible && !m_StatusReg.GetField(SPRITE_ZERO_HIT) &&
+         m_MaskReg.GetField(RENDER_BACKGROUND) &&
+         m_MaskReg.GetField(RENDER_SPRITES))) {
+        return 1;
+    }
+    // Otherwise, it changes when the vertical blank starts or ends, and when
+    // the sprite overflow is found
+    const uint64_t position = GetFramePosition(m_ScanLine, m_Cycle);
+    const uint64_t cyclesPerFrame = GetCyclesPerFrame();
+    return std::min(
+        {GetCyclesUntil(position, GetFramePosition(241, 1), cyclesPerFrame),
+         GetCyclesUntil(position, GetFramePosition(-1, 1), cyclesPerFrame),
+         GetCyclesUntilSpriteEvaluation()});
+}
+
+void Ppu::SetExtraScanLines(uint16_t scanLines) {
+    m_RequestedExtraScanLines = scanLines;
+}
+
+uint64_t Ppu::GetCyclesPerFrame() const {
+    return static_cast<uint64_t>(kScanLinesPerFrame + m_ExtraScanLines) *
+           kCyclesPerScanLine;
+}
+
+void Ppu::SetScheduler(Scheduler* scheduler) { m_Scheduler = scheduler; }
+
+void Ppu::SynchronizeTick(uint64_t tick) {
+    m_Tick = tick;
+    m_StatusChangeTick = tick;
+    ScheduleEvents();
+}
+
+void Ppu::ScheduleEvents() {
+    if (m_Scheduler == nullptr) {
+        return;
+    }
+    // A pending NMI event is not moved, even if the NMI was disabled. It might
+    // be due on this tick, and the emulator checks NeedsToDoNMI() anyway
+    const uint64_t cyclesUntilNMI = GetCyclesUntilNMI();
+    if (cyclesUntilNMI != kNoPendingEvent &&
+        !m_Scheduler->IsScheduled(SchedulerEvent::kNonMaskableInterrupt)) {
+        m_Scheduler->Schedule(SchedulerEvent::kNonMaskableInterrupt,
+                              m_Tick + cyclesUntilNMI - 1);
+    }
+    if (!m_Scheduler->IsScheduled(SchedulerEvent::kFrameCompleted)) {
+        m_Scheduler->Schedule(SchedulerEvent::kFrameCompleted,
+                              m_Tick + GetCyclesUntilFrameCompleted() - 1);
     }
-    return arrIndex;
 }
 
 std::pair<uint8_t, uint8_t> Ppu::GetCurrentPixelToRender() {
@@ -378,11 +694,11 @@ std::pair<uint8_t, uint8_t> Ppu::GetCurrentPixelToRender() {
                 if (!(m_MaskReg.GetField(RENDER_BACKGROUND_LEFT) |
                       m_MaskReg.GetField(RENDER_SPRITES_LEFT))) {
                     if (m_Cycle >= 9 && m_Cycle < 258) {
-                        m_StatusReg.SetField(SPRITE_ZERO_HIT, true);
+                        SetStatusField(SPRITE_ZERO_HIT, true);
                     }
                 } else {
                     if (m_Cycle >= 1 && m_Cycle < 258) {
-                        m_StatusReg.SetField(SPRITE_ZERO_HIT, true);
+                        SetStatusField(SPRITE_ZERO_HIT, true);
                     }
                 }
             }
@@ -391,7 +707,55 @@ std::pair<uint8_t, uint8_t> Ppu::GetCurrentPixelToRender() {
     return std::make_pair(pixel, palette);
 }
 
+template <bool kVideoOutput>
 void Ppu::Clock() {
+    // Most cycles fetch tiles, or do nothing
+    const uint16_t actions = kTimeline[m_ScanLineClass][m_Cycle].actions;
+    if (actions == GetActionBit(kRenderProcessNextTile)) {
+        DoPpuActionRenderProcessNextTile();
+    } else if (actions != 0) {
+        RunCycleActions(actions);
+    }
+    RenderCyclePixel<kVideoOutput>();
+    AdvanceCycles(1);
+}
+
+template void Ppu::Clock<true>();
+template void Ppu::Clock<false>();
+
+template <bool kVideoOutput>
+int16_t Ppu::ClockRun(uint64_t maxCycles) {
+    const TimelineCycle& first = kTimeline[m_ScanLineClass][m_Cycle];
+    const int16_t cycles = static_cast<int16_t>(
+        std::min<uint64_t>(first.runLength, maxCycles));
+    // The run ends at the end of the scan line at most, so the class of the
+    // scan line does not change until its last cycle
+    switch (first.actions) {
+        case 0:
+            for (int16_t i = 0; i < cycles; ++i) {
+                RenderCyclePixel<kVideoOutput>();
+                AdvanceCycles(1);
+            }
+            break;
+        case GetActionBit(kRenderProcessNextTile):
+            for (int16_t i = 0; i < cycles; ++i) {
+                DoPpuActionRenderProcessNextTile();
+                RenderCyclePixel<kVideoOutput>();
+                AdvanceCycles(1);
+            }
+            break;
+        default:
+            for (int16_t i = 0; i < cycles; ++i) {
+                RunCycleActions(first.actions);
+                RenderCyclePixel<kVideoOutput>();
+                AdvanceCycles(1);
+            }
+            break;
+    }
+    return cycles;
+}
+
+void Ppu::RunCycleActions(uint16_t actions) {
     static constexpr std::array<void (Ppu::*)(), PpuAction::kPpuActionSize>
         ppuActionsCallbackFunctions = {
             &Ppu::DoPpuActionPrerenderClear,
@@ -406,41 +770,247 @@ void Ppu::Clock() {
             &Ppu::DoPpuActionRenderEndFrameRendering,
         };
 
-    std::array<PpuAction, 3> nextActions;
-    size_t actions = GetNextActions(nextActions);
-
-    for (int i = 0; i < actions; ++i) {
-        size_t actionCallbackIndex = static_cast<size_t>(nextActions[i]);
-        (this->*ppuActionsCallbackFunctions[actionCallbackIndex])();
+    for (size_t action = 0; actions != 0; ++action, actions >>= 1) {
+        if (actions & 0x01) {
+            (this->*ppuActionsCallbackFunctions[action])();
+        }
     }
+}
 
+template <bool kVideoOutput>
+void Ppu::RenderCyclePixel() {
     auto [pixel, palette] = GetCurrentPixelToRender();
 
-    const int x = static_cast<int>(m_Cycle - 1);
-    const int y = static_cast<int>(m_ScanLine);
-    const int color = GetColorFromPalette(palette, pixel);
-    if (x >= 0 && x < 256 && y >= 0 && y < 240) {
-        const int position = (y * 256) + x;
-        m_OutputScreen[position] = color;
+    if constexpr (kVideoOutput) {
+        const int x = static_cast<int>(m_Cycle - 1);
+        const int y = static_cast<int>(m_ScanLine);
+        if (x >= 0 && x < 256 && y >= 0 && y < 240) {
+            const int position = (y * 256) + x;
+            m_IndexScreen[position] = GetColorIndexFromPalette(palette, pixel);
+            m_IsOutputScreenStale = true;
+            if (x == 255) {
+                FinishScanLine(m_ScanLine);
+            }
+        }
     }
+}
 
-    ++m_Cycle;
-    if (m_Cycle >= 341) {
+void Ppu::AdvanceCycles(int16_t cycles) {
+    m_Tick += cycles;
+    m_Cycle += cycles;
+    if (m_Cycle >= kCyclesPerScanLine) {
         m_Cycle = 0;
         ++m_ScanLine;
-        if (m_ScanLine >= 261) {
+        // The extra scan lines follow the last one of the vertical blank.
+        // No action is done on them
+        if (m_ScanLine >= kScanLinesPerFrame - 1 + m_ExtraScanLines) {
             m_ScanLine = -1;
             m_FrameIsCompleted = true;
+            // The events of the new frame are predicted with its length
+            m_ExtraScanLines = m_RequestedExtraScanLines;
         }
+        m_ScanLineClass = GetScanLineClass(m_ScanLine);
+    }
+}
+
+template <bool kVideoOutput>
+void Ppu::RenderScanLine() {
+    const uint64_t lineTick = m_Tick;
+    const bool renderBackground = m_MaskReg.GetField(RENDER_BACKGROUND);
+    const bool renderSprites = m_MaskReg.GetField(RENDER_SPRITES);
+
+    // Opaque sprite pixels of the line, in the format of the pixel
+    // compositor. The first sprite found in the OAM is in front
+    alignas(32) uint8_t spritePixels[256] = {};
+    if (renderSprites) {
+        for (int i = m_SpriteCount - 1; i >= 0; --i) {
+            const int x = m_SpriteScanLine[i].x;
+            const uint8_t attribute = m_SpriteScanLine[i].attribute;
+            const uint8_t flags =
+                ((attribute & 0x03) << 2) |
+                ((attribute & 0x20) ? PixelCompositor::kSpriteBehindBackground
+                                    : 0x00) |
+                (i == 0 ? PixelCompositor::kSpriteZero : 0x00);
+            const uint8_t patternLo = m_SpriteShifterPatternLo[i];
+            const uint8_t patternHi = m_SpriteShifterPatternHi[i];
+            for (int j = 0; j < 8 && x + j < 256; ++j) {
+                const uint8_t pixel = (((patternHi >> (7 - j)) & 0x01) << 1) |
+                                      ((patternLo >> (7 - j)) & 0x01);
+                if (pixel != 0) {
+                    spritePixels[x + j] = pixel | flags;
+                }
+            }
+        }
+    }
+
+    // Background pixels of the line, as color index | palette << 2, in the
+    // order they go through the shifters: the two tiles loaded by the
+    // previous line, followed by the ones fetched on this one. The pixel x is
+    // at x + fine x
+    uint8_t bgPixels[16 + 32 * 8] = {};
+    if (renderBackground) {
+        const BackgroundShifter& shifter = m_BackgroundShifter;
+        for (int i = 0; i < 16; ++i) {
+            const int bit = 15 - i;
+            bgPixels[i] = (((shifter.attributeHi >> bit) & 0x01) << 3) |
+                          (((shifter.attributeLo >> bit) & 0x01) << 2) |
+                          (((shifter.patternHi >> bit) & 0x01) << 1) |
+                          ((shifter.patternLo >> bit) & 0x01);
+        }
+    }
+
+    // Cycles 1 to 256, a tile every 8 cycles. From the cycle 2 on, each one
+    // shifts the background first. The first cycle of a tile loads the
+    // shifters with the tile fetched by the previous one
+    const uint16_t patternTable =
+        m_ControlReg.GetField(ControlRegisterFields::PATTERN_BACKGROUND) << 12;
+    for (int tile = 0; tile < 32; ++tile) {
+        if (tile > 0) {
+            if (renderBackground) {
+                m_BackgroundShifter.patternLo <<= 1;
+                m_BackgroundShifter.patternHi <<= 1;
+                m_BackgroundShifter.attributeLo <<= 1;
+                m_BackgroundShifter.attributeHi <<= 1;
+            }
+            LoadBackgroundShifters();
+            FetchBackgroundTileId();
+        }
+        if (renderBackground) {
+            m_BackgroundShifter.patternLo <<= 7;
+            m_BackgroundShifter.patternHi <<= 7;
+            m_BackgroundShifter.attributeLo <<= 7;
+            m_BackgroundShifter.attributeHi <<= 7;
+        }
+        FetchBackgroundTileAttribute();
+        // Both bit planes come from a single row of the tile cache
+        const uint64_t row = GetPatternRow(
+            patternTable + (m_NextBackgroundTileInfo.id << 4) +
+                m_VramAddress.fine_y,
+            false);
+        m_NextBackgroundTileInfo.lsb = TileCache::GetLowPlane(row);
+        m_NextBackgroundTileInfo.msb = TileCache::GetHighPlane(row);
+        IncrementScrollX();
+        if (renderBackground) {
+            const uint64_t pixels =
+                row | (0x0101010101010101 *
+                       (m_NextBackgroundTileInfo.attribute << 2));
+            uint8_t* const tilePixels = &bgPixels[16 + tile * 8];
+            for (int x = 0; x < 8; ++x) {
+                tilePixels[x] = static_cast<uint8_t>(pixels >> (8 * x));
+            }
+        }
+    }
+
+    // Same priority rules as GetCurrentPixelToRender()
+    alignas(32) uint8_t indices[256];
+    uint32_t spriteZeroHits[256 / 32];
+    m_Compositor.Compose(bgPixels + m_FineX, spritePixels, 256, indices,
+                         spriteZeroHits);
+    if constexpr (kVideoOutput) {
+        // The CPU cannot write the palettes in the middle of the line
+        uint8_t colors[32];
+        for (uint8_t i = 0; i < 32; ++i) {
+            colors[i] = GetColorIndexFromPalette(i >> 2, i & 0x03);
+        }
+        uint8_t* const outputLine = m_IndexScreen + m_ScanLine * 256;
+        for (int x = 0; x < 256; ++x) {
+            outputLine[x] = colors[indices[x]];
+        }
+        FinishScanLine(m_ScanLine);
+    }
+
+    // The pixel x is composed on the cycle x + 1. The left edge of the screen
+    // only hits the sprite zero if one of its switches is on
+    if (m_SpriteZeroHitPossible && renderBackground && renderSprites &&
+        !m_StatusReg.GetField(SPRITE_ZERO_HIT)) {
+        const int firstX = (m_MaskReg.GetField(RENDER_BACKGROUND_LEFT) |
+                            m_MaskReg.GetField(RENDER_SPRITES_LEFT))
+                               ? 0
+                               : 8;
+        for (int x = firstX; x < 256; ++x) {
+            if ((spriteZeroHits[x / 32] >> (x % 32)) & 0x01) {
+                m_Tick = lineTick + x + 1;
+                SetStatusField(SPRITE_ZERO_HIT, true);
+                break;
+            }
+        }
+    }
+    DoPpuActionRenderIncrementScrollY();
+
+    // The cycles 2 to 256 count the x position of the sprites down to 0, and
+    // then shift their patterns
+    if (renderSprites) {
+        for (uint8_t i = 0; i < m_SpriteCount; ++i) {
+            const int shifts = 255 - m_SpriteScanLine[i].x;
+            m_SpriteScanLine[i].x = 0;
+            if (shifts >= 8) {
+                m_SpriteShifterPatternLo[i] = 0;
+                m_SpriteShifterPatternHi[i] = 0;
+            } else {
+                m_SpriteShifterPatternLo[i] <<= shifts;
+                m_SpriteShifterPatternHi[i] <<= shifts;
+            }
+        }
+    }
+
+    // The rest of the cycles as Clock() does them. The pixel of the cycle 257
+    // is not shown, but it can still hit the sprite zero, with the sprites of
+    // the next line. The cycle 340 leaves the sprite zero state
+    auto moveTo = [&](int16_t cycle) {
+        m_Cycle = cycle;
+        m_Tick = lineTick + cycle;
+    };
+    moveTo(257);
+    DoPpuActionRenderProcessNextTile();
+    DoPpuActionRenderLoadShiftersAndTransferX();
+    DoPpuActionRenderDoOAMTransfer();
+    GetCurrentPixelToRender();
+    for (int16_t cycle = 321; cycle < 338; ++cycle) {
+        moveTo(cycle);
+        DoPpuActionRenderProcessNextTile();
+    }
+    moveTo(338);
+    DoPpuActionRenderLoadNextBackgroundTile();
+    moveTo(340);
+    DoPpuActionRenderLoadNextBackgroundTile();
+    DoPpuActionRenderUpdateSprites();
+    GetCurrentPixelToRender();
+    AdvanceCycles(1);
+}
+
+void Ppu::SkipIdleCycles(int16_t cycles) {
+    // Nothing changes the pixel along the scan line. Only whether it hits the
+    // sprite zero depends on the cycle, which is checked from the cycles 1
+    // and 9 on
+    static constexpr int16_t kSpriteZeroHitCycles[] = {1, 9};
+    const int16_t firstCycle = m_Cycle;
+    const uint64_t firstTick = m_Tick;
+    GetCurrentPixelToRender();
+    for (const int16_t cycle : kSpriteZeroHitCycles) {
+        if (cycle > firstCycle && cycle < firstCycle + cycles) {
+            m_Cycle = cycle;
+            m_Tick = firstTick + (cycle - firstCycle);
+            GetCurrentPixelToRender();
+        }
+    }
+    m_Cycle = firstCycle;
+    m_Tick = firstTick;
+    AdvanceCycles(cycles);
+}
+
+void Ppu::SetStatusField(StatusRegisterFields field, bool value) {
+    if (m_StatusReg.GetField(field) != value) {
+        m_StatusReg.SetField(field, value);
+        m_StatusChangeTick = m_Tick;
     }
 }
 
 void Ppu::DoPpuActionPrerenderClear() {
-    m_StatusReg.SetField(VERTICAL_BLANK, false);
+    SetStatusField(VERTICAL_BLANK, false);
 
-    m_StatusReg.SetField(SPRITE_OVERFLOW, false);
+    SetStatusField(SPRITE_OVERFLOW, false);
 
-    m_StatusReg.SetField(SPRITE_ZERO_HIT, false);
+    SetStatusField(SPRITE_ZERO_HIT, false);
 
     for (int i = 0; i < 8; ++i) {
         m_SpriteShifterPatternLo[i] = 0;
@@ -465,36 +1035,16 @@ void Ppu::DoPpuActionRenderProcessNextTile() {
     switch ((m_Cycle - 1) % 8) {
         case 0:
             LoadBackgroundShifters();
-            m_NextBackgroundTileInfo.id =
-                PpuRead(0x2000 | (m_VramAddress.reg & 0x0FFF));
+            FetchBackgroundTileId();
             break;
         case 2:
-            m_NextBackgroundTileInfo.attribute =
-                PpuRead(0x23C0 | (m_VramAddress.nametable_y << 11) |
-                        (m_VramAddress.nametable_x << 10) |
-                        ((m_VramAddress.coarse_y >> 2) << 3) |
-                        (m_VramAddress.coarse_x >> 2));
-            if (m_VramAddress.coarse_y & 0x02)
-                m_NextBackgroundTileInfo.attribute >>= 4;
-            if (m_VramAddress.coarse_x & 0x02)
-                m_NextBackgroundTileInfo.attribute >>= 2;
-            m_NextBackgroundTileInfo.attribute &= 0x03;
+            FetchBackgroundTileAttribute();
             break;
         case 4:
-            m_NextBackgroundTileInfo.lsb =
-                PpuRead((m_ControlReg.GetField(
-                             ControlRegisterFields::PATTERN_BACKGROUND)
-                         << 12) +
-                        ((uint16_t)m_NextBackgroundTileInfo.id << 4) +
-                        (m_VramAddress.fine_y + 0));
+            FetchBackgroundTileLsb();
             break;
         case 6:
-            m_NextBackgroundTileInfo.msb =
-                PpuRead((m_ControlReg.GetField(
-                             ControlRegisterFields::PATTERN_BACKGROUND)
-                         << 12) +
-                        ((uint16_t)m_NextBackgroundTileInfo.id << 4) +
-                        (m_VramAddress.fine_y + 8));
+            FetchBackgroundTileMsb();
             break;
         case 7:
             IncrementScrollX();
@@ -528,34 +1078,46 @@ void Ppu::DoPpuActionRenderLoadShiftersAndTransferX() {
 }
 
 void Ppu::DoPpuActionRenderLoadNextBackgroundTile() {
-    m_NextBackgroundTileInfo.id =
-        PpuRead(0x2000 | (m_VramAddress.reg & 0x0FFF));
+    FetchBackgroundTileId();
 }
 
 void Ppu::DoPpuActionRenderDoOAMTransfer() {
     std::memset(m_SpriteScanLine, 0xFF, 8 * sizeof(ObjectAttributeEntry));
-    m_SpriteCount = 0;
-
-    uint8_t nOAMEntry = 0;
-    m_SpriteZeroHitPossible = false;
-    while (nOAMEntry < 64 && m_SpriteCount < 9) {
-        int16_t diff = ((int16_t)m_ScanLine - (int16_t)m_OAM[nOAMEntry].y);
-        if (diff >= 0 &&
-            diff < (m_ControlReg.GetField(ControlRegisterFields::SPRITE_SIZE)
-                        ? 16
-                        : 8)) {
-            if (m_SpriteCount < 8) {
-                if (nOAMEntry == 0) {
-                    m_SpriteZeroHitPossible = true;
-                }
-                memcpy(&m_SpriteScanLine[m_SpriteCount], &m_OAM[nOAMEntry],
-                       sizeof(ObjectAttributeEntry));
-                ++m_SpriteCount;
-            }
+
+    const uint8_t spriteHeight =
+        m_ControlReg.GetField(ControlRegisterFields::SPRITE_SIZE) ? 16 : 8;
+    SpriteList& spriteList = m_SpriteLists[m_ScanLine];
+    if (spriteList.oamVersion != m_OamVersion ||
+        spriteList.spriteHeight != spriteHeight) {
+        EvaluateSprites(m_ScanLine, spriteHeight);
+    }
+    for (uint8_t i = 0; i < spriteList.count; ++i) {
+        const uint8_t sprite = spriteList.sprites[i];
+        m_SpriteScanLine[i].y = m_OAM[kOamY][sprite];
+        m_SpriteScanLine[i].id = m_OAM[kOamId][sprite];
+        m_SpriteScanLine[i].attribute = m_OAM[kOamAttribute][sprite];
+        m_SpriteScanLine[i].x = m_OAM[kOamX][sprite];
+    }
+    m_SpriteCount = spriteList.count;
+    m_SpriteZeroHitPossible =
+        spriteList.count > 0 && spriteList.sprites[0] == 0;
+    SetStatusField(SPRITE_OVERFLOW, (m_SpriteCount > 8));
+}
+
+void Ppu::EvaluateSprites(int16_t scanLine, uint8_t spriteHeight) {
+    SpriteList& spriteList = m_SpriteLists[scanLine];
+    spriteList.oamVersion = m_OamVersion;
+    spriteList.spriteHeight = spriteHeight;
+    spriteList.count = 0;
+    // The first 8 sprites of the scan line, in OAM order
+    uint64_t sprites =
+        GetSpritesOnScanLine(m_OAM[kOamY], scanLine, spriteHeight);
+    for (uint8_t sprite = 0; sprites != 0 && spriteList.count < 8;
+         ++sprite, sprites >>= 1) {
+        if (sprites & 0x01) {
+            spriteList.sprites[spriteList.count++] = sprite;
         }
-        ++nOAMEntry;
     }
-    m_StatusReg.SetField(SPRITE_OVERFLOW, (m_SpriteCount > 8));
 }
 
 void Ppu::DoPpuActionRenderUpdateSprites() {
@@ -615,27 +1177,42 @@ void Ppu::DoPpuActionRenderUpdateSprites() {
             }
         }
 
-        uint16_t sprite_pattern_addr_hi = sprite_pattern_addr_lo + 8;
-
-        uint8_t sprite_pattern_bits_lo = PpuRead(sprite_pattern_addr_lo);
-        uint8_t sprite_pattern_bits_hi = PpuRead(sprite_pattern_addr_hi);
-
         // If the sprite is flipped horizontally, we need to flip the
-        // pattern bytes.
-        if (m_SpriteScanLine[i].attribute & 0x40) {
-            // This little lambda function "flips" a byte
-            // so 0b11100000 becomes 0b00000111. It's very
-            // clever, and stolen completely from here:
-            // https://stackoverflow.com/a/2602885
-            auto flipbyte = [](uint8_t b) -> uint8_t {
-                b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
-                b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
-                b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
-                return b;
-            };
-
-            sprite_pattern_bits_lo = flipbyte(sprite_pattern_bits_lo);
-            sprite_pattern_bits_hi = flipbyte(sprite_pattern_bits_hi);
+        // pattern bytes. The tile cache has the rows flipped already.
+        const bool isFlipped = m_SpriteScanLine[i].attribute & 0x40;
+        uint8_t sprite_pattern_bits_lo = 0x00;
+        uint8_t sprite_pattern_bits_hi = 0x00;
+
+        // The address is only off the rows of a tile for a sprite that is
+        // not on the scan line: on the pre-render one, or after the sprite
+        // size changed
+        if (sprite_pattern_addr_lo <= 0x1FFF &&
+            (sprite_pattern_addr_lo & 0x08) == 0) {
+            const uint64_t row =
+                GetPatternRow(sprite_pattern_addr_lo, isFlipped);
+            sprite_pattern_bits_lo = TileCache::GetLowPlane(row);
+            sprite_pattern_bits_hi = TileCache::GetHighPlane(row);
+        } else {
+            uint16_t sprite_pattern_addr_hi = sprite_pattern_addr_lo + 8;
+
+            sprite_pattern_bits_lo = PpuRead(sprite_pattern_addr_lo);
+            sprite_pattern_bits_hi = PpuRead(sprite_pattern_addr_hi);
+
+            if (isFlipped) {
+                // This little lambda function "flips" a byte
+                // so 0b11100000 becomes 0b00000111. It's very
+                // clever, and stolen completely from here:
+                // https://stackoverflow.com/a/2602885
+                auto flipbyte = [](uint8_t b) -> uint8_t {
+                    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+                    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+                    b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+                    return b;
+                };
+
+                sprite_pattern_bits_lo = flipbyte(sprite_pattern_bits_lo);
+                sprite_pattern_bits_hi = flipbyte(sprite_pattern_bits_hi);
+            }
         }
 
         // Finally! We can load the pattern into our sprite shift
@@ -646,7 +1223,7 @@ void Ppu::DoPpuActionRenderUpdateSprites() {
 }
 
 void Ppu::DoPpuActionRenderEndFrameRendering() {
-    m_StatusReg.SetField(StatusRegisterFields::VERTICAL_BLANK, true);
+    SetStatusField(VERTICAL_BLANK, true);
     if (m_ControlReg.GetField(ControlRegisterFields::ENABLE_NMI)) {
         m_DoNMI = true;
     }
@@ -0,0 +1,87 @@
+// Copyright (c) 2020 Emmanuel Arias
+#include "dear_nes_lib/scheduler.h"
+
+#include <algorithm>
+
+namespace dearnes {
+
+namespace {
+
+// The entries of moved and canceled events are only removed when they reach
+// the top. Rebuild the heap when there are too many of them
+constexpr size_t kMaxHeapSize =
+    4 * static_cast<size_t>(SchedulerEvent::kSchedulerEventSize);
+
+}  // namespace
+
+Scheduler::Scheduler() { Clear(); }
+
+void Scheduler::Schedule(SchedulerEvent event, uint64_t tick) {
+    m_ScheduledTicks[static_cast<size_t>(event)] = tick;
+    if (m_Heap.size() >= kMaxHeapSize) {
+        m_Heap.clear();
+        for (size_t i = 0; i < m_ScheduledTicks.size(); ++i) {
+            if (m_ScheduledTicks[i] != kNoPendingEvent) {
+                m_Heap.push_back(
+                    {m_ScheduledTicks[i], static_cast<SchedulerEvent>(i)});
+            }
+        }
+        std::make_heap(m_Heap.begin(), m_Heap.end(), IsLater);
+    } else {
+        m_Heap.push_back({tick, event});
+        std::push_heap(m_Heap.begin(), m_Heap.end(), IsLater);
+    }
+    PopStaleEntries();
+}
+
+void Scheduler::Cancel(SchedulerEvent event) {
+    m_ScheduledTicks[static_cast<size_t>(event)] = kNoPendingEvent;
+    PopStaleEntries();
+}
+
+bool Scheduler::PopDueEvent(uint64_t tick, SchedulerEvent& event) {
+    if (m_Heap.empty() || m_Heap.front().tick > tick) {
+        return false;
+    }
+    event = m_Heap.front().event;
+    m_ScheduledTicks[static_cast<size_t>(event)] = kNoPendingEvent;
+    std::pop_heap(m_Heap.begin(), m_Heap.end(), IsLater);
+    m_Heap.pop_back();
+    PopStaleEntries();
+    return true;
+}
+
+void Scheduler::Clear() {
+    m_Heap.clear();
+    m_ScheduledTicks.fill(kNoPendingEvent);
+    m_CurrentTick = 0;
+    m_IrqSources = 0x00;
+}
+
+void Scheduler::SetIrqLine(IrqSource source, bool asserted) {
+    const uint8_t mask = 0x01 << static_cast<uint8_t>(source);
+    if (asserted) {
+        m_IrqSources |= mask;
+    } else {
+        m_IrqSources &= ~mask;
+    }
+}
+
+bool Scheduler::IsLater(const Entry& lhs, const Entry& rhs) {
+    if (lhs.tick != rhs.tick) {
+        return lhs.tick > rhs.tick;
+    }
+    return lhs.event > rhs.event;
+}
+
+void Scheduler::PopStaleEntries() {
+    // Keep the top valid, so that GetNextEventTick() is exact
+    while (!m_Heap.empty() &&
+           m_ScheduledTicks[static_cast<size_t>(m_Heap.front().event)] !=
+               m_Heap.front().tick) {
+        std::pop_heap(m_Heap.begin(), m_Heap.end(), IsLater);
+        m_Heap.pop_back();
+    }
+}
+
+}  // namespace dearnes
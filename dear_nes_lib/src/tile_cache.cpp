@@ -0,0 +1,45 @@
+// Copyright (c) 2020 Emmanuel Arias
+#include "dear_nes_lib/tile_cache.h"
+
+#include <algorithm>
+
+namespace dearnes {
+
+TileCache::TileCache()
+    : m_Rows(kTiles * 8, 0),
+      m_FlippedRows(kTiles * 8, 0),
+      m_IsDecoded(kTiles, false) {}
+
+void TileCache::Decode(uint16_t address, const uint8_t (&data)[16]) {
+    const size_t tile = GetTile(address);
+    for (size_t row = 0; row < 8; ++row) {
+        uint64_t pixels = 0;
+        uint64_t flippedPixels = 0;
+        for (int x = 0; x < 8; ++x) {
+            const uint64_t pixel = (((data[row + 8] >> (7 - x)) & 0x01) << 1) |
+                                   ((data[row] >> (7 - x)) & 0x01);
+            pixels |= pixel << (8 * x);
+            flippedPixels |= pixel << (8 * (7 - x));
+        }
+        m_Rows[(tile << 3) | row] = pixels;
+        m_FlippedRows[(tile << 3) | row] = flippedPixels;
+    }
+    m_IsDecoded[tile] = true;
+}
+
+void TileCache::Invalidate(uint16_t firstAddress, uint16_t lastAddress) {
+    if (lastAddress - firstAddress >= 0x1FFF) {
+        InvalidateAll();
+        return;
+    }
+    for (uint32_t address = firstAddress & ~0x0F; address <= lastAddress;
+         address += 0x10) {
+        m_IsDecoded[GetTile(static_cast<uint16_t>(address))] = false;
+    }
+}
+
+void TileCache::InvalidateAll() {
+    std::fill(m_IsDecoded.begin(), m_IsDecoded.end(), false);
+}
+
+}  // namespace dearnes
@@ -0,0 +1,117 @@
+// Copyright (c) 2020 Emmanuel Arias
+#include "dear_nes_lib/trace_recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+
+#include "dear_nes_lib/disassembler.h"
+
+namespace dearnes {
+
+// The CPU runs on every third master clock tick
+constexpr uint64_t kTicksPerCpuCycle = 3;
+
+static_assert(sizeof(TraceRecorder::Record) == 24,
+              "The records are written to the trace files as they are");
+
+TraceRecorder::TraceRecorder(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    m_Records.resize(size);
+    m_IndexMask = size - 1;
+}
+
+TraceRecorder::~TraceRecorder() { Stop(); }
+
+std::string TraceRecorder::FormatRecord(const Record& record) {
+    char line[128];
+    std::snprintf(
+        line, sizeof(line),
+        "%04X  %-8s  %-30s  A:%02X X:%02X Y:%02X P:%02X SP:%02X "
+        "PPU:%3d,%3d CYC:%" PRIu64,
+        record.programCounter,
+        FormatInstructionBytes(record.opCode, record.operand).c_str(),
+        Disassemble(record.programCounter, record.opCode, record.operand)
+            .c_str(),
+        record.registerA, record.registerX, record.registerY,
+        record.statusRegister, record.stackPointer, record.scanLine,
+        record.cycle, record.tick / kTicksPerCpuCycle);
+    return line;
+}
+
+bool TraceRecorder::SpillToFile(const std::string& path) {
+    Stop();
+    m_File.open(path, std::ofstream::binary | std::ofstream::trunc);
+    if (!m_File.is_open()) {
+        return false;
+    }
+    FileHeader header = {};
+    std::copy(std::begin(kFileMagic), std::end(kFileMagic), header.magic);
+    header.recordSize = sizeof(Record);
+    m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // The records kept in memory are not written
+    m_Tail.store(m_Head.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+    m_IsStopping.store(false, std::memory_order_relaxed);
+    m_IsSpilling = true;
+    m_Writer = std::thread(&TraceRecorder::WriteRecords, this);
+    return true;
+}
+
+void TraceRecorder::Stop() {
+    if (!m_IsSpilling) {
+        return;
+    }
+    m_IsStopping.store(true, std::memory_order_release);
+    m_Writer.join();
+    m_File.close();
+    m_IsSpilling = false;
+}
+
+std::vector<TraceRecorder::Record> TraceRecorder::GetRecords() const {
+    std::vector<Record> records;
+    if (m_IsSpilling) {
+        return records;
+    }
+    const uint64_t head = m_Head.load(std::memory_order_acquire);
+    const uint64_t count =
+        std::min<uint64_t>(head, static_cast<uint64_t>(m_Records.size()));
+    records.reserve(static_cast<size_t>(count));
+    for (uint64_t index = head - count; index < head; ++index) {
+        records.push_back(m_Records[index & m_IndexMask]);
+    }
+    return records;
+}
+
+void TraceRecorder::WriteRecords() {
+    for (;;) {
+        // Read the flag first, so that the records added before it was set are
+        // seen below
+        const bool isStopping = m_IsStopping.load(std::memory_order_acquire);
+        const uint64_t head = m_Head.load(std::memory_order_acquire);
+        uint64_t tail = m_Tail.load(std::memory_order_relaxed);
+        if (head == tail) {
+            if (isStopping) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        // Write up to the end of the buffer, the rest goes in the next round
+        const size_t start = static_cast<size_t>(tail & m_IndexMask);
+        const size_t count = static_cast<size_t>(
+            std::min<uint64_t>(head - tail, m_Records.size() - start));
+        m_File.write(reinterpret_cast<const char*>(&m_Records[start]),
+                     static_cast<std::streamsize>(count * sizeof(Record)));
+        tail += count;
+        m_Tail.store(tail, std::memory_order_release);
+    }
+    m_File.flush();
+}
+
+}  // namespace dearnes
@@ -0,0 +1,129 @@
+// Copyright (c) 2020 Emmanuel Arias
+//
+// Benchmark of the kernels of dearnes::PixelCompositor. Every kernel the
+// processor supports composes the same random scan lines, which are checked
+// against the scalar kernel, and the time per scan line is reported.
+//
+// Usage: nes_compositor_benchmark [scan lines]
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "dear_nes_lib/pixel_compositor.h"
+
+namespace {
+
+using dearnes::PixelCompositor;
+using Kernel = PixelCompositor::Kernel;
+
+constexpr size_t kPixelsPerScanLine = 256;
+constexpr size_t kHitWordsPerScanLine = kPixelsPerScanLine / 32;
+
+// Distinct scan lines composed in turn, so that they stay in the cache
+constexpr size_t kScanLineSet = 64;
+
+struct ScanLines {
+    std::vector<uint8_t> background;
+    std::vector<uint8_t> sprites;
+};
+
+// Lines with about half of the background and a quarter of the sprite pixels
+// opaque
+ScanLines CreateScanLines() {
+    std::mt19937 random(2020);
+    ScanLines lines;
+    lines.background.resize(kScanLineSet * kPixelsPerScanLine);
+    lines.sprites.resize(kScanLineSet * kPixelsPerScanLine);
+    for (size_t i = 0; i < lines.background.size(); ++i) {
+        lines.background[i] = static_cast<uint8_t>(random() & 0x0F);
+        uint8_t sprite = 0x00;
+        if (random() % 4 == 0) {
+            sprite = static_cast<uint8_t>(
+                (random() % 3 + 1) | (random() & 0x0C) |
+                (random() % 2 ? PixelCompositor::kSpriteBehindBackground
+                              : 0x00) |
+                (random() % 8 == 0 ? PixelCompositor::kSpriteZero : 0x00));
+        }
+        lines.sprites[i] = sprite;
+    }
+    return lines;
+}
+
+void ComposeAll(const PixelCompositor& compositor, const ScanLines& lines,
+                std::vector<uint8_t>& indices, std::vector<uint32_t>& hits) {
+    for (size_t line = 0; line < kScanLineSet; ++line) {
+        compositor.Compose(&lines.background[line * kPixelsPerScanLine],
+                           &lines.sprites[line * kPixelsPerScanLine],
+                           kPixelsPerScanLine,
+                           &indices[line * kPixelsPerScanLine],
+                           &hits[line * kHitWordsPerScanLine]);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const long scanLines = argc > 1 ? std::atol(argv[1]) : 1000000;
+    if (scanLines <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [scan lines]\n";
+        return 1;
+    }
+    const ScanLines lines = CreateScanLines();
+
+    PixelCompositor reference;
+    reference.SetKernel(Kernel::kScalar);
+    std::vector<uint8_t> expectedIndices(lines.background.size());
+    std::vector<uint32_t> expectedHits(kScanLineSet * kHitWordsPerScanLine);
+    ComposeAll(reference, lines, expectedIndices, expectedHits);
+
+    int exitCode = 0;
+    double scalarTime = 0.0;
+    for (const Kernel kernel :
+         {Kernel::kScalar, Kernel::kSse2, Kernel::kAvx2}) {
+        PixelCompositor compositor;
+        if (!compositor.SetKernel(kernel)) {
+            std::cout << PixelCompositor::GetKernelName(kernel)
+                      << ": not available\n";
+            continue;
+        }
+
+        std::vector<uint8_t> indices(lines.background.size());
+        std::vector<uint32_t> hits(expectedHits.size());
+        ComposeAll(compositor, lines, indices, hits);
+        if (indices != expectedIndices || hits != expectedHits) {
+            std::cout << PixelCompositor::GetKernelName(kernel)
+                      << ": differs from the scalar kernel\n";
+            exitCode = 2;
+            continue;
+        }
+
+        // The checksum keeps the compositions from being optimized away
+        uint32_t checksum = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < scanLines; ++i) {
+            const size_t line = static_cast<size_t>(i) % kScanLineSet;
+            compositor.Compose(&lines.background[line * kPixelsPerScanLine],
+                               &lines.sprites[line * kPixelsPerScanLine],
+                               kPixelsPerScanLine, indices.data(),
+                               hits.data());
+            checksum += indices[i % kPixelsPerScanLine] + hits[0];
+        }
+        const double time = std::chrono::duration<double, std::nano>(
+                                std::chrono::steady_clock::now() - start)
+                                .count() /
+                            static_cast<double>(scanLines);
+        if (kernel == Kernel::kScalar) {
+            scalarTime = time;
+        }
+        std::cout << PixelCompositor::GetKernelName(kernel) << ": " << time
+                  << " ns per scan line";
+        if (kernel != Kernel::kScalar && time > 0.0) {
+            std::cout << ", " << scalarTime / time << "x the scalar kernel";
+        }
+        std::cout << " (checksum " << checksum << ")\n";
+    }
+    return exitCode;
+}
@@ -0,0 +1,274 @@
+// Copyright (c) 2020 Emmanuel Arias
+//
+// Differential runner. It runs a cartridge on the reference console, the
+// AccuratePolicy one stepped tick by tick, and on a console with the fast
+// paths, with the same controller inputs. Their states are compared after
+// every frame. On the first frame that differs, the tick the fast paths
+// diverge on is searched by running both again, and reported with the last
+// instructions executed by the reference.
+//
+// Usage: nes_diff <cartridge.nes> <frames> [options]
+//   --jit                    Translate the program to native code
+//   --no-fusion              Do not fuse instruction pairs
+//   --no-idle-loops          Do not skip idle loops
+//   --no-scan-line-renderer  Use the DotRenderingPolicy, which clocks the PPU
+//                            cycle by cycle
+//   --headless               Use the HeadlessPolicy, without the output screen.
+//                            It cannot be combined with the option above
+//   --extra-scan-lines N     Overclock both consoles
+//   --seed N                 Seed of the controller inputs, 0 for no input
+//
+// The exit code is 0 if the states never differ, 2 if they do, and 1 on
+// errors. ctest runs it with every option on the cartridges of nes_test_rom.
+#include <cinttypes>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "dear_nes_lib/cartridge_loader.h"
+#include "dear_nes_lib/nes.h"
+#include "dear_nes_lib/nes_state.h"
+#include "dear_nes_lib/trace_recorder.h"
+
+namespace {
+
+using dearnes::NesState;
+using dearnes::TraceRecorder;
+using Reference = dearnes::BasicNes<dearnes::AccuratePolicy>;
+
+// Instructions of the reference shown before the divergence
+constexpr size_t kContextInstructions = 16;
+
+struct Options {
+    std::string cartridgeFileName;
+    int frames = 0;
+    bool isJitEnabled = false;
+    bool isFusionEnabled = true;
+    bool isIdleLoopDetectionEnabled = true;
+    bool isScanLineRendererEnabled = true;
+    bool isHeadless = false;
+    uint16_t extraScanLines = 0;
+    uint32_t seed = 1;
+};
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    if (argc < 3) {
+        return false;
+    }
+    options.cartridgeFileName = argv[1];
+    options.frames = std::atoi(argv[2]);
+    for (int i = 3; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (option == "--jit") {
+            options.isJitEnabled = true;
+        } else if (option == "--no-fusion") {
+            options.isFusionEnabled = false;
+        } else if (option == "--no-idle-loops") {
+            options.isIdleLoopDetectionEnabled = false;
+        } else if (option == "--no-scan-line-renderer") {
+            options.isScanLineRendererEnabled = false;
+        } else if (option == "--headless") {
+            options.isHeadless = true;
+        } else if (option == "--extra-scan-lines" && i + 1 < argc) {
+            options.extraScanLines =
+                static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (option == "--seed" && i + 1 < argc) {
+            options.seed =
+                static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        } else {
+            return false;
+        }
+    }
+    // No policy combines both
+    if (options.isHeadless && !options.isScanLineRendererEnabled) {
+        return false;
+    }
+    return options.frames > 0;
+}
+
+// Buttons of the controller 1 on a frame. They are held for 8 frames
+uint8_t GetInput(uint32_t seed, int frame) {
+    if (seed == 0) {
+        return 0x00;
+    }
+    uint32_t value = seed * 0x9E3779B9 + static_cast<uint32_t>(frame / 8);
+    value ^= value >> 15;
+    value *= 0x2C1B3C6D;
+    value ^= value >> 12;
+    return static_cast<uint8_t>(value);
+}
+
+template <typename Console>
+std::unique_ptr<Console> CreateConsole(const Options& options) {
+    dearnes::CartridgeLoader loader;
+    auto result = loader.LoadNewCartridge(options.cartridgeFileName);
+    if (std::holds_alternative<dearnes::CartridgeLoaderError>(result)) {
+        return nullptr;
+    }
+    auto console = std::make_unique<Console>();
+    console->InsertCatridge(std::get<dearnes::Cartridge*>(result));
+    console->SetExtraScanLines(options.extraScanLines);
+    return console;
+}
+
+template <typename Candidate>
+std::unique_ptr<Candidate> CreateCandidate(const Options& options) {
+    auto candidate = CreateConsole<Candidate>(options);
+    if (candidate != nullptr) {
+        dearnes::Cpu* cpu = candidate->GetCpu();
+        cpu->SetJitEnabled(options.isJitEnabled);
+        cpu->SetFusionEnabled(options.isFusionEnabled);
+        cpu->SetIdleLoopDetectionEnabled(
+            options.isIdleLoopDetectionEnabled);
+    }
+    return candidate;
+}
+
+template <typename Console>
+void ApplyInput(Console& console, const Options& options, int frame) {
+    console.ClearControllerState(0);
+    console.WriteControllerState(0, GetInput(options.seed, frame));
+}
+
+void PrintContext(const NesState& expected, const NesState& actual,
+                  const TraceRecorder* recorder) {
+    std::cout << "  reference: " << dearnes::FormatState(expected) << "\n";
+    std::cout << "  candidate: " << dearnes::FormatState(actual) << "\n";
+    if (recorder == nullptr) {
+        return;
+    }
+    std::cout << "Last instructions of the reference:\n";
+    for (const TraceRecorder::Record& record : recorder->GetRecords()) {
+        std::cout << "  " << TraceRecorder::FormatRecord(record) << "\n";
+    }
+}
+
+// Run both consoles from power on to the start of the frame, and then the
+// amount of ticks into it, the candidate in a single RunCycles() call. The
+// trace recorder, if any, gets the instructions of the reference frame
+template <typename Candidate>
+std::string CompareAtTick(const Options& options, int frame, uint64_t ticks,
+                          NesState& expected, NesState& actual,
+                          TraceRecorder* recorder) {
+    auto reference = CreateConsole<Reference>(options);
+    auto candidate = CreateCandidate<Candidate>(options);
+    for (int i = 0; i < frame; ++i) {
+        ApplyInput(*reference, options, i);
+        ApplyInput(*candidate, options, i);
+        reference->DoFrame();
+        candidate->RunFrame();
+    }
+    ApplyInput(*reference, options, frame);
+    ApplyInput(*candidate, options, frame);
+
+    reference->SetTraceRecorder(recorder);
+    for (uint64_t i = 0; i < ticks; ++i) {
+        reference->Clock();
+    }
+    candidate->RunCycles(ticks);
+
+    const bool hasScreen = !options.isHeadless;
+    expected = reference->CaptureState(hasScreen);
+    actual = candidate->CaptureState(hasScreen);
+    return dearnes::FindStateDifference(expected, actual);
+}
+
+// Search the first tick of the divergent frame on which the states differ.
+// Every probe runs the consoles again from power on, so that the candidate
+// runs the frame in big steps like RunFrame() does. Returns false if the
+// states only differ after the frame is finished
+template <typename Candidate>
+bool FindDivergentTick(const Options& options, int frame,
+                       uint64_t frameTicks) {
+    NesState expected;
+    NesState actual;
+    uint64_t sameTicks = 0;
+    uint64_t differentTicks = frameTicks;
+    if (CompareAtTick<Candidate>(options, frame, differentTicks, expected,
+                                 actual, nullptr)
+            .empty()) {
+        return false;
+    }
+    while (differentTicks - sameTicks > 1) {
+        const uint64_t ticks = sameTicks + (differentTicks - sameTicks) / 2;
+        if (CompareAtTick<Candidate>(options, frame, ticks, expected, actual,
+                                     nullptr)
+                .empty()) {
+            sameTicks = ticks;
+        } else {
+            differentTicks = ticks;
+        }
+    }
+
+    TraceRecorder recorder(kContextInstructions);
+    const std::string difference = CompareAtTick<Candidate>(
+        options, frame, differentTicks, expected, actual, &recorder);
+    std::cout << "First difference on tick " << expected.tick << ": "
+              << difference << "\n";
+    PrintContext(expected, actual, &recorder);
+    return true;
+}
+
+template <typename Candidate>
+int Run(const Options& options) {
+    auto reference = CreateConsole<Reference>(options);
+    auto candidate = CreateCandidate<Candidate>(options);
+    if (reference == nullptr || candidate == nullptr) {
+        std::cerr << "Could not load the cartridge "
+                  << options.cartridgeFileName << "\n";
+        return 1;
+    }
+
+    const bool hasScreen = !options.isHeadless;
+    for (int frame = 0; frame < options.frames; ++frame) {
+        ApplyInput(*reference, options, frame);
+        ApplyInput(*candidate, options, frame);
+        const uint64_t frameStart = reference->GetSystemClockCounter();
+        reference->DoFrame();
+        candidate->RunFrame();
+
+        const NesState expected = reference->CaptureState(hasScreen);
+        const NesState actual = candidate->CaptureState(hasScreen);
+        const std::string difference =
+            dearnes::FindStateDifference(expected, actual);
+        if (difference.empty()) {
+            continue;
+        }
+        std::cout << "Divergence on frame " << frame << ": " << difference
+                  << "\n";
+        const uint64_t frameTicks =
+            reference->GetSystemClockCounter() - frameStart;
+        if (!FindDivergentTick<Candidate>(options, frame, frameTicks)) {
+            std::cout << "Not found cycle by cycle, the states at the end of "
+                         "the frame are:\n";
+            PrintContext(expected, actual, nullptr);
+        }
+        return 2;
+    }
+    std::cout << "No divergence in " << options.frames << " frames\n";
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <cartridge.nes> <frames> [--jit] [--no-fusion]"
+                     " [--no-idle-loops] [--no-scan-line-renderer]"
+                     " [--headless]"
+                     " [--extra-scan-lines N] [--seed N]\n";
+        return 1;
+    }
+    if (options.isHeadless) {
+        return Run<dearnes::BasicNes<dearnes::HeadlessPolicy>>(options);
+    }
+    if (!options.isScanLineRendererEnabled) {
+        return Run<dearnes::BasicNes<dearnes::DotRenderingPolicy>>(options);
+    }
+    return Run<dearnes::Nes>(options);
+}
@@ -0,0 +1,220 @@
+// Copyright (c) 2020 Emmanuel Arias
+//
+// Benchmark of the dispatch to the cartridge mappers. The mappers are
+// alternatives of dearnes::MapperVariant, reached with std::visit. They are
+// compared against the virtual dispatch they replaced, emulated here with an
+// abstract interface that wraps the same mapper. Both paths translate the same
+// CPU and PPU addresses, and the time per translation is reported.
+//
+// With a cartridge, the time per frame of Nes::DoFrame() and Nes::RunFrame()
+// is reported too, to compare whole builds against each other.
+//
+// Usage: nes_mapper_benchmark [translations] [cartridge [frames]]
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "dear_nes_lib/cartridge_loader.h"
+#include "dear_nes_lib/mapper_variant.h"
+#include "dear_nes_lib/nes.h"
+
+// The virtual mappers were defined in their own translation units, so their
+// functions were never inlined into the callers
+#if defined(_MSC_VER)
+#define DEARNES_NOINLINE __declspec(noinline)
+#else
+#define DEARNES_NOINLINE __attribute__((noinline))
+#endif
+
+namespace {
+
+using dearnes::MapperVariant;
+
+// Program and character memory of a 32 KiB NROM cartridge
+constexpr uint8_t kProgramBanks = 2;
+constexpr uint8_t kCharacterBanks = 1;
+constexpr size_t kProgramMemorySize = 0x8000;
+constexpr size_t kCharacterMemorySize = 0x2000;
+
+/// <summary>
+/// Interface of the mappers before they were bound at compile time
+/// </summary>
+class VirtualMapper {
+   public:
+    virtual ~VirtualMapper() = default;
+    virtual bool CpuMapRead(uint16_t addr, uint32_t& mappedAddr) const = 0;
+    virtual bool PpuMapRead(uint16_t addr, uint32_t& mappedAddr) const = 0;
+};
+
+template <typename Mapper>
+class VirtualMapperAdapter : public VirtualMapper {
+   public:
+    explicit VirtualMapperAdapter(const Mapper& mapper) : m_Mapper{mapper} {}
+
+    DEARNES_NOINLINE bool CpuMapRead(uint16_t addr,
+                                     uint32_t& mappedAddr) const override {
+        return m_Mapper.CpuMapRead(addr, mappedAddr);
+    }
+
+    DEARNES_NOINLINE bool PpuMapRead(uint16_t addr,
+                                     uint32_t& mappedAddr) const override {
+        return m_Mapper.PpuMapRead(addr, mappedAddr);
+    }
+
+   private:
+    Mapper m_Mapper;
+};
+
+// Like Cartridge::CpuRead() and Cartridge::PpuRead()
+uint32_t TranslateWithVariant(const MapperVariant& mapper,
+                              const std::vector<uint8_t>& programMemory,
+                              const std::vector<uint8_t>& characterMemory,
+                              long translations) {
+    uint32_t checksum = 0;
+    for (long i = 0; i < translations; ++i) {
+        const uint16_t address = static_cast<uint16_t>(i);
+        uint32_t mappedAddr = 0;
+        const bool isMapped = std::visit(
+            [address, &mappedAddr](const auto& alternative) {
+                return address & 0x01
+                           ? alternative.CpuMapRead(address | 0x8000,
+                                                    mappedAddr)
+                           : alternative.PpuMapRead(address & 0x1FFF,
+                                                    mappedAddr);
+            },
+            mapper);
+        if (isMapped) {
+            checksum += address & 0x01 ? programMemory[mappedAddr]
+                                       : characterMemory[mappedAddr];
+        }
+    }
+    return checksum;
+}
+
+uint32_t TranslateWithVirtual(const VirtualMapper& mapper,
+                              const std::vector<uint8_t>& programMemory,
+                              const std::vector<uint8_t>& characterMemory,
+                              long translations) {
+    uint32_t checksum = 0;
+    for (long i = 0; i < translations; ++i) {
+        const uint16_t address = static_cast<uint16_t>(i);
+        uint32_t mappedAddr = 0;
+        const bool isMapped =
+            address & 0x01 ? mapper.CpuMapRead(address | 0x8000, mappedAddr)
+                           : mapper.PpuMapRead(address & 0x1FFF, mappedAddr);
+        if (isMapped) {
+            checksum += address & 0x01 ? programMemory[mappedAddr]
+                                       : characterMemory[mappedAddr];
+        }
+    }
+    return checksum;
+}
+
+template <typename Function>
+double MeasureNanoseconds(Function function) {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// Returns false if the cartridge cannot be loaded
+template <typename Function>
+bool MeasureFrames(const std::string& fileName, long frames, const char* name,
+                   Function runFrame) {
+    dearnes::CartridgeLoader loader;
+    auto result = loader.LoadNewCartridge(fileName);
+    if (std::holds_alternative<dearnes::CartridgeLoaderError>(result)) {
+        return false;
+    }
+    dearnes::Nes nes;
+    nes.InsertCatridge(std::get<dearnes::Cartridge*>(result));
+    const double time = MeasureNanoseconds([&]() {
+        for (long i = 0; i < frames; ++i) {
+            runFrame(nes);
+        }
+    });
+    std::cout << name << ": " << time / 1e6 / static_cast<double>(frames)
+              << " ms per frame (cycle " << nes.GetSystemClockCounter()
+              << ")\n";
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const long translations = argc > 1 ? std::atol(argv[1]) : 100000000;
+    const long frames = argc > 3 ? std::atol(argv[3]) : 300;
+    if (translations <= 0 || frames <= 0) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [translations] [cartridge [frames]]\n";
+        return 1;
+    }
+
+    std::vector<uint8_t> programMemory(kProgramMemorySize);
+    std::vector<uint8_t> characterMemory(kCharacterMemorySize);
+    for (size_t i = 0; i < programMemory.size(); ++i) {
+        programMemory[i] = static_cast<uint8_t>(i * 7);
+    }
+    for (size_t i = 0; i < characterMemory.size(); ++i) {
+        characterMemory[i] = static_cast<uint8_t>(i * 13);
+    }
+
+    // Both paths wrap the same mapper
+    const MapperVariant mapper =
+        dearnes::Mapper_000{kProgramBanks, kCharacterBanks};
+    std::unique_ptr<VirtualMapper> virtualMapper;
+    std::visit(
+        [&virtualMapper](const auto& alternative) {
+            using Mapper = std::decay_t<decltype(alternative)>;
+            virtualMapper =
+                std::make_unique<VirtualMapperAdapter<Mapper>>(alternative);
+        },
+        mapper);
+
+    uint32_t variantChecksum = 0;
+    const double variantTime = MeasureNanoseconds([&]() {
+        variantChecksum = TranslateWithVariant(mapper, programMemory,
+                                               characterMemory, translations);
+    });
+    uint32_t virtualChecksum = 0;
+    const double virtualTime = MeasureNanoseconds([&]() {
+        virtualChecksum = TranslateWithVirtual(*virtualMapper, programMemory,
+                                               characterMemory, translations);
+    });
+    if (variantChecksum != virtualChecksum) {
+        std::cout << "The dispatch paths translate differently\n";
+        return 2;
+    }
+
+    const double count = static_cast<double>(translations);
+    std::cout << "variant: " << variantTime / count
+              << " ns per translation\n";
+    std::cout << "virtual: " << virtualTime / count
+              << " ns per translation";
+    if (variantTime > 0.0) {
+        std::cout << ", " << virtualTime / variantTime << "x the variant";
+    }
+    std::cout << " (checksum " << variantChecksum << ")\n";
+
+    if (argc > 2) {
+        const std::string fileName = argv[2];
+        const bool isLoaded =
+            MeasureFrames(fileName, frames, "Nes::DoFrame",
+                          [](dearnes::Nes& nes) { nes.DoFrame(); }) &&
+            MeasureFrames(fileName, frames, "Nes::RunFrame",
+                          [](dearnes::Nes& nes) { nes.RunFrame(); });
+        if (!isLoaded) {
+            std::cerr << "Cannot load " << fileName << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,341 @@
+// Copyright (c) 2020 Emmanuel Arias
+//
+// Ahead-of-time recompiler of NROM programs. It traces the code reachable from
+// the interrupt vectors of a cartridge and writes a C++ translation unit with
+// one function per routine, defining a dearnes::RecompiledProgram that can be
+// installed with Nes::SetRecompiledProgram().
+//
+// Usage: nes_recompiler <cartridge.nes> <output.cpp> [symbol]
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "dear_nes_lib/cartridge.h"
+#include "dear_nes_lib/cartridge_loader.h"
+#include "dear_nes_lib/cpu.h"
+#include "dear_nes_lib/disassembler.h"
+
+namespace {
+
+using dearnes::Cpu;
+using dearnes::Disassemble;
+using dearnes::FormatHex;
+using AddressingMode = Cpu::AddressingMode;
+using Operation = Cpu::Operation;
+
+constexpr uint16_t kCartridgeRomStart = 0x8000;
+constexpr size_t kCartridgeRomSize = 0x10000 - kCartridgeRomStart;
+
+constexpr uint16_t kNmiVector = 0xFFFA;
+constexpr uint16_t kResetVector = 0xFFFC;
+constexpr uint16_t kIrqVector = 0xFFFE;
+
+// Same limit as the blocks of CpuJit, so that routines fit in small budgets
+constexpr uint32_t kMaxRoutineInstructions = 64;
+
+struct DecodedInstruction {
+    uint16_t address = 0x0000;
+    uint16_t operand = 0x0000;
+    uint8_t opCode = 0x00;
+    uint8_t length = 0;
+};
+
+struct Routine {
+    uint16_t address = 0x0000;
+    uint32_t cyclesBeforeLastInstruction = 0;
+    std::vector<DecodedInstruction> instructions;
+};
+
+/// <summary>
+/// Cartridge ROM as seen by the CPU, 0x8000 -> 0xFFFF
+/// </summary>
+class ProgramImage {
+   public:
+    explicit ProgramImage(dearnes::Cartridge& cartridge)
+        : m_Memory(kCartridgeRomSize) {
+        for (size_t offset = 0; offset < kCartridgeRomSize; ++offset) {
+            cartridge.CpuRead(static_cast<uint16_t>(kCartridgeRomStart + offset),
+                              m_Memory[offset]);
+        }
+    }
+
+    uint8_t Read(uint16_t address) const {
+        return m_Memory[address - kCartridgeRomStart];
+    }
+
+    uint16_t ReadVector(uint16_t address) const {
+        return Read(address) | (Read(address + 1) << 8);
+    }
+
+    /// <summary>
+    /// Decode the instruction at the address. Fails if it is not implemented
+    /// or if it is not entirely in cartridge ROM.
+    /// </summary>
+    bool Decode(uint16_t address, DecodedInstruction& instruction) const {
+        if (address < kCartridgeRomStart) {
+            return false;
+        }
+        const uint8_t opCode = Read(address);
+        const uint8_t length = Cpu::GetInstructionLength(opCode);
+        if (!Cpu::IsTranslatable(opCode) || address + length - 1 > 0xFFFF) {
+            return false;
+        }
+
+        instruction.address = address;
+        instruction.opCode = opCode;
+        instruction.length = length;
+        instruction.operand = 0x0000;
+        if (length > 1) {
+            instruction.operand = Read(address + 1);
+        }
+        if (length > 2) {
+            instruction.operand |= Read(address + 2) << 8;
+        }
+        return true;
+    }
+
+   private:
+    std::vector<uint8_t> m_Memory;
+};
+
+/// <summary>
+/// Follow the control flow from the interrupt vectors and collect the
+/// addresses where the CPU can land coming from somewhere else than the
+/// previous instruction: vectors, jump and branch targets, return addresses
+/// and the instructions after the ones left to the interpreter.
+/// </summary>
+std::set<uint16_t> FindEntryPoints(const ProgramImage& program,
+                                   size_t& instructionCount) {
+    std::set<uint16_t> entryPoints;
+    std::vector<bool> isVisited(kCartridgeRomSize, false);
+    std::vector<uint16_t> pending;
+
+    auto addTarget = [&](uint32_t address, bool isEntryPoint) {
+        if (address < kCartridgeRomStart || address > 0xFFFF) {
+            return;
+        }
+        if (isEntryPoint) {
+            entryPoints.insert(static_cast<uint16_t>(address));
+        }
+        pending.push_back(static_cast<uint16_t>(address));
+    };
+
+    addTarget(program.ReadVector(kResetVector), true);
+    addTarget(program.ReadVector(kNmiVector), true);
+    addTarget(program.ReadVector(kIrqVector), true);
+
+    instructionCount = 0;
+    while (!pending.empty()) {
+        const uint16_t address = pending.back();
+        pending.pop_back();
+        if (isVisited[address - kCartridgeRomStart]) {
+            continue;
+        }
+        isVisited[address - kCartridgeRomStart] = true;
+
+        DecodedInstruction instruction;
+        if (!program.Decode(address, instruction)) {
+            continue;
+        }
+        ++instructionCount;
+
+        const uint32_t nextAddress = address + instruction.length;
+        const Cpu::Instruction& info = Cpu::GetInstruction(instruction.opCode);
+        if (Cpu::IsBranch(info.m_Operation)) {
+            const int8_t offset = static_cast<int8_t>(instruction.operand);
+            addTarget((nextAddress + offset) & 0xFFFF, true);
+            addTarget(nextAddress, true);
+            continue;
+        }
+        switch (info.m_Operation) {
+            case Operation::kJMP:
+                // The target of the indirect jump is only known at run time
+                if (info.m_AddressingMode == AddressingMode::kAbsolute) {
+                    addTarget(instruction.operand, true);
+                }
+                break;
+            case Operation::kJSR:
+                addTarget(instruction.operand, true);
+                addTarget(nextAddress, true);
+                break;
+            case Operation::kBRK:
+            case Operation::kRTI:
+            case Operation::kRTS:
+                break;
+            default:
+                addTarget(nextAddress, !Cpu::IsAlwaysIsolated(
+                                           instruction.opCode,
+                                           instruction.operand));
+                break;
+        }
+    }
+    return entryPoints;
+}
+
+/// <summary>
+/// Collect the straight-line instructions starting at the address, with the
+/// same rules as CpuJit. The routine stops before an entry point, so that
+/// every instruction belongs to a single routine.
+/// </summary>
+bool BuildRoutine(const ProgramImage& program, uint16_t address,
+                  std::set<uint16_t>& entryPoints, Routine& routine) {
+    routine.address = address;
+    uint32_t maxCycles = 0;
+    DecodedInstruction instruction;
+    while (program.Decode(address, instruction)) {
+        if (!Cpu::IsAlwaysIsolated(instruction.opCode, instruction.operand) ||
+            (!routine.instructions.empty() && entryPoints.count(address) > 0)) {
+            break;
+        }
+        if (routine.instructions.size() == kMaxRoutineInstructions) {
+            // The rest of the code gets its own routine
+            entryPoints.insert(address);
+            break;
+        }
+
+        routine.cyclesBeforeLastInstruction = maxCycles;
+        maxCycles += Cpu::GetMaxTranslatedCycles(instruction.opCode);
+
+        routine.instructions.push_back(instruction);
+        const Operation operation =
+            Cpu::GetInstruction(instruction.opCode).m_Operation;
+        if (Cpu::EndsTranslatedBlock(operation)) {
+            break;
+        }
+        address += instruction.length;
+    }
+    return !routine.instructions.empty();
+}
+
+void WriteProgram(std::ostream& output, const std::string& cartridgeFileName,
+                  const std::string& symbol,
+                  const dearnes::Cartridge& cartridge,
+                  const std::vector<Routine>& routines) {
+    output << "// Generated by nes_recompiler from " << cartridgeFileName
+           << ". Do not edit.\n"
+           << "#include \"dear_nes_lib/cpu.h\"\n"
+           << "#include \"dear_nes_lib/recompiled_program.h\"\n\n"
+           << "using dearnes::Cpu;\n\n"
+           << "namespace {\n";
+
+    for (const Routine& routine : routines) {
+        output << "\nuint32_t Routine_" << FormatHex(routine.address, 4)
+               << "(Cpu* cpu) {\n"
+               << "    uint32_t cycles = 0;\n";
+        for (const DecodedInstruction& instruction : routine.instructions) {
+            output << "    // " << FormatHex(instruction.address, 4) << " "
+                   << Disassemble(instruction.address, instruction.opCode,
+                                  instruction.operand)
+                   << "\n"
+                   << "    cycles += Cpu::ExecuteTranslatedInstruction<0x"
+                   << FormatHex(instruction.opCode, 2) << ">(cpu, 0x"
+                   << FormatHex(instruction.operand, 4) << ", 0x"
+                   << FormatHex(instruction.address + instruction.length, 4)
+                   << ");\n";
+        }
+        output << "    return cycles;\n"
+               << "}\n";
+    }
+
+    if (!routines.empty()) {
+        output << "\nconst dearnes::RecompiledRoutine kRoutines[] = {\n";
+        for (const Routine& routine : routines) {
+            const std::string address = FormatHex(routine.address, 4);
+            output << "    {0x" << address << ", "
+                   << routine.cyclesBeforeLastInstruction << ", &Routine_"
+                   << address << "},\n";
+        }
+        output << "};\n";
+    }
+
+    output << "\n}  // namespace\n\n"
+           << "extern const dearnes::RecompiledProgram " << symbol << ";\n"
+           << "const dearnes::RecompiledProgram " << symbol << " = {\n"
+           << "    0x" << FormatHex(cartridge.GetProgramMemoryChecksum(), 8)
+           << ", 0x" << FormatHex(static_cast<uint32_t>(
+                                      cartridge.GetProgramMemorySize()),
+                                  8)
+           << ", " << (routines.empty() ? "nullptr" : "kRoutines") << ", "
+           << routines.size() << "};\n";
+}
+
+bool IsValidSymbol(const std::string& symbol) {
+    if (symbol.empty() || std::isdigit(static_cast<unsigned char>(symbol[0]))) {
+        return false;
+    }
+    for (const char c : symbol) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc > 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <cartridge.nes> <output.cpp> [symbol]\n";
+        return 1;
+    }
+    const std::string cartridgeFileName = argv[1];
+    const std::string outputFileName = argv[2];
+    const std::string symbol = argc > 3 ? argv[3] : "kRecompiledProgram";
+    if (!IsValidSymbol(symbol)) {
+        std::cerr << "Invalid symbol name: " << symbol << "\n";
+        return 1;
+    }
+
+    dearnes::CartridgeLoader loader;
+    auto result = loader.LoadNewCartridge(cartridgeFileName);
+    if (std::holds_alternative<dearnes::CartridgeLoaderError>(result)) {
+        std::cerr << "Could not load the cartridge " << cartridgeFileName
+                  << "\n";
+        return 1;
+    }
+    dearnes::Cartridge* cartridge = std::get<dearnes::Cartridge*>(result);
+    if (cartridge->GetMapperId() != 0) {
+        std::cerr << "Only NROM (mapper 0) cartridges can be recompiled\n";
+        delete cartridge;
+        return 1;
+    }
+
+    const ProgramImage program(*cartridge);
+    size_t instructionCount = 0;
+    std::set<uint16_t> entryPoints =
+        FindEntryPoints(program, instructionCount);
+
+    // Routines that reach their limit add an entry point after the current
+    // one, which is still visited by the loop
+    std::vector<Routine> routines;
+    size_t recompiledCount = 0;
+    for (const uint16_t address : entryPoints) {
+        Routine routine;
+        if (BuildRoutine(program, address, entryPoints, routine)) {
+            recompiledCount += routine.instructions.size();
+            routines.push_back(std::move(routine));
+        }
+    }
+
+    std::ofstream output(outputFileName);
+    if (!output) {
+        std::cerr << "Could not open " << outputFileName << "\n";
+        delete cartridge;
+        return 1;
+    }
+    WriteProgram(output, cartridgeFileName, symbol, *cartridge, routines);
+    delete cartridge;
+
+    std::cout << "Traced " << instructionCount << " instructions, "
+              << recompiledCount << " recompiled in " << routines.size()
+              << " routines\n";
+    return 0;
+}
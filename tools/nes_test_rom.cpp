@@ -0,0 +1,433 @@
+// Copyright (c) 2020 Emmanuel Arias
+//
+// Generator of the cartridges of the differential tests. It writes an NROM
+// cartridge with a random program that stresses the fast paths: it reads
+// and writes the PPU, the OAM DMA and the controllers between runs of plain
+// instructions, runs counted loops and code copied to CPU RAM, and waits for
+// the vertical blank in an idle loop. The same seed always gives the same
+// cartridge.
+//
+// Usage: nes_test_rom <seed> <output.nes>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint16_t kProgramStart = 0x8000;
+constexpr size_t kProgramMemorySize = 0x8000;
+constexpr size_t kCharacterMemorySize = 0x2000;
+
+// Tables in cartridge ROM: nametable bytes, initial OAM and a data area that
+// the program writes to
+constexpr uint16_t kNametableData = 0xF800;
+constexpr uint16_t kOamData = 0xF900;
+constexpr uint16_t kRomDataStart = 0xF000;
+
+// Subroutine copied to CPU RAM by the reset code
+constexpr uint16_t kRamRoutine = 0x0700;
+
+// Zero page variables of the NMI handler
+constexpr uint8_t kScrollX = 0x10;
+constexpr uint8_t kScrollY = 0x11;
+constexpr uint8_t kLastFrame = 0x20;
+
+enum Mode { kImmediate, kZeroPage, kZeroPageX, kAbsolute, kAbsoluteX,
+            kAbsoluteY, kIndirectX, kIndirectY };
+
+struct Opcode {
+    uint8_t opCode;
+    bool isStore;
+};
+
+// Official op codes by addressing mode
+const std::vector<Opcode> kOpcodes[] = {
+    // Immediate: LDA LDX LDY ADC SBC AND ORA EOR CMP CPX CPY
+    {{0xA9, false}, {0xA2, false}, {0xA0, false}, {0x69, false},
+     {0xE9, false}, {0x29, false}, {0x09, false}, {0x49, false},
+     {0xC9, false}, {0xE0, false}, {0xC0, false}},
+    // Zero page: the loads and stores, BIT and the read-modify-writes
+    {{0xA5, false}, {0xA6, false}, {0xA4, false}, {0x65, false},
+     {0xE5, false}, {0x25, false}, {0x05, false}, {0x45, false},
+     {0xC5, false}, {0xE4, false}, {0xC4, false}, {0x24, false},
+     {0x85, true},  {0x86, true},  {0x84, true},  {0xE6, true},
+     {0xC6, true},  {0x06, true},  {0x46, true},  {0x26, true},
+     {0x66, true}},
+    // Zero page, X
+    {{0xB5, false}, {0xB4, false}, {0x75, false}, {0xF5, false},
+     {0x35, false}, {0x15, false}, {0x55, false}, {0xD5, false},
+     {0x95, true},  {0x94, true},  {0xF6, true},  {0xD6, true},
+     {0x16, true},  {0x56, true},  {0x36, true},  {0x76, true}},
+    // Absolute
+    {{0xAD, false}, {0xAE, false}, {0xAC, false}, {0x6D, false},
+     {0xED, false}, {0x2D, false}, {0x0D, false}, {0x4D, false},
+     {0xCD, false}, {0xEC, false}, {0xCC, false}, {0x2C, false},
+     {0x8D, true},  {0x8E, true},  {0x8C, true},  {0xEE, true},
+     {0xCE, true},  {0x0E, true},  {0x4E, true},  {0x2E, true},
+     {0x6E, true}},
+    // Absolute, X
+    {{0xBD, false}, {0xBC, false}, {0x7D, false}, {0xFD, false},
+     {0x3D, false}, {0x1D, false}, {0x5D, false}, {0xDD, false},
+     {0x9D, true},  {0xFE, true},  {0xDE, true},  {0x1E, true},
+     {0x5E, true},  {0x3E, true},  {0x7E, true}},
+    // Absolute, Y
+    {{0xB9, false}, {0xBE, false}, {0x79, false}, {0xF9, false},
+     {0x39, false}, {0x19, false}, {0x59, false}, {0xD9, false},
+     {0x99, true}},
+    // (Indirect, X)
+    {{0xA1, false}, {0x61, false}, {0xE1, false}, {0x21, false},
+     {0x01, false}, {0x41, false}, {0xC1, false}},
+    // (Indirect), Y
+    {{0xB1, false}, {0x71, false}, {0xF1, false}, {0x31, false},
+     {0x11, false}, {0x51, false}, {0xD1, false}}};
+
+// Implied and accumulator op codes, the stack ones included
+constexpr std::array<uint8_t, 25> kImpliedOpcodes = {
+    0x0A, 0x4A, 0x2A, 0x6A, 0x18, 0x38, 0x58, 0x78, 0xB8,
+    0xD8, 0xF8, 0xCA, 0x88, 0xE8, 0xC8, 0xAA, 0xA8, 0xBA,
+    0x8A, 0x98, 0xEA, 0x48, 0x68, 0x08, 0x28};
+
+constexpr std::array<uint8_t, 8> kBranchOpcodes = {0x10, 0x30, 0x50, 0x70,
+                                                   0x90, 0xB0, 0xD0, 0xF0};
+
+class ProgramGenerator {
+   public:
+    explicit ProgramGenerator(uint32_t seed) : m_Random{seed} {}
+
+    std::vector<uint8_t> GenerateCartridge() {
+        const uint16_t reset = GetAddress();
+        EmitReset();
+        const uint16_t main = GetAddress();
+        const uint32_t blocks = 2 + Next(4);
+        for (uint32_t i = 0; i < blocks; ++i) {
+            EmitBlock(30 + Next(170));
+        }
+        EmitWaitLoop();
+        Emit({0x4C, Low(main), High(main)});  // JMP main
+
+        const uint16_t nmi = GetAddress();
+        EmitNmi();
+        const uint16_t irq = GetAddress();
+        Emit({0x40});  // RTI
+
+        std::vector<uint8_t> program(kProgramMemorySize);
+        for (uint8_t& data : program) {
+            data = static_cast<uint8_t>(Next(0x100));
+        }
+        std::copy(m_Code.begin(), m_Code.end(), program.begin());
+        // Visible sprites
+        for (uint16_t i = 0; i < 64; ++i) {
+            program[kOamData - kProgramStart + 4 * i] =
+                static_cast<uint8_t>(Next(240));
+        }
+        const uint16_t vectors[] = {nmi, reset, irq};
+        for (size_t i = 0; i < 3; ++i) {
+            program[0x7FFA + 2 * i] = Low(vectors[i]);
+            program[0x7FFB + 2 * i] = High(vectors[i]);
+        }
+
+        // iNES header: 2 program banks, 1 character bank, mapper 000
+        std::vector<uint8_t> cartridge = {'N', 'E', 'S', 0x1A, 2, 1,
+                                          static_cast<uint8_t>(Next(2)), 0};
+        cartridge.resize(16, 0x00);
+        cartridge.insert(cartridge.end(), program.begin(), program.end());
+        for (size_t i = 0; i < kCharacterMemorySize; ++i) {
+            cartridge.push_back(static_cast<uint8_t>(Next(0x100)));
+        }
+        return cartridge;
+    }
+
+   private:
+    // The generator is specified by the standard, unlike the distributions
+    uint32_t Next(uint32_t bound) { return m_Random() % bound; }
+
+    bool Chance(uint32_t percent) { return Next(100) < percent; }
+
+    template <typename Container>
+    auto Pick(const Container& values) {
+        return values[Next(static_cast<uint32_t>(std::size(values)))];
+    }
+
+    static uint8_t Low(uint16_t address) { return address & 0xFF; }
+    static uint8_t High(uint16_t address) { return address >> 8; }
+
+    uint16_t GetAddress() const {
+        return static_cast<uint16_t>(kProgramStart + m_Code.size());
+    }
+
+    void Emit(std::initializer_list<uint8_t> bytes) {
+        m_Code.insert(m_Code.end(), bytes.begin(), bytes.end());
+    }
+
+    // Branch back to a previous address
+    void EmitBranch(uint8_t opCode, uint16_t target) {
+        Emit({opCode, static_cast<uint8_t>(target - (GetAddress() + 2))});
+    }
+
+    void EmitStore(uint16_t address, uint8_t value) {
+        Emit({0xA9, value, 0x8D, Low(address), High(address)});
+    }
+
+    // Mostly CPU RAM, then the PPU and I/O registers, and cartridge ROM
+    uint16_t GetLoadAddress() {
+        const uint32_t r = Next(100);
+        if (r < 55) {
+            return static_cast<uint16_t>(Next(0x800));
+        }
+        if (r < 65) {
+            return static_cast<uint16_t>(0x800 + Next(0x1800));
+        }
+        if (r < 80) {
+            return Pick(std::array<uint16_t, 6>{0x2002, 0x2002, 0x2007,
+                                                0x2004, 0x3FFA, 0x200A});
+        }
+        if (r < 85) {
+            return Pick(std::array<uint16_t, 4>{0x4016, 0x4017, 0x4015,
+                                                0x5000});
+        }
+        return static_cast<uint16_t>(kProgramStart + Next(0x8000));
+    }
+
+    uint16_t GetStoreAddress(bool isReadModifyWrite) {
+        const uint32_t r = Next(1000);
+        if (isReadModifyWrite) {
+            return static_cast<uint16_t>(r < 900 ? Next(0x800)
+                                                 : 0x800 + Next(0x1800));
+        }
+        if (r < 700) {
+            return static_cast<uint16_t>(Next(0x800));
+        }
+        if (r < 780) {
+            return static_cast<uint16_t>(0x800 + Next(0x1800));
+        }
+        if (r < 950) {
+            return Pick(std::array<uint16_t, 10>{0x2000, 0x2001, 0x2003,
+                                                 0x2004, 0x2005, 0x2006,
+                                                 0x2007, 0x2007, 0x2005,
+                                                 0x200D});
+        }
+        if (r < 985) {
+            return Pick(std::array<uint16_t, 3>{0x4016, 0x4014, 0x4000});
+        }
+        return static_cast<uint16_t>(kRomDataStart + Next(0x800));
+    }
+
+    // Returns the bytes of a random instruction. Branches have no offset yet
+    std::vector<uint8_t> GetInstruction() {
+        const uint32_t r = Next(100);
+        if (r < 18) {
+            return {Pick(kImpliedOpcodes)};
+        }
+        Mode mode;
+        if (r < 30) {
+            mode = kImmediate;
+        } else if (r < 48) {
+            mode = kZeroPage;
+        } else if (r < 58) {
+            mode = kZeroPageX;
+        } else if (r < 75) {
+            mode = kAbsolute;
+        } else if (r < 82) {
+            mode = kAbsoluteX;
+        } else if (r < 87) {
+            mode = kAbsoluteY;
+        } else if (r < 90) {
+            mode = kIndirectX;
+        } else if (r < 93) {
+            mode = kIndirectY;
+        } else if (r < 95) {
+            return {0x20, Low(kRamRoutine), High(kRamRoutine)};  // JSR
+        } else {
+            return {Pick(kBranchOpcodes)};
+        }
+
+        const Opcode opcode = Pick(kOpcodes[mode]);
+        if (mode < kAbsolute || mode > kAbsoluteY) {
+            return {opcode.opCode, static_cast<uint8_t>(Next(0x100))};
+        }
+        uint16_t address = 0x0000;
+        if (mode == kAbsolute) {
+            // Stores of the registers can reach the devices, the
+            // read-modify-writes stay in RAM
+            const bool isRegisterStore = (opcode.opCode & 0xE0) == 0x80;
+            address = opcode.isStore ? GetStoreAddress(!isRegisterStore)
+                                     : GetLoadAddress();
+        } else {
+            address = opcode.isStore ? static_cast<uint16_t>(Next(0x1F00))
+                                     : GetLoadAddress();
+        }
+        return {opcode.opCode, Low(address), High(address)};
+    }
+
+    // A branch of GetInstruction(), still without its offset
+    static bool IsBranch(const std::vector<uint8_t>& instruction) {
+        return instruction.size() == 1 &&
+               std::find(kBranchOpcodes.begin(), kBranchOpcodes.end(),
+                         instruction[0]) != kBranchOpcodes.end();
+    }
+
+    // Random instructions, with forward branches over a few of them, and
+    // maybe a counted loop at the end
+    void EmitBlock(uint32_t instructionCount) {
+        std::vector<std::vector<uint8_t>> instructions(instructionCount);
+        for (std::vector<uint8_t>& instruction : instructions) {
+            instruction = GetInstruction();
+        }
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            std::vector<uint8_t>& instruction = instructions[i];
+            if (IsBranch(instruction)) {
+                const size_t skipped = Next(4);
+                size_t offset = 0;
+                if (i + 1 + skipped <= instructions.size()) {
+                    for (size_t j = i + 1; j < i + 1 + skipped; ++j) {
+                        offset += IsBranch(instructions[j])
+                                      ? 2
+                                      : instructions[j].size();
+                    }
+                }
+                instruction.push_back(static_cast<uint8_t>(offset));
+            }
+            m_Code.insert(m_Code.end(), instruction.begin(),
+                          instruction.end());
+        }
+
+        if (Chance(70)) {
+            Emit({0xA2, static_cast<uint8_t>(1 + Next(39))});  // LDX #n
+            const uint16_t top = GetAddress();
+            const uint32_t bodySize = 1 + Next(5);
+            for (uint32_t i = 0; i < bodySize; ++i) {
+                // LDA, ADC, EOR, STA or INC of RAM
+                const uint8_t opCode =
+                    Pick(std::array<uint8_t, 5>{0xAD, 0x6D, 0x4D, 0x8D, 0xEE});
+                const uint16_t address =
+                    static_cast<uint16_t>(0x300 + Next(0x500));
+                Emit({opCode, Low(address), High(address)});
+            }
+            Emit({0xCA});  // DEX
+            EmitBranch(0xD0, top);
+        }
+    }
+
+    void EmitReset() {
+        Emit({0x78, 0xD8, 0xA2, 0xFF, 0x9A});  // SEI CLD LDX #$FF TXS
+
+        // Palette
+        EmitStore(0x2006, 0x3F);
+        EmitStore(0x2006, 0x00);
+        for (int i = 0; i < 32; ++i) {
+            EmitStore(0x2007, static_cast<uint8_t>(Next(64)));
+        }
+
+        // Nametables, 4 times 256 bytes of the table
+        EmitStore(0x2006, 0x20);
+        EmitStore(0x2006, 0x00);
+        Emit({0xA0, 0x04});  // LDY #4
+        const uint16_t outer = GetAddress();
+        Emit({0xA2, 0x00});  // LDX #0
+        const uint16_t inner = GetAddress();
+        Emit({0xBD, Low(kNametableData), High(kNametableData)});
+        Emit({0x8D, 0x07, 0x20, 0xE8});  // STA $2007, INX
+        EmitBranch(0xD0, inner);
+        Emit({0x88});  // DEY
+        EmitBranch(0xD0, outer);
+
+        // OAM to page 2, and DMA
+        Emit({0xA2, 0x00});
+        const uint16_t copy = GetAddress();
+        Emit({0xBD, Low(kOamData), High(kOamData), 0x9D, 0x00, 0x02, 0xE8});
+        EmitBranch(0xD0, copy);
+        EmitStore(0x4014, 0x02);
+
+        Emit({0xA9, 0x00, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20});
+        m_PpuControl = static_cast<uint8_t>(
+            0x80 | Pick(std::array<uint8_t, 7>{0x00, 0x08, 0x10, 0x18, 0x20,
+                                               0x28, 0x30}));
+        EmitStore(0x2000, m_PpuControl);
+        EmitStore(0x2001, Pick(std::array<uint8_t, 6>{0x1E, 0x18, 0x1E, 0x08,
+                                                      0x10, 0x1A}));
+
+        // LDA #$05, ADC #$01, STA $0701, INC $12, RTS
+        const uint8_t routine[] = {0xA9, 0x05, 0x69, 0x01, 0x8D,
+                                   0x01, 0x07, 0xE6, 0x12, 0x60};
+        for (uint16_t i = 0; i < sizeof(routine); ++i) {
+            EmitStore(kRamRoutine + i, routine[i]);
+        }
+    }
+
+    // Wait for the next frame, in one of the idle loops the console skips
+    void EmitWaitLoop() {
+        switch (Next(3)) {
+            case 0: {
+                // Poll the vertical blank flag
+                const uint16_t wait = GetAddress();
+                Emit({0x2C, 0x02, 0x20});  // BIT $2002
+                EmitBranch(0x10, wait);    // BPL
+                break;
+            }
+            case 1: {
+                // Poll the counter of the NMI handler
+                Emit({0xA5, kScrollX, 0x85, kLastFrame});
+                const uint16_t wait = GetAddress();
+                Emit({0xA5, kScrollX, 0xC5, kLastFrame});
+                EmitBranch(0xF0, wait);  // BEQ
+                break;
+            }
+            default: {
+                // Sprite 0 hit, and then the vertical blank
+                uint16_t wait = GetAddress();
+                Emit({0x2C, 0x02, 0x20});  // BIT $2002
+                EmitBranch(0x50, wait);    // BVC
+                wait = GetAddress();
+                Emit({0xAD, 0x02, 0x20, 0x29, 0x80});  // LDA $2002 AND #$80
+                EmitBranch(0xF0, wait);                // BEQ
+                break;
+            }
+        }
+    }
+
+    void EmitNmi() {
+        Emit({0x48, 0x8A, 0x48, 0x98, 0x48});  // Push A, X and Y
+        EmitStore(0x4014, 0x02);
+        Emit({0xAD, 0x02, 0x20});  // LDA $2002
+        Emit({0xA5, kScrollX, 0x8D, 0x05, 0x20, 0xE6, kScrollX});
+        Emit({0xA5, kScrollY, 0x8D, 0x05, 0x20});
+        if (Chance(50)) {
+            Emit({0xE6, kScrollY});
+        }
+        EmitStore(0x2000, m_PpuControl);
+        Emit({0x68, 0xA8, 0x68, 0xAA, 0x68, 0x40});  // Pull Y, X and A, RTI
+    }
+
+    std::mt19937 m_Random;
+    std::vector<uint8_t> m_Code;
+    uint8_t m_PpuControl = 0x80;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <seed> <output.nes>\n";
+        return 1;
+    }
+    const uint32_t seed =
+        static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 0));
+
+    ProgramGenerator generator(seed);
+    const std::vector<uint8_t> cartridge = generator.GenerateCartridge();
+    std::ofstream output(argv[2],
+                         std::ofstream::binary | std::ofstream::trunc);
+    if (!output.write(reinterpret_cast<const char*>(cartridge.data()),
+                      static_cast<std::streamsize>(cartridge.size()))) {
+        std::cerr << "Could not write " << argv[2] << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2020 Emmanuel Arias
+//
+// Decoder of the trace files written by dearnes::TraceRecorder. Each record
+// becomes a line in the format of the nestest log: address, instruction
+// bytes, disassembly, registers, PPU position and CPU cycle.
+//
+// Usage: nes_trace_decoder <trace.bin> [output.txt]
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "dear_nes_lib/trace_recorder.h"
+
+namespace {
+
+using dearnes::TraceRecorder;
+
+void WriteRecord(std::ostream& output, const TraceRecorder::Record& record) {
+    output << TraceRecorder::FormatRecord(record) << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " <trace.bin> [output.txt]\n";
+        return 1;
+    }
+    const std::string traceFileName = argv[1];
+
+    std::ifstream input(traceFileName, std::ifstream::binary);
+    TraceRecorder::FileHeader header = {};
+    if (!input ||
+        !input.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        !std::equal(std::begin(header.magic), std::end(header.magic),
+                    std::begin(TraceRecorder::kFileMagic))) {
+        std::cerr << "Not a trace file: " << traceFileName << "\n";
+        return 1;
+    }
+    if (header.recordSize != sizeof(TraceRecorder::Record)) {
+        std::cerr << "Records of " << header.recordSize
+                  << " bytes are not supported\n";
+        return 1;
+    }
+
+    std::ofstream outputFile;
+    if (argc > 2) {
+        outputFile.open(argv[2]);
+        if (!outputFile) {
+            std::cerr << "Could not open " << argv[2] << "\n";
+            return 1;
+        }
+    }
+    std::ostream& output = argc > 2 ? outputFile : std::cout;
+
+    TraceRecorder::Record record = {};
+    while (input.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        WriteRecord(output, record);
+    }
+    return 0;
+}